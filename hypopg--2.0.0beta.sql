@@ -64,12 +64,216 @@ hypopg_relation_size(IN indexid oid)
 LANGUAGE C STRICT VOLATILE COST 100
 AS '$libdir/hypopg', 'hypopg_relation_size';
 
+CREATE FUNCTION
+hypopg_relation_sizes(IN indexids oid[] DEFAULT NULL,
+    OUT indexrelid oid, OUT relid oid, OUT pages bigint, OUT bytes bigint,
+    OUT tuples double precision, OUT tree_height integer)
+    RETURNS SETOF record
+LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_relation_sizes';
+
+CREATE FUNCTION
+hypopg_set_index_estimates(IN indexid oid, IN pages bigint,
+    IN tuples double precision DEFAULT NULL,
+    IN tree_height integer DEFAULT NULL)
+    RETURNS void
+LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_set_index_estimates';
+
 CREATE FUNCTION
 hypopg_get_indexdef(IN indexid oid)
     RETURNS text
 LANGUAGE C STRICT VOLATILE COST 100
 AS '$libdir/hypopg', 'hypopg_get_indexdef';
 
+CREATE FUNCTION
+hypopg_hide_index(IN indexid oid)
+    RETURNS bool
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_hide_index';
+
+CREATE FUNCTION
+hypopg_unhide_index(IN indexid oid)
+    RETURNS bool
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_unhide_index';
+
+CREATE FUNCTION hypopg_unhide_all_indexes()
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_unhide_all_indexes';
+
+CREATE FUNCTION hypopg_hidden_indexes(OUT indexid oid, OUT hypothetical bool)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_hidden_indexes';
+
+CREATE FUNCTION
+hypopg_consolidation_report(IN tablename regclass, IN queries text[] DEFAULT NULL,
+    OUT indexrelid oid, OUT indexname text, OUT hypothetical bool,
+    OUT overlap text, OUT covered_by oid, OUT replacement oid,
+    OUT reclaimed_bytes bigint, OUT nb_queries integer,
+    OUT cost_before float8, OUT cost_after float8,
+    OUT predicted_ms_before float8, OUT predicted_ms_after float8)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_consolidation_report';
+
+CREATE FUNCTION
+hypopg_fk_index_report(IN tablename regclass DEFAULT NULL,
+    OUT relid oid, OUT conname text, OUT refrelid oid, OUT indexdef text,
+    OUT index_size bigint, OUT cost_without float8, OUT cost_with float8,
+    OUT predicted_ms_without float8, OUT predicted_ms_with float8,
+    OUT parent_deletes bigint, OUT parent_updates bigint,
+    OUT weighted_gain float8)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_fk_index_report';
+
+CREATE FUNCTION
+hypopg_evaluate(IN queries text[], IN configs oid[],
+    OUT query_num integer, OUT config_num integer, OUT startup_cost float8,
+    OUT total_cost float8, OUT plan_rows float8, OUT predicted_ms float8)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_evaluate';
+
+CREATE FUNCTION
+hypopg_plan_diff(IN query text, IN config oid[] DEFAULT NULL,
+    OUT node_num integer, OUT depth integer, OUT change text,
+    OUT node_before text, OUT node_after text,
+    OUT relation_before text, OUT relation_after text,
+    OUT index_before text, OUT index_after text,
+    OUT rows_before float8, OUT rows_after float8,
+    OUT cost_before float8, OUT cost_after float8,
+    OUT predicted_ms_before float8, OUT predicted_ms_after float8)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_plan_diff';
+
+CREATE FUNCTION
+hypopg_cache_pressure_report(IN queries text[], IN configs oid[] DEFAULT NULL,
+    OUT config_num integer, OUT relations integer, OUT table_bytes bigint,
+    OUT index_bytes bigint, OUT working_set bigint,
+    OUT shared_buffers bigint, OUT effective_cache_size bigint,
+    OUT fits_shared_buffers boolean, OUT fits_effective_cache boolean)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_cache_pressure_report';
+
+CREATE FUNCTION
+hypopg_assert_plan(IN query text, IN max_total_cost float8 DEFAULT NULL,
+    IN forbid_nodes text[] DEFAULT NULL, IN require_index oid DEFAULT NULL)
+    RETURNS boolean
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_assert_plan';
+
+CREATE FUNCTION
+hypopg_parallel_evaluate(IN queries text[], IN nb_workers integer DEFAULT 4,
+    OUT query_num integer, OUT worker integer, OUT startup_cost float8,
+    OUT total_cost float8, OUT plan_rows float8, OUT predicted_ms float8,
+    OUT error text)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_parallel_evaluate';
+
+CREATE FUNCTION
+hypopg_apply_ddl(IN script text,
+    OUT stmt_num integer, OUT command text, OUT action text,
+    OUT objid oid, OUT objname text)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_apply_ddl';
+
+-- Cost calibration related functions
+--
+
+CREATE FUNCTION
+hypopg_calibrate(IN queries text[],
+    OUT node_type text, OUT samples integer, OUT ms_per_cost float8)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_calibrate';
+
+CREATE FUNCTION
+hypopg_calibration(OUT node_type text, OUT samples integer,
+    OUT ms_per_cost float8)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_calibration';
+
+CREATE FUNCTION hypopg_reset_calibration()
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_reset_calibration';
+
+-- Hypothetical storage parameters and column types related functions
+--
+
+CREATE FUNCTION hypopg_set_table_options(IN tablename regclass,
+    IN options text[])
+    RETURNS void
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_set_table_options';
+
+CREATE FUNCTION hypopg_reset_table_options(IN tablename regclass DEFAULT NULL)
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_reset_table_options';
+
+CREATE FUNCTION hypopg_table_options(OUT relid oid, OUT options text[],
+    OUT pages bigint, OUT toast_pages bigint, OUT estimated_pages bigint,
+    OUT estimated_toast_pages bigint)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_table_options';
+
+CREATE FUNCTION hypopg_alter_column_type(IN tablename regclass,
+    IN colname name, IN typename text)
+    RETURNS void
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_alter_column_type';
+
+CREATE FUNCTION hypopg_reset_column_types(IN tablename regclass DEFAULT NULL)
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_reset_column_types';
+
+CREATE FUNCTION hypopg_column_types(OUT relid oid, OUT attname text,
+    OUT old_type text, OUT new_type text)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_column_types';
+
+-- Statistics snapshots related functions
+--
+
+CREATE FUNCTION hypopg_export_real_stats(IN tables regclass[] DEFAULT NULL)
+    RETURNS bytea
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_export_real_stats';
+
+CREATE FUNCTION hypopg_import_stats(IN snapshot bytea)
+    RETURNS integer
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_import_stats';
+
+-- The imported statistics are trusted by the planner, only allow superusers
+-- to import them unless explicitly granted
+REVOKE ALL ON FUNCTION hypopg_import_stats(bytea) FROM PUBLIC;
+
+CREATE FUNCTION hypopg_reset_imported_stats(IN tablename regclass DEFAULT NULL)
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_reset_imported_stats';
+
+CREATE FUNCTION hypopg_imported_stats(OUT relid oid, OUT relpages bigint,
+    OUT reltuples double precision, OUT relallvisible bigint,
+    OUT tree_height integer, OUT nb_stats integer)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_imported_stats';
+
 -- Hypothetical partitioning related functions
 --
 
@@ -104,7 +308,30 @@ CREATE FUNCTION hypopg_table(OUT relid oid, OUT tablename text,
     LANGUAGE c COST 100
 AS '$libdir/hypopg', 'hypopg_table';
 
-CREATE FUNCTION hypopg_analyze(IN tablename regclass, IN fraction real = 1)
+CREATE FUNCTION
+hypopg_hide_partition(IN relid regclass)
+    RETURNS bool
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_hide_partition';
+
+CREATE FUNCTION
+hypopg_unhide_partition(IN relid regclass)
+    RETURNS bool
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_unhide_partition';
+
+CREATE FUNCTION hypopg_unhide_all_partitions()
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_unhide_all_partitions';
+
+CREATE FUNCTION hypopg_hidden_partitions(OUT relid oid, OUT parentid oid)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_hidden_partitions';
+
+CREATE FUNCTION hypopg_analyze(IN tablename regclass, IN fraction real = 1,
+    IN resume bool = false)
     RETURNS void
     LANGUAGE c COST 100
 AS '$libdir/hypopg', 'hypopg_analyze';
@@ -279,3 +506,63 @@ BEGIN
     END IF;
 END;
 $_$ language plpgsql;
+
+-- The backend progress API only knows the core commands, so hypopg_analyze()
+-- reports its progress as a VACUUM command, flagged with a magic number in
+-- the last parameter, if hypopg.analyze_progress is enabled.
+DO
+$_$
+DECLARE
+  v_has_progress bool;
+BEGIN
+    SELECT COUNT(*) = 1 INTO v_has_progress
+    FROM pg_proc p
+    WHERE p.proname = 'pg_stat_get_progress_info';
+
+    IF v_has_progress THEN
+        CREATE VIEW hypopg_stat_progress_analyze AS
+            SELECT s.pid, s.datid, d.datname, s.relid,
+                CASE s.param1
+                    WHEN 0 THEN 'initializing'
+                    WHEN 1 THEN 'acquiring sample rows'
+                    WHEN 2 THEN 'computing statistics'
+                END AS phase,
+                s.param2 AS partitions_total,
+                s.param3 AS partitions_done,
+                s.param4::oid AS current_partition,
+                s.param5 AS sample_rows,
+                s.param6 AS columns_total,
+                s.param7 AS columns_done
+            FROM pg_stat_get_progress_info('VACUUM') s
+                LEFT JOIN pg_database d ON s.datid = d.oid
+            WHERE s.param10 = 1213812807;
+    END IF;
+END;
+$_$ language plpgsql;
+
+-- Hypothetical extended statistics related functions
+--
+
+CREATE FUNCTION
+hypopg_create_statistics(IN definition text, IN fraction real = 1,
+    OUT statid oid, OUT statname text)
+    RETURNS record
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_create_statistics';
+
+CREATE FUNCTION hypopg_drop_statistics(IN statid oid)
+    RETURNS bool
+    LANGUAGE C STRICT VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_drop_statistics';
+
+CREATE FUNCTION hypopg_reset_statistics()
+    RETURNS void
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_reset_statistics';
+
+CREATE FUNCTION hypopg_list_statistics(OUT statid oid, OUT statname text,
+    OUT relid oid, OUT attnums int2[], OUT ndistinct text,
+    OUT dependencies text, OUT nb_mcv integer)
+    RETURNS SETOF record
+    LANGUAGE C VOLATILE COST 100
+AS '$libdir/hypopg', 'hypopg_list_statistics';
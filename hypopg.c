@@ -21,19 +21,27 @@
 #if PG_VERSION_NUM >= 90300
 #include "access/htup_details.h"
 #endif
-#if PG_VERSION_NUM >= 100000
 #include "access/xact.h"
-#endif
+#include "catalog/pg_statistic.h"
+#include "utils/guc.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "parser/parsetree.h"
+#if PG_VERSION_NUM >= 100000
+#include "tcop/tcopprot.h"
+#endif
 #include "utils/selfuncs.h"
 #include "utils/syscache.h"
 
 #include "include/hypopg.h"
+#include "include/hypopg_advisor.h"
 #include "include/hypopg_analyze.h"
+#include "include/hypopg_calibration.h"
 #include "include/hypopg_import.h"
 #include "include/hypopg_index.h"
+#include "include/hypopg_reloptions.h"
+#include "include/hypopg_snapshot.h"
+#include "include/hypopg_statistics.h"
 #include "include/hypopg_table.h"
 
 PG_MODULE_MAGIC;
@@ -41,22 +49,79 @@ PG_MODULE_MAGIC;
 /*--- Macros ---*/
 #define HYPO_ENABLED() (isExplain && hypo_is_enabled)
 
+/* Maximum number of pg_statistic hash values remembered */
+#define HYPO_MAX_PENDING_STAT_INVALS	64
+
+#if PG_VERSION_NUM >= 110000
+#define HYPO_EXPLAIN_INTEGER(label, value, es) \
+	ExplainPropertyInteger(label, NULL, value, es)
+#define HYPO_EXPLAIN_FLOAT(label, value, ndigits, es) \
+	ExplainPropertyFloat(label, NULL, value, ndigits, es)
+#else
+#define HYPO_EXPLAIN_INTEGER(label, value, es) \
+	ExplainPropertyLong(label, value, es)
+#define HYPO_EXPLAIN_FLOAT(label, value, ndigits, es) \
+	ExplainPropertyFloat(label, value, ndigits, es)
+#endif
+
 typedef struct hypoWalkerContext
 {
 	bool		explain_found;
 } hypoWalkerContext;
 
+#if PG_VERSION_NUM >= 100000
+/* Plan nodes referencing hypothetical objects, found by hypo_explain_walker */
+typedef struct hypoExplainContext
+{
+	PlannedStmt *pstmt;
+	List	   *indexes;		/* scan nodes using an hypothetical index */
+	List	   *partitions;		/* scan nodes of an hypothetical partition */
+} hypoExplainContext;
+#endif
+
 /*--- Variables exported ---*/
 
 bool		isExplain;
 bool		hypo_is_enabled;
+int			hypo_estimation_mode;
+double		hypo_index_bloat_factor;
+bool		hypo_analyze_progress;
 MemoryContext HypoMemoryContext;
 
 /*--- Variables not exported ---*/
 
+static const struct config_enum_entry estimation_mode_options[] = {
+	{"fast", HYPO_ESTIMATION_FAST, false},
+	{"standard", HYPO_ESTIMATION_STANDARD, false},
+	{"accurate", HYPO_ESTIMATION_ACCURATE, false},
+	{NULL, 0, false}
+};
+
+/* GUC for adding hypothetical objects annotations to EXPLAIN output */
+static bool hypo_explain_annotations;
+
 static List *pending_invals = NIL;	/* List of interesting OID for which we
 									 * received inval messages that need to be
 									 * processed. */
+static List *pending_index_invals = NIL;	/* List of OID of relations having
+											 * hypothetical indexes for which
+											 * we received relcache inval
+											 * messages. */
+static List *pending_stat_invals = NIL; /* List of pg_statistic syscache hash
+										 * values received while hypothetical
+										 * indexes exist. */
+static bool pending_stat_inval_all = false; /* Too many pg_statistic hash
+											 * values were received, all the
+											 * hypothetical indexes have to
+											 * be invalidated. */
+static List *pending_reloptions_invals = NIL;	/* List of OID of relations
+												 * having hypothetical storage
+												 * parameters, column types,
+												 * imported statistics,
+												 * extended statistics or
+												 * hidden partitions for which
+												 * we received relcache inval
+												 * messages. */
 
 /*--- Functions --- */
 
@@ -104,7 +169,14 @@ static bool hypo_get_relation_stats_hook(PlannerInfo *root,
 							 AttrNumber attnum,
 							 VariableStatData *vardata);
 static get_relation_stats_hook_type prev_get_relation_stats_hook = NULL;
-#if PG_VERSION_NUM >= 100000 && PG_VERSION_NUM < 110000
+static bool hypo_get_relation_stats(PlannerInfo *root,
+						RangeTblEntry *rte,
+						AttrNumber attnum,
+						VariableStatData *vardata);
+
+static int32 hypo_get_attavgwidth_hook(Oid relid, AttrNumber attnum);
+static get_attavgwidth_hook_type prev_get_attavgwidth_hook = NULL;
+#if PG_VERSION_NUM >= 100000
 static void hypo_set_rel_pathlist_hook(PlannerInfo *root,
 						   RelOptInfo *rel,
 						   Index rti,
@@ -117,8 +189,29 @@ static PlannedStmt *hypo_planner_hook(Query *parse, int cursorOptions,
 static planner_hook_type prev_planner_hook = NULL;
 #endif
 
+#if PG_VERSION_NUM >= 100000
+static void hypo_ExplainOneQuery_hook(Query *query, int cursorOptions,
+						  IntoClause *into, ExplainState *es,
+						  const char *queryString, ParamListInfo params,
+						  QueryEnvironment *queryEnv);
+static ExplainOneQuery_hook_type prev_ExplainOneQuery_hook = NULL;
+#endif
+
 static bool hypo_query_walker(Node *node, hypoWalkerContext *context);
 static void hypo_CacheRelCallback(Datum arg, Oid relid);
+static void hypo_CacheStatCallback(Datum arg, int cacheid, uint32 hashvalue);
+static Oid	hypo_index_get_real_relid(hypoIndex *entry);
+static void hypo_process_index_inval(void);
+static void hypo_process_reloptions_inval(void);
+#if PG_VERSION_NUM >= 100000
+static bool hypo_explain_walker(Plan *plan, void *context);
+static void hypo_explain_open_entry(const char *objname, const char *name,
+						ExplainState *es);
+static void hypo_explain_close_entry(const char *objname, ExplainState *es);
+static void hypo_explain_annotate(hypoExplainContext *context,
+					  ExplainState *es);
+static const char *hypo_explain_stats_source(hypoTable *part);
+#endif
 
 void
 _PG_init(void)
@@ -138,18 +231,28 @@ _PG_init(void)
 
 	prev_get_relation_stats_hook = get_relation_stats_hook;
 	get_relation_stats_hook = hypo_get_relation_stats_hook;
-#if PG_VERSION_NUM >= 100000 && PG_VERSION_NUM < 110000
+
+	prev_get_attavgwidth_hook = get_attavgwidth_hook;
+	get_attavgwidth_hook = hypo_get_attavgwidth_hook;
+#if PG_VERSION_NUM >= 100000
 	prev_set_rel_pathlist_hook = set_rel_pathlist_hook;
 	set_rel_pathlist_hook = hypo_set_rel_pathlist_hook;
 #endif
 #if PG_VERSION_NUM >= 110000 && PG_VERSION_NUM < 120000
 	prev_planner_hook = planner_hook;
 	planner_hook = hypo_planner_hook;
+#endif
+#if PG_VERSION_NUM >= 100000
+	prev_ExplainOneQuery_hook = ExplainOneQuery_hook;
+	ExplainOneQuery_hook = hypo_ExplainOneQuery_hook;
 #endif
 	isExplain = false;
 	hypoIndexes = NIL;
+	hypoHiddenIndexes = NIL;
 #if PG_VERSION_NUM >= 100000
 	hypoTables = NULL;
+	hypoHiddenPartitions = NIL;
+	hypoStatsExts = NIL;
 #endif
 
 	HypoMemoryContext = AllocSetContextCreate(TopMemoryContext,
@@ -174,7 +277,60 @@ _PG_init(void)
 							 NULL,
 							 NULL);
 
+	DefineCustomEnumVariable("hypopg.estimation_mode",
+							 "Strategy used to estimate hypothetical objects",
+							 "fast only uses cheap approximations, standard "
+							 "relies on the statistics and accurate samples "
+							 "the tables when possible.",
+							 &hypo_estimation_mode,
+							 HYPO_ESTIMATION_STANDARD,
+							 estimation_mode_options,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomRealVariable("hypopg.index_bloat_factor",
+							 "Bloat factor applied to the estimated size of "
+							 "hypothetical indexes",
+							 "1 estimates a freshly built index.",
+							 &hypo_index_bloat_factor,
+							 1.0,
+							 1.0,
+							 100.0,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("hypopg.analyze_progress",
+							 "Report the progress of hypopg_analyze()",
+							 "The progress is reported as a VACUUM command, "
+							 "so it's also visible in pg_stat_progress_vacuum.",
+							 &hypo_analyze_progress,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("hypopg.explain_annotations",
+							 "Add hypothetical objects details to EXPLAIN output",
+							 NULL,
+							 &hypo_explain_annotations,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
 	CacheRegisterRelcacheCallback(hypo_CacheRelCallback, (Datum) 0);
+	CacheRegisterSyscacheCallback(STATRELATTINH, hypo_CacheStatCallback,
+								  (Datum) 0);
 }
 
 void
@@ -186,12 +342,16 @@ _PG_fini(void)
 	get_relation_info_hook = prev_get_relation_info_hook;
 	explain_get_index_name_hook = prev_explain_get_index_name_hook;
 	get_relation_stats_hook = prev_get_relation_stats_hook;
-#if PG_VERSION_NUM >= 100000 && PG_VERSION_NUM < 110000
+	get_attavgwidth_hook = prev_get_attavgwidth_hook;
+#if PG_VERSION_NUM >= 100000
 	set_rel_pathlist_hook = prev_set_rel_pathlist_hook;
 #endif
 #if PG_VERSION_NUM >= 110000 && PG_VERSION_NUM < 120000
 	planner_hook = prev_planner_hook;
 #endif
+#if PG_VERSION_NUM >= 100000
+	ExplainOneQuery_hook = prev_ExplainOneQuery_hook;
+#endif
 }
 
 /*---------------------------------
@@ -268,7 +428,11 @@ hypo_utility_hook(
 	 * Process pending invalidation.  For now, just do it if the current query
 	 * might try to acess stored hypothetical objects
 	 */
-	if (isExplain && list_length(pending_invals) != 0)
+	if (isExplain && (list_length(pending_invals) != 0 ||
+					  list_length(pending_index_invals) != 0 ||
+					  list_length(pending_stat_invals) != 0 ||
+					  pending_stat_inval_all ||
+					  list_length(pending_reloptions_invals) != 0))
 		hypo_process_inval();
 
 	if (prev_utility_hook)
@@ -403,11 +567,41 @@ hypo_query_walker(Node *node, hypoWalkerContext *context)
 										   QTW_IGNORE_RANGE_TABLE);
 }
 
+/*
+ * Check that the given query can be planned with the stored hypothetical
+ * objects, and process any pending invalidation.  This has to be called by
+ * any code planning a query on its own rather than through an EXPLAIN.
+ */
+void
+hypo_check_query(Query *query)
+{
+#if PG_VERSION_NUM >= 100000
+	hypoWalkerContext hypo_context = {0};
+#endif
+
+	if (list_length(pending_invals) != 0 ||
+		list_length(pending_index_invals) != 0 ||
+		list_length(pending_stat_invals) != 0 ||
+		pending_stat_inval_all ||
+		list_length(pending_reloptions_invals) != 0)
+		hypo_process_inval();
+
+#if PG_VERSION_NUM >= 100000
+	if (!hypoTables)
+		return;
+
+	hypo_context.explain_found = true;
+	hypo_query_walker((Node *) query, &hypo_context);
+#endif
+}
+
 /*
  * Callback for relcache inval message.  Detect if the given relid correspond
- * to something we should take care of.  For now, we only care of table being
- * dropped for which we have hypothetical partitioning information, thus
- * needing to remove relevant hypoTable entries.  At this point, we can't
+ * to something we should take care of.  We care of table being dropped for
+ * which we have hypothetical partitioning information, thus needing to remove
+ * relevant hypoTable entries, and of tables having hypothetical indexes, which
+ * may have been dropped or had some of their columns dropped or modified.
+ * At this point, we can't
  * detect if the inval message is due to table dropping or not, because any
  * cache access require a valid transaction, and we don't have a guarantee that
  * it's the case at this point.  Instead, maintain a deduplicated list of
@@ -417,19 +611,134 @@ hypo_query_walker(Node *node, hypoWalkerContext *context)
 static void
 hypo_CacheRelCallback(Datum arg, Oid relid)
 {
+	MemoryContext oldcontext;
+	ListCell   *lc;
 #if PG_VERSION_NUM >= 100000
 	hypoTable  *entry;
 
 	entry = hypo_find_table(relid, true);
 	if (entry)
 	{
-		MemoryContext oldcontext;
-
 		oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
 		pending_invals = list_append_unique_oid(pending_invals, relid);
 		MemoryContextSwitchTo(oldcontext);
 	}
 #endif
+
+	/* The sampled ranges of the relation may not be accurate anymore */
+	hypo_actual_range_inval(relid);
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *index = (hypoIndex *) lfirst(lc);
+		Oid			realid = hypo_index_get_real_relid(index);
+
+		/* An invalid relid means that the whole relcache was reset */
+		if (relid == InvalidOid || realid == relid)
+			pending_index_invals = list_append_unique_oid(pending_index_invals,
+														  realid);
+	}
+
+	foreach(lc, hypoRelOptionsList)
+	{
+		hypoRelOptions *options = (hypoRelOptions *) lfirst(lc);
+
+		if (relid == InvalidOid || options->relid == relid)
+			pending_reloptions_invals = list_append_unique_oid(pending_reloptions_invals,
+															   options->relid);
+	}
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		if (relid == InvalidOid || coltype->relid == relid)
+			pending_reloptions_invals = list_append_unique_oid(pending_reloptions_invals,
+															   coltype->relid);
+	}
+
+	if (hypoRelStatsHash)
+	{
+		HASH_SEQ_STATUS hash_seq;
+		hypoRelStats *relstats;
+
+		hash_seq_init(&hash_seq, hypoRelStatsHash);
+		while ((relstats = hash_seq_search(&hash_seq)) != NULL)
+		{
+			if (relid == InvalidOid || relstats->relid == relid)
+				pending_reloptions_invals = list_append_unique_oid(pending_reloptions_invals,
+																   relstats->relid);
+		}
+	}
+
+#if PG_VERSION_NUM >= 100000
+	foreach(lc, hypoStatsExts)
+	{
+		hypoStatsExt *stat = (hypoStatsExt *) lfirst(lc);
+
+		if (relid == InvalidOid || stat->relid == relid)
+			pending_reloptions_invals = list_append_unique_oid(pending_reloptions_invals,
+															   stat->relid);
+	}
+
+	foreach(lc, hypoHiddenPartitions)
+	{
+		Oid			partid = lfirst_oid(lc);
+
+		if (relid == InvalidOid || partid == relid)
+			pending_reloptions_invals = list_append_unique_oid(pending_reloptions_invals,
+															   partid);
+	}
+#endif
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Callback for pg_statistic syscache inval message.  The hash value can only
+ * be compared to the ones of the hypothetical indexes columns in a valid
+ * transaction, so just remember it for later processing.  As checking if the
+ * hash value is already remembered is linear, only a few of them are kept,
+ * and all the hypothetical indexes are invalidated after that, as for a
+ * relcache reset.
+ */
+static void
+hypo_CacheStatCallback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	MemoryContext oldcontext;
+
+	if (hypoIndexes == NIL || pending_stat_inval_all)
+		return;
+
+	if (list_length(pending_stat_invals) >= HYPO_MAX_PENDING_STAT_INVALS)
+	{
+		list_free(pending_stat_invals);
+		pending_stat_invals = NIL;
+		pending_stat_inval_all = true;
+		return;
+	}
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	pending_stat_invals = list_append_unique_int(pending_stat_invals,
+												 (int) hashvalue);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Return the oid of the real relation an hypothetical index depends on, which
+ * is the root table for an index on an hypothetical partition.
+ */
+static Oid
+hypo_index_get_real_relid(hypoIndex *entry)
+{
+#if PG_VERSION_NUM >= 100000
+	hypoTable  *table = hypo_find_table(entry->relid, true);
+
+	if (table)
+		return table->rootid;
+#endif
+
+	return entry->relid;
 }
 
 /* Process any RelCache invalidation we previously received.  We have to
@@ -444,9 +753,19 @@ hypo_process_inval(void)
 {
 #if PG_VERSION_NUM >= 100000
 	ListCell   *lc;
+#endif
 
 	Assert(IsTransactionState());
 
+	/*
+	 * Process hypothetical indexes first, as the real relation of the ones
+	 * defined on hypothetical partitions is found using the hypoTable
+	 * entries.
+	 */
+	hypo_process_index_inval();
+	hypo_process_reloptions_inval();
+
+#if PG_VERSION_NUM >= 100000
 	/* XXX: remove this if support for hypothetical indexes is added */
 	if (!hypoTables)
 	{
@@ -478,6 +797,8 @@ hypo_process_inval(void)
 		if (found)
 			elog(DEBUG1, "hypopg: hypo_process_inval removed table %s (%d)",
 				 relname, relid);
+		else
+			hypo_table_reset_fractions(relid);
 	}
 
 	list_free(pending_invals);
@@ -485,6 +806,139 @@ hypo_process_inval(void)
 #endif
 }
 
+/*
+ * Process the relcache and pg_statistic invalidations received for relations
+ * having hypothetical indexes.  Hypothetical indexes whose relation or any
+ * column has been dropped, or whose columns type changed, are removed, as
+ * they couldn't be planned anymore.  The cached estimations of the others are
+ * discarded, so they'll be computed again using the up to date statistics.
+ */
+static void
+hypo_process_index_inval(void)
+{
+	List	   *to_remove = NIL;
+	ListCell   *lc;
+
+	if (pending_index_invals == NIL && pending_stat_invals == NIL &&
+		!pending_stat_inval_all)
+		return;
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+		Oid			realid = hypo_index_get_real_relid(entry);
+		ListCell   *lc2;
+
+		if (list_member_oid(pending_index_invals, realid))
+		{
+			if (!hypo_index_check_columns(entry, realid))
+			{
+				to_remove = lappend_oid(to_remove, entry->oid);
+				continue;
+			}
+
+			entry->avg_width = -1;
+			continue;
+		}
+
+		if (pending_stat_inval_all)
+		{
+			entry->avg_width = -1;
+			continue;
+		}
+
+		foreach(lc2, pending_stat_invals)
+		{
+			if (hypo_index_match_stats(entry, realid,
+									   (uint32) lfirst_int(lc2)))
+			{
+				entry->avg_width = -1;
+				break;
+			}
+		}
+	}
+
+	foreach(lc, to_remove)
+	{
+		Oid			indexid = lfirst_oid(lc);
+
+		if (hypo_index_remove(indexid))
+			elog(DEBUG1, "hypopg: hypo_process_index_inval removed index %d",
+				 indexid);
+	}
+
+	list_free(to_remove);
+	list_free(pending_index_invals);
+	pending_index_invals = NIL;
+	list_free(pending_stat_invals);
+	pending_stat_invals = NIL;
+	pending_stat_inval_all = false;
+}
+
+/*
+ * Remove the hypothetical storage parameters, the imported and extended
+ * statistics and the hidden state of the dropped relations we received
+ * relcache invalidations for, and the hypothetical column types of the
+ * columns that were dropped or whose real type changed.
+ */
+static void
+hypo_process_reloptions_inval(void)
+{
+	List	   *to_remove = NIL;
+	ListCell   *lc;
+
+	foreach(lc, pending_reloptions_invals)
+	{
+		Oid			relid = lfirst_oid(lc);
+
+		if (SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relid)))
+			continue;
+
+		if (hypo_reloptions_remove(relid))
+			elog(DEBUG1, "hypopg: hypo_process_reloptions_inval removed storage parameters of relation %d",
+				 relid);
+
+		if (hypo_snapshot_remove(relid))
+			elog(DEBUG1, "hypopg: hypo_process_reloptions_inval removed imported statistics of relation %d",
+				 relid);
+
+#if PG_VERSION_NUM >= 100000
+		if (hypo_stats_ext_remove_rel(relid))
+			elog(DEBUG1, "hypopg: hypo_process_reloptions_inval removed extended statistics of relation %d",
+				 relid);
+
+		if (hypo_hidden_partition_remove(relid))
+			elog(DEBUG1, "hypopg: hypo_process_reloptions_inval removed hidden partition %d",
+				 relid);
+#endif
+	}
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		if (list_member_oid(pending_reloptions_invals, coltype->relid) &&
+			!hypo_column_type_is_valid(coltype))
+			to_remove = lappend(to_remove, coltype);
+	}
+
+	foreach(lc, to_remove)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+		Oid			relid = coltype->relid;
+		AttrNumber	attnum = coltype->attnum;
+
+		if (hypo_column_type_remove(relid, attnum))
+			elog(DEBUG1, "hypopg: hypo_process_reloptions_inval removed type of column %d of relation %d",
+				 attnum, relid);
+	}
+
+	list_free(to_remove);
+
+	list_free(pending_reloptions_invals);
+	pending_reloptions_invals = NIL;
+}
+
 /*
  * Clear all pending invalidations.  This is required when dropping all
  * hypoTable entries.
@@ -523,12 +977,25 @@ hypo_get_relation_info_hook(PlannerInfo *root,
 {
 	Relation	relation;
 #if PG_VERSION_NUM >= 100000
-	RangeTblEntry *rte = planner_rt_fetch(rel->relid, root);
+	hypoTable  *part = NULL;
 	bool		hypopart = false;
 #endif
 
-	if (HYPO_ENABLED())
+	/*
+	 * A hidden partition is marked as proven empty, there's no need to
+	 * process it any further.
+	 */
+	if (HYPO_ENABLED()
+#if PG_VERSION_NUM >= 100000
+		&& !hypo_hidePartition(root, relationObjectId, rel)
+#endif
+		)
 	{
+		/*
+		 * Use the imported statistics first, as all the other estimations
+		 * rely on the size of the relation.
+		 */
+		hypo_snapshot_apply(rel, relationObjectId, inhparent);
 
 #if PG_VERSION_NUM >= 100000
 		hypopart = hypo_table_oid_is_hypothetical(relationObjectId);
@@ -538,7 +1005,10 @@ hypo_get_relation_info_hook(PlannerInfo *root,
 		 * hypothetical partitioning
 		 */
 		if (hypopart)
+		{
 			hypo_injectHypotheticalPartitioning(root, relationObjectId, rel);
+			part = hypo_rti_get_table(root, rel->relid);
+		}
 #endif
 
 		/* Open the current relation */
@@ -553,6 +1023,9 @@ hypo_get_relation_info_hook(PlannerInfo *root,
 			ListCell   *lc;
 			Oid			parentId = relationObjectId;
 
+			/* Use the hypothetical storage parameters and column types */
+			hypo_reloptions_apply(root, relation, rel);
+
 #if PG_VERSION_NUM >= 100000
 
 			/*
@@ -612,13 +1085,9 @@ hypo_get_relation_info_hook(PlannerInfo *root,
 				/*
 				 * check for hypothetical index on hypothetical leaf partition
 				 */
-				else if (hypo_table_oid_is_hypothetical(relationObjectId) &&
-						 HYPO_TABLE_RTE_HAS_HYPOOID(rte) &&
-						 entry->relid == HYPO_TABLE_RTE_GET_HYPOOID(rte)
-					)
+				else if (hypopart && part && entry->relid == part->oid)
 				{
-					Assert(rte->rtekind != RTE_CTE);
-					oid = HYPO_TABLE_RTE_GET_HYPOOID(rte);
+					oid = part->oid;
 				}
 #endif
 
@@ -626,10 +1095,13 @@ hypo_get_relation_info_hook(PlannerInfo *root,
 				 * hypothetical index found, add it to the relation's
 				 * indextlist
 				 */
-				if (OidIsValid(oid))
+				if (OidIsValid(oid) && !hypo_index_is_hidden(entry->oid))
 					hypo_injectHypotheticalIndex(root, oid,
 												 inhparent, rel, relation, entry);
 			}
+
+			/* remove any hidden real index */
+			hypo_hideIndexes(rel);
 		}
 		/* Close the relation and keep the lock, it might be reopened later */
 		heap_close(relation, NoLock);
@@ -644,84 +1116,156 @@ hypo_get_relation_stats_hook(PlannerInfo *root,
 							 AttrNumber attnum,
 							 VariableStatData *vardata)
 {
-#if PG_VERSION_NUM < 100000
-	return false;
-#else
-	Oid			poid = InvalidOid;
-	hypoStatsKey key;
-	hypoStatsEntry *entry;
-	bool		found;
+	bool		found = hypo_get_relation_stats(root, rte, attnum, vardata);
+
+	/*
+	 * Widen the histogram to the actual range of the column if the planner
+	 * would probe a real btree index instead of the hypothetical one.
+	 */
+	if (HYPO_ENABLED() && rte->rtekind == RTE_RELATION)
+		found = hypo_actual_range_adjust(root, rte, attnum, vardata, found);
+
+	return found;
+}
+
+/*
+ * Retrieve the pg_statistic row of the given column of an hypothetical
+ * partition, or imported from a snapshot.  Returns false to let postgres
+ * retrieve the real one.
+ */
+static bool
+hypo_get_relation_stats(PlannerInfo *root,
+						RangeTblEntry *rte,
+						AttrNumber attnum,
+						VariableStatData *vardata)
+{
+	HeapTuple	statsTuple;
+	bool		inherit;
 
 	/* Nothing to do if it's not a plain relation */
 	if (rte->rtekind != RTE_RELATION)
 		return false;
 
-	/*
-	 * If this is a root table hypothetically partitioned, we have to retrieve
-	 * the pg_statistic row ourselves, even if no hypopg_analyze has been
-	 * performed yet, because postgres will search for an entry with
-	 * stainherit = true, which won't exist.
-	 */
-	if (HYPO_RTE_IS_TAGGED(rte) && (!HYPO_TABLE_RTE_HAS_HYPOOID(rte)))
+	inherit = rte->inh;
+
+#if PG_VERSION_NUM >= 100000
+	if (hypoTables)
 	{
-		vardata->statsTuple = SearchSysCache3(STATRELATTINH,
-											  ObjectIdGetDatum(rte->relid),
-											  Int16GetDatum(attnum),
-											  BoolGetDatum(false));
-		vardata->freefunc = ReleaseSysCache;
+		Index		rti;
+		hypoTable  *part = NULL;
 
-		if (HeapTupleIsValid(vardata->statsTuple))
+		rti = hypo_rte_get_rti(root, rte,
+							   (vardata->var && IsA(vardata->var, Var)) ?
+							   ((Var *) vardata->var)->varno : 0);
+		if (rti != 0)
+			part = hypo_rti_get_table(root, rti);
+
+		/*
+		 * If this is a root table hypothetically partitioned, we have to
+		 * retrieve the pg_statistic row ourselves, even if no hypopg_analyze
+		 * has been performed yet, because postgres will search for an entry
+		 * with stainherit = true, which won't exist.  The imported
+		 * statistics, if any, are handled below.
+		 */
+		if (rti != 0 && hypo_rti_is_tagged(root, rti) && part == NULL)
 		{
-			/* check if user has permission to read this column */
-			vardata->acl_ok =
-				(pg_class_aclcheck(rte->relid, GetUserId(),
-								   ACL_SELECT) == ACLCHECK_OK) ||
-				(pg_attribute_aclcheck(rte->relid, attnum, GetUserId(),
-									   ACL_SELECT) == ACLCHECK_OK);
+			inherit = false;
+
+			if (!HYPO_ENABLED() ||
+				!hypo_get_imported_stats_tuple(rte->relid, attnum, false))
+			{
+				vardata->statsTuple = SearchSysCache3(STATRELATTINH,
+													  ObjectIdGetDatum(rte->relid),
+													  Int16GetDatum(attnum),
+													  BoolGetDatum(false));
+				vardata->freefunc = ReleaseSysCache;
+
+				if (HeapTupleIsValid(vardata->statsTuple))
+				{
+					/* check if user has permission to read this column */
+					vardata->acl_ok =
+						(pg_class_aclcheck(rte->relid, GetUserId(),
+										   ACL_SELECT) == ACLCHECK_OK) ||
+						(pg_attribute_aclcheck(rte->relid, attnum, GetUserId(),
+											   ACL_SELECT) == ACLCHECK_OK);
+				}
+				else
+				{
+					/* suppress any possible leakproofness checks later */
+					vardata->acl_ok = true;
+				}
+
+				return true;
+			}
 		}
-		else
+		/* Retrieve the pg_statistic stored row of an hypothetical partition */
+		else if (part != NULL && hypoStatsHash)
 		{
-			/* suppress any possible leakproofness checks later */
-			vardata->acl_ok = true;
-		}
+			statsTuple = hypo_get_stats_tuple(part->oid, attnum);
+
+			/*
+			 * XXX should we warn about possible very bad estimation if
+			 * there's no row?
+			 */
+			if (statsTuple)
+			{
+				vardata->statsTuple = heap_copytuple(statsTuple);
+				vardata->freefunc = (void *) pfree;
 
-		return true;
+				return true;
+			}
+		}
 	}
+#endif
 
-	/* Fast exit if the local hash hasn't been created yet */
-	if (!hypoStatsHash)
+	/* Use the statistics imported from a snapshot if any */
+	if (!HYPO_ENABLED() || !hypoRelStatsHash)
 		return false;
 
-	/* Nothing to do if it's not a hypothetical partition */
-	if (!HYPO_TABLE_RTE_HAS_HYPOOID(rte))
+	statsTuple = hypo_get_imported_stats_tuple(rte->relid, attnum, inherit);
+	if (!statsTuple)
 		return false;
 
-	/* At this point, we have a hypothetical partition.  Get its oid */
-	poid = HYPO_TABLE_RTE_GET_HYPOOID(rte);
-	if (poid == InvalidOid)
-		/* This should not happen */
-		return false;
+	vardata->statsTuple = heap_copytuple(statsTuple);
+	vardata->freefunc = (void *) pfree;
+	/* the privileges were checked when the snapshot was exported */
+	vardata->acl_ok = true;
 
-	/* Retrieve the pg_statistic stored row */
-	memset(&key, 0, sizeof(hypoStatsKey));
-	key.relid = poid;
-	key.attnum = attnum;
-	entry = hash_search(hypoStatsHash, &key, HASH_FIND, &found);
+	return true;
+}
 
-	/* XXX should we warn about possible very bad estimation? */
-	if (!found)
-		return false;
+/*
+ * Return the average width of the given column from the statistics imported
+ * from a snapshot if any, or 0 to let postgres compute it.
+ */
+static int32
+hypo_get_attavgwidth_hook(Oid relid, AttrNumber attnum)
+{
+	if (HYPO_ENABLED() && hypoRelStatsHash)
+	{
+		HeapTuple	statsTuple = hypo_get_imported_stats_tuple(relid, attnum,
+															   false);
 
-	vardata->statsTuple = heap_copytuple(entry->statsTuple);
-	vardata->freefunc = (void *) pfree;
+		if (statsTuple)
+		{
+			int32		stawidth = ((Form_pg_statistic) GETSTRUCT(statsTuple))->stawidth;
 
-	return true;
-#endif
+			if (stawidth > 0)
+				return stawidth;
+		}
+	}
+
+	if (prev_get_attavgwidth_hook)
+		return prev_get_attavgwidth_hook(relid, attnum);
+
+	return 0;
 }
 
-#if PG_VERSION_NUM >= 100000 && PG_VERSION_NUM < 110000
+#if PG_VERSION_NUM >= 100000
 /*
- * if this child relation is excluded by constraints, call set_dummy_rel_pathlist
+ * if this child relation is excluded by constraints, call
+ * set_dummy_rel_pathlist.  Also adjust the estimated number of rows using the
+ * hypothetical extended statistics if any.
  */
 static void
 hypo_set_rel_pathlist_hook(PlannerInfo *root,
@@ -729,8 +1273,14 @@ hypo_set_rel_pathlist_hook(PlannerInfo *root,
 						   Index rti,
 						   RangeTblEntry *rte)
 {
-	if (HYPO_ENABLED() && hypo_table_oid_is_hypothetical(rte->relid) && rte->relkind == 'r')
+#if PG_VERSION_NUM < 110000
+	if (HYPO_ENABLED() && hypo_rti_get_table(root, rti) != NULL &&
+		rte->relkind == 'r')
 		hypo_markDummyIfExcluded(root, rel, rti, rte);
+#endif
+
+	if (HYPO_ENABLED() && hypoStatsExts != NIL)
+		hypo_stats_ext_adjust_rel(root, rel, rte);
 
 	if (prev_set_rel_pathlist_hook)
 		prev_set_rel_pathlist_hook(root, rel, rti, rte);
@@ -764,6 +1314,286 @@ hypo_planner_hook(Query *parse, int cursorOptions,
 }
 #endif
 
+#if PG_VERSION_NUM >= 100000
+/*
+ * Plan and explain the query as ExplainOneQuery would, and if asked to append
+ * the details of the hypothetical objects the plan relies on.  Those are
+ * emitted as a separate group after the plan, as there's no way to add
+ * properties to a plan node from an extension.
+ */
+static void
+hypo_ExplainOneQuery_hook(Query *query, int cursorOptions,
+						  IntoClause *into, ExplainState *es,
+						  const char *queryString, ParamListInfo params,
+						  QueryEnvironment *queryEnv)
+{
+	PlannedStmt *plan;
+	instr_time	planstart,
+				planduration;
+	hypoExplainContext context;
+	bool		annotate;
+
+	/* Another extension is in charge, we can't get the plan */
+	if (prev_ExplainOneQuery_hook)
+	{
+		prev_ExplainOneQuery_hook(query, cursorOptions, into, es,
+								  queryString, params, queryEnv);
+		return;
+	}
+
+	/* isExplain will be reset by our ExecutorEnd hook, check it now */
+	annotate = HYPO_ENABLED() && hypo_explain_annotations;
+
+	INSTR_TIME_SET_CURRENT(planstart);
+
+	/*
+	 * The same hypothetical index can be estimated for multiple relations,
+	 * keep each estimation to describe the node that used it.
+	 */
+	if (annotate)
+		hypo_index_collect_estimates(true);
+
+	/*
+	 * The estimations are used until the annotations are emitted, and are
+	 * allocated in a memory context that won't survive an error.
+	 */
+	PG_TRY();
+	{
+		plan = pg_plan_query(query, cursorOptions, params);
+
+		INSTR_TIME_SET_CURRENT(planduration);
+		INSTR_TIME_SUBTRACT(planduration, planstart);
+
+		/* Look for the hypothetical objects before they can be removed */
+		memset(&context, 0, sizeof(hypoExplainContext));
+		if (annotate)
+		{
+			context.pstmt = plan;
+			hypo_walk_plannedstmt(plan, hypo_explain_walker, &context);
+		}
+
+		ExplainOnePlan(plan, into, es, queryString, params, queryEnv,
+					   &planduration);
+
+		if (context.indexes != NIL || context.partitions != NIL)
+			hypo_explain_annotate(&context, es);
+	}
+	PG_CATCH();
+	{
+		hypo_index_collect_estimates(false);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	hypo_index_collect_estimates(false);
+}
+
+/*
+ * Remember the scan nodes using an hypothetical index or an hypothetical
+ * partition.
+ */
+static bool
+hypo_explain_walker(Plan *plan, void *context)
+{
+	hypoExplainContext *ctx = (hypoExplainContext *) context;
+	Oid			indexid = InvalidOid;
+	RangeTblEntry *rte;
+
+	switch (nodeTag(plan))
+	{
+		case T_IndexScan:
+			indexid = ((IndexScan *) plan)->indexid;
+			break;
+		case T_IndexOnlyScan:
+			indexid = ((IndexOnlyScan *) plan)->indexid;
+			break;
+		case T_BitmapIndexScan:
+			indexid = ((BitmapIndexScan *) plan)->indexid;
+			break;
+		case T_SeqScan:
+		case T_SampleScan:
+		case T_BitmapHeapScan:
+		case T_TidScan:
+			break;
+		default:
+			return false;
+	}
+
+	if (OidIsValid(indexid) && hypo_get_index(indexid) != NULL)
+		ctx->indexes = lappend(ctx->indexes, plan);
+
+	/* The parent Bitmap Heap Scan will describe the partition */
+	if (IsA(plan, BitmapIndexScan))
+		return false;
+
+	rte = rt_fetch(((Scan *) plan)->scanrelid, ctx->pstmt->rtable);
+	if (rte->rtekind == RTE_RELATION && HYPO_TABLE_RTE_HAS_HYPOOID(rte))
+		ctx->partitions = lappend(ctx->partitions, plan);
+
+	return false;
+}
+
+/*
+ * Start the description of an hypothetical object.  Text format has no
+ * grouping, so use the name as a header of indented properties.
+ */
+static void
+hypo_explain_open_entry(const char *objname, const char *name,
+						ExplainState *es)
+{
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "%s: %s\n", objname, name);
+		es->indent++;
+	}
+	else
+	{
+		ExplainOpenGroup(objname, NULL, true, es);
+		ExplainPropertyText("Name", name, es);
+	}
+
+	ExplainPropertyBool("Hypothetical", true, es);
+}
+
+static void
+hypo_explain_close_entry(const char *objname, ExplainState *es)
+{
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+		es->indent--;
+	else
+		ExplainCloseGroup(objname, NULL, true, es);
+}
+
+/*
+ * Return the source of the statistics used to estimate the rows of the given
+ * hypothetical partition, in the order the estimation uses them.  The
+ * fraction sampled in accurate mode is cached, so it's only used in this
+ * mode.
+ */
+static const char *
+hypo_explain_stats_source(hypoTable *part)
+{
+	if (part->set_tuples)
+		return "hypopg_analyze";
+
+	if (hypo_estimation_mode == HYPO_ESTIMATION_FAST)
+		return "uniform distribution";
+
+	if (hypo_estimation_mode == HYPO_ESTIMATION_ACCURATE &&
+		part->fraction_sampled && part->fraction >= 0)
+		return "sampled";
+
+	if (hypo_find_relstats(part->rootid) != NULL)
+		return "imported statistics";
+
+	return "partition bounds";
+}
+
+/*
+ * Emit the details of the hypothetical indexes and partitions used in the
+ * plan, one entry per scan node.
+ */
+static void
+hypo_explain_annotate(hypoExplainContext *context, ExplainState *es)
+{
+	ListCell   *lc;
+
+	ExplainOpenGroup("Hypothetical Objects", NULL, true, es);
+
+	ExplainOpenGroup("Hypothetical Indexes", "Hypothetical Indexes", false,
+					 es);
+	foreach(lc, context->indexes)
+	{
+		Plan	   *plan = (Plan *) lfirst(lc);
+		Oid			indexid;
+		hypoIndex  *entry;
+		RangeTblEntry *rte;
+		hypoIndexEstimate *estimate;
+		BlockNumber pages;
+		double		tuples;
+		int			tree_height;
+		double		predicted_ms;
+
+		if (IsA(plan, IndexScan))
+			indexid = ((IndexScan *) plan)->indexid;
+		else if (IsA(plan, IndexOnlyScan))
+			indexid = ((IndexOnlyScan *) plan)->indexid;
+		else
+			indexid = ((BitmapIndexScan *) plan)->indexid;
+
+		entry = hypo_get_index(indexid);
+		Assert(entry != NULL);
+
+		/* Use the estimation done for this node's relation if any */
+		rte = rt_fetch(((Scan *) plan)->scanrelid, context->pstmt->rtable);
+		estimate = hypo_index_find_estimate(indexid, rte->relid,
+											HYPO_TABLE_RTE_HAS_HYPOOID(rte) ?
+											HYPO_TABLE_RTE_GET_HYPOOID(rte) :
+											InvalidOid);
+		if (estimate)
+		{
+			pages = estimate->pages;
+			tuples = estimate->tuples;
+			tree_height = estimate->tree_height;
+		}
+		else
+		{
+			pages = entry->pages;
+			tuples = entry->tuples;
+			tree_height = entry->tree_height;
+		}
+
+		hypo_explain_open_entry("Hypothetical Index", entry->indexname, es);
+		ExplainPropertyText("Node Type", hypo_plan_node_name(plan), es);
+		ExplainPropertyText("Relation Name",
+							hypo_plan_relname(context->pstmt, plan),
+							es);
+		HYPO_EXPLAIN_INTEGER("Estimated Pages", pages, es);
+		HYPO_EXPLAIN_INTEGER("Estimated Bytes", (int64) pages * BLCKSZ, es);
+		HYPO_EXPLAIN_FLOAT("Estimated Tuples", tuples, 0, es);
+		HYPO_EXPLAIN_INTEGER("Tree Height", tree_height, es);
+		predicted_ms = hypo_predict_node_latency(context->pstmt, plan);
+		if (predicted_ms >= 0)
+			HYPO_EXPLAIN_FLOAT("Predicted Latency", predicted_ms, 3, es);
+		hypo_explain_close_entry("Hypothetical Index", es);
+	}
+	ExplainCloseGroup("Hypothetical Indexes", "Hypothetical Indexes", false,
+					  es);
+
+	ExplainOpenGroup("Hypothetical Partitions", "Hypothetical Partitions",
+					 false, es);
+	foreach(lc, context->partitions)
+	{
+		Plan	   *plan = (Plan *) lfirst(lc);
+		RangeTblEntry *rte;
+		hypoTable  *part;
+		double		predicted_ms;
+
+		rte = rt_fetch(((Scan *) plan)->scanrelid, context->pstmt->rtable);
+		part = hypo_find_table(HYPO_TABLE_RTE_GET_HYPOOID(rte), false);
+
+		hypo_explain_open_entry("Hypothetical Partition", part->tablename,
+								es);
+		ExplainPropertyText("Node Type", hypo_plan_node_name(plan), es);
+		ExplainPropertyText("Parent Name",
+							hypo_find_table(part->parentid, false)->tablename,
+							es);
+		HYPO_EXPLAIN_FLOAT("Estimated Rows", plan->plan_rows, 0, es);
+		ExplainPropertyText("Stats Source", hypo_explain_stats_source(part),
+							es);
+		predicted_ms = hypo_predict_node_latency(context->pstmt, plan);
+		if (predicted_ms >= 0)
+			HYPO_EXPLAIN_FLOAT("Predicted Latency", predicted_ms, 3, es);
+		hypo_explain_close_entry("Hypothetical Partition", es);
+	}
+	ExplainCloseGroup("Hypothetical Partitions", "Hypothetical Partitions",
+					  false, es);
+
+	ExplainCloseGroup("Hypothetical Objects", NULL, true, es);
+}
+#endif
+
 /*
  * Reset all stored entries.
  */
@@ -771,8 +1601,17 @@ PGDLLEXPORT Datum
 hypopg_reset(PG_FUNCTION_ARGS)
 {
 	hypo_index_reset();
+	list_free(hypoHiddenIndexes);
+	hypoHiddenIndexes = NIL;
+	hypo_reloptions_reset();
+	hypo_column_type_reset();
+	hypo_snapshot_reset();
+	hypo_actual_range_inval(InvalidOid);
 #if PG_VERSION_NUM >= 100000
 	hypo_table_reset();
+	list_free(hypoHiddenPartitions);
+	hypoHiddenPartitions = NIL;
+	hypo_stats_ext_reset();
 #endif
 	PG_RETURN_VOID();
 }
@@ -0,0 +1,2791 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_advisor.c: Implementation of hypothetical indexes for PostgreSQL
+ *
+ * This file contains the functions planning queries on their own with the
+ * stored hypothetical objects, rather than relying on an EXPLAIN, and the
+ * reports built on top of them.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/genam.h"
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
+#include "catalog/dependency.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_constraint.h"
+#include "catalog/pg_index.h"
+#include "catalog/pg_operator.h"
+#include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "nodes/relation.h"
+#include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "optimizer/plancat.h"
+#include "optimizer/predtest.h"
+#include "parser/parser.h"
+#include "parser/parsetree.h"
+#include "storage/bufmgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+#if PG_VERSION_NUM >= 90500
+#include "utils/ruleutils.h"
+#endif
+#include "utils/syscache.h"
+
+#include "include/hypopg.h"
+#include "include/hypopg_advisor.h"
+#include "include/hypopg_calibration.h"
+#include "include/hypopg_import.h"
+#include "include/hypopg_index.h"
+#include "include/hypopg_table.h"
+
+/*--- Structs --- */
+
+/*
+ * Kind of overlap detected between two indexes, ordered by preference when
+ * an index overlaps with multiple other indexes.
+ */
+typedef enum hypoOverlapKind
+{
+	HYPO_OVERLAP_NONE = 0,
+	HYPO_OVERLAP_DUPLICATE,		/* same definition */
+	HYPO_OVERLAP_INCLUDE,		/* same keys, INCLUDE columns are a subset */
+	HYPO_OVERLAP_PREFIX,		/* keys are a prefix of the other index keys */
+	HYPO_OVERLAP_PARTIAL,		/* predicate implies the other index one */
+	HYPO_OVERLAP_INCLUDE_MERGE	/* same keys, different INCLUDE columns */
+} hypoOverlapKind;
+
+/*
+ * Common description of a real or hypothetical index, containing only the
+ * fields needed to detect overlapping indexes.
+ */
+typedef struct hypoIndexDesc
+{
+	Oid			indexid;		/* real or hypothetical index oid */
+	char	   *indexname;		/* index name */
+	bool		hypothetical;	/* is it an hypothetical index? */
+	bool		constraint;		/* does the index back a constraint? */
+	Oid			relam;			/* OID of the access method */
+	bool		unique;			/* is it an unique index? */
+	int			ncolumns;		/* number of columns */
+	int			nkeycolumns;	/* number of key columns */
+	AttrNumber *indexkeys;		/* attnums, 0 for expressions */
+	Node	  **exprs;			/* expression of each column, or NULL */
+	Oid		   *opclass;		/* OIDs of opclass of key columns */
+	Oid		   *collations;		/* OIDs of collations of key columns */
+	int16	   *indoption;		/* per-column flags of key columns */
+	List	   *indpred;		/* predicate if a partial index, else NIL */
+	int64		bytes;			/* real or estimated size */
+} hypoIndexDesc;
+
+/*
+ * Baseline cost of a query used to validate the consolidation proposals
+ */
+typedef struct hypoQueryEntry
+{
+	Query	   *query;			/* analyzed and rewritten query */
+	PlannedStmt *pstmt;			/* plan with the current set of indexes */
+	Cost		cost;			/* total cost of the plan */
+	double		predicted_ms;	/* predicted latency of the plan, or -1 */
+} hypoQueryEntry;
+
+/*
+ * State of the comparison of two plans by hypopg_plan_diff()
+ */
+typedef struct hypoPlanDiffContext
+{
+	PlannedStmt *before;		/* plan without hypothetical indexes */
+	PlannedStmt *after;			/* plan with the hypothetical indexes */
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	int			node_num;		/* number of the last emitted node */
+} hypoPlanDiffContext;
+
+/*
+ * Estimated hot portion of a real table or of a real or hypothetical index
+ * used by a workload, for hypopg_cache_pressure_report()
+ */
+typedef struct hypoCacheEntry
+{
+	Oid			relid;			/* real table or real or hypothetical index */
+	bool		isindex;		/* is it an index? */
+	double		pages;			/* estimated number of hot pages */
+} hypoCacheEntry;
+
+/*
+ * Forbidden plan node looked for by hypopg_assert_plan()
+ */
+typedef struct hypoAssertContext
+{
+	PlannedStmt *pstmt;			/* plan being checked */
+	const char *nodename;		/* forbidden node type */
+	const char *relname;		/* scanned relation, or NULL for any */
+	Plan	   *found;			/* first matching node, if any */
+} hypoAssertContext;
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_consolidation_report);
+PG_FUNCTION_INFO_V1(hypopg_fk_index_report);
+PG_FUNCTION_INFO_V1(hypopg_evaluate);
+PG_FUNCTION_INFO_V1(hypopg_plan_diff);
+PG_FUNCTION_INFO_V1(hypopg_cache_pressure_report);
+PG_FUNCTION_INFO_V1(hypopg_assert_plan);
+
+/* ERRCODE_ASSERT_FAILURE was introduced in pg 9.5 */
+#if PG_VERSION_NUM < 90500
+#define ERRCODE_ASSERT_FAILURE ERRCODE_RAISE_EXCEPTION
+#endif
+
+#if PG_VERSION_NUM < 100000
+extern Datum pg_stat_get_tuples_updated(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_tuples_hot_updated(PG_FUNCTION_ARGS);
+extern Datum pg_stat_get_tuples_deleted(PG_FUNCTION_ARGS);
+#endif
+
+static bool hypo_plan_tree_walker(Plan *plan,
+					  hypo_walk_plan_callback callback, void *context);
+static bool hypo_plan_list_walker(List *plans,
+					  hypo_walk_plan_callback callback, void *context);
+static bool hypo_plan_uses_index_walker(Plan *plan, void *context);
+static const char *hypo_plan_index_name(Plan *plan);
+static void hypo_plan_fragment(StringInfo buf, PlannedStmt *pstmt,
+				   Plan *plan, int depth);
+static bool hypo_assert_forbidden_walker(Plan *plan, void *context);
+
+static List *hypo_get_index_descs(Oid relid);
+static void hypo_index_desc_set_exprs(hypoIndexDesc *desc, List *indexprs);
+static bool hypo_index_desc_col_equal(hypoIndexDesc *a, int i,
+						  hypoIndexDesc *b, int j);
+static bool hypo_index_desc_has_column(hypoIndexDesc *desc, AttrNumber attnum);
+static bool hypo_index_desc_covered(hypoIndexDesc *a, hypoIndexDesc *b);
+static bool hypo_index_desc_same_pred(hypoIndexDesc *a, hypoIndexDesc *b);
+static hypoOverlapKind hypo_index_desc_overlap(hypoIndexDesc *a,
+						hypoIndexDesc *b);
+static const char *hypo_overlap_name(hypoOverlapKind kind);
+#if PG_VERSION_NUM >= 110000
+static const hypoIndex *hypo_create_merged_index(Oid relid, hypoIndexDesc *a,
+						 hypoIndexDesc *b);
+#endif
+static void hypo_restore_hidden_indexes(List *saved);
+static bool hypo_fk_is_indexed(Oid relid, int nkeys, AttrNumber *keys);
+static char *hypo_fk_check_query(Oid relid, int nkeys, AttrNumber *keys,
+					Oid *eqops);
+static List *hypo_get_configurations(ArrayType *array);
+static void hypo_set_configuration(List *config, List *saved_hidden);
+static bool hypo_plan_is_decorator(Plan *plan);
+static void hypo_plan_diff_nodes(hypoPlanDiffContext *context, Plan *before,
+					 Plan *after, int depth);
+static List *hypo_cache_add(List *entries, Oid relid, bool isindex,
+			   double pages);
+static double hypo_cache_heap_pages(RangeTblEntry *rte, double tuples_fetched,
+					  bool index_only);
+static List *hypo_cache_plan_walker(PlannedStmt *pstmt, Plan *plan,
+					   double loops, List *entries);
+static void hypo_plan_diff_emit(hypoPlanDiffContext *context, Plan *before,
+					Plan *after, int depth, const char *change);
+
+
+/*
+ * Parse, analyze and rewrite the given query string, which must contain a
+ * single plannable statement, and return the resulting Query.
+ */
+Query *
+hypo_parse_query(const char *query, Oid *paramTypes, int numParams)
+{
+	List	   *parsetree_list;
+	List	   *querytree_list;
+	Query	   *result;
+
+	parsetree_list = pg_parse_query(query);
+
+	if (list_length(parsetree_list) != 1)
+		elog(ERROR, "hypopg: query \"%s\" must contain a single statement",
+			 query);
+
+	querytree_list = pg_analyze_and_rewrite(
+#if PG_VERSION_NUM >= 100000
+											(RawStmt *) linitial(parsetree_list),
+#else
+											(Node *) linitial(parsetree_list),
+#endif
+											query, paramTypes, numParams
+#if PG_VERSION_NUM >= 100000
+											,NULL
+#endif
+		);
+
+	if (list_length(querytree_list) != 1)
+		elog(ERROR, "hypopg: query \"%s\" is rewritten to multiple queries",
+			 query);
+
+	result = (Query *) linitial(querytree_list);
+
+	if (result->commandType == CMD_UTILITY)
+		elog(ERROR, "hypopg: utility statements are not supported");
+
+	return result;
+}
+
+/*
+ * Plan the given query with the stored hypothetical objects and the current
+ * set of hidden indexes.  The given query is not modified.
+ */
+PlannedStmt *
+hypo_plan_query(Query *query)
+{
+	PlannedStmt *pstmt;
+	bool		saved_isExplain = isExplain;
+
+	hypo_check_query(query);
+
+	/* Let the hooks consider the hypothetical objects */
+	isExplain = true;
+
+	PG_TRY();
+	{
+		pstmt = pg_plan_query((Query *) copyObject(query),
+#if PG_VERSION_NUM >= 90600
+							  CURSOR_OPT_PARALLEL_OK,
+#else
+							  0,
+#endif
+							  NULL);
+	}
+	PG_CATCH();
+	{
+		isExplain = saved_isExplain;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	isExplain = saved_isExplain;
+
+	return pstmt;
+}
+
+/*
+ * Call the given callback on each node of the given plan, including
+ * subplans, until the callback returns true.
+ */
+bool
+hypo_walk_plannedstmt(PlannedStmt *pstmt, hypo_walk_plan_callback callback,
+				 void *context)
+{
+	if (hypo_plan_tree_walker(pstmt->planTree, callback, context))
+		return true;
+
+	return hypo_plan_list_walker(pstmt->subplans, callback, context);
+}
+
+static bool
+hypo_plan_tree_walker(Plan *plan, hypo_walk_plan_callback callback,
+					  void *context)
+{
+	if (plan == NULL)
+		return false;
+
+	if (callback(plan, context))
+		return true;
+
+	return hypo_plan_list_walker(hypo_plan_children(plan), callback, context);
+}
+
+static bool
+hypo_plan_list_walker(List *plans, hypo_walk_plan_callback callback,
+					  void *context)
+{
+	ListCell   *lc;
+
+	foreach(lc, plans)
+	{
+		if (hypo_plan_tree_walker((Plan *) lfirst(lc), callback, context))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Return the list of the child nodes of the given plan node, outer plan
+ * first, excluding the subplans referenced in expressions.
+ */
+List *
+hypo_plan_children(Plan *plan)
+{
+	List	   *children = NIL;
+
+	if (plan->lefttree)
+		children = lappend(children, plan->lefttree);
+	if (plan->righttree)
+		children = lappend(children, plan->righttree);
+
+	switch (nodeTag(plan))
+	{
+		case T_Append:
+			children = list_concat(children,
+								   list_copy(((Append *) plan)->appendplans));
+			break;
+		case T_MergeAppend:
+			children = list_concat(children,
+								   list_copy(((MergeAppend *) plan)->mergeplans));
+			break;
+		case T_ModifyTable:
+			children = list_concat(children,
+								   list_copy(((ModifyTable *) plan)->plans));
+			break;
+		case T_SubqueryScan:
+			children = lappend(children, ((SubqueryScan *) plan)->subplan);
+			break;
+		case T_BitmapAnd:
+			children = list_concat(children,
+								   list_copy(((BitmapAnd *) plan)->bitmapplans));
+			break;
+		case T_BitmapOr:
+			children = list_concat(children,
+								   list_copy(((BitmapOr *) plan)->bitmapplans));
+			break;
+#if PG_VERSION_NUM >= 90500
+		case T_CustomScan:
+			children = list_concat(children,
+								   list_copy(((CustomScan *) plan)->custom_plans));
+			break;
+#endif
+		default:
+			break;
+	}
+
+	return children;
+}
+
+/*
+ * Return the node type of the given plan node, as EXPLAIN displays it
+ */
+const char *
+hypo_plan_node_name(Plan *plan)
+{
+	switch (nodeTag(plan))
+	{
+		case T_Result:
+			return "Result";
+#if PG_VERSION_NUM >= 100000
+		case T_ProjectSet:
+			return "ProjectSet";
+#endif
+		case T_ModifyTable:
+			return "ModifyTable";
+		case T_Append:
+			return "Append";
+		case T_MergeAppend:
+			return "Merge Append";
+		case T_RecursiveUnion:
+			return "Recursive Union";
+		case T_BitmapAnd:
+			return "BitmapAnd";
+		case T_BitmapOr:
+			return "BitmapOr";
+		case T_NestLoop:
+			return "Nested Loop";
+		case T_MergeJoin:
+			return "Merge Join";
+		case T_HashJoin:
+			return "Hash Join";
+		case T_SeqScan:
+			return "Seq Scan";
+#if PG_VERSION_NUM >= 90500
+		case T_SampleScan:
+			return "Sample Scan";
+#endif
+#if PG_VERSION_NUM >= 100000
+		case T_GatherMerge:
+			return "Gather Merge";
+#endif
+#if PG_VERSION_NUM >= 90600
+		case T_Gather:
+			return "Gather";
+#endif
+		case T_IndexScan:
+			return "Index Scan";
+		case T_IndexOnlyScan:
+			return "Index Only Scan";
+		case T_BitmapIndexScan:
+			return "Bitmap Index Scan";
+		case T_BitmapHeapScan:
+			return "Bitmap Heap Scan";
+		case T_TidScan:
+			return "Tid Scan";
+		case T_SubqueryScan:
+			return "Subquery Scan";
+		case T_FunctionScan:
+			return "Function Scan";
+#if PG_VERSION_NUM >= 100000
+		case T_TableFuncScan:
+			return "Table Function Scan";
+#endif
+		case T_ValuesScan:
+			return "Values Scan";
+		case T_CteScan:
+			return "CTE Scan";
+#if PG_VERSION_NUM >= 100000
+		case T_NamedTuplestoreScan:
+			return "Named Tuplestore Scan";
+#endif
+		case T_WorkTableScan:
+			return "WorkTable Scan";
+		case T_ForeignScan:
+			return "Foreign Scan";
+#if PG_VERSION_NUM >= 90500
+		case T_CustomScan:
+			return "Custom Scan";
+#endif
+		case T_Material:
+			return "Materialize";
+		case T_Sort:
+			return "Sort";
+		case T_Group:
+			return "Group";
+		case T_Agg:
+			switch (((Agg *) plan)->aggstrategy)
+			{
+				case AGG_PLAIN:
+					return "Aggregate";
+				case AGG_SORTED:
+					return "GroupAggregate";
+				case AGG_HASHED:
+					return "HashAggregate";
+#if PG_VERSION_NUM >= 100000
+				case AGG_MIXED:
+					return "MixedAggregate";
+#endif
+				default:
+					return "Aggregate ???";
+			}
+		case T_WindowAgg:
+			return "WindowAgg";
+		case T_Unique:
+			return "Unique";
+		case T_SetOp:
+			return "SetOp";
+		case T_LockRows:
+			return "LockRows";
+		case T_Limit:
+			return "Limit";
+		case T_Hash:
+			return "Hash";
+		default:
+			return "???";
+	}
+}
+
+/*
+ * Return the real or hypothetical index used by the given plan node, or
+ * InvalidOid if it's not an index scan.
+ */
+Oid
+hypo_plan_indexid(Plan *plan)
+{
+	switch (nodeTag(plan))
+	{
+		case T_IndexScan:
+			return ((IndexScan *) plan)->indexid;
+		case T_IndexOnlyScan:
+			return ((IndexOnlyScan *) plan)->indexid;
+		case T_BitmapIndexScan:
+			return ((BitmapIndexScan *) plan)->indexid;
+		default:
+			return InvalidOid;
+	}
+}
+
+/*
+ * Return the name of the real or hypothetical relation the given plan node
+ * scans, or NULL if it's not a relation scan.
+ */
+const char *
+hypo_plan_relname(PlannedStmt *pstmt, Plan *plan)
+{
+	RangeTblEntry *rte;
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+#if PG_VERSION_NUM >= 90500
+		case T_SampleScan:
+#endif
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapIndexScan:
+		case T_BitmapHeapScan:
+		case T_TidScan:
+		case T_ForeignScan:
+			break;
+		default:
+			return NULL;
+	}
+
+	/* Foreign joins don't scan a single relation */
+	if (((Scan *) plan)->scanrelid == 0)
+		return NULL;
+
+	rte = rt_fetch(((Scan *) plan)->scanrelid, pstmt->rtable);
+	if (rte->rtekind != RTE_RELATION)
+		return NULL;
+
+#if PG_VERSION_NUM >= 100000
+	if (HYPO_TABLE_RTE_HAS_HYPOOID(rte))
+		return hypo_find_table(HYPO_TABLE_RTE_GET_HYPOOID(rte),
+							   false)->tablename;
+#endif
+
+	return get_rel_name(rte->relid);
+}
+
+/*
+ * Does the given plan use the given real or hypothetical index?
+ */
+bool
+hypo_plan_uses_index(PlannedStmt *pstmt, Oid indexid)
+{
+	return hypo_walk_plannedstmt(pstmt, hypo_plan_uses_index_walker, &indexid);
+}
+
+static bool
+hypo_plan_uses_index_walker(Plan *plan, void *context)
+{
+	Oid			indexid = *((Oid *) context);
+
+	return hypo_plan_indexid(plan) == indexid;
+}
+
+/*
+ * Return the name of the real or hypothetical index used by the given plan
+ * node, or NULL if it's not an index scan.
+ */
+static const char *
+hypo_plan_index_name(Plan *plan)
+{
+	Oid			indexid = hypo_plan_indexid(plan);
+	hypoIndex  *entry;
+
+	if (!OidIsValid(indexid))
+		return NULL;
+
+	entry = hypo_get_index(indexid);
+	if (entry != NULL)
+		return entry->indexname;
+
+	return get_rel_name(indexid);
+}
+
+/*
+ * Append to the given buffer a textual representation of the given plan
+ * node and its children, looking like the EXPLAIN output.
+ */
+static void
+hypo_plan_fragment(StringInfo buf, PlannedStmt *pstmt, Plan *plan, int depth)
+{
+	const char *indexname = hypo_plan_index_name(plan);
+	const char *relname = hypo_plan_relname(pstmt, plan);
+	ListCell   *lc;
+
+	if (depth > 0)
+	{
+		appendStringInfoChar(buf, '\n');
+		appendStringInfoSpaces(buf, 6 * depth - 4);
+		appendStringInfoString(buf, "->  ");
+	}
+
+	appendStringInfoString(buf, hypo_plan_node_name(plan));
+	if (IsA(plan, BitmapIndexScan))
+		appendStringInfo(buf, " on %s", indexname);
+	else
+	{
+		if (indexname != NULL)
+			appendStringInfo(buf, " using %s", indexname);
+		if (relname != NULL)
+			appendStringInfo(buf, " on %s", relname);
+	}
+	appendStringInfo(buf, "  (cost=%.2f..%.2f rows=%.0f width=%d)",
+					 plan->startup_cost, plan->total_cost,
+					 plan->plan_rows, plan->plan_width);
+
+	foreach(lc, hypo_plan_children(plan))
+		hypo_plan_fragment(buf, pstmt, (Plan *) lfirst(lc), depth + 1);
+}
+
+/*
+ * Build the description of all the valid and not hidden real and
+ * hypothetical indexes of the given relation.  Real indexes come first.
+ */
+static List *
+hypo_get_index_descs(Oid relid)
+{
+	List	   *result = NIL;
+	List	   *indexoids;
+	Relation	relation;
+	ListCell   *lc;
+
+	relation = heap_open(relid, AccessShareLock);
+	indexoids = RelationGetIndexList(relation);
+	heap_close(relation, AccessShareLock);
+
+	foreach(lc, indexoids)
+	{
+		Oid			indexoid = lfirst_oid(lc);
+		Relation	indexRel;
+		Form_pg_index index;
+		hypoIndexDesc *desc;
+		oidvector  *indclass;
+		Datum		indclassDatum;
+		bool		isnull;
+		int			i;
+
+		if (hypo_index_is_hidden(indexoid))
+			continue;
+
+		indexRel = index_open(indexoid, AccessShareLock);
+		index = indexRel->rd_index;
+
+		/* Ignore invalid and exclusion constraints indexes */
+		if (!index->indisvalid || index->indisexclusion)
+		{
+			index_close(indexRel, AccessShareLock);
+			continue;
+		}
+
+		indclassDatum = SysCacheGetAttr(INDEXRELID, indexRel->rd_indextuple,
+										Anum_pg_index_indclass, &isnull);
+		Assert(!isnull);
+		indclass = (oidvector *) DatumGetPointer(indclassDatum);
+
+		desc = (hypoIndexDesc *) palloc0(sizeof(hypoIndexDesc));
+		desc->indexid = indexoid;
+		desc->indexname = pstrdup(RelationGetRelationName(indexRel));
+		desc->hypothetical = false;
+		desc->constraint = (index->indisprimary ||
+							OidIsValid(get_index_constraint(indexoid)));
+		desc->relam = indexRel->rd_rel->relam;
+		desc->unique = index->indisunique;
+		desc->ncolumns = RelationGetNumberOfAttributes(indexRel);
+#if PG_VERSION_NUM >= 110000
+		desc->nkeycolumns = IndexRelationGetNumberOfKeyAttributes(indexRel);
+#else
+		desc->nkeycolumns = desc->ncolumns;
+#endif
+		desc->indexkeys = (AttrNumber *) palloc0(sizeof(AttrNumber) * desc->ncolumns);
+		desc->opclass = (Oid *) palloc0(sizeof(Oid) * desc->ncolumns);
+		desc->collations = (Oid *) palloc0(sizeof(Oid) * desc->ncolumns);
+		desc->indoption = (int16 *) palloc0(sizeof(int16) * desc->ncolumns);
+
+		for (i = 0; i < desc->ncolumns; i++)
+			desc->indexkeys[i] = index->indkey.values[i];
+
+		for (i = 0; i < desc->nkeycolumns; i++)
+		{
+			desc->opclass[i] = indclass->values[i];
+			desc->collations[i] = indexRel->rd_indcollation[i];
+			desc->indoption[i] = indexRel->rd_indoption[i];
+		}
+
+		hypo_index_desc_set_exprs(desc, RelationGetIndexExpressions(indexRel));
+		desc->indpred = RelationGetIndexPredicate(indexRel);
+		desc->bytes = (int64) RelationGetNumberOfBlocks(indexRel) * BLCKSZ;
+
+		index_close(indexRel, AccessShareLock);
+
+		result = lappend(result, desc);
+	}
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+		hypoIndexDesc *desc;
+		List	   *indexprs = NIL;
+		ListCell   *lc2;
+		BlockNumber pages;
+		double		tuples;
+		int			i;
+
+		if (entry->relid != relid || hypo_index_is_hidden(entry->oid))
+			continue;
+
+		desc = (hypoIndexDesc *) palloc0(sizeof(hypoIndexDesc));
+		desc->indexid = entry->oid;
+		desc->indexname = pstrdup(entry->indexname);
+		desc->hypothetical = true;
+		desc->constraint = false;
+		desc->relam = entry->relam;
+		desc->unique = entry->unique;
+		desc->ncolumns = entry->ncolumns;
+		desc->nkeycolumns = entry->nkeycolumns;
+		desc->indexkeys = (AttrNumber *) palloc0(sizeof(AttrNumber) * desc->ncolumns);
+		desc->opclass = (Oid *) palloc0(sizeof(Oid) * desc->ncolumns);
+		desc->collations = (Oid *) palloc0(sizeof(Oid) * desc->ncolumns);
+		desc->indoption = (int16 *) palloc0(sizeof(int16) * desc->ncolumns);
+
+		for (i = 0; i < desc->ncolumns; i++)
+			desc->indexkeys[i] = entry->indexkeys[i];
+
+		for (i = 0; i < desc->nkeycolumns; i++)
+		{
+			desc->opclass[i] = entry->opclass[i];
+			desc->collations[i] = entry->indexcollations[i];
+			if (entry->amcanorder)
+			{
+				if (entry->reverse_sort[i])
+					desc->indoption[i] |= INDOPTION_DESC;
+				if (entry->nulls_first[i])
+					desc->indoption[i] |= INDOPTION_NULLS_FIRST;
+			}
+		}
+
+		/*
+		 * Hypothetical index expressions and predicate are stored as
+		 * transformed, make them comparable with the ones of real indexes.
+		 */
+		foreach(lc2, entry->indexprs)
+			indexprs = lappend(indexprs,
+							   eval_const_expressions(NULL, (Node *) lfirst(lc2)));
+		hypo_index_desc_set_exprs(desc, indexprs);
+		desc->indpred = (List *) eval_const_expressions(NULL,
+														(Node *) entry->indpred);
+
+		hypo_estimate_index_simple(entry, &pages, &tuples);
+		desc->bytes = (int64) pages * BLCKSZ;
+
+		result = lappend(result, desc);
+	}
+
+	return result;
+}
+
+/*
+ * Assign the given expressions to the corresponding index columns
+ */
+static void
+hypo_index_desc_set_exprs(hypoIndexDesc *desc, List *indexprs)
+{
+	ListCell   *indexpr_item = list_head(indexprs);
+	int			i;
+
+	desc->exprs = (Node **) palloc0(sizeof(Node *) * desc->ncolumns);
+
+	for (i = 0; i < desc->ncolumns; i++)
+	{
+		if (desc->indexkeys[i] != 0)
+			continue;
+
+		if (indexpr_item == NULL)
+			elog(ERROR, "too few entries in indexprs list");
+
+		desc->exprs[i] = (Node *) lfirst(indexpr_item);
+		indexpr_item = lnext(indexpr_item);
+	}
+}
+
+/*
+ * Are the ith key column of a and the jth key column of b equivalent?
+ */
+static bool
+hypo_index_desc_col_equal(hypoIndexDesc *a, int i, hypoIndexDesc *b, int j)
+{
+	if (a->indexkeys[i] != b->indexkeys[j])
+		return false;
+
+	if (a->indexkeys[i] == 0 && !equal(a->exprs[i], b->exprs[j]))
+		return false;
+
+	return (a->opclass[i] == b->opclass[j] &&
+			a->collations[i] == b->collations[j] &&
+			a->indoption[i] == b->indoption[j]);
+}
+
+/*
+ * Does the given index store the given plain column?
+ */
+static bool
+hypo_index_desc_has_column(hypoIndexDesc *desc, AttrNumber attnum)
+{
+	int			i;
+
+	for (i = 0; i < desc->ncolumns; i++)
+	{
+		if (desc->indexkeys[i] == attnum)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Are all the non key columns of a stored in b?
+ */
+static bool
+hypo_index_desc_covered(hypoIndexDesc *a, hypoIndexDesc *b)
+{
+	int			i;
+
+	for (i = a->nkeycolumns; i < a->ncolumns; i++)
+	{
+		if (!hypo_index_desc_has_column(b, a->indexkeys[i]))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Do a and b have equivalent predicates?
+ */
+static bool
+hypo_index_desc_same_pred(hypoIndexDesc *a, hypoIndexDesc *b)
+{
+	if (a->indpred == NIL || b->indpred == NIL)
+		return (a->indpred == b->indpred);
+
+	if (equal(a->indpred, b->indpred))
+		return true;
+
+#if PG_VERSION_NUM >= 100000
+	return (predicate_implied_by(a->indpred, b->indpred, false) &&
+			predicate_implied_by(b->indpred, a->indpred, false));
+#else
+	return (predicate_implied_by(a->indpred, b->indpred) &&
+			predicate_implied_by(b->indpred, a->indpred));
+#endif
+}
+
+/*
+ * Detect how the index a overlaps with the index b, if it does.  Anything
+ * else than HYPO_OVERLAP_NONE means that a could be dropped, either because b
+ * can be used instead, or for HYPO_OVERLAP_INCLUDE_MERGE because both a and b
+ * could be replaced with a single index.
+ */
+static hypoOverlapKind
+hypo_index_desc_overlap(hypoIndexDesc *a, hypoIndexDesc *b)
+{
+	bool		samekeys;
+	bool		prefix;
+	bool		samepred;
+	int			i;
+
+	/* indexes backing a constraint can't be dropped */
+	if (a->constraint)
+		return HYPO_OVERLAP_NONE;
+
+	if (a->relam != b->relam)
+		return HYPO_OVERLAP_NONE;
+
+	/* are the keys of a a prefix of the keys of b? */
+	prefix = (a->nkeycolumns <= b->nkeycolumns);
+	for (i = 0; prefix && i < a->nkeycolumns; i++)
+		prefix = hypo_index_desc_col_equal(a, i, b, i);
+
+	samekeys = prefix && (a->nkeycolumns == b->nkeycolumns);
+	samepred = hypo_index_desc_same_pred(a, b);
+
+	/* an unique index can only be replaced by the same unique index */
+	if (a->unique && (!b->unique || !samekeys || !samepred))
+		return HYPO_OVERLAP_NONE;
+
+	if (samekeys && samepred)
+	{
+		bool		a_in_b = hypo_index_desc_covered(a, b);
+		bool		b_in_a = hypo_index_desc_covered(b, a);
+
+		if (a_in_b && b_in_a && a->ncolumns == b->ncolumns &&
+			a->unique == b->unique)
+			return HYPO_OVERLAP_DUPLICATE;
+		if (a_in_b)
+			return HYPO_OVERLAP_INCLUDE;
+		/* merging would drop b too, which isn't possible for a constraint */
+		if (!a_in_b && !b_in_a && a->relam == BTREE_AM_OID &&
+			!b->constraint)
+			return HYPO_OVERLAP_INCLUDE_MERGE;
+
+		return HYPO_OVERLAP_NONE;
+	}
+
+	/* only btree can use the leading columns of a multicolumn index */
+	if (!samekeys && (!prefix || a->relam != BTREE_AM_OID))
+		return HYPO_OVERLAP_NONE;
+
+	if (!hypo_index_desc_covered(a, b))
+		return HYPO_OVERLAP_NONE;
+
+	if (samepred)
+		return HYPO_OVERLAP_PREFIX;
+
+	/*
+	 * a is a partial index whose predicate implies the one of b, so b can
+	 * be used in every query where a can.
+	 */
+	if (a->indpred != NIL &&
+		(b->indpred == NIL ||
+#if PG_VERSION_NUM >= 100000
+		 predicate_implied_by(b->indpred, a->indpred, false)
+#else
+		 predicate_implied_by(b->indpred, a->indpred)
+#endif
+		 ))
+		return HYPO_OVERLAP_PARTIAL;
+
+	return HYPO_OVERLAP_NONE;
+}
+
+static const char *
+hypo_overlap_name(hypoOverlapKind kind)
+{
+	switch (kind)
+	{
+		case HYPO_OVERLAP_DUPLICATE:
+			return "duplicate";
+		case HYPO_OVERLAP_INCLUDE:
+			return "include";
+		case HYPO_OVERLAP_PREFIX:
+			return "prefix";
+		case HYPO_OVERLAP_PARTIAL:
+			return "partial";
+		case HYPO_OVERLAP_INCLUDE_MERGE:
+			return "include_merge";
+		default:
+			elog(ERROR, "hypopg: unexpected overlap kind %d", kind);
+	}
+
+	return NULL;				/* keep compiler quiet */
+}
+
+#if PG_VERSION_NUM >= 110000
+/*
+ * Create an hypothetical index having the key columns and predicate of both
+ * given indexes, and the union of their INCLUDE columns.
+ */
+static const hypoIndex *
+hypo_create_merged_index(Oid relid, hypoIndexDesc *a, hypoIndexDesc *b)
+{
+	StringInfoData buf;
+	List	   *context;
+	List	   *parsetree_list;
+	Node	   *parsetree;
+	bool		first = true;
+	int			i;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE %s ON %s.%s USING %s (",
+					 ((a->unique || b->unique) ? "UNIQUE INDEX" : "INDEX"),
+					 quote_identifier(get_namespace_name(get_rel_namespace(relid))),
+					 quote_identifier(get_rel_name(relid)),
+					 get_am_name(a->relam));
+
+	context = deparse_context_for(get_rel_name(relid), relid);
+
+	for (i = 0; i < a->nkeycolumns; i++)
+	{
+		Oid			keycoltype;
+		Oid			keycolcollation;
+
+		if (i != 0)
+			appendStringInfo(&buf, ", ");
+
+		if (a->indexkeys[i] != 0)
+		{
+			int32		keycoltypmod;
+
+			appendStringInfoString(&buf,
+								   quote_identifier(get_attname(relid,
+																a->indexkeys[i], false)));
+			get_atttypetypmodcoll(relid, a->indexkeys[i], &keycoltype,
+								  &keycoltypmod, &keycolcollation);
+		}
+		else
+		{
+			appendStringInfo(&buf, "(%s)",
+							 deparse_expression(a->exprs[i], context, false,
+												false));
+			keycoltype = exprType(a->exprs[i]);
+			keycolcollation = exprCollation(a->exprs[i]);
+		}
+
+		if (OidIsValid(a->collations[i]) &&
+			a->collations[i] != keycolcollation)
+			appendStringInfo(&buf, " COLLATE %s",
+							 generate_collation_name(a->collations[i]));
+
+		get_opclass_name(a->opclass[i], keycoltype, &buf);
+
+		if (a->indoption[i] & INDOPTION_DESC)
+		{
+			appendStringInfoString(&buf, " DESC");
+			/* NULLS FIRST is the default in this case */
+			if (!(a->indoption[i] & INDOPTION_NULLS_FIRST))
+				appendStringInfoString(&buf, " NULLS LAST");
+		}
+		else if (a->indoption[i] & INDOPTION_NULLS_FIRST)
+			appendStringInfoString(&buf, " NULLS FIRST");
+	}
+
+	appendStringInfo(&buf, ") INCLUDE (");
+
+	for (i = a->nkeycolumns; i < a->ncolumns; i++)
+	{
+		if (!first)
+			appendStringInfo(&buf, ", ");
+		appendStringInfoString(&buf,
+							   quote_identifier(get_attname(relid,
+															a->indexkeys[i], false)));
+		first = false;
+	}
+
+	for (i = b->nkeycolumns; i < b->ncolumns; i++)
+	{
+		if (hypo_index_desc_has_column(a, b->indexkeys[i]))
+			continue;
+		if (!first)
+			appendStringInfo(&buf, ", ");
+		appendStringInfoString(&buf,
+							   quote_identifier(get_attname(relid,
+															b->indexkeys[i], false)));
+		first = false;
+	}
+
+	appendStringInfo(&buf, ")");
+
+	if (a->indpred)
+		appendStringInfo(&buf, " WHERE %s",
+						 deparse_expression((Node *) make_ands_explicit(a->indpred),
+											context, false, false));
+
+	parsetree_list = pg_parse_query(buf.data);
+	Assert(list_length(parsetree_list) == 1);
+	parsetree = ((RawStmt *) linitial(parsetree_list))->stmt;
+	Assert(IsA(parsetree, IndexStmt));
+
+	return hypo_index_store_parsetree((IndexStmt *) parsetree, buf.data);
+}
+#endif
+
+/*
+ * Restore the given list of hidden indexes
+ */
+static void
+hypo_restore_hidden_indexes(List *saved)
+{
+	MemoryContext oldcontext;
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	list_free(hypoHiddenIndexes);
+	hypoHiddenIndexes = list_copy(saved);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Detect the real and hypothetical indexes of the given relation that
+ * overlap with another index, and could therefore be dropped or merged.  If
+ * queries are given, each proposal is validated by planning the queries
+ * using the overlapping index with and without it.  Merged indexes are
+ * created as regular hypothetical indexes and kept for further analysis,
+ * unless the given queries are more expensive using them.
+ */
+Datum
+hypopg_consolidation_report(PG_FUNCTION_ARGS)
+{
+	Oid			relid;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	List	   *descs;
+	List	   *queries = NIL;
+	List	   *saved_hidden;
+	List	   *volatile merged = NIL;
+	bool		has_queries = false;
+	hypoIndexDesc **desc_array;
+	hypoOverlapKind *kinds;
+	int		   *covering;
+	const hypoIndex **replacements;
+	int			ndescs;
+	int			i;
+	ListCell   *lc;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "hypopg: tablename must not be NULL");
+
+	relid = PG_GETARG_OID(0);
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (get_rel_relkind(relid) != RELKIND_RELATION
+#if PG_VERSION_NUM >= 90300
+		&& get_rel_relkind(relid) != RELKIND_MATVIEW
+#endif
+		)
+		elog(ERROR, "hypopg: \"%s\" is not a table",
+			 get_rel_name(relid));
+
+	/* Parse and analyze the queries only once */
+	if (!PG_ARGISNULL(1))
+	{
+		ArrayType  *array = PG_GETARG_ARRAYTYPE_P(1);
+		Datum	   *elems;
+		bool	   *elemnulls;
+		int			nelems;
+
+		has_queries = true;
+		deconstruct_array(array, TEXTOID, -1, false, 'i',
+						  &elems, &elemnulls, &nelems);
+
+		for (i = 0; i < nelems; i++)
+		{
+			hypoQueryEntry *q;
+
+			if (elemnulls[i])
+				continue;
+
+			q = (hypoQueryEntry *) palloc0(sizeof(hypoQueryEntry));
+			q->query = hypo_parse_query(TextDatumGetCString(elems[i]), NULL, 0);
+			queries = lappend(queries, q);
+		}
+	}
+
+	/* Detect the overlapping indexes */
+	descs = hypo_get_index_descs(relid);
+	ndescs = list_length(descs);
+	desc_array = (hypoIndexDesc **) palloc0(sizeof(hypoIndexDesc *) * (ndescs + 1));
+	kinds = (hypoOverlapKind *) palloc0(sizeof(hypoOverlapKind) * (ndescs + 1));
+	covering = (int *) palloc0(sizeof(int) * (ndescs + 1));
+	replacements = (const hypoIndex **) palloc0(sizeof(hypoIndex *) * (ndescs + 1));
+
+	i = 0;
+	foreach(lc, descs)
+		desc_array[i++] = (hypoIndexDesc *) lfirst(lc);
+
+	for (i = 0; i < ndescs; i++)
+	{
+		int			j;
+
+		for (j = 0; j < ndescs; j++)
+		{
+			hypoOverlapKind kind;
+
+			if (i == j)
+				continue;
+
+			kind = hypo_index_desc_overlap(desc_array[i], desc_array[j]);
+
+			if (kind == HYPO_OVERLAP_NONE)
+				continue;
+
+			/*
+			 * Only report one of two duplicated indexes, keeping the one
+			 * backing a constraint or the first one, and only report a merge
+			 * proposal once.
+			 */
+			if (kind == HYPO_OVERLAP_DUPLICATE && j > i &&
+				!desc_array[j]->constraint)
+				continue;
+			if (kind == HYPO_OVERLAP_INCLUDE_MERGE && j < i)
+				continue;
+
+			if (kinds[i] == HYPO_OVERLAP_NONE || kind < kinds[i])
+			{
+				kinds[i] = kind;
+				covering[i] = j;
+			}
+		}
+	}
+
+	saved_hidden = list_copy(hypoHiddenIndexes);
+
+	PG_TRY();
+	{
+		/* Create the merged indexes, hidden until they're evaluated */
+		for (i = 0; i < ndescs; i++)
+		{
+			if (kinds[i] != HYPO_OVERLAP_INCLUDE_MERGE)
+				continue;
+
+#if PG_VERSION_NUM >= 110000
+			replacements[i] = hypo_create_merged_index(relid, desc_array[i],
+													   desc_array[covering[i]]);
+#endif
+			if (replacements[i] == NULL)
+			{
+				kinds[i] = HYPO_OVERLAP_NONE;
+				continue;
+			}
+
+			merged = lappend_oid(merged, replacements[i]->oid);
+			hypo_index_set_hidden(replacements[i]->oid, true);
+		}
+
+		/* Compute the baseline plans */
+		foreach(lc, queries)
+		{
+			hypoQueryEntry *q = (hypoQueryEntry *) lfirst(lc);
+
+			q->pstmt = hypo_plan_query(q->query);
+			q->cost = q->pstmt->planTree->total_cost;
+			q->predicted_ms = hypo_predict_latency(q->pstmt);
+		}
+
+		for (i = 0; i < ndescs; i++)
+		{
+			Datum		values[HYPO_CONSOLIDATION_NB_COLS];
+			bool		nulls[HYPO_CONSOLIDATION_NB_COLS];
+			hypoIndexDesc *a = desc_array[i];
+			hypoIndexDesc *b;
+			int64		reclaimed;
+			int			nb_queries = 0;
+			Cost		cost_before = 0;
+			Cost		cost_after = 0;
+			double		predicted_before = 0;
+			double		predicted_after = 0;
+			int			j = 0;
+
+			if (kinds[i] == HYPO_OVERLAP_NONE)
+				continue;
+
+			b = desc_array[covering[i]];
+			reclaimed = a->bytes;
+
+			/* Hide the index(es) we propose to drop */
+			hypo_index_set_hidden(a->indexid, true);
+			if (replacements[i] != NULL)
+			{
+				BlockNumber pages;
+				double		tuples;
+
+				hypo_estimate_index_simple((hypoIndex *) replacements[i],
+										   &pages, &tuples);
+				reclaimed += b->bytes - (int64) pages * BLCKSZ;
+
+				hypo_index_set_hidden(b->indexid, true);
+				hypo_index_set_hidden(replacements[i]->oid, false);
+			}
+
+			foreach(lc, queries)
+			{
+				hypoQueryEntry *q = (hypoQueryEntry *) lfirst(lc);
+				PlannedStmt *pstmt;
+
+				if (!hypo_plan_uses_index(q->pstmt, a->indexid) &&
+					(replacements[i] == NULL ||
+					 !hypo_plan_uses_index(q->pstmt, b->indexid)))
+					continue;
+
+				pstmt = hypo_plan_query(q->query);
+				nb_queries++;
+				cost_before += q->cost;
+				cost_after += pstmt->planTree->total_cost;
+				predicted_before += q->predicted_ms;
+				predicted_after += hypo_predict_latency(pstmt);
+			}
+
+			hypo_index_set_hidden(a->indexid, false);
+			if (replacements[i] != NULL)
+			{
+				hypo_index_set_hidden(b->indexid, false);
+				hypo_index_set_hidden(replacements[i]->oid, true);
+
+				/*
+				 * Don't keep a merged index that makes the given queries more
+				 * expensive, otherwise the rejected candidates would pile up
+				 * in the hypothetical indexes list.
+				 */
+				if (nb_queries > 0 && cost_after > cost_before)
+				{
+					merged = list_delete_oid(merged, replacements[i]->oid);
+					hypo_index_remove(replacements[i]->oid);
+					replacements[i] = NULL;
+				}
+			}
+
+			memset(values, 0, sizeof(values));
+			memset(nulls, 0, sizeof(nulls));
+
+			values[j++] = ObjectIdGetDatum(a->indexid);
+			values[j++] = CStringGetTextDatum(a->indexname);
+			values[j++] = BoolGetDatum(a->hypothetical);
+			values[j++] = CStringGetTextDatum(hypo_overlap_name(kinds[i]));
+			values[j++] = ObjectIdGetDatum(b->indexid);
+			if (replacements[i] != NULL)
+				values[j++] = ObjectIdGetDatum(replacements[i]->oid);
+			else
+				nulls[j++] = true;
+			values[j++] = Int64GetDatum(reclaimed);
+			if (has_queries)
+				values[j++] = Int32GetDatum(nb_queries);
+			else
+				nulls[j++] = true;
+			if (nb_queries > 0)
+			{
+				values[j++] = Float8GetDatum(cost_before);
+				values[j++] = Float8GetDatum(cost_after);
+			}
+			else
+			{
+				nulls[j++] = true;
+				nulls[j++] = true;
+			}
+			if (nb_queries > 0 && hypoCalibrations != NIL)
+			{
+				values[j++] = Float8GetDatum(predicted_before);
+				values[j++] = Float8GetDatum(predicted_after);
+			}
+			else
+			{
+				nulls[j++] = true;
+				nulls[j++] = true;
+			}
+			Assert(j == HYPO_CONSOLIDATION_NB_COLS);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+	PG_CATCH();
+	{
+		hypo_restore_hidden_indexes(saved_hidden);
+		foreach(lc, merged)
+			hypo_index_remove(lfirst_oid(lc));
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/* The merged indexes are now regular hypothetical indexes */
+	hypo_restore_hidden_indexes(saved_hidden);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Does the given relation have a valid and not hidden real btree or hash
+ * index whose leading key columns are exactly the given columns, in any
+ * order?  Other access methods, like BRIN which only stores a summary of
+ * each block range, can't efficiently find the referencing rows.
+ */
+static bool
+hypo_fk_is_indexed(Oid relid, int nkeys, AttrNumber *keys)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypo_get_index_descs(relid))
+	{
+		hypoIndexDesc *desc = (hypoIndexDesc *) lfirst(lc);
+		int			i;
+		bool		ok = true;
+
+		if (desc->hypothetical || desc->indpred != NIL ||
+			desc->nkeycolumns < nkeys)
+			continue;
+
+		if (desc->relam != BTREE_AM_OID && desc->relam != HASH_AM_OID)
+			continue;
+
+		for (i = 0; ok && i < nkeys; i++)
+		{
+			int			j;
+
+			ok = false;
+			for (j = 0; j < nkeys; j++)
+			{
+				if (desc->indexkeys[i] == keys[j])
+				{
+					ok = true;
+					break;
+				}
+			}
+		}
+
+		if (ok)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Build the query run by the referential integrity triggers to check if a
+ * referenced row is still referenced, as done in RI_FKey_noaction_del().
+ */
+static char *
+hypo_fk_check_query(Oid relid, int nkeys, AttrNumber *keys, Oid *eqops)
+{
+	StringInfoData buf;
+	int			i;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT 1 FROM ONLY %s.%s x",
+					 quote_identifier(get_namespace_name(get_rel_namespace(relid))),
+					 quote_identifier(get_rel_name(relid)));
+
+	for (i = 0; i < nkeys; i++)
+	{
+		HeapTuple	opertup;
+		Form_pg_operator operform;
+
+		opertup = SearchSysCache1(OPEROID, ObjectIdGetDatum(eqops[i]));
+		if (!HeapTupleIsValid(opertup))
+			elog(ERROR, "cache lookup failed for operator %u", eqops[i]);
+		operform = (Form_pg_operator) GETSTRUCT(opertup);
+
+		appendStringInfo(&buf, " %s $%d OPERATOR(%s.%s) x.%s",
+						 (i == 0 ? "WHERE" : "AND"), i + 1,
+						 quote_identifier(get_namespace_name(operform->oprnamespace)),
+						 NameStr(operform->oprname),
+						 quote_identifier(get_attname(relid, keys[i]
+#if PG_VERSION_NUM >= 110000
+													  ,false
+#endif
+													  )));
+
+		ReleaseSysCache(opertup);
+	}
+
+#if PG_VERSION_NUM >= 90300
+	appendStringInfoString(&buf, " FOR KEY SHARE OF x");
+#else
+	appendStringInfoString(&buf, " FOR SHARE OF x");
+#endif
+
+	return buf.data;
+}
+
+/*
+ * Report the foreign keys whose referencing columns are not indexed.  For
+ * each of them, an hypothetical index is created on the referencing columns,
+ * and the query run by the referential integrity triggers when a referenced
+ * row is deleted or updated is planned with and without it.  The cost gain
+ * is weighted by the number of rows deleted and updated in the referenced
+ * table.  HOT updates are ignored, as they can't modify the referenced key
+ * columns, which are always indexed.  The counters are the cumulative ones
+ * since the last statistics reset, so this is only an approximation of the
+ * current workload.
+ */
+Datum
+hypopg_fk_index_report(PG_FUNCTION_ARGS)
+{
+	Oid			filter_relid = InvalidOid;
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	Relation	conrel;
+	SysScanDesc scan;
+	HeapTuple	tuple;
+
+	if (!PG_ARGISNULL(0))
+		filter_relid = PG_GETARG_OID(0);
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	conrel = heap_open(ConstraintRelationId, AccessShareLock);
+	scan = systable_beginscan(conrel, InvalidOid, false, NULL, 0, NULL);
+
+	while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		Form_pg_constraint con = (Form_pg_constraint) GETSTRUCT(tuple);
+		Datum		values[HYPO_FK_REPORT_NB_COLS];
+		bool		nulls[HYPO_FK_REPORT_NB_COLS];
+		Datum		datum;
+		Datum	   *elems;
+		bool		isnull;
+		int			nkeys;
+		int			nelems;
+		AttrNumber *keys;
+		Oid		   *eqops;
+		Oid		   *paramTypes;
+		StringInfoData indexdef;
+		char	   *sql;
+		Query	   *query;
+		List	   *parsetree_list;
+		Node	   *parsetree;
+		const hypoIndex *volatile entry = NULL;
+		BlockNumber pages;
+		double		tuples;
+		PlannedStmt *pstmt;
+		Cost		cost_without;
+		Cost		cost_with;
+		double		predicted_without;
+		double		predicted_with;
+		int64		nb_deletes;
+		int64		nb_updates;
+		int			i;
+		int			j = 0;
+
+		if (con->contype != CONSTRAINT_FOREIGN)
+			continue;
+
+		if (OidIsValid(filter_relid) && con->conrelid != filter_relid)
+			continue;
+
+		/*
+		 * Partitioned tables can't have indexes, their partitions have their
+		 * own foreign keys.
+		 */
+		if (get_rel_relkind(con->conrelid) != RELKIND_RELATION)
+			continue;
+
+		datum = heap_getattr(tuple, Anum_pg_constraint_conkey,
+							 RelationGetDescr(conrel), &isnull);
+		if (isnull)
+			continue;
+		deconstruct_array(DatumGetArrayTypeP(datum), INT2OID, 2, true, 's',
+						  &elems, NULL, &nkeys);
+		keys = (AttrNumber *) palloc(sizeof(AttrNumber) * nkeys);
+		for (i = 0; i < nkeys; i++)
+			keys[i] = DatumGetInt16(elems[i]);
+
+		if (hypo_fk_is_indexed(con->conrelid, nkeys, keys))
+			continue;
+
+		datum = heap_getattr(tuple, Anum_pg_constraint_conpfeqop,
+							 RelationGetDescr(conrel), &isnull);
+		if (isnull)
+			continue;
+		deconstruct_array(DatumGetArrayTypeP(datum), OIDOID, sizeof(Oid),
+						  true, 'i', &elems, NULL, &nelems);
+		if (nelems != nkeys)
+			elog(ERROR, "hypopg: invalid conpfeqop for constraint \"%s\"",
+				 NameStr(con->conname));
+		eqops = (Oid *) palloc(sizeof(Oid) * nkeys);
+		paramTypes = (Oid *) palloc(sizeof(Oid) * nkeys);
+		for (i = 0; i < nkeys; i++)
+		{
+			Oid			righttype;
+
+			eqops[i] = DatumGetObjectId(elems[i]);
+			op_input_types(eqops[i], &paramTypes[i], &righttype);
+		}
+
+		/* Plan the referential integrity check without the index */
+		sql = hypo_fk_check_query(con->conrelid, nkeys, keys, eqops);
+		query = hypo_parse_query(sql, paramTypes, nkeys);
+		pstmt = hypo_plan_query(query);
+		cost_without = pstmt->planTree->total_cost;
+		predicted_without = hypo_predict_latency(pstmt);
+
+		/* And with an hypothetical index on the referencing columns */
+		initStringInfo(&indexdef);
+		appendStringInfo(&indexdef, "CREATE INDEX ON %s.%s USING btree (",
+						 quote_identifier(get_namespace_name(get_rel_namespace(con->conrelid))),
+						 quote_identifier(get_rel_name(con->conrelid)));
+		for (i = 0; i < nkeys; i++)
+			appendStringInfo(&indexdef, "%s%s", (i == 0 ? "" : ", "),
+							 quote_identifier(get_attname(con->conrelid, keys[i]
+#if PG_VERSION_NUM >= 110000
+														  ,false
+#endif
+														  )));
+		appendStringInfoChar(&indexdef, ')');
+
+		PG_TRY();
+		{
+			parsetree_list = pg_parse_query(indexdef.data);
+			Assert(list_length(parsetree_list) == 1);
+#if PG_VERSION_NUM >= 100000
+			parsetree = ((RawStmt *) linitial(parsetree_list))->stmt;
+#else
+			parsetree = (Node *) linitial(parsetree_list);
+#endif
+			Assert(IsA(parsetree, IndexStmt));
+
+			entry = hypo_index_store_parsetree((IndexStmt *) parsetree,
+											   indexdef.data);
+			pstmt = hypo_plan_query(query);
+			cost_with = pstmt->planTree->total_cost;
+			predicted_with = hypo_predict_latency(pstmt);
+			hypo_estimate_index_simple((hypoIndex *) entry, &pages, &tuples);
+		}
+		PG_CATCH();
+		{
+			if (entry)
+				hypo_index_remove(entry->oid);
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+
+		hypo_index_remove(entry->oid);
+
+		nb_deletes = DatumGetInt64(DirectFunctionCall1(pg_stat_get_tuples_deleted,
+													   ObjectIdGetDatum(con->confrelid)));
+		nb_updates = DatumGetInt64(DirectFunctionCall1(pg_stat_get_tuples_updated,
+													   ObjectIdGetDatum(con->confrelid)))
+			- DatumGetInt64(DirectFunctionCall1(pg_stat_get_tuples_hot_updated,
+												ObjectIdGetDatum(con->confrelid)));
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[j++] = ObjectIdGetDatum(con->conrelid);
+		values[j++] = CStringGetTextDatum(NameStr(con->conname));
+		values[j++] = ObjectIdGetDatum(con->confrelid);
+		values[j++] = CStringGetTextDatum(indexdef.data);
+		values[j++] = Int64GetDatum((int64) pages * BLCKSZ);
+		values[j++] = Float8GetDatum(cost_without);
+		values[j++] = Float8GetDatum(cost_with);
+		if (predicted_without >= 0)
+		{
+			values[j++] = Float8GetDatum(predicted_without);
+			values[j++] = Float8GetDatum(predicted_with);
+		}
+		else
+		{
+			nulls[j++] = true;
+			nulls[j++] = true;
+		}
+		values[j++] = Int64GetDatum(nb_deletes);
+		values[j++] = Int64GetDatum(nb_updates);
+		values[j++] = Float8GetDatum((cost_without - cost_with) *
+									 (nb_deletes + nb_updates));
+		Assert(j == HYPO_FK_REPORT_NB_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	systable_endscan(scan);
+	heap_close(conrel, AccessShareLock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Build the list of configurations, as List of List of hypothetical index
+ * oids, from the given oid array.  Each row of a two-dimensional array is a
+ * configuration, NULL or 0 elements can be used to pad the rows.  A
+ * one-dimensional array is a single configuration, and an empty array is
+ * the configuration without any hypothetical index.
+ */
+static List *
+hypo_get_configurations(ArrayType *array)
+{
+	List	   *configs = NIL;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int			nelems;
+	int			nconfigs;
+	int			width;
+	int			i;
+
+	if (ARR_NDIM(array) > 2)
+		elog(ERROR, "hypopg: configurations must be a one or two-dimensional array");
+
+	deconstruct_array(array, OIDOID, sizeof(Oid), true, 'i',
+					  &elems, &elemnulls, &nelems);
+
+	if (ARR_NDIM(array) == 2)
+	{
+		nconfigs = ARR_DIMS(array)[0];
+		width = ARR_DIMS(array)[1];
+	}
+	else
+	{
+		nconfigs = 1;
+		width = nelems;
+	}
+
+	for (i = 0; i < nconfigs; i++)
+	{
+		List	   *config = NIL;
+		int			j;
+
+		for (j = 0; j < width; j++)
+		{
+			Oid			indexid;
+
+			if (elemnulls[i * width + j])
+				continue;
+
+			indexid = DatumGetObjectId(elems[i * width + j]);
+			if (!OidIsValid(indexid))
+				continue;
+
+			if (hypo_get_index(indexid) == NULL)
+				elog(ERROR, "hypopg: oid %u is not an hypothetical index",
+					 indexid);
+
+			config = lappend_oid(config, indexid);
+		}
+
+		configs = lappend(configs, config);
+	}
+
+	return configs;
+}
+
+/*
+ * Only show the hypothetical indexes of the given configuration, on top of
+ * the given list of hidden indexes.
+ */
+static void
+hypo_set_configuration(List *config, List *saved_hidden)
+{
+	ListCell   *lc;
+
+	hypo_restore_hidden_indexes(saved_hidden);
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+
+		hypo_index_set_hidden(entry->oid, !list_member_oid(config, entry->oid));
+	}
+}
+
+/*
+ * Plan each of the given queries with each of the given configurations of
+ * hypothetical indexes, and return the estimated costs and number of rows.
+ * The queries are parsed, analyzed and rewritten only once, only the planner
+ * is run for each configuration.  All the hypothetical indexes that are not
+ * part of a configuration are hidden while it's evaluated, the visibility of
+ * the real indexes is kept as-is.
+ */
+Datum
+hypopg_evaluate(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	MemoryContext plan_ctx;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ArrayType  *array;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int			nelems;
+	Query	  **queries;
+	List	   *configs;
+	List	   *saved_hidden;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	configs = hypo_get_configurations(PG_GETARG_ARRAYTYPE_P(1));
+
+	/* Parse, analyze and rewrite the queries only once */
+	array = PG_GETARG_ARRAYTYPE_P(0);
+	deconstruct_array(array, TEXTOID, -1, false, 'i',
+					  &elems, &elemnulls, &nelems);
+
+	queries = (Query **) palloc0(sizeof(Query *) * (nelems + 1));
+	for (i = 0; i < nelems; i++)
+	{
+		if (elemnulls[i])
+			continue;
+
+		queries[i] = hypo_parse_query(TextDatumGetCString(elems[i]), NULL, 0);
+	}
+
+	/* Planning memory is released after each query */
+	plan_ctx = AllocSetContextCreate(CurrentMemoryContext,
+									 "hypopg evaluate",
+#if PG_VERSION_NUM >= 90600
+									 ALLOCSET_DEFAULT_SIZES
+#else
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE
+#endif
+		);
+
+	saved_hidden = list_copy(hypoHiddenIndexes);
+
+	PG_TRY();
+	{
+		ListCell   *lc;
+		int			config_num = 0;
+
+		foreach(lc, configs)
+		{
+			List	   *config = (List *) lfirst(lc);
+
+			config_num++;
+
+			hypo_set_configuration(config, saved_hidden);
+
+			for (i = 0; i < nelems; i++)
+			{
+				Datum		values[HYPO_EVALUATE_NB_COLS];
+				bool		nulls[HYPO_EVALUATE_NB_COLS];
+				PlannedStmt *pstmt;
+				double		predicted_ms;
+				int			j = 0;
+
+				if (queries[i] == NULL)
+					continue;
+
+				oldcontext = MemoryContextSwitchTo(plan_ctx);
+				pstmt = hypo_plan_query(queries[i]);
+				MemoryContextSwitchTo(oldcontext);
+
+				memset(values, 0, sizeof(values));
+				memset(nulls, 0, sizeof(nulls));
+
+				values[j++] = Int32GetDatum(i + 1);
+				values[j++] = Int32GetDatum(config_num);
+				values[j++] = Float8GetDatum(pstmt->planTree->startup_cost);
+				values[j++] = Float8GetDatum(pstmt->planTree->total_cost);
+				values[j++] = Float8GetDatum(pstmt->planTree->plan_rows);
+				predicted_ms = hypo_predict_latency(pstmt);
+				if (predicted_ms >= 0)
+					values[j++] = Float8GetDatum(predicted_ms);
+				else
+					nulls[j++] = true;
+				Assert(j == HYPO_EVALUATE_NB_COLS);
+
+				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+				MemoryContextReset(plan_ctx);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		hypo_restore_hidden_indexes(saved_hidden);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	hypo_restore_hidden_indexes(saved_hidden);
+	MemoryContextDelete(plan_ctx);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Is the given plan node only processing the tuples of its single child,
+ * like a Sort, so that it can be added or removed without changing the rest
+ * of the plan?
+ */
+static bool
+hypo_plan_is_decorator(Plan *plan)
+{
+	if (plan->lefttree == NULL || plan->righttree != NULL)
+		return false;
+
+	switch (nodeTag(plan))
+	{
+		case T_Sort:
+		case T_Material:
+		case T_Hash:
+#if PG_VERSION_NUM >= 90600
+		case T_Gather:
+#endif
+#if PG_VERSION_NUM >= 100000
+		case T_GatherMerge:
+#endif
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Align the two given plan trees and emit the differences.  Nodes of the
+ * same type are matched and their children are aligned by position.  An
+ * added or removed node like a Sort is reported alone, and its child is
+ * aligned with the node of the other plan.
+ */
+static void
+hypo_plan_diff_nodes(hypoPlanDiffContext *context, Plan *before,
+					 Plan *after, int depth)
+{
+	List	   *before_children = NIL;
+	List	   *after_children = NIL;
+	ListCell   *lc1;
+	ListCell   *lc2;
+	const char *change;
+
+	if (before == NULL && after == NULL)
+		return;
+
+	if (before != NULL && after != NULL)
+	{
+		bool		same_node;
+
+		same_node = (nodeTag(before) == nodeTag(after) &&
+					 strcmp(hypo_plan_node_name(before),
+							hypo_plan_node_name(after)) == 0);
+
+		if (!same_node && hypo_plan_is_decorator(before))
+		{
+			hypo_plan_diff_emit(context, before, NULL, depth, "removed");
+			hypo_plan_diff_nodes(context, before->lefttree, after, depth + 1);
+			return;
+		}
+
+		if (!same_node && hypo_plan_is_decorator(after))
+		{
+			hypo_plan_diff_emit(context, NULL, after, depth, "added");
+			hypo_plan_diff_nodes(context, before, after->lefttree, depth + 1);
+			return;
+		}
+
+		if (!same_node)
+			change = "replaced";
+		else
+		{
+			const char *before_rel = hypo_plan_relname(context->before, before);
+			const char *after_rel = hypo_plan_relname(context->after, after);
+
+			if (hypo_plan_indexid(before) != hypo_plan_indexid(after) ||
+				(before_rel == NULL) != (after_rel == NULL) ||
+				(before_rel != NULL && strcmp(before_rel, after_rel) != 0))
+				change = "changed";
+			else
+				change = "same";
+		}
+	}
+	else if (before != NULL)
+		change = "removed";
+	else
+		change = "added";
+
+	hypo_plan_diff_emit(context, before, after, depth, change);
+
+	if (before != NULL)
+		before_children = hypo_plan_children(before);
+	if (after != NULL)
+		after_children = hypo_plan_children(after);
+
+	lc1 = list_head(before_children);
+	lc2 = list_head(after_children);
+	while (lc1 != NULL || lc2 != NULL)
+	{
+		hypo_plan_diff_nodes(context,
+							 lc1 ? (Plan *) lfirst(lc1) : NULL,
+							 lc2 ? (Plan *) lfirst(lc2) : NULL,
+							 depth + 1);
+
+		if (lc1)
+			lc1 = lnext(lc1);
+		if (lc2)
+			lc2 = lnext(lc2);
+	}
+}
+
+/*
+ * Emit a row describing the given aligned plan nodes, any of them being
+ * possibly NULL.
+ */
+static void
+hypo_plan_diff_emit(hypoPlanDiffContext *context, Plan *before,
+					Plan *after, int depth, const char *change)
+{
+	Datum		values[HYPO_PLAN_DIFF_NB_COLS];
+	bool		nulls[HYPO_PLAN_DIFF_NB_COLS];
+	Plan	   *plans[2];
+	PlannedStmt *pstmts[2];
+	int			i;
+	int			j = 0;
+
+	plans[0] = before;
+	plans[1] = after;
+	pstmts[0] = context->before;
+	pstmts[1] = context->after;
+
+	memset(values, 0, sizeof(values));
+	memset(nulls, 0, sizeof(nulls));
+
+	values[j++] = Int32GetDatum(++context->node_num);
+	values[j++] = Int32GetDatum(depth);
+	values[j++] = CStringGetTextDatum(change);
+
+	/* node type, relation and index of each plan */
+	for (i = 0; i < 2; i++)
+	{
+		Plan	   *plan = plans[i];
+		const char *relname;
+		const char *indexname;
+
+		if (plan == NULL)
+		{
+			nulls[j + i] = true;
+			nulls[j + i + 2] = true;
+			nulls[j + i + 4] = true;
+			continue;
+		}
+
+		values[j + i] = CStringGetTextDatum(hypo_plan_node_name(plan));
+
+		relname = hypo_plan_relname(pstmts[i], plan);
+		if (relname != NULL)
+			values[j + i + 2] = CStringGetTextDatum(relname);
+		else
+			nulls[j + i + 2] = true;
+
+		indexname = hypo_plan_index_name(plan);
+		if (indexname != NULL)
+			values[j + i + 4] = CStringGetTextDatum(indexname);
+		else
+			nulls[j + i + 4] = true;
+	}
+	j += 6;
+
+	/* estimated rows, total cost and predicted latency of each plan */
+	for (i = 0; i < 2; i++)
+	{
+		Plan	   *plan = plans[i];
+		double		predicted_ms;
+
+		if (plan == NULL)
+		{
+			nulls[j + i] = true;
+			nulls[j + i + 2] = true;
+			nulls[j + i + 4] = true;
+			continue;
+		}
+
+		values[j + i] = Float8GetDatum(plan->plan_rows);
+		values[j + i + 2] = Float8GetDatum(plan->total_cost);
+
+		predicted_ms = hypo_predict_node_latency(pstmts[i], plan);
+		if (predicted_ms >= 0)
+			values[j + i + 4] = Float8GetDatum(predicted_ms);
+		else
+			nulls[j + i + 4] = true;
+	}
+	j += 6;
+	Assert(j == HYPO_PLAN_DIFF_NB_COLS);
+
+	tuplestore_putvalues(context->tupstore, context->tupdesc, values, nulls);
+}
+
+/*
+ * Plan the given query without any hypothetical index and with the given
+ * hypothetical indexes, or the currently visible ones if none is given, and
+ * return the node-level differences between the two plans.
+ */
+Datum
+hypopg_plan_diff(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	hypoPlanDiffContext context;
+	Query	   *query;
+	List	   *config = NIL;
+	List	   *saved_hidden;
+	ListCell   *lc1;
+	ListCell   *lc2;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "hypopg: query must not be NULL");
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	if (!PG_ARGISNULL(1))
+	{
+		List	   *configs = hypo_get_configurations(PG_GETARG_ARRAYTYPE_P(1));
+
+		if (list_length(configs) != 1)
+			elog(ERROR, "hypopg: a single configuration must be given");
+
+		config = (List *) linitial(configs);
+	}
+
+	query = hypo_parse_query(text_to_cstring(PG_GETARG_TEXT_PP(0)), NULL, 0);
+
+	saved_hidden = list_copy(hypoHiddenIndexes);
+
+	PG_TRY();
+	{
+		hypo_set_configuration(NIL, saved_hidden);
+		context.before = hypo_plan_query(query);
+
+		if (PG_ARGISNULL(1))
+			hypo_restore_hidden_indexes(saved_hidden);
+		else
+			hypo_set_configuration(config, saved_hidden);
+		context.after = hypo_plan_query(query);
+	}
+	PG_CATCH();
+	{
+		hypo_restore_hidden_indexes(saved_hidden);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	hypo_restore_hidden_indexes(saved_hidden);
+
+	context.tupstore = tupstore;
+	context.tupdesc = tupdesc;
+	context.node_num = 0;
+
+	hypo_plan_diff_nodes(&context, context.before->planTree,
+						 context.after->planTree, 0);
+
+	/* The subplans are aligned by position */
+	lc1 = list_head(context.before->subplans);
+	lc2 = list_head(context.after->subplans);
+	while (lc1 != NULL || lc2 != NULL)
+	{
+		hypo_plan_diff_nodes(&context,
+							 lc1 ? (Plan *) lfirst(lc1) : NULL,
+							 lc2 ? (Plan *) lfirst(lc2) : NULL,
+							 0);
+
+		if (lc1)
+			lc1 = lnext(lc1);
+		if (lc2)
+			lc2 = lnext(lc2);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Add the given number of hot pages of a relation to the list of entries.
+ * Each scan of the same relation is assumed to touch the same pages, so only
+ * the biggest number of hot pages is kept.
+ */
+static List *
+hypo_cache_add(List *entries, Oid relid, bool isindex, double pages)
+{
+	hypoCacheEntry *entry;
+	ListCell   *lc;
+
+	foreach(lc, entries)
+	{
+		entry = (hypoCacheEntry *) lfirst(lc);
+
+		if (entry->relid == relid && entry->isindex == isindex)
+		{
+			entry->pages = Max(entry->pages, pages);
+			return entries;
+		}
+	}
+
+	entry = (hypoCacheEntry *) palloc(sizeof(hypoCacheEntry));
+	entry->relid = relid;
+	entry->isindex = isindex;
+	entry->pages = pages;
+
+	return lappend(entries, entry);
+}
+
+/*
+ * Estimate the number of distinct heap pages of the given table read to
+ * fetch the given number of tuples in index order, using the Mackert and
+ * Lohman formula as index_pages_fetched() does, ignoring the cache size.
+ * Index-only scans only read the pages not marked all-visible.  A negative
+ * number of tuples stands for a full scan of the table.  If the table is a
+ * hypothetical partition, only its estimated share of the root table pages
+ * is used.
+ */
+static double
+hypo_cache_heap_pages(RangeTblEntry *rte, double tuples_fetched,
+					  bool index_only)
+{
+	Relation	relation;
+	BlockNumber pages;
+	double		tuples;
+	double		allvisfrac;
+	double		result;
+
+	relation = heap_open(rte->relid, AccessShareLock);
+	estimate_rel_size(relation, NULL, &pages, &tuples, &allvisfrac);
+	heap_close(relation, AccessShareLock);
+
+#if PG_VERSION_NUM >= 100000
+	if (HYPO_TABLE_RTE_HAS_HYPOOID(rte))
+	{
+		hypoTable  *part;
+
+		part = hypo_find_table(HYPO_TABLE_RTE_GET_HYPOOID(rte), true);
+		if (part)
+			pages = (BlockNumber) ceil(pages *
+									   hypo_partition_fraction(part, tuples));
+	}
+#endif
+
+	if (tuples_fetched < 0)
+		return pages;
+
+	if (pages == 0)
+		return 0;
+
+	result = (2.0 * pages * tuples_fetched) / (2.0 * pages + tuples_fetched);
+	result = Min(ceil(result), pages);
+
+	if (index_only)
+		result = ceil(result * (1.0 - allvisfrac));
+
+	return result;
+}
+
+/*
+ * Add the hot pages of the tables and indexes scanned by the given plan tree
+ * to the list of entries.  A sequential scan reads the whole table, an index
+ * scan reads the upper levels of the index and the fraction of the leaves
+ * containing the fetched tuples, and then the heap pages containing them.
+ * loops is the number of times the node is expected to be executed, as the
+ * inner side of a nested loop is rescanned for each outer tuple.
+ */
+static List *
+hypo_cache_plan_walker(PlannedStmt *pstmt, Plan *plan, double loops,
+					   List *entries)
+{
+	RangeTblEntry *rte = NULL;
+	double		rows = plan->plan_rows * loops;
+	Oid			indexid;
+	List	   *children;
+	ListCell   *lc;
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+#if PG_VERSION_NUM >= 90500
+		case T_SampleScan:
+#endif
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapHeapScan:
+			rte = rt_fetch(((Scan *) plan)->scanrelid, pstmt->rtable);
+			break;
+		default:
+			break;
+	}
+
+	if (rte && rte->rtekind == RTE_RELATION)
+	{
+		Oid			relid = rte->relid;
+
+#if PG_VERSION_NUM >= 100000
+		/* The scans of a hypothetical partition are counted on their own */
+		if (HYPO_TABLE_RTE_HAS_HYPOOID(rte))
+			relid = HYPO_TABLE_RTE_GET_HYPOOID(rte);
+#endif
+
+		if (IsA(plan, SeqScan)
+#if PG_VERSION_NUM >= 90500
+			|| IsA(plan, SampleScan)
+#endif
+			)
+			entries = hypo_cache_add(entries, relid, false,
+									 hypo_cache_heap_pages(rte, -1, false));
+		else
+			entries = hypo_cache_add(entries, relid, false,
+									 hypo_cache_heap_pages(rte, rows,
+														   IsA(plan, IndexOnlyScan)));
+	}
+
+	indexid = hypo_plan_indexid(plan);
+	if (OidIsValid(indexid))
+	{
+		hypoIndex  *entry = hypo_get_index(indexid);
+		BlockNumber pages;
+		double		tuples;
+		double		fanout;
+		double		hot;
+
+		if (entry)
+			hypo_estimate_index_simple(entry, &pages, &tuples);
+		else
+		{
+			Relation	index = index_open(indexid, AccessShareLock);
+
+			pages = RelationGetNumberOfBlocks(index);
+			tuples = index->rd_rel->reltuples;
+			index_close(index, AccessShareLock);
+		}
+
+		/*
+		 * The upper levels are read by every scan, assuming as many tuples
+		 * per page in the internal pages as in the leaves.
+		 */
+		fanout = Max(tuples / Max(pages, 1), 2);
+		hot = 1 + ceil(pages / fanout);
+		if (tuples > 0)
+			hot += ceil(pages * Min(rows / tuples, 1.0));
+
+		entries = hypo_cache_add(entries, indexid, true, Min(hot, pages));
+	}
+
+	if (IsA(plan, NestLoop))
+	{
+		entries = hypo_cache_plan_walker(pstmt, plan->lefttree, loops,
+										 entries);
+		return hypo_cache_plan_walker(pstmt, plan->righttree,
+									  loops * Max(plan->lefttree->plan_rows, 1),
+									  entries);
+	}
+
+	children = hypo_plan_children(plan);
+	foreach(lc, children)
+		entries = hypo_cache_plan_walker(pstmt, (Plan *) lfirst(lc), loops,
+										 entries);
+	list_free(children);
+
+	return entries;
+}
+
+/*
+ * SQL wrapper to estimate the working set of a workload with multiple
+ * configurations of hypothetical indexes, and compare it with the cache
+ * sizes.  The planner costs each index on its own, so a configuration adding
+ * many indexes can look cheap while their combined hot pages don't fit in
+ * the cache anymore.  The configurations are given as for hypopg_evaluate(),
+ * or the current state is used if none is given.
+ */
+Datum
+hypopg_cache_pressure_report(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	MemoryContext plan_ctx;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int			nelems;
+	Query	  **queries;
+	List	   *configs;
+	List	   *saved_hidden;
+	int			i;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "hypopg: queries must not be NULL");
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	/* A NIL configuration stands for the current state */
+	if (PG_ARGISNULL(1))
+		configs = list_make1(NIL);
+	else
+		configs = hypo_get_configurations(PG_GETARG_ARRAYTYPE_P(1));
+
+	deconstruct_array(PG_GETARG_ARRAYTYPE_P(0), TEXTOID, -1, false, 'i',
+					  &elems, &elemnulls, &nelems);
+
+	queries = (Query **) palloc0(sizeof(Query *) * (nelems + 1));
+	for (i = 0; i < nelems; i++)
+	{
+		if (elemnulls[i])
+			continue;
+
+		queries[i] = hypo_parse_query(TextDatumGetCString(elems[i]), NULL, 0);
+	}
+
+	/* Planning memory is released after each configuration */
+	plan_ctx = AllocSetContextCreate(CurrentMemoryContext,
+									 "hypopg cache pressure",
+#if PG_VERSION_NUM >= 90600
+									 ALLOCSET_DEFAULT_SIZES
+#else
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE
+#endif
+		);
+
+	saved_hidden = list_copy(hypoHiddenIndexes);
+
+	PG_TRY();
+	{
+		ListCell   *lc;
+		int			config_num = 0;
+
+		foreach(lc, configs)
+		{
+			List	   *config = (List *) lfirst(lc);
+			Datum		values[HYPO_CACHE_PRESSURE_NB_COLS];
+			bool		nulls[HYPO_CACHE_PRESSURE_NB_COLS];
+			List	   *entries = NIL;
+			ListCell   *lc2;
+			double		table_pages = 0;
+			double		index_pages = 0;
+			int64		working_set;
+			int64		shared_buffers = (int64) NBuffers * BLCKSZ;
+			int64		cache_size = (int64) effective_cache_size * BLCKSZ;
+			int			j = 0;
+
+			config_num++;
+
+			if (PG_ARGISNULL(1))
+				hypo_restore_hidden_indexes(saved_hidden);
+			else
+				hypo_set_configuration(config, saved_hidden);
+
+			oldcontext = MemoryContextSwitchTo(plan_ctx);
+
+			for (i = 0; i < nelems; i++)
+			{
+				PlannedStmt *pstmt;
+
+				if (queries[i] == NULL)
+					continue;
+
+				pstmt = hypo_plan_query(queries[i]);
+
+				entries = hypo_cache_plan_walker(pstmt, pstmt->planTree, 1,
+												 entries);
+				foreach(lc2, pstmt->subplans)
+				{
+					if (lfirst(lc2) == NULL)
+						continue;
+
+					entries = hypo_cache_plan_walker(pstmt,
+													 (Plan *) lfirst(lc2), 1,
+													 entries);
+				}
+			}
+
+			MemoryContextSwitchTo(oldcontext);
+
+			foreach(lc2, entries)
+			{
+				hypoCacheEntry *entry = (hypoCacheEntry *) lfirst(lc2);
+
+				if (entry->isindex)
+					index_pages += entry->pages;
+				else
+					table_pages += entry->pages;
+			}
+
+			working_set = (int64) (table_pages + index_pages) * BLCKSZ;
+
+			memset(values, 0, sizeof(values));
+			memset(nulls, 0, sizeof(nulls));
+
+			values[j++] = Int32GetDatum(config_num);
+			values[j++] = Int32GetDatum(list_length(entries));
+			values[j++] = Int64GetDatum((int64) table_pages * BLCKSZ);
+			values[j++] = Int64GetDatum((int64) index_pages * BLCKSZ);
+			values[j++] = Int64GetDatum(working_set);
+			values[j++] = Int64GetDatum(shared_buffers);
+			values[j++] = Int64GetDatum(cache_size);
+			values[j++] = BoolGetDatum(working_set <= shared_buffers);
+			values[j++] = BoolGetDatum(working_set <= cache_size);
+			Assert(j == HYPO_CACHE_PRESSURE_NB_COLS);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+			MemoryContextReset(plan_ctx);
+		}
+	}
+	PG_CATCH();
+	{
+		hypo_restore_hidden_indexes(saved_hidden);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	hypo_restore_hidden_indexes(saved_hidden);
+	MemoryContextDelete(plan_ctx);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * Does the given plan node match the forbidden node type, and relation if
+ * any, of the given hypoAssertContext?
+ */
+static bool
+hypo_assert_forbidden_walker(Plan *plan, void *context)
+{
+	hypoAssertContext *ctx = (hypoAssertContext *) context;
+
+	if (pg_strcasecmp(hypo_plan_node_name(plan), ctx->nodename) != 0)
+		return false;
+
+	if (ctx->relname != NULL)
+	{
+		const char *relname = hypo_plan_relname(ctx->pstmt, plan);
+
+		if (relname == NULL || strcmp(relname, ctx->relname) != 0)
+			return false;
+	}
+
+	ctx->found = plan;
+	return true;
+}
+
+/*
+ * SQL wrapper to check that the plan of a query, using the stored
+ * hypothetical objects, meets the given requirements.  An error containing
+ * the offending part of the plan is raised otherwise.  Each requirement is
+ * optional and ignored if NULL:
+ *
+ * - max_total_cost: upper bound of the total cost of the plan
+ * - forbid_nodes: node types that must not appear in the plan, as EXPLAIN
+ *   displays them, optionally followed by "on <relation>" to only forbid
+ *   them on the given relation, eg. 'Seq Scan on orders'
+ * - require_index: real or hypothetical index that the plan must use
+ */
+Datum
+hypopg_assert_plan(PG_FUNCTION_ARGS)
+{
+	Query	   *query;
+	PlannedStmt *pstmt;
+	StringInfoData buf;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "hypopg: query must not be NULL");
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	query = hypo_parse_query(TextDatumGetCString(PG_GETARG_TEXT_PP(0)),
+							 NULL, 0);
+	pstmt = hypo_plan_query(query);
+
+	initStringInfo(&buf);
+
+	if (!PG_ARGISNULL(1))
+	{
+		float8		max_total_cost = PG_GETARG_FLOAT8(1);
+
+		if (pstmt->planTree->total_cost > max_total_cost)
+		{
+			hypo_plan_fragment(&buf, pstmt, pstmt->planTree, 0);
+			ereport(ERROR,
+					(errcode(ERRCODE_ASSERT_FAILURE),
+					 errmsg("hypopg: plan total cost exceeds the limit of %g",
+							max_total_cost),
+					 errdetail("Plan is:\n%s", buf.data)));
+		}
+	}
+
+	if (!PG_ARGISNULL(2))
+	{
+		Datum	   *elems;
+		bool	   *elemnulls;
+		int			nelems;
+		int			i;
+
+		deconstruct_array(PG_GETARG_ARRAYTYPE_P(2), TEXTOID, -1, false, 'i',
+						  &elems, &elemnulls, &nelems);
+
+		for (i = 0; i < nelems; i++)
+		{
+			hypoAssertContext context;
+			char	   *forbidden;
+			char	   *sep;
+
+			if (elemnulls[i])
+				continue;
+
+			forbidden = TextDatumGetCString(elems[i]);
+
+			context.pstmt = pstmt;
+			context.nodename = pstrdup(forbidden);
+			context.relname = NULL;
+			context.found = NULL;
+
+			/* no node type contains " on ", split the optional relation */
+			sep = strstr(context.nodename, " on ");
+			if (sep != NULL)
+			{
+				*sep = '\0';
+				context.relname = sep + strlen(" on ");
+			}
+
+			if (hypo_walk_plannedstmt(pstmt, hypo_assert_forbidden_walker,
+									  &context))
+			{
+				hypo_plan_fragment(&buf, pstmt, context.found, 0);
+				ereport(ERROR,
+						(errcode(ERRCODE_ASSERT_FAILURE),
+						 errmsg("hypopg: plan contains a forbidden \"%s\" node",
+								forbidden),
+						 errdetail("Offending plan fragment is:\n%s",
+								   buf.data)));
+			}
+		}
+	}
+
+	if (!PG_ARGISNULL(3))
+	{
+		Oid			indexid = PG_GETARG_OID(3);
+
+		if (!hypo_plan_uses_index(pstmt, indexid))
+		{
+			hypoIndex  *entry = hypo_get_index(indexid);
+			const char *indexname;
+
+			if (entry != NULL)
+				indexname = entry->indexname;
+			else
+				indexname = get_rel_name(indexid);
+
+			if (indexname == NULL)
+				elog(ERROR, "hypopg: oid %u is not a real or hypothetical index",
+					 indexid);
+
+			hypo_plan_fragment(&buf, pstmt, pstmt->planTree, 0);
+			ereport(ERROR,
+					(errcode(ERRCODE_ASSERT_FAILURE),
+					 errmsg("hypopg: plan does not use the required index"),
+					 errdetail("Index %s is not used, plan is:\n%s",
+							   indexname, buf.data)));
+		}
+	}
+
+	PG_RETURN_BOOL(true);
+}
@@ -34,6 +34,7 @@
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "parser/parsetree.h"
+#include "pgstat.h"
 #include "rewrite/rewriteManip.h"
 #include "utils/attoptcache.h"
 #include "utils/builtins.h"
@@ -52,6 +53,7 @@
 
 #include "include/hypopg.h"
 #include "include/hypopg_analyze.h"
+#include "include/hypopg_index.h"
 #include "include/hypopg_table.h"
 
 /*--- Variables exported ---*/
@@ -61,6 +63,8 @@ HTAB *hypoStatsHash = NULL;
 
 /* A few variables that don't seem worth passing around as parameters */
 static MemoryContext anl_context = NULL;
+static int64 anl_done_partitions = 0;
+static bool anl_progress = false;
 #endif
 
 /*--- Functions --- */
@@ -72,10 +76,16 @@ PG_FUNCTION_INFO_V1(hypopg_statistic);
 static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 		hypoTable *entry, float4 fraction);
 static void hypo_do_analyze_tree(Relation onerel, Relation pgstats,
-		float4 fraction, hypoTable *parent);
+		float4 fraction, bool resume, hypoTable *parent);
+static int	hypo_count_partitions(hypoTable *parent);
+static void hypo_reset_index_width(Oid root_tableid);
 static uint32 hypo_hash_fn(const void *key, Size keysize);
+static void hypo_initStatsHash(void);
 static void hypo_update_attstats(hypoTable *part, int natts,
 		VacAttrStats **vacattrstats, Relation pgstats);
+static void hypo_progress_update_param(int index, int64 val);
+static void hypo_progress_update_multi_param(int nparam, const int *index,
+		const int64 *val);
 #endif
 
 
@@ -135,49 +145,59 @@ hypo_clauselist_selectivity(PlannerInfo *root, RelOptInfo *rel, List *clauses,
 	if (clauses == NIL)
 	{
 		hypoTable *part = hypo_find_table(parent_oid, false);
-		RangeTblEntry *save_rte = planner_rt_fetch(save_relid, root);
 
 		Assert(root != NULL);
 		Assert(part->partkey);
 
-		/* add the hypothetical partition oid to be able to get the
-		 * constraints */
-		Assert(save_rte->rtekind != RTE_CTE);
-		Assert(rte->rtekind != RTE_CTE);
-		HYPO_TABLE_RTE_COPY_HYPOOID_FROM_RTE(rte, save_rte);
-		root_dummy->parse->rtable = list_make1(rte);
+		/* add the hypothetical partition to be able to get the constraints */
+		hypo_tag_rti(root_dummy, 1, hypo_rti_get_table(root, save_relid));
 
 		/* get the partition constraints, setup for a rel with relid 1 */
 		clauses = hypo_get_partition_constraints(root_dummy, rel, part, true);
 
 		/*
-		 * and remove the hypothetical oid to avoid computing selectivity with
-		 * hypothetical statistics
+		 * and forget the hypothetical partition to avoid computing
+		 * selectivity with hypothetical statistics
 		 */
-		Assert(rte->rtekind != RTE_CTE);
-		HYPO_TABLE_RTE_CLEAR_HYPOOID(rte);
-		root_dummy->parse->rtable = list_make1(rte);
+		hypo_planner_map_release(root_dummy);
 	}
 	else
 	{	/* We estimates selectivity for hypothetical indexes */
 		RangeTblEntry *rt = NULL;
 		RangeTblEntry *dummyrte = planner_rt_fetch(1, root_dummy);
+		hypoTable  *part = NULL;
 
 		if (root)
+		{
 			rt = planner_rt_fetch(save_relid, root);
+			part = hypo_rti_get_table(root, save_relid);
+		}
 
 		/* modify RangeTableEntry to be able to get correct oid */
-		if (HYPO_TABLE_RTE_HAS_HYPOOID(rt))  /* Is this a hypothetical partition? */
+		/*
+		 * For hypothetical partitions, the statistics stored by
+		 * hypopg_analyze will be used if any, otherwise the ones of the root
+		 * table.
+		 */
+		if (part)  /* Is this a hypothetical partition? */
 		{
-			Assert(dummyrte->rtekind != RTE_CTE);
-			Assert(rt->rtekind != RTE_CTE);
-			HYPO_TABLE_RTE_COPY_HYPOOID_FROM_RTE(dummyrte, rt);
+			hypo_tag_rti(root_dummy, 1, part);
+			dummyrte->relid = rt->relid;
 		}
 		else if (rt)
 			dummyrte->relid = rt->relid;
 		else
 		{
+			part = hypo_find_table(table_relid, true);
+
 			Assert(save_relid == 1);
+
+			/* Index on a hypothetical partition, without planner info */
+			if (part && OidIsValid(part->parentid))
+			{
+				dummyrte->relid = part->rootid;
+				hypo_tag_rti(root_dummy, 1, part);
+			}
 		}
 	}
 #else
@@ -195,6 +215,10 @@ hypo_clauselist_selectivity(PlannerInfo *root, RelOptInfo *rel, List *clauses,
 			JOIN_INNER,
 			NULL);
 
+#if PG_VERSION_NUM >= 100000
+	hypo_planner_map_release(root_dummy);
+#endif
+
 	/* restore the original rel's relid */
 	rel->relid = save_relid;
 
@@ -204,6 +228,206 @@ hypo_clauselist_selectivity(PlannerInfo *root, RelOptInfo *rel, List *clauses,
 }
 
 #if PG_VERSION_NUM >= 100000
+/*
+ * Return the pg_statistic row stored by hypopg_analyze for the given
+ * hypothetical partition's column, or NULL if there isn't any.
+ */
+HeapTuple
+hypo_get_stats_tuple(Oid partid, AttrNumber attnum)
+{
+	hypoStatsKey key;
+	hypoStatsEntry *entry;
+	bool		found;
+
+	if (!hypoStatsHash)
+		return NULL;
+
+	memset(&key, 0, sizeof(hypoStatsKey));
+	key.relid = partid;
+	key.attnum = attnum;
+	entry = hash_search(hypoStatsHash, &key, HASH_FIND, &found);
+
+	if (!found)
+		return NULL;
+
+	return entry->statsTuple;
+}
+#endif
+
+/*
+ * Compute the given target list, which must return a single numeric value,
+ * on a sample of the given relation of about the size ANALYZE would use,
+ * restricted to the rows matching the given qual if it's not NULL.
+ * Returns false if the value couldn't be computed, or is NULL.
+ *
+ * This can be called during planning, so make sure that the sample query
+ * won't see any hypothetical object.
+ */
+bool
+hypo_sample_relation(Oid relid, double reltuples, const char *targetlist,
+					 const char *qual, double *result)
+{
+#if PG_VERSION_NUM >= 90500
+	StringInfoData buf;
+	double		targrows = 300.0 * default_statistics_target;
+	double		percent = 100.0;
+	bool		save_isExplain = isExplain;
+	bool		found = false;
+	int			ret;
+
+	if (reltuples > targrows)
+		percent = targrows * 100.0 / reltuples;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT (%s)::pg_catalog.float8"
+					 " FROM %s.%s TABLESAMPLE SYSTEM(%f)",
+					 targetlist,
+					 quote_identifier(get_namespace_name(get_rel_namespace(relid))),
+					 quote_identifier(get_rel_name(relid)),
+					 percent);
+	if (qual)
+		appendStringInfo(&buf, " WHERE %s", qual);
+
+	isExplain = false;
+	PG_TRY();
+	{
+		if (SPI_connect() != SPI_OK_CONNECT)
+			elog(ERROR, "hypopg: could not connect to SPI manager");
+
+		ret = SPI_execute(buf.data, true, 1);
+		if (ret != SPI_OK_SELECT)
+			elog(ERROR, "hypopg: could not sample relation \"%s\":"
+				 " SPI_execute returned %d", get_rel_name(relid), ret);
+
+		if (SPI_processed == 1)
+		{
+			Datum		value;
+			bool		isnull;
+
+			value = SPI_getbinval(SPI_tuptable->vals[0],
+								  SPI_tuptable->tupdesc, 1, &isnull);
+			if (!isnull)
+			{
+				*result = DatumGetFloat8(value);
+				found = true;
+			}
+		}
+
+		SPI_finish();
+	}
+	PG_CATCH();
+	{
+		isExplain = save_isExplain;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	isExplain = save_isExplain;
+	pfree(buf.data);
+
+	return found;
+#else
+	/* TABLESAMPLE is required */
+	return false;
+#endif
+}
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * Return the constraints of the given hypothetical partition and of its
+ * ancestors as an SQL expression on the root table, or NULL if there isn't
+ * any.
+ */
+char *
+hypo_partition_qual_string(hypoTable *part)
+{
+	Oid			root_tableid = part->rootid;
+	List	   *constraints;
+
+	constraints = hypo_get_partition_quals_inh(part, NULL);
+	if (constraints == NIL)
+		return NULL;
+
+	constraints = (List *) make_ands_explicit(constraints);
+
+	return deparse_expression((Node *) constraints,
+							  deparse_context_for(get_rel_name(root_tableid),
+												  root_tableid),
+							  false, false);
+}
+
+/*
+ * Compute the fraction of the root table's rows that would belong to the
+ * given hypothetical partition on a sample of the root table.  The result is
+ * cached in the hypoTable entry, until the root table is invalidated or a
+ * partition is added or removed.
+ */
+bool
+hypo_sample_partition_fraction(hypoTable *part, double reltuples,
+							   Selectivity *fraction)
+{
+	char	   *qual;
+	StringInfoData buf;
+	double		result;
+
+	if (part->fraction_sampled)
+	{
+		if (part->fraction < 0)
+			return false;
+
+		*fraction = part->fraction;
+		return true;
+	}
+
+	part->fraction_sampled = true;
+	part->fraction = -1;
+
+	qual = hypo_partition_qual_string(part);
+	if (qual == NULL)
+		return false;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "pg_catalog.count(*) FILTER (WHERE %s)::pg_catalog.float8"
+					 " / NULLIF(pg_catalog.count(*), 0)",
+					 qual);
+
+	if (!hypo_sample_relation(part->rootid, reltuples, buf.data, NULL,
+							  &result))
+		return false;
+
+	*fraction = result;
+	CLAMP_PROBABILITY(*fraction);
+	part->fraction = *fraction;
+
+	elog(DEBUG1, "hypopg: sampled fraction for partition \"%s\": %lf",
+		 part->tablename, *fraction);
+
+	return true;
+}
+#endif
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * Report the progress of hypopg_analyze(), if asked to.  The backend progress
+ * API only knows about the core commands, so it's reported as a VACUUM
+ * command, which is only done if hypopg.analyze_progress is enabled to avoid
+ * showing phantom rows in pg_stat_progress_vacuum.
+ */
+static void
+hypo_progress_update_param(int index, int64 val)
+{
+	if (anl_progress)
+		pgstat_progress_update_param(index, val);
+}
+
+static void
+hypo_progress_update_multi_param(int nparam, const int *index,
+		const int64 *val)
+{
+	if (anl_progress)
+		pgstat_progress_update_multi_param(nparam, index, val);
+}
+
 /*
  * Heavily inspired on do_analyze_rel().
  *
@@ -295,6 +519,9 @@ static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 	/*
 	 * Acquire the sample rows
 	 */
+	hypo_progress_update_param(HYPO_PROGRESS_ANALYZE_PHASE,
+							   HYPO_PROGRESS_ANALYZE_PHASE_ACQUIRE);
+
 	constraints = hypo_get_partition_quals_inh(part, NULL);
 	constraints = (List *) make_ands_explicit(constraints);
 	str = deparse_expression((Node *) constraints, context, false, false);
@@ -334,8 +561,21 @@ static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 	 * partition
 	 * */
 	totalrows = SPI_processed * 100 / fraction;
-	part->tuples = (int) totalrows;
-	part->set_tuples = true;
+
+	{
+		const int	index[] = {
+			HYPO_PROGRESS_ANALYZE_PHASE,
+			HYPO_PROGRESS_ANALYZE_SAMPLE_ROWS,
+			HYPO_PROGRESS_ANALYZE_TOTAL_COLUMNS
+		};
+		const int64 val[] = {
+			HYPO_PROGRESS_ANALYZE_PHASE_COMPUTE,
+			numrows,
+			attr_cnt
+		};
+
+		hypo_progress_update_multi_param(3, index, val);
+	}
 
 	/*
 	 * Compute the statistics.  Temporary results during the calculations for
@@ -358,6 +598,8 @@ static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 			VacAttrStats *stats = vacattrstats[i];
 			AttributeOpts *aopt;
 
+			CHECK_FOR_INTERRUPTS();
+
 			stats->rows = SPI_tuptable->vals;
 			stats->tupDesc = onerel->rd_att;
 			stats->compute_stats(stats,
@@ -380,6 +622,9 @@ static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 			}
 
 			MemoryContextResetAndDeleteChildren(col_context);
+
+			hypo_progress_update_param(HYPO_PROGRESS_ANALYZE_DONE_COLUMNS,
+									   i + 1);
 		}
 
 		/* TODO Handle indexes and hypothetical indexes */
@@ -388,6 +633,13 @@ static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 		MemoryContextDelete(col_context);
 
 		hypo_update_attstats(part, attr_cnt, vacattrstats, pgstats);
+
+		/*
+		 * Only flag the partition as analyzed once all its statistics are
+		 * stored, so that an interrupted run can be resumed.
+		 */
+		part->tuples = (int) totalrows;
+		part->set_tuples = true;
 	}
 
 	/* Roll back any GUC changes executed by index functions */
@@ -402,8 +654,12 @@ static void hypo_do_analyze_partition(Relation onerel, Relation pgstats,
 	anl_context = NULL;
 }
 
+/*
+ * Analyze all the partitions of the given hypoTable entry, recursively.  If
+ * resume is true, the partitions already analyzed are skipped.
+ */
 static void hypo_do_analyze_tree(Relation onerel, Relation pgstats,
-		float4 fraction, hypoTable *parent)
+		float4 fraction, bool resume, hypoTable *parent)
 {
 	ListCell *lc;
 
@@ -413,8 +669,71 @@ static void hypo_do_analyze_tree(Relation onerel, Relation pgstats,
 	{
 		hypoTable  *part = hypo_find_table(lfirst_oid(lc), false);
 
-		hypo_do_analyze_partition(onerel, pgstats, part, fraction);
-		hypo_do_analyze_tree(onerel, pgstats, fraction, part);
+		CHECK_FOR_INTERRUPTS();
+
+		if (!resume || !part->set_tuples)
+		{
+			const int	index[] = {
+				HYPO_PROGRESS_ANALYZE_PHASE,
+				HYPO_PROGRESS_ANALYZE_CURRENT_PARTITION,
+				HYPO_PROGRESS_ANALYZE_SAMPLE_ROWS,
+				HYPO_PROGRESS_ANALYZE_TOTAL_COLUMNS,
+				HYPO_PROGRESS_ANALYZE_DONE_COLUMNS
+			};
+			const int64 val[] = {
+				HYPO_PROGRESS_ANALYZE_PHASE_INIT,
+				part->oid,
+				0,
+				0,
+				0
+			};
+
+			hypo_progress_update_multi_param(5, index, val);
+
+			hypo_do_analyze_partition(onerel, pgstats, part, fraction);
+		}
+
+		hypo_progress_update_param(HYPO_PROGRESS_ANALYZE_DONE_PARTITIONS,
+								   ++anl_done_partitions);
+
+		hypo_do_analyze_tree(onerel, pgstats, fraction, resume, part);
+	}
+}
+
+/*
+ * Return the number of partitions of the given hypoTable entry, recursively.
+ */
+static int
+hypo_count_partitions(hypoTable *parent)
+{
+	ListCell   *lc;
+	int			nb = 0;
+
+	foreach(lc, parent->children)
+		nb += 1 + hypo_count_partitions(hypo_find_table(lfirst_oid(lc),
+														false));
+
+	return nb;
+}
+
+/*
+ * Forget the cached average width of all the hypothetical indexes defined on
+ * the given hypothetically partitioned table or any of its partitions, as it
+ * depends on the statistics that were just computed.
+ */
+static void
+hypo_reset_index_width(Oid root_tableid)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+		hypoTable  *table = hypo_find_table(entry->relid, true);
+
+		if (entry->relid == root_tableid ||
+			(table && table->rootid == root_tableid))
+			entry->avg_width = -1;
 	}
 }
 
@@ -426,6 +745,60 @@ static uint32 hypo_hash_fn(const void *key, Size keysize)
 		   (uint32) k->attnum);
 }
 
+/* Setup the hypoStatsHash hash */
+static void
+hypo_initStatsHash(void)
+{
+	HASHCTL info;
+
+	Assert(!hypoStatsHash);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(hypoStatsKey);
+	info.entrysize = sizeof(hypoStatsEntry);
+	info.hash = hypo_hash_fn;
+	info.hcxt = HypoMemoryContext;
+	hypoStatsHash = hash_create("hypo_stats",
+			500,
+			&info,
+			HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+/*
+ * Store a copy of the given pg_statistic tuple for the given relation and
+ * attribute, replacing any existing one.  The tuple's starelid is set to the
+ * given relation.
+ */
+void
+hypo_stat_store(Oid relid, AttrNumber attnum, HeapTuple statsTuple)
+{
+	hypoStatsKey key;
+	hypoStatsEntry *s;
+	MemoryContext oldcontext;
+	bool		found;
+
+	if (!hypoStatsHash)
+		hypo_initStatsHash();
+
+	memset(&key, 0, sizeof(hypoStatsKey));
+	key.relid = relid;
+	key.attnum = attnum;
+
+	s = hash_search(hypoStatsHash, &key, HASH_ENTER, &found);
+
+	/* Free tuple if one existed */
+	if (found)
+	{
+		pfree(s->statsTuple);
+		s->statsTuple = NULL;
+	}
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	s->statsTuple = heap_copytuple(statsTuple);
+	((Form_pg_statistic) GETSTRUCT(s->statsTuple))->starelid = relid;
+	MemoryContextSwitchTo(oldcontext);
+}
+
 /*
  * Remove all stored stats for a given hypothetical partition
  */
@@ -570,7 +943,9 @@ static void hypo_update_attstats(hypoTable *part, int natts,
 #endif
 
 /*
- * SQL wrapper to perform an ANALYZE-like operation.
+ * SQL wrapper to perform an ANALYZE-like operation.  If
+ * hypopg.analyze_progress is enabled, the progress is reported in the
+ * hypopg_stat_progress_analyze view.
  */
 Datum
 hypopg_analyze(PG_FUNCTION_ARGS)
@@ -580,9 +955,11 @@ HYPO_PARTITION_NOT_SUPPORTED();
 #else
 	Oid				root_tableid = PG_GETARG_OID(0);
 	float4			fraction = PG_GETARG_FLOAT4(1);
+	bool			resume = PG_GETARG_BOOL(2);
 	hypoTable	   *root_entry;
 	Relation		onerel;
 	Relation		pgstats;
+	MemoryContext	oldcontext = CurrentMemoryContext;
 	int				ret;
 
 	/* Process any pending invalidation */
@@ -603,24 +980,47 @@ HYPO_PARTITION_NOT_SUPPORTED();
 		elog(ERROR, "hypopg: SPI_connect returned %d", ret);
 
 	if (!hypoStatsHash)
-	{
-		HASHCTL info;
-
-		memset(&info, 0, sizeof(info));
-		info.keysize = sizeof(hypoStatsKey);
-		info.entrysize = sizeof(hypoStatsEntry);
-		info.hash = hypo_hash_fn;
-		info.hcxt = HypoMemoryContext;
-		hypoStatsHash = hash_create("hypo_stats",
-				500,
-				&info,
-				HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
-	}
+		hypo_initStatsHash();
 
 	onerel = heap_open(root_tableid, AccessShareLock);
 	pgstats = heap_open(StatisticRelationId, AccessShareLock);
 
-	hypo_do_analyze_tree(onerel, pgstats, fraction, root_entry);
+	anl_progress = hypo_analyze_progress;
+	if (anl_progress)
+		pgstat_progress_start_command(PROGRESS_COMMAND_VACUUM, root_tableid);
+	hypo_progress_update_param(HYPO_PROGRESS_ANALYZE_MAGIC_PARAM,
+							   HYPO_PROGRESS_ANALYZE_MAGIC);
+	hypo_progress_update_param(HYPO_PROGRESS_ANALYZE_TOTAL_PARTITIONS,
+							   hypo_count_partitions(root_entry));
+	anl_done_partitions = 0;
+
+	/*
+	 * The statistics of each partition are stored as soon as they're
+	 * computed, so an interrupted run keeps the already analyzed partitions.
+	 */
+	PG_TRY();
+	{
+		hypo_do_analyze_tree(onerel, pgstats, fraction, resume, root_entry);
+	}
+	PG_CATCH();
+	{
+		/* Some partitions may have been analyzed before the error */
+		hypo_reset_index_width(root_tableid);
+		if (anl_progress)
+			pgstat_progress_end_command();
+
+		/* Release the working context of the interrupted partition */
+		MemoryContextSwitchTo(oldcontext);
+		if (anl_context)
+			MemoryContextDelete(anl_context);
+		anl_context = NULL;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	hypo_reset_index_width(root_tableid);
+	if (anl_progress)
+		pgstat_progress_end_command();
 
 	/* release SPI related resources (and return to caller's context) */
 	SPI_finish();
@@ -0,0 +1,628 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_calibration.c: Implementation of cost calibration for PostgreSQL
+ *
+ * This file contains all the internal code related to the conversion of the
+ * estimated costs of the plans to predicted latencies.
+ *
+ * hypopg_calibrate() executes a sample of the workload with the real objects
+ * only, with per-node timing instrumentation as EXPLAIN ANALYZE does.  The
+ * exclusive cost and time of each executed node, that is without the cost
+ * and time of its children, are then used to fit a cost to time ratio per
+ * node type.  The plans built with hypothetical objects can then be
+ * converted to a predicted latency by applying the ratio of each node type
+ * to its exclusive cost, falling back to the ratio of all the measured nodes
+ * for the node types that weren't measured, such as an index scan on a
+ * hypothetical index.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/instrument.h"
+#include "nodes/execnodes.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "tcop/dest.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "include/hypopg.h"
+#include "include/hypopg_advisor.h"
+#include "include/hypopg_calibration.h"
+
+/*--- Variables exported ---*/
+
+List	   *hypoCalibrations = NIL;
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_calibrate);
+PG_FUNCTION_INFO_V1(hypopg_calibration);
+PG_FUNCTION_INFO_V1(hypopg_reset_calibration);
+
+static hypoCalibration *hypo_find_calibration(const char *nodename,
+					  bool create);
+static double hypo_calibration_ratio(const char *nodename);
+static void hypo_calibrate_query(Query *query, const char *sourceText);
+static List *hypo_planstate_children(PlanState *planstate);
+static double hypo_plan_cost(Plan *plan, double fraction);
+static double hypo_child_fraction(Plan *plan, Plan *child, double fraction);
+static void hypo_calibrate_planstate(PlanState *planstate, double fraction);
+static bool hypo_find_subplans_walker(Node *node, List **subplans);
+static double hypo_predict_plan(PlannedStmt *pstmt, Plan *plan, double loops,
+				  double fraction);
+static Datum hypo_calibration_report(FunctionCallInfo fcinfo);
+
+/*
+ * Return the calibration of the given node type.  If create is true, it's
+ * created if it doesn't exist yet, otherwise NULL is returned.
+ */
+static hypoCalibration *
+hypo_find_calibration(const char *nodename, bool create)
+{
+	hypoCalibration *entry;
+	MemoryContext oldcontext;
+	ListCell   *lc;
+
+	foreach(lc, hypoCalibrations)
+	{
+		entry = (hypoCalibration *) lfirst(lc);
+
+		if (strcmp(entry->nodename, nodename) == 0)
+			return entry;
+	}
+
+	if (!create)
+		return NULL;
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	entry = (hypoCalibration *) palloc0(sizeof(hypoCalibration));
+	strlcpy(entry->nodename, nodename, NAMEDATALEN);
+	hypoCalibrations = lappend(hypoCalibrations, entry);
+	MemoryContextSwitchTo(oldcontext);
+
+	return entry;
+}
+
+/*
+ * Return the fitted milliseconds per cost unit of the given node type, or of
+ * all the measured nodes if the node type wasn't measured.  Return -1 if
+ * nothing was calibrated.
+ */
+static double
+hypo_calibration_ratio(const char *nodename)
+{
+	hypoCalibration *entry = hypo_find_calibration(nodename, false);
+	double		sum_ct = 0;
+	double		sum_cc = 0;
+	ListCell   *lc;
+
+	if (entry != NULL && entry->sum_cc > 0)
+		return entry->sum_ct / entry->sum_cc;
+
+	foreach(lc, hypoCalibrations)
+	{
+		entry = (hypoCalibration *) lfirst(lc);
+
+		sum_ct += entry->sum_ct;
+		sum_cc += entry->sum_cc;
+	}
+
+	if (sum_cc <= 0)
+		return -1;
+
+	return sum_ct / sum_cc;
+}
+
+/*
+ * Return the list of the child nodes of the given plan state, in the same
+ * way as hypo_plan_children().
+ */
+static List *
+hypo_planstate_children(PlanState *planstate)
+{
+	List	   *children = NIL;
+	int			i;
+
+	if (outerPlanState(planstate))
+		children = lappend(children, outerPlanState(planstate));
+	if (innerPlanState(planstate))
+		children = lappend(children, innerPlanState(planstate));
+
+	switch (nodeTag(planstate))
+	{
+		case T_AppendState:
+			for (i = 0; i < ((AppendState *) planstate)->as_nplans; i++)
+				children = lappend(children,
+								   ((AppendState *) planstate)->appendplans[i]);
+			break;
+		case T_MergeAppendState:
+			for (i = 0; i < ((MergeAppendState *) planstate)->ms_nplans; i++)
+				children = lappend(children,
+								   ((MergeAppendState *) planstate)->mergeplans[i]);
+			break;
+		case T_BitmapAndState:
+			for (i = 0; i < ((BitmapAndState *) planstate)->nplans; i++)
+				children = lappend(children,
+								   ((BitmapAndState *) planstate)->bitmapplans[i]);
+			break;
+		case T_BitmapOrState:
+			for (i = 0; i < ((BitmapOrState *) planstate)->nplans; i++)
+				children = lappend(children,
+								   ((BitmapOrState *) planstate)->bitmapplans[i]);
+			break;
+		case T_SubqueryScanState:
+			children = lappend(children,
+							   ((SubqueryScanState *) planstate)->subplan);
+			break;
+#if PG_VERSION_NUM >= 90500
+		case T_CustomScanState:
+			children = list_concat(children,
+								   list_copy(((CustomScanState *) planstate)->custom_ps));
+			break;
+#endif
+		default:
+			break;
+	}
+
+	return children;
+}
+
+/*
+ * Return the cost of the given plan node when only the given fraction of its
+ * output is fetched, the same way as the planner costs a LIMIT.
+ */
+static double
+hypo_plan_cost(Plan *plan, double fraction)
+{
+	return plan->startup_cost +
+		(plan->total_cost - plan->startup_cost) * fraction;
+}
+
+/*
+ * Return the fraction of the output of the given child node that is fetched
+ * by its parent plan node, when the given fraction of the parent output is
+ * fetched.  A LIMIT only fetches the rows its cost was computed for, nodes
+ * that read all their input before returning their first row fetch all of
+ * it, and the other nodes are assumed to stop early in the same proportion.
+ */
+static double
+hypo_child_fraction(Plan *plan, Plan *child, double fraction)
+{
+	double		run_cost = child->total_cost - child->startup_cost;
+
+	switch (nodeTag(plan))
+	{
+		case T_Limit:
+			if (run_cost <= 0)
+				return 1.0;
+			fraction = (hypo_plan_cost(plan, fraction) - child->startup_cost)
+				/ run_cost;
+			return Min(Max(fraction, 0.0), 1.0);
+		case T_Sort:
+		case T_Hash:
+			return 1.0;
+		case T_Agg:
+			if (((Agg *) plan)->aggstrategy != AGG_SORTED)
+				return 1.0;
+			return fraction;
+		case T_NestLoop:
+			/* The inner side is fully scanned for each outer row */
+			if (child == innerPlan(plan))
+				return 1.0;
+			return fraction;
+		default:
+			return fraction;
+	}
+}
+
+/*
+ * Add the exclusive cost and time of the given executed plan state and of its
+ * children to the calibration of their node types.  The costs of the plan
+ * nodes are per loop, so they're multiplied by the actual number of loops to
+ * be comparable with the measured time of all the loops.  Only the given
+ * fraction of the output of the node is charged, so that the nodes stopped
+ * early by a LIMIT aren't compared with their full cost.
+ */
+static void
+hypo_calibrate_planstate(PlanState *planstate, double fraction)
+{
+	Instrumentation *instr = planstate->instrument;
+	hypoCalibration *entry;
+	double		cost;
+	double		time;
+	ListCell   *lc;
+
+	if (instr == NULL)
+		return;
+
+	InstrEndLoop(instr);
+
+	/* Never executed nodes don't give any information */
+	if (instr->nloops <= 0)
+		return;
+
+	cost = hypo_plan_cost(planstate->plan, fraction) * instr->nloops;
+	time = instr->total * 1000.0;
+
+	foreach(lc, hypo_planstate_children(planstate))
+	{
+		PlanState  *child = (PlanState *) lfirst(lc);
+		double		child_fraction = hypo_child_fraction(planstate->plan,
+														 child->plan,
+														 fraction);
+
+		hypo_calibrate_planstate(child, child_fraction);
+
+		if (child->instrument == NULL)
+			continue;
+
+		cost -= hypo_plan_cost(child->plan, child_fraction) *
+			child->instrument->nloops;
+		time -= child->instrument->total * 1000.0;
+	}
+
+	/*
+	 * The cost and time of the InitPlans and SubPlans are included in the
+	 * ones of the node evaluating them, so calibrate them on their own.
+	 */
+	foreach(lc, list_concat(list_copy(planstate->initPlan),
+							planstate->subPlan))
+	{
+		PlanState  *sub = ((SubPlanState *) lfirst(lc))->planstate;
+
+		hypo_calibrate_planstate(sub, 1.0);
+
+		if (sub->instrument == NULL)
+			continue;
+
+		cost -= hypo_plan_cost(sub->plan, 1.0) * sub->instrument->nloops;
+		time -= sub->instrument->total * 1000.0;
+	}
+
+	if (cost <= 0)
+		return;
+
+	time = Max(time, 0);
+
+	entry = hypo_find_calibration(hypo_plan_node_name(planstate->plan), true);
+	entry->samples++;
+	entry->sum_ct += cost * time;
+	entry->sum_cc += cost * cost;
+}
+
+/*
+ * Plan the given query with the real objects only, execute it with timing
+ * instrumentation and add the measures to the calibration.
+ */
+static void
+hypo_calibrate_query(Query *query, const char *sourceText)
+{
+	PlannedStmt *pstmt;
+	QueryDesc  *queryDesc;
+	bool		saved_isExplain = isExplain;
+
+	if (query->commandType != CMD_SELECT || query->hasModifyingCTE ||
+		query->rowMarks != NIL)
+		elog(ERROR, "hypopg: only read-only SELECT queries can be used for"
+			 " calibration");
+
+	/*
+	 * The queries are really executed, so refuse the ones calling volatile
+	 * functions, as they could have side effects such as modifying data or
+	 * advancing a sequence.
+	 */
+	if (contain_volatile_functions((Node *) query))
+		elog(ERROR, "hypopg: queries calling volatile functions can't be used"
+			 " for calibration");
+
+	/*
+	 * Make sure that the hypothetical objects are ignored, as the plan is
+	 * executed.  The parallel plans are also disabled, as the timing of the
+	 * parallel workers isn't reported in the nodes of the leader.
+	 */
+	isExplain = false;
+
+	PG_TRY();
+	{
+		pstmt = pg_plan_query((Query *) copyObject(query), 0, NULL);
+	}
+	PG_CATCH();
+	{
+		isExplain = saved_isExplain;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	isExplain = saved_isExplain;
+
+	/* Execute the plan like EXPLAIN ANALYZE does */
+	PushCopiedSnapshot(GetActiveSnapshot());
+	UpdateActiveSnapshotCommandId();
+
+	queryDesc = CreateQueryDesc(pstmt, sourceText,
+								GetActiveSnapshot(), InvalidSnapshot,
+								None_Receiver, NULL,
+#if PG_VERSION_NUM >= 100000
+								NULL,
+#endif
+								INSTRUMENT_TIMER);
+
+	ExecutorStart(queryDesc, 0);
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L
+#if PG_VERSION_NUM >= 100000
+				,true
+#endif
+		);
+	ExecutorFinish(queryDesc);
+
+	hypo_calibrate_planstate(queryDesc->planstate, 1.0);
+
+	ExecutorEnd(queryDesc);
+	FreeQueryDesc(queryDesc);
+
+	PopActiveSnapshot();
+}
+
+/*
+ * Add the SubPlans found in the given expression to the list.  Only the first
+ * alternative of an AlternativeSubPlan is kept, as only one is executed.
+ */
+static bool
+hypo_find_subplans_walker(Node *node, List **subplans)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, AlternativeSubPlan))
+	{
+		AlternativeSubPlan *asplan = (AlternativeSubPlan *) node;
+
+		return hypo_find_subplans_walker((Node *) linitial(asplan->subplans),
+										 subplans);
+	}
+
+	if (IsA(node, SubPlan))
+		*subplans = lappend(*subplans, node);
+
+	return expression_tree_walker(node, hypo_find_subplans_walker,
+								  (void *) subplans);
+}
+
+/*
+ * Return the predicted latency in milliseconds of the given plan node, run
+ * the given estimated number of times, when the given fraction of its output
+ * is fetched.  As for the calibration, the InitPlans and the SubPlans of the
+ * target list and quals of the node are predicted on their own, an InitPlan
+ * being run once and a SubPlan once per input row.
+ */
+static double
+hypo_predict_plan(PlannedStmt *pstmt, Plan *plan, double loops,
+				  double fraction)
+{
+	double		cost = hypo_plan_cost(plan, fraction) * loops;
+	double		ms = 0;
+	List	   *subplans = NIL;
+	double		input_rows;
+	ListCell   *lc;
+
+	foreach(lc, hypo_plan_children(plan))
+	{
+		Plan	   *child = (Plan *) lfirst(lc);
+		double		child_loops = loops;
+		double		child_fraction = hypo_child_fraction(plan, child,
+														 fraction);
+
+		/* The inner side of a nested loop is rescanned for each outer row */
+		if (IsA(plan, NestLoop) && child == innerPlan(plan))
+			child_loops = loops *
+				Max(outerPlan(plan)->plan_rows * fraction, 1);
+
+		cost -= hypo_plan_cost(child, child_fraction) * child_loops;
+		ms += hypo_predict_plan(pstmt, child, child_loops, child_fraction);
+	}
+
+	if (outerPlan(plan))
+		input_rows = outerPlan(plan)->plan_rows;
+	else
+		input_rows = plan->plan_rows;
+
+	hypo_find_subplans_walker((Node *) plan->targetlist, &subplans);
+	hypo_find_subplans_walker((Node *) plan->qual, &subplans);
+	subplans = list_concat(list_copy(plan->initPlan), subplans);
+
+	foreach(lc, subplans)
+	{
+		SubPlan    *subplan = (SubPlan *) lfirst(lc);
+		Plan	   *sub = (Plan *) list_nth(pstmt->subplans,
+											subplan->plan_id - 1);
+		double		sub_loops = 1;
+
+		if (!list_member_ptr(plan->initPlan, subplan))
+			sub_loops = loops * Max(input_rows * fraction, 1);
+
+		cost -= hypo_plan_cost(sub, 1.0) * sub_loops;
+		ms += hypo_predict_plan(pstmt, sub, sub_loops, 1.0);
+	}
+
+	if (cost > 0)
+		ms += cost * hypo_calibration_ratio(hypo_plan_node_name(plan));
+
+	return ms;
+}
+
+/*
+ * Return the predicted latency in milliseconds of the given plan, or -1 if
+ * nothing was calibrated.
+ */
+double
+hypo_predict_latency(PlannedStmt *pstmt)
+{
+	return hypo_predict_node_latency(pstmt, pstmt->planTree);
+}
+
+/*
+ * Return the predicted latency in milliseconds of a single execution of the
+ * given node of the given plan, including its children, or -1 if nothing was
+ * calibrated.
+ */
+double
+hypo_predict_node_latency(PlannedStmt *pstmt, Plan *plan)
+{
+	if (hypoCalibrations == NIL)
+		return -1;
+
+	return hypo_predict_plan(pstmt, plan, 1, 1.0);
+}
+
+/*
+ * Return the current calibration as a tuplestore
+ */
+static Datum
+hypo_calibration_report(FunctionCallInfo fcinfo)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ListCell   *lc;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	foreach(lc, hypoCalibrations)
+	{
+		hypoCalibration *entry = (hypoCalibration *) lfirst(lc);
+		Datum		values[HYPO_CALIBRATION_NB_COLS];
+		bool		nulls[HYPO_CALIBRATION_NB_COLS];
+		int			j = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[j++] = CStringGetTextDatum(entry->nodename);
+		values[j++] = Int32GetDatum(entry->samples);
+		values[j++] = Float8GetDatum(entry->sum_ct / entry->sum_cc);
+		Assert(j == HYPO_CALIBRATION_NB_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * SQL wrapper to execute the given queries with the real objects and add
+ * their measured timings to the calibration.  The resulting calibration is
+ * returned.
+ */
+Datum
+hypopg_calibrate(PG_FUNCTION_ARGS)
+{
+	ArrayType  *array = PG_GETARG_ARRAYTYPE_P(0);
+	MemoryContext exec_ctx;
+	MemoryContext oldcontext;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int			nelems;
+	int			i;
+
+	deconstruct_array(array, TEXTOID, -1, false, 'i',
+					  &elems, &elemnulls, &nelems);
+
+	/* Execution memory is released after each query */
+	exec_ctx = AllocSetContextCreate(CurrentMemoryContext,
+									 "hypopg calibrate",
+#if PG_VERSION_NUM >= 90600
+									 ALLOCSET_DEFAULT_SIZES
+#else
+									 ALLOCSET_DEFAULT_MINSIZE,
+									 ALLOCSET_DEFAULT_INITSIZE,
+									 ALLOCSET_DEFAULT_MAXSIZE
+#endif
+		);
+
+	for (i = 0; i < nelems; i++)
+	{
+		char	   *query;
+
+		if (elemnulls[i])
+			continue;
+
+		CHECK_FOR_INTERRUPTS();
+
+		oldcontext = MemoryContextSwitchTo(exec_ctx);
+		query = TextDatumGetCString(elems[i]);
+		hypo_calibrate_query(hypo_parse_query(query, NULL, 0), query);
+		MemoryContextSwitchTo(oldcontext);
+
+		MemoryContextReset(exec_ctx);
+	}
+
+	MemoryContextDelete(exec_ctx);
+
+	return hypo_calibration_report(fcinfo);
+}
+
+/*
+ * SQL wrapper to return the current calibration
+ */
+Datum
+hypopg_calibration(PG_FUNCTION_ARGS)
+{
+	return hypo_calibration_report(fcinfo);
+}
+
+/*
+ * SQL wrapper to remove the current calibration
+ */
+Datum
+hypopg_reset_calibration(PG_FUNCTION_ARGS)
+{
+	list_free_deep(hypoCalibrations);
+	hypoCalibrations = NIL;
+
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,477 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_ddl.c: Implementation of hypothetical migrations for PostgreSQL
+ *
+ * This file contains all the internal code related to the rehearsal of a DDL
+ * script, such as a migration, as hypothetical objects.  Each supported
+ * statement of the script is routed to the matching hypothetical action:
+ *
+ * - CREATE INDEX creates a hypothetical index
+ * - DROP INDEX hides the real or hypothetical index
+ * - CREATE TABLE ... PARTITION OF adds a hypothetical partition (pg10+)
+ * - ALTER TABLE ... ADD PRIMARY KEY / UNIQUE creates the hypothetical index
+ *   backing the constraint
+ *
+ * All other statements are reported as unsupported, and left unapplied.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "catalog/index.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "nodes/makefuncs.h"
+#include "nodes/parsenodes.h"
+#include "tcop/tcopprot.h"
+#include "tcop/utility.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+#include "include/hypopg.h"
+#include "include/hypopg_ddl.h"
+#include "include/hypopg_index.h"
+#include "include/hypopg_table.h"
+
+/*--- Structs --- */
+
+/*
+ * State of the rehearsal of a DDL script by hypopg_apply_ddl().  It's
+ * modified in a PG_TRY() block and read in the PG_CATCH() block to revert the
+ * actions already done, so it's always accessed as volatile.
+ */
+typedef struct hypoDDLContext
+{
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	const char *script;			/* whole script, for error positions */
+	int			stmt_num;		/* number of the current statement */
+	const char *command;		/* command tag of the current statement */
+	List	   *indexes;		/* hypothetical indexes created so far */
+	List	   *names;			/* names given to the created indexes */
+	List	   *hidden;			/* indexes hidden so far */
+	List	   *tables;			/* hypothetical partitions added so far,
+								 * last first */
+} hypoDDLContext;
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_apply_ddl);
+
+static void hypo_ddl_emit(volatile hypoDDLContext *context,
+			  const char *action, Oid objid, const char *objname);
+static void hypo_ddl_create_index(volatile hypoDDLContext *context,
+					  IndexStmt *stmt, const char *action);
+static void hypo_ddl_drop_index(volatile hypoDDLContext *context,
+					DropStmt *stmt);
+#if PG_VERSION_NUM >= 100000
+static void hypo_ddl_add_partition(volatile hypoDDLContext *context,
+					   CreateStmt *stmt);
+#endif
+static void hypo_ddl_alter_table(volatile hypoDDLContext *context,
+					 AlterTableStmt *stmt);
+static IndexStmt *hypo_ddl_constraint_index(RangeVar *relation,
+						  Constraint *constraint);
+static hypoIndex *hypo_ddl_find_index(const char *indexname);
+static void hypo_ddl_undo(volatile hypoDDLContext *context);
+
+/*
+ * Add a row describing the action done for the current statement
+ */
+static void
+hypo_ddl_emit(volatile hypoDDLContext *context, const char *action,
+			  Oid objid, const char *objname)
+{
+	Datum		values[HYPO_APPLY_DDL_NB_COLS];
+	bool		nulls[HYPO_APPLY_DDL_NB_COLS];
+	int			j = 0;
+
+	memset(values, 0, sizeof(values));
+	memset(nulls, 0, sizeof(nulls));
+
+	values[j++] = Int32GetDatum(context->stmt_num);
+	values[j++] = CStringGetTextDatum(context->command);
+	values[j++] = CStringGetTextDatum(action);
+	if (OidIsValid(objid))
+		values[j++] = ObjectIdGetDatum(objid);
+	else
+		nulls[j++] = true;
+	if (objname != NULL)
+		values[j++] = CStringGetTextDatum(objname);
+	else
+		nulls[j++] = true;
+	Assert(j == HYPO_APPLY_DDL_NB_COLS);
+
+	tuplestore_putvalues(context->tupstore, context->tupdesc, values, nulls);
+}
+
+/*
+ * Create the hypothetical index described by the given IndexStmt, unless
+ * IF NOT EXISTS is used and the given name is already used by a relation in
+ * the namespace of the table, an hypothetical index, or an index created by a
+ * previous statement.  Hypothetical indexes get a generated name, so the
+ * last case has to be remembered.
+ */
+static void
+hypo_ddl_create_index(volatile hypoDDLContext *context, IndexStmt *stmt,
+					  const char *action)
+{
+	const hypoIndex *entry;
+
+#if PG_VERSION_NUM >= 90500
+	if (stmt->if_not_exists && stmt->idxname != NULL)
+	{
+		Oid			relid = RangeVarGetRelid(stmt->relation, NoLock, true);
+		bool		found = (hypo_ddl_find_index(stmt->idxname) != NULL);
+		ListCell   *lc;
+
+		foreach(lc, context->names)
+		{
+			if (strcmp((char *) lfirst(lc), stmt->idxname) == 0)
+				found = true;
+		}
+
+		if (!found && OidIsValid(relid))
+			found = OidIsValid(get_relname_relid(stmt->idxname,
+												 get_rel_namespace(relid)));
+
+		if (found)
+		{
+			hypo_ddl_emit(context, "skipped", InvalidOid, stmt->idxname);
+			return;
+		}
+	}
+#endif
+
+	entry = hypo_index_store_parsetree(stmt, context->script);
+
+	context->indexes = lappend_oid(context->indexes, entry->oid);
+	if (stmt->idxname != NULL)
+		context->names = lappend(context->names, stmt->idxname);
+	hypo_ddl_emit(context, action, entry->oid, entry->indexname);
+}
+
+/*
+ * Find a hypothetical index by name.  As the name comes from a parsetree, it
+ * may have been truncated to NAMEDATALEN.
+ */
+static hypoIndex *
+hypo_ddl_find_index(const char *indexname)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+
+		if (strncmp(entry->indexname, indexname, NAMEDATALEN - 1) == 0 &&
+			strlen(indexname) == Min(strlen(entry->indexname), NAMEDATALEN - 1))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Hide the real or hypothetical indexes dropped by the given DropStmt
+ */
+static void
+hypo_ddl_drop_index(volatile hypoDDLContext *context, DropStmt *stmt)
+{
+	ListCell   *lc;
+
+	foreach(lc, stmt->objects)
+	{
+		List	   *names = (List *) lfirst(lc);
+		char	   *name = NameListToString(names);
+		Oid			indexid = InvalidOid;
+
+		/* Hypothetical indexes are never schema-qualified */
+		if (list_length(names) == 1)
+		{
+			hypoIndex  *entry = hypo_ddl_find_index(strVal(linitial(names)));
+
+			if (entry != NULL)
+				indexid = entry->oid;
+		}
+
+		if (!OidIsValid(indexid))
+		{
+			char		relkind;
+
+			indexid = RangeVarGetRelid(makeRangeVarFromNameList(names),
+									   NoLock, true);
+
+			if (!OidIsValid(indexid))
+			{
+				if (!stmt->missing_ok)
+					elog(ERROR, "hypopg: index %s does not exist", name);
+
+				hypo_ddl_emit(context, "skipped", InvalidOid, name);
+				continue;
+			}
+
+			relkind = get_rel_relkind(indexid);
+			if (relkind != RELKIND_INDEX
+#if PG_VERSION_NUM >= 110000
+				&& relkind != RELKIND_PARTITIONED_INDEX
+#endif
+				)
+				elog(ERROR, "hypopg: %s is not an index", name);
+		}
+
+		if (hypo_index_set_hidden(indexid, true))
+			context->hidden = lappend_oid(context->hidden, indexid);
+
+		hypo_ddl_emit(context, "hide index", indexid, name);
+	}
+}
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * Add the hypothetical partition described by the given CreateStmt
+ */
+static void
+hypo_ddl_add_partition(volatile hypoDDLContext *context, CreateStmt *stmt)
+{
+	hypoTable  *entry;
+
+	entry = hypo_table_add_partition(stmt, context->script);
+
+	context->tables = lcons_oid(entry->oid, context->tables);
+	hypo_ddl_emit(context, "add partition", entry->oid, entry->tablename);
+}
+#endif
+
+/*
+ * Apply the supported subcommands of the given AlterTableStmt, which are
+ * the addition of a PRIMARY KEY or UNIQUE constraint, by creating the
+ * hypothetical index that would back them.
+ */
+static void
+hypo_ddl_alter_table(volatile hypoDDLContext *context, AlterTableStmt *stmt)
+{
+	ListCell   *lc;
+
+	foreach(lc, stmt->cmds)
+	{
+		AlterTableCmd *cmd = (AlterTableCmd *) lfirst(lc);
+		Constraint *constraint;
+
+		if (cmd->subtype != AT_AddConstraint)
+		{
+			hypo_ddl_emit(context, "unsupported", InvalidOid, NULL);
+			continue;
+		}
+
+		constraint = (Constraint *) cmd->def;
+		Assert(IsA(constraint, Constraint));
+
+		if ((constraint->contype != CONSTR_PRIMARY &&
+			 constraint->contype != CONSTR_UNIQUE) ||
+			constraint->indexname != NULL)
+		{
+			hypo_ddl_emit(context, "unsupported", InvalidOid,
+						  constraint->conname);
+			continue;
+		}
+
+		hypo_ddl_create_index(context,
+							  hypo_ddl_constraint_index(stmt->relation,
+														constraint),
+							  "add constraint");
+	}
+}
+
+/*
+ * Build the IndexStmt of the index backing the given PRIMARY KEY or UNIQUE
+ * constraint, like transformIndexConstraint() does.
+ */
+static IndexStmt *
+hypo_ddl_constraint_index(RangeVar *relation, Constraint *constraint)
+{
+	IndexStmt  *index = makeNode(IndexStmt);
+	ListCell   *lc;
+
+	index->relation = relation;
+	if (constraint->access_method != NULL)
+		index->accessMethod = constraint->access_method;
+	else
+		index->accessMethod = DEFAULT_INDEX_TYPE;
+	index->options = constraint->options;
+	index->tableSpace = constraint->indexspace;
+	index->idxname = constraint->conname;
+	index->unique = true;
+	index->primary = (constraint->contype == CONSTR_PRIMARY);
+	index->isconstraint = true;
+
+	foreach(lc, constraint->keys)
+	{
+		IndexElem  *elem = makeNode(IndexElem);
+
+		elem->name = pstrdup(strVal(lfirst(lc)));
+		elem->ordering = SORTBY_DEFAULT;
+		elem->nulls_ordering = SORTBY_NULLS_DEFAULT;
+		index->indexParams = lappend(index->indexParams, elem);
+	}
+
+#if PG_VERSION_NUM >= 110000
+	foreach(lc, constraint->including)
+	{
+		IndexElem  *elem = makeNode(IndexElem);
+
+		elem->name = pstrdup(strVal(lfirst(lc)));
+		index->indexIncludingParams = lappend(index->indexIncludingParams,
+											  elem);
+	}
+#endif
+
+	return index;
+}
+
+/*
+ * Revert all the actions done so far, when the script can't be applied
+ * entirely.
+ */
+static void
+hypo_ddl_undo(volatile hypoDDLContext *context)
+{
+	ListCell   *lc;
+
+	foreach(lc, context->indexes)
+		hypo_index_remove(lfirst_oid(lc));
+
+	foreach(lc, context->hidden)
+		hypo_index_set_hidden(lfirst_oid(lc), false);
+
+#if PG_VERSION_NUM >= 100000
+	foreach(lc, context->tables)
+		hypo_table_remove(lfirst_oid(lc), NULL, true);
+#endif
+}
+
+/*
+ * SQL wrapper to rehearse a DDL script, such as a migration, with
+ * hypothetical objects.  A row is returned for each action done, or for each
+ * unsupported statement.  If any statement fails, all the actions already
+ * done are reverted.
+ */
+Datum
+hypopg_apply_ddl(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	volatile hypoDDLContext context;
+	List	   *parsetree_list;
+	ListCell   *lc;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	context.tupstore = tupstore;
+	context.tupdesc = tupdesc;
+	context.script = TextDatumGetCString(PG_GETARG_TEXT_PP(0));
+	context.stmt_num = 0;
+	context.command = NULL;
+	context.indexes = NIL;
+	context.names = NIL;
+	context.hidden = NIL;
+	context.tables = NIL;
+
+	parsetree_list = pg_parse_query(context.script);
+
+	PG_TRY();
+	{
+		foreach(lc, parsetree_list)
+		{
+			Node	   *parsetree = (Node *) lfirst(lc);
+
+#if PG_VERSION_NUM >= 100000
+			parsetree = ((RawStmt *) parsetree)->stmt;
+#endif
+			context.stmt_num++;
+			context.command = CreateCommandTag(parsetree);
+
+			switch (nodeTag(parsetree))
+			{
+				case T_IndexStmt:
+					hypo_ddl_create_index(&context, (IndexStmt *) parsetree,
+										  "create index");
+					break;
+				case T_DropStmt:
+					if (((DropStmt *) parsetree)->removeType == OBJECT_INDEX)
+						hypo_ddl_drop_index(&context, (DropStmt *) parsetree);
+					else
+						hypo_ddl_emit(&context, "unsupported", InvalidOid,
+									  NULL);
+					break;
+#if PG_VERSION_NUM >= 100000
+				case T_CreateStmt:
+					if (((CreateStmt *) parsetree)->partbound != NULL)
+						hypo_ddl_add_partition(&context,
+											   (CreateStmt *) parsetree);
+					else
+						hypo_ddl_emit(&context, "unsupported", InvalidOid,
+									  NULL);
+					break;
+#endif
+				case T_AlterTableStmt:
+					hypo_ddl_alter_table(&context,
+										 (AlterTableStmt *) parsetree);
+					break;
+				default:
+					hypo_ddl_emit(&context, "unsupported", InvalidOid, NULL);
+					break;
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		hypo_ddl_undo(&context);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -41,22 +41,30 @@
 #include "catalog/pg_am.h"
 #include "catalog/pg_amproc.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_index.h"
 #include "catalog/pg_opclass.h"
+#include "catalog/pg_statistic.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
+#include "commands/vacuum.h"
+#include "executor/spi.h"
 #include "nodes/relation.h"
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
 #include "optimizer/var.h"
+#include "parser/parse_coerce.h"
 #include "parser/parse_utilcmd.h"
 #include "parser/parser.h"
 #include "parser/parsetree.h"
 #include "rewrite/rewriteManip.h"
 #include "storage/bufmgr.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/selfuncs.h"
 #if PG_VERSION_NUM >= 110000
 #include "utils/partcache.h"
 #endif
@@ -68,11 +76,37 @@
 #include "include/hypopg.h"
 #include "include/hypopg_analyze.h"
 #include "include/hypopg_index.h"
+#include "include/hypopg_reloptions.h"
+#include "include/hypopg_snapshot.h"
 
 #if PG_VERSION_NUM >= 100000
 #include "include/hypopg_table.h"
 #endif
 
+/*
+ * Cached extreme values of a column, found using a real index or on a sample
+ * of its table
+ */
+typedef struct hypoActualRange
+{
+	Oid			relid;
+	AttrNumber	attnum;
+	bool		inherit;
+	bool		probed;			/* found using a real index */
+	bool		found;			/* false if no non-NULL value was found */
+	bool		typbyval;
+	Datum		min;
+	Datum		max;
+} hypoActualRange;
+
+/* An hypothetical index and the real relation used for its estimation */
+typedef struct hypoIndexRel
+{
+	Oid			relid;			/* oid of the base relation */
+	int			pos;			/* position in the original list */
+	hypoIndex  *entry;
+} hypoIndexRel;
+
 #if PG_VERSION_NUM >= 90600
 /* this will be updated, when needed, by hypo_discover_am */
 static Oid	BLOOM_AM_OID = InvalidOid;
@@ -82,6 +116,15 @@ static Oid	BLOOM_AM_OID = InvalidOid;
 
 explain_get_index_name_hook_type prev_explain_get_index_name_hook;
 List	   *hypoIndexes;
+List	   *hypoHiddenIndexes;
+
+/*--- Variables not exported ---*/
+
+static List *hypoActualRanges = NIL;	/* cached hypoActualRange entries */
+#if PG_VERSION_NUM >= 100000
+static bool hypoCollectEstimates = false;
+static List *hypoIndexEstimates = NIL;	/* hypoIndexEstimate entries */
+#endif
 
 /*--- Functions --- */
 
@@ -89,30 +132,58 @@ PG_FUNCTION_INFO_V1(hypopg);
 PG_FUNCTION_INFO_V1(hypopg_create_index);
 PG_FUNCTION_INFO_V1(hypopg_drop_index);
 PG_FUNCTION_INFO_V1(hypopg_relation_size);
+PG_FUNCTION_INFO_V1(hypopg_relation_sizes);
+PG_FUNCTION_INFO_V1(hypopg_set_index_estimates);
 PG_FUNCTION_INFO_V1(hypopg_get_indexdef);
 PG_FUNCTION_INFO_V1(hypopg_reset_index);
+PG_FUNCTION_INFO_V1(hypopg_hide_index);
+PG_FUNCTION_INFO_V1(hypopg_unhide_index);
+PG_FUNCTION_INFO_V1(hypopg_unhide_all_indexes);
+PG_FUNCTION_INFO_V1(hypopg_hidden_indexes);
 
 
 static void hypo_addIndex(hypoIndex *entry);
 static bool hypo_can_return(hypoIndex *entry, Oid atttype, int i, char *amname);
 static void hypo_discover_am(char *amname, Oid oid);
-static void hypo_estimate_index_simple(hypoIndex *entry,
-						   BlockNumber *pages, double *tuples);
 static void hypo_estimate_index(hypoIndex *entry, RelOptInfo *rel,
 					PlannerInfo *root);
-static int	hypo_estimate_index_colsize(hypoIndex *entry, int col);
+static int	hypo_estimate_index_colsize(hypoIndex *entry, int col,
+							bool use_coltypes);
+static int32 hypo_get_attwidth(hypoIndex *entry, AttrNumber attnum,
+				  bool use_coltypes);
+static bool hypo_index_has_column_types(hypoIndex *entry);
+#if PG_VERSION_NUM >= 90500
+static int	hypo_estimate_brin_colsize(hypoIndex *entry, int col, int width);
+#endif
+static bool hypo_sample_index_width(hypoIndex *entry, double reltuples,
+						int *width);
+static bool hypo_index_vars_walker(Node *node, Oid *relid);
 #if PG_VERSION_NUM >= 110000
 static void hypo_index_check_uniqueness_compatibility(IndexStmt *stmt,
 										  Oid relid, hypoIndex *entry);
 #endif
 static void hypo_index_pfree(hypoIndex *entry);
-static bool hypo_index_remove(Oid indexid);
-static const hypoIndex *hypo_index_store_parsetree(IndexStmt *node,
-						   const char *queryString);
 static hypoIndex *hypo_newIndex(Oid relid, char *accessMethod, int nkeycolumns,
 			  int ninccolumns,
 			  List *options);
 static void hypo_set_indexname(hypoIndex *entry, char *indexname);
+static Oid	hypo_index_base_relid(hypoIndex *entry);
+static RelOptInfo *hypo_estimate_rel_simple(Oid relid);
+static void hypo_estimate_index_rel(hypoIndex *entry, RelOptInfo *rel);
+static int	hypo_index_rel_cmp(const void *a, const void *b);
+static bool hypo_index_has_leading_btree(Oid relid, Oid partid,
+							 AttrNumber attnum);
+static bool hypo_real_leading_btree(Oid relid, AttrNumber attnum,
+						bool *visible);
+static bool hypo_fetch_endpoint(Oid relid, AttrNumber attnum, bool inherit,
+					bool sample, bool max, Datum *value);
+static bool hypo_get_actual_range(Oid relid, AttrNumber attnum, bool inherit,
+					  bool has_index, Datum *min, Datum *max);
+#if PG_VERSION_NUM >= 100000
+static void hypo_actual_range_clamp(hypoTable *part, AttrNumber attnum,
+						Oid atttype, Oid ltop, Oid collid,
+						Datum *min, Datum *max);
+#endif
 
 
 /*
@@ -153,6 +224,10 @@ hypo_newIndex(Oid relid, char *accessMethod, int nkeycolumns, int ninccolumns,
 	entry = palloc0(sizeof(hypoIndex));
 
 	entry->relam = HeapTupleGetOid(tuple);
+	entry->avg_width = -1;
+	entry->set_pages = -1;
+	entry->set_tuples = -1;
+	entry->set_tree_height = -1;
 
 #if PG_VERSION_NUM >= 90600
 
@@ -321,7 +396,7 @@ hypo_index_reset(void)
  * is where all the hypothetic index creation is done, except the index size
  * estimation.
  */
-static const hypoIndex *
+const hypoIndex *
 hypo_index_store_parsetree(IndexStmt *node, const char *queryString)
 {
 	/* must be declared "volatile", because used in a PG_CATCH() */
@@ -598,7 +673,7 @@ hypo_index_store_parsetree(IndexStmt *node, const char *queryString)
 				}
 			}
 
-			ind_avg_width += hypo_estimate_index_colsize(entry, attn);
+			ind_avg_width += hypo_estimate_index_colsize(entry, attn, true);
 
 			/*
 			 * Apply collation override if any
@@ -768,7 +843,7 @@ hypo_index_store_parsetree(IndexStmt *node, const char *queryString)
 						 errmsg("hypopg: expressions are not supported in included columns")));
 			}
 
-			ind_avg_width += hypo_estimate_index_colsize(entry, attn);
+			ind_avg_width += hypo_estimate_index_colsize(entry, attn, true);
 
 			/* per-column IOS information */
 			entry->canreturn[attn] = hypo_can_return(entry, atttype, attn,
@@ -908,7 +983,7 @@ hypo_index_store_parsetree(IndexStmt *node, const char *queryString)
  * Remove an hypothetical index from the list of hypothetical indexes.
  * pfree (by calling hypo_index_pfree) all memory that has been allocated.
  */
-static bool
+bool
 hypo_index_remove(Oid indexid)
 {
 	ListCell   *lc;
@@ -920,6 +995,7 @@ hypo_index_remove(Oid indexid)
 		if (entry->oid == indexid)
 		{
 			hypoIndexes = list_delete_ptr(hypoIndexes, entry);
+			hypoHiddenIndexes = list_delete_oid(hypoHiddenIndexes, indexid);
 			hypo_index_pfree(entry);
 			return true;
 		}
@@ -927,6 +1003,87 @@ hypo_index_remove(Oid indexid)
 	return false;
 }
 
+/*
+ * Return the stored hypothetical index corresponding to the given oid if any,
+ * otherwise return NULL.
+ */
+hypoIndex *
+hypo_get_index(Oid indexid)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+
+		if (entry->oid == indexid)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Is the given real or hypothetical index hidden?
+ */
+bool
+hypo_index_is_hidden(Oid indexid)
+{
+	return list_member_oid(hypoHiddenIndexes, indexid);
+}
+
+/*
+ * Hide or unhide the given real or hypothetical index.  Return true if the
+ * visibility of the index changed.
+ */
+bool
+hypo_index_set_hidden(Oid indexid, bool hidden)
+{
+	MemoryContext oldcontext;
+
+	if (hypo_index_is_hidden(indexid) == hidden)
+		return false;
+
+	if (!hidden)
+	{
+		hypoHiddenIndexes = list_delete_oid(hypoHiddenIndexes, indexid);
+		return true;
+	}
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	hypoHiddenIndexes = lappend_oid(hypoHiddenIndexes, indexid);
+	MemoryContextSwitchTo(oldcontext);
+
+	return true;
+}
+
+/*
+ * Remove all the hidden indexes from the given relation's indexlist, so that
+ * the planner behaves as if they had been dropped.
+ */
+void
+hypo_hideIndexes(RelOptInfo *rel)
+{
+	ListCell   *cell;
+	ListCell   *prev = NULL;
+	ListCell   *next;
+
+	if (hypoHiddenIndexes == NIL)
+		return;
+
+	for (cell = list_head(rel->indexlist); cell; cell = next)
+	{
+		IndexOptInfo *index = (IndexOptInfo *) lfirst(cell);
+
+		next = lnext(cell);
+
+		if (hypo_index_is_hidden(index->indexoid))
+			rel->indexlist = list_delete_cell(rel->indexlist, cell, prev);
+		else
+			prev = cell;
+	}
+}
+
 #if PG_VERSION_NUM >= 110000
 /*
  * If this table is partitioned and we're creating a unique index or a
@@ -1233,6 +1390,25 @@ hypo_injectHypotheticalIndex(PlannerInfo *root,
 	index->tree_height = entry->tree_height;
 #endif
 
+#if PG_VERSION_NUM >= 100000
+	/* Remember this estimation, the entry will be overwritten by the next */
+	if (hypoCollectEstimates)
+	{
+		hypoIndexEstimate *estimate;
+		hypoTable  *part = hypo_rti_get_table(root, rel->relid);
+
+		estimate = (hypoIndexEstimate *) palloc(sizeof(hypoIndexEstimate));
+		estimate->indexid = entry->oid;
+		estimate->relid = RelationGetRelid(relation);
+		estimate->partid = part ? part->oid : InvalidOid;
+		estimate->pages = entry->pages;
+		estimate->tuples = entry->tuples;
+		estimate->tree_height = entry->tree_height;
+
+		hypoIndexEstimates = lcons(estimate, hypoIndexEstimates);
+	}
+#endif
+
 	/*
 	 * obviously, setup this tag. However, it's only checked in
 	 * selfuncs.c/get_actual_variable_range, so we still need to add
@@ -1244,6 +1420,43 @@ hypo_injectHypotheticalIndex(PlannerInfo *root,
 	rel->indexlist = lcons(index, rel->indexlist);
 }
 
+#if PG_VERSION_NUM >= 100000
+/*
+ * Start or stop remembering the estimations of the hypothetical indexes
+ * added to the relations' indexlist.  The estimations are allocated in the
+ * planner memory context, so the caller has to stop the collection once the
+ * planning is done and the estimations aren't needed anymore, including in
+ * case of error.
+ */
+void
+hypo_index_collect_estimates(bool collect)
+{
+	hypoCollectEstimates = collect;
+	hypoIndexEstimates = NIL;
+}
+
+/*
+ * Return the last estimation collected for the given hypothetical index on
+ * the given relation, or NULL if none.
+ */
+hypoIndexEstimate *
+hypo_index_find_estimate(Oid indexid, Oid relid, Oid partid)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoIndexEstimates)
+	{
+		hypoIndexEstimate *estimate = (hypoIndexEstimate *) lfirst(lc);
+
+		if (estimate->indexid == indexid && estimate->relid == relid &&
+			estimate->partid == partid)
+			return estimate;
+	}
+
+	return NULL;
+}
+#endif
+
 /* Return the hypothetical index name is indexId is ours, NULL otherwise, as
  * this is what explain_get_index_name expects to continue his job.
  */
@@ -1294,6 +1507,9 @@ hypopg(PG_FUNCTION_ARGS)
 	ListCell   *lc;
 	Datum		predDatum;
 
+	/* Remove the hypothetical indexes depending on dropped objects first */
+	hypo_process_inval();
+
 	/* check to see if caller supports us returning a tuplestore */
 	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
 		ereport(ERROR,
@@ -1488,6 +1704,8 @@ hypopg_relation_size(PG_FUNCTION_ARGS)
 	Oid			indexid = PG_GETARG_OID(0);
 	ListCell   *lc;
 
+	hypo_process_inval();
+
 	pages = 0;
 	tuples = 0;
 	foreach(lc, hypoIndexes)
@@ -1503,6 +1721,144 @@ hypopg_relation_size(PG_FUNCTION_ARGS)
 	PG_RETURN_INT64(pages * BLCKSZ);
 }
 
+/*
+ * SQL wrapper to estimate the size of all the given hypothetical indexes, or
+ * of all of them if none is given.  Unknown oids are ignored.
+ */
+Datum
+hypopg_relation_sizes(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	List	   *entries = NIL;
+	ListCell   *lc;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	hypo_process_inval();
+
+	if (PG_ARGISNULL(0))
+		entries = list_copy(hypoIndexes);
+	else
+	{
+		Datum	   *elems;
+		bool	   *nulls;
+		int			nelems;
+		int			i;
+
+		deconstruct_array(PG_GETARG_ARRAYTYPE_P(0), OIDOID, sizeof(Oid),
+						  true, 'i', &elems, &nulls, &nelems);
+
+		for (i = 0; i < nelems; i++)
+		{
+			hypoIndex  *entry;
+
+			if (nulls[i])
+				continue;
+
+			entry = hypo_get_index(DatumGetObjectId(elems[i]));
+			if (entry)
+				entries = list_append_unique_ptr(entries, entry);
+		}
+	}
+
+	/* Estimate all the indexes, opening each relation only once */
+	hypo_estimate_indexes(entries);
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	foreach(lc, entries)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+		Datum		values[HYPO_RELATION_SIZES_COLS];
+		bool		nulls[HYPO_RELATION_SIZES_COLS];
+		int			i = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[i++] = ObjectIdGetDatum(entry->oid);
+		values[i++] = ObjectIdGetDatum(entry->relid);
+		values[i++] = Int64GetDatum((int64) entry->pages);
+		values[i++] = Int64GetDatum((int64) entry->pages * BLCKSZ);
+		values[i++] = Float8GetDatum(entry->tuples);
+		if (entry->tree_height >= 0)
+			values[i++] = Int32GetDatum(entry->tree_height);
+		else
+			nulls[i++] = true;
+		Assert(i == HYPO_RELATION_SIZES_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * SQL wrapper to set the estimated number of pages, number of tuples and tree
+ * height of an hypothetical index, used instead of hypopg's estimations.  A
+ * NULL value restores the estimation.
+ */
+Datum
+hypopg_set_index_estimates(PG_FUNCTION_ARGS)
+{
+	Oid			indexid;
+	hypoIndex  *entry;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "hypopg: indexid cannot be NULL");
+
+	indexid = PG_GETARG_OID(0);
+	entry = hypo_get_index(indexid);
+	if (!entry)
+		elog(ERROR, "hypopg: oid %u is not a hypothetical index", indexid);
+
+	if (!PG_ARGISNULL(1) && PG_GETARG_INT64(1) < 1)
+		elog(ERROR, "hypopg: pages must be at least 1");
+	if (!PG_ARGISNULL(2) && PG_GETARG_FLOAT8(2) < 0)
+		elog(ERROR, "hypopg: tuples cannot be negative");
+	if (!PG_ARGISNULL(3) && PG_GETARG_INT32(3) < 0)
+		elog(ERROR, "hypopg: tree_height cannot be negative");
+
+#if PG_VERSION_NUM < 90300
+	if (!PG_ARGISNULL(3))
+		elog(WARNING, "hypopg: tree_height is ignored before PostgreSQL 9.3");
+#endif
+
+	entry->set_pages = PG_ARGISNULL(1) ? -1 : (double) PG_GETARG_INT64(1);
+	entry->set_tuples = PG_ARGISNULL(2) ? -1 : PG_GETARG_FLOAT8(2);
+	entry->set_tree_height = PG_ARGISNULL(3) ? -1 : PG_GETARG_INT32(3);
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Deparse an hypoIndex, indentified by its indexid to the actual CREATE INDEX
  * command.
@@ -1519,9 +1875,13 @@ hypopg_get_indexdef(PG_FUNCTION_ARGS)
 	hypoIndex  *entry = NULL;
 	ListCell   *lc;
 	List	   *context;
+	Oid			relid;
+	char	   *relname;
 	int			keyno,
 				cpt = 0;
 
+	hypo_process_inval();
+
 	foreach(lc, hypoIndexes)
 	{
 		entry = (hypoIndex *) lfirst(lc);
@@ -1533,16 +1893,39 @@ hypopg_get_indexdef(PG_FUNCTION_ARGS)
 	if (!entry || entry->oid != indexid)
 		PG_RETURN_NULL();
 
+	relid = entry->relid;
+	relname = NULL;
+#if PG_VERSION_NUM >= 100000
+
+	/*
+	 * Indexes on a hypothetical partition reference the partition oid, use
+	 * the root table to deparse the columns, and the unqualified partition
+	 * name.
+	 */
+	{
+		hypoTable  *table = hypo_find_table(entry->relid, true);
+
+		if (table && OidIsValid(table->parentid))
+		{
+			relid = table->rootid;
+			relname = pstrdup(quote_identifier(table->tablename));
+		}
+	}
+#endif
+	if (!relname)
+		relname = psprintf("%s.%s",
+						   quote_identifier(get_namespace_name(get_rel_namespace(relid))),
+						   quote_identifier(get_rel_name(relid)));
+
 	initStringInfo(&buf);
-	appendStringInfo(&buf, "CREATE %s ON %s.%s USING %s (",
+	appendStringInfo(&buf, "CREATE %s ON %s USING %s (",
 					 (entry->unique ? "UNIQUE INDEX" : "INDEX"),
-					 quote_identifier(get_namespace_name(get_rel_namespace(entry->relid))),
-					 quote_identifier(get_rel_name(entry->relid)),
+					 relname,
 					 get_am_name(entry->relam));
 
 	indexpr_item = list_head(entry->indexprs);
 
-	context = deparse_context_for(get_rel_name(entry->relid), entry->relid);
+	context = deparse_context_for(get_rel_name(relid), relid);
 
 	for (keyno = 0; keyno < entry->nkeycolumns; keyno++)
 	{
@@ -1558,14 +1941,14 @@ hypopg_get_indexdef(PG_FUNCTION_ARGS)
 		{
 			int32		keycoltypmod;
 #if PG_VERSION_NUM >= 110000
-			appendStringInfo(&buf, "%s", get_attname(entry->relid,
+			appendStringInfo(&buf, "%s", get_attname(relid,
 													 entry->indexkeys[keyno], false));
 #else
-			appendStringInfo(&buf, "%s", get_attname(entry->relid,
+			appendStringInfo(&buf, "%s", get_attname(relid,
 													 entry->indexkeys[keyno]));
 #endif
 
-			get_atttypetypmodcoll(entry->relid, entry->indexkeys[keyno],
+			get_atttypetypmodcoll(relid, entry->indexkeys[keyno],
 								  &keycoltype, &keycoltypmod,
 								  &keycolcollation);
 		}
@@ -1636,7 +2019,7 @@ hypopg_get_indexdef(PG_FUNCTION_ARGS)
 			if (keyno != entry->nkeycolumns)
 				appendStringInfo(&buf, ", ");
 
-			appendStringInfo(&buf, "%s", get_attname(entry->relid,
+			appendStringInfo(&buf, "%s", get_attname(relid,
 													 entry->indexkeys[keyno], false));
 		}
 		appendStringInfo(&buf, ")");
@@ -1685,64 +2068,183 @@ hypopg_reset_index(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
-
-/* Simple function to set the indexname, dealing with max name length, and the
- * ending \0
+/*
+ * SQL wrapper to hide a real or hypothetical index from the planner during
+ * EXPLAIN.
  */
-static void
-hypo_set_indexname(hypoIndex *entry, char *indexname)
+Datum
+hypopg_hide_index(PG_FUNCTION_ARGS)
 {
-	char		oid[12];		/* store <oid>, oid shouldn't be more than
-								 * 9999999999 */
-	int			totalsize;
-
-	snprintf(oid, sizeof(oid), "<%d>", entry->oid);
+	Oid			indexid = PG_GETARG_OID(0);
 
-	/* we'll prefix the given indexname with the oid, and reserve a final \0 */
-	totalsize = strlen(oid) + strlen(indexname) + 1;
+	if (!hypo_get_index(indexid))
+	{
+		HeapTuple	tuple;
 
-	/* final index name must not exceed NAMEDATALEN */
-	if (totalsize > NAMEDATALEN)
-		totalsize = NAMEDATALEN;
+		tuple = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(indexid));
+		if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "hypopg: oid %u is not an index", indexid);
+		ReleaseSysCache(tuple);
+	}
 
-	/* eventually truncate the given indexname at NAMEDATALEN-1 if needed */
-	strncpy(entry->indexname, oid, strlen(oid));
-	strncat(entry->indexname, indexname, totalsize - strlen(oid) - 1);
+	PG_RETURN_BOOL(hypo_index_set_hidden(indexid, true));
 }
 
 /*
- * Fill the pages and tuples information for a given hypoIndex.
+ * SQL wrapper to restore the visibility of a previously hidden index.
  */
-static void
-hypo_estimate_index_simple(hypoIndex *entry, BlockNumber *pages, double *tuples)
+Datum
+hypopg_unhide_index(PG_FUNCTION_ARGS)
 {
-	RelOptInfo *rel;
-	Relation	relation;
+	Oid			indexid = PG_GETARG_OID(0);
 
-	/*
-	 * retrieve number of tuples and pages of the related relation, adapted
-	 * from plancat.c/get_relation_info().
-	 */
+	PG_RETURN_BOOL(hypo_index_set_hidden(indexid, false));
+}
 
-	rel = makeNode(RelOptInfo);
+/*
+ * SQL wrapper to restore the visibility of all hidden indexes.
+ */
+Datum
+hypopg_unhide_all_indexes(PG_FUNCTION_ARGS)
+{
+	list_free(hypoHiddenIndexes);
+	hypoHiddenIndexes = NIL;
+	PG_RETURN_VOID();
+}
 
-	/* Open the hypo index' relation */
-	relation = heap_open(entry->relid, AccessShareLock);
+/*
+ * List all the hidden indexes
+ */
+Datum
+hypopg_hidden_indexes(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ListCell   *lc;
 
-	if (!RelationNeedsWAL(relation) && RecoveryInProgress())
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
 		ereport(ERROR,
 				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-				 errmsg("hypopg: cannot access temporary or unlogged relations during recovery")));
-
-	rel->min_attr = FirstLowInvalidHeapAttributeNumber + 1;
-	rel->max_attr = RelationGetNumberOfAttributes(relation);
-	rel->reltablespace = RelationGetForm(relation)->reltablespace;
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
 
-	Assert(rel->max_attr >= rel->min_attr);
-	rel->attr_needed = (Relids *)
-		palloc0((rel->max_attr - rel->min_attr + 1) * sizeof(Relids));
-	rel->attr_widths = (int32 *)
-		palloc0((rel->max_attr - rel->min_attr + 1) * sizeof(int32));
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	foreach(lc, hypoHiddenIndexes)
+	{
+		Datum		values[HYPO_HIDDEN_INDEX_COLS];
+		bool		nulls[HYPO_HIDDEN_INDEX_COLS];
+		Oid			indexid = lfirst_oid(lc);
+		int			i = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[i++] = ObjectIdGetDatum(indexid);
+		values[i++] = BoolGetDatum(hypo_get_index(indexid) != NULL);
+		Assert(i == HYPO_HIDDEN_INDEX_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
+/* Simple function to set the indexname, dealing with max name length, and the
+ * ending \0
+ */
+static void
+hypo_set_indexname(hypoIndex *entry, char *indexname)
+{
+	char		oid[12];		/* store <oid>, oid shouldn't be more than
+								 * 9999999999 */
+	int			totalsize;
+
+	snprintf(oid, sizeof(oid), "<%d>", entry->oid);
+
+	/* we'll prefix the given indexname with the oid, and reserve a final \0 */
+	totalsize = strlen(oid) + strlen(indexname) + 1;
+
+	/* final index name must not exceed NAMEDATALEN */
+	if (totalsize > NAMEDATALEN)
+		totalsize = NAMEDATALEN;
+
+	/* eventually truncate the given indexname at NAMEDATALEN-1 if needed */
+	strncpy(entry->indexname, oid, strlen(oid));
+	strncat(entry->indexname, indexname, totalsize - strlen(oid) - 1);
+}
+
+/*
+ * Return the oid of the real relation whose size is used to estimate the
+ * given hypoIndex.  For an index on an hypothetical partition, the root table
+ * is estimated and scaled to the partition later.
+ */
+static Oid
+hypo_index_base_relid(hypoIndex *entry)
+{
+#if PG_VERSION_NUM >= 100000
+	hypoTable  *part = hypo_find_table(entry->relid, true);
+
+	if (part && OidIsValid(part->parentid))
+		return part->rootid;
+#endif
+
+	return entry->relid;
+}
+
+/*
+ * Build a RelOptInfo containing the number of tuples and pages of the given
+ * real relation, adapted from plancat.c/get_relation_info().
+ */
+static RelOptInfo *
+hypo_estimate_rel_simple(Oid relid)
+{
+	RelOptInfo *rel;
+	Relation	relation;
+
+	rel = makeNode(RelOptInfo);
+
+	/* Open the hypo index' relation */
+	relation = heap_open(relid, AccessShareLock);
+
+	if (!RelationNeedsWAL(relation) && RecoveryInProgress())
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hypopg: cannot access temporary or unlogged relations during recovery")));
+
+	rel->min_attr = FirstLowInvalidHeapAttributeNumber + 1;
+	rel->max_attr = RelationGetNumberOfAttributes(relation);
+	rel->reltablespace = RelationGetForm(relation)->reltablespace;
+
+	Assert(rel->max_attr >= rel->min_attr);
+	rel->attr_needed = (Relids *)
+		palloc0((rel->max_attr - rel->min_attr + 1) * sizeof(Relids));
+	rel->attr_widths = (int32 *)
+		palloc0((rel->max_attr - rel->min_attr + 1) * sizeof(int32));
 
 	/*
 	 * We may need to call clauselist_selectivity, so even if
@@ -1754,14 +2256,250 @@ hypo_estimate_index_simple(hypoIndex *entry, BlockNumber *pages, double *tuples)
 	estimate_rel_size(relation, rel->attr_widths - rel->min_attr,
 					  &rel->pages, &rel->tuples, &rel->allvisfrac);
 
+	/* Use the imported statistics of the table if any */
+	hypo_snapshot_apply(rel, relid, false);
+
 	/* Close the relation and release the lock now */
 	heap_close(relation, AccessShareLock);
 
+	return rel;
+}
+
+/*
+ * Fill the pages and tuples information for a given hypoIndex, using the
+ * RelOptInfo built by hypo_estimate_rel_simple() for its base relation.  The
+ * RelOptInfo is left untouched so it can be used for other indexes.
+ */
+static void
+hypo_estimate_index_rel(hypoIndex *entry, RelOptInfo *rel)
+{
+#if PG_VERSION_NUM >= 100000
+	hypoTable  *part = hypo_find_table(entry->relid, true);
+	BlockNumber pages = rel->pages;
+	double		tuples = rel->tuples;
+
+	if (part && OidIsValid(part->parentid))
+	{
+		Selectivity fraction;
+
+		/*
+		 * Use the number of tuples computed by hypopg_analyze if any,
+		 * otherwise there's no planner information to compute the selectivity
+		 * of the partition bounds, so sample the table in accurate mode or
+		 * assume an uniform distribution.
+		 */
+		if (part->set_tuples)
+			fraction = rel->tuples > 0 ? part->tuples / rel->tuples : 1.0;
+		else if (hypo_estimation_mode != HYPO_ESTIMATION_ACCURATE ||
+				 !hypo_sample_partition_fraction(part, rel->tuples, &fraction))
+			fraction = hypo_partition_uniform_fraction(part);
+
+		CLAMP_PROBABILITY(fraction);
+
+		rel->pages = (BlockNumber) ceil(rel->pages * fraction);
+		rel->tuples = clamp_row_est(rel->tuples * fraction);
+	}
+#endif
+
 	hypo_estimate_index(entry, rel, NULL);
+
+#if PG_VERSION_NUM >= 100000
+	rel->pages = pages;
+	rel->tuples = tuples;
+#endif
+}
+
+/*
+ * Fill the pages and tuples information for a given hypoIndex.
+ */
+void
+hypo_estimate_index_simple(hypoIndex *entry, BlockNumber *pages, double *tuples)
+{
+	RelOptInfo *rel = hypo_estimate_rel_simple(hypo_index_base_relid(entry));
+
+	hypo_estimate_index_rel(entry, rel);
 	*pages = entry->pages;
 	*tuples = entry->tuples;
 }
 
+/*
+ * qsort comparator for hypoIndexRel, on the base relation and then on the
+ * original position.
+ */
+static int
+hypo_index_rel_cmp(const void *a, const void *b)
+{
+	const hypoIndexRel *ia = (const hypoIndexRel *) a;
+	const hypoIndexRel *ib = (const hypoIndexRel *) b;
+
+	if (ia->relid != ib->relid)
+		return ia->relid < ib->relid ? -1 : 1;
+	if (ia->pos != ib->pos)
+		return ia->pos < ib->pos ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Fill the pages and tuples information of all the given hypoIndex.  The
+ * indexes are grouped by base relation, so that each relation is only opened
+ * and measured once.
+ */
+void
+hypo_estimate_indexes(List *entries)
+{
+	hypoIndexRel *items;
+	RelOptInfo *rel = NULL;
+	ListCell   *lc;
+	int			nitems = list_length(entries);
+	int			i = 0;
+
+	if (nitems == 0)
+		return;
+
+	items = (hypoIndexRel *) palloc(sizeof(hypoIndexRel) * nitems);
+	foreach(lc, entries)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+
+		items[i].relid = hypo_index_base_relid(entry);
+		items[i].pos = i;
+		items[i].entry = entry;
+		i++;
+	}
+
+	qsort(items, nitems, sizeof(hypoIndexRel), hypo_index_rel_cmp);
+
+	for (i = 0; i < nitems; i++)
+	{
+		if (i == 0 || items[i].relid != items[i - 1].relid)
+			rel = hypo_estimate_rel_simple(items[i].relid);
+
+		hypo_estimate_index_rel(items[i].entry, rel);
+	}
+
+	pfree(items);
+}
+
+/*
+ * Return the number of pages the given real index would have if the columns
+ * it depends on had their hypothetical types.  The index is described as a
+ * transient hypoIndex, estimated with both the real and the hypothetical
+ * columns average width, and its real number of pages is scaled by the ratio
+ * of both estimations so that any bloat of the real index is preserved.
+ */
+BlockNumber
+hypo_estimate_real_index_pages(PlannerInfo *root, RelOptInfo *rel,
+							   Oid relid, IndexOptInfo *index)
+{
+	hypoIndex	entry;
+	HeapTuple	tuple;
+	Datum		datum;
+	bool		isnull;
+	int			real_width = 0;
+	int			hypo_width = 0;
+	BlockNumber real_pages;
+	int			i;
+
+	/* only the access methods hypopg knows how to estimate are handled */
+	if (index->relam != BTREE_AM_OID
+#if PG_VERSION_NUM >= 90500
+		&& index->relam != BRIN_AM_OID
+#endif
+#if PG_VERSION_NUM >= 90600
+		&& index->relam != BLOOM_AM_OID
+#endif
+		)
+		return index->pages;
+
+	memset(&entry, 0, sizeof(hypoIndex));
+	entry.oid = index->indexoid;
+	entry.relid = relid;
+	entry.set_pages = -1;
+	entry.set_tuples = -1;
+	entry.set_tree_height = -1;
+	entry.relam = index->relam;
+	entry.indexname = get_rel_name(index->indexoid);
+	entry.ncolumns = index->ncolumns;
+#if PG_VERSION_NUM >= 110000
+	entry.nkeycolumns = index->nkeycolumns;
+#else
+	entry.nkeycolumns = index->ncolumns;
+#endif
+	entry.indexkeys = palloc0(sizeof(short int) * index->ncolumns);
+	for (i = 0; i < index->ncolumns; i++)
+		entry.indexkeys[i] = (short int) index->indexkeys[i];
+
+	/*
+	 * The predicate selectivity doesn't change the ratio of both estimations,
+	 * so ignore it.  The expressions are only looked at for simple Vars.
+	 */
+	entry.indexprs = index->indexprs;
+	entry.indpred = NIL;
+
+	/* the BRIN estimation needs the operator classes */
+	tuple = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(index->indexoid));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "hypopg: cache lookup failed for index %u",
+			 index->indexoid);
+	datum = SysCacheGetAttr(INDEXRELID, tuple, Anum_pg_index_indclass,
+							&isnull);
+	Assert(!isnull);
+	entry.opclass = palloc0(sizeof(Oid) * entry.nkeycolumns);
+	memcpy(entry.opclass, ((oidvector *) DatumGetPointer(datum))->values,
+		   sizeof(Oid) * entry.nkeycolumns);
+	ReleaseSysCache(tuple);
+
+	/* and the storage parameters are stored as integers */
+	tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(index->indexoid));
+	if (!HeapTupleIsValid(tuple))
+		elog(ERROR, "hypopg: cache lookup failed for relation %u",
+			 index->indexoid);
+	datum = SysCacheGetAttr(RELOID, tuple, Anum_pg_class_reloptions, &isnull);
+	if (!isnull)
+	{
+		ListCell   *lc;
+
+		entry.options = untransformRelOptions(datum);
+		foreach(lc, entry.options)
+		{
+			DefElem    *elem = (DefElem *) lfirst(lc);
+
+			if (strcmp(elem->defname, "fillfactor") == 0 ||
+				strcmp(elem->defname, "pages_per_range") == 0 ||
+				strcmp(elem->defname, "length") == 0)
+				elem->arg = (Node *) makeInteger(atoi(strVal(elem->arg)));
+		}
+	}
+	ReleaseSysCache(tuple);
+
+	for (i = 0; i < entry.ncolumns; i++)
+	{
+		real_width += hypo_estimate_index_colsize(&entry, i, false);
+		hypo_width += hypo_estimate_index_colsize(&entry, i, true);
+	}
+
+	if (real_width == hypo_width || index->pages == 0)
+		return index->pages;
+
+	/* The cached width is used as-is, so the table is never sampled */
+	entry.avg_width_mode = hypo_estimation_mode;
+
+	entry.avg_width = real_width;
+	hypo_estimate_index(&entry, rel, root);
+	real_pages = entry.pages;
+
+	entry.avg_width = hypo_width;
+	hypo_estimate_index(&entry, rel, root);
+
+	elog(DEBUG1, "hypopg: column types of index \"%s\": %u pages instead of %u",
+		 entry.indexname, entry.pages, real_pages);
+
+	if (real_pages == 0)
+		return index->pages;
+
+	return (BlockNumber) Max(ceil((double) index->pages * entry.pages /
+								  real_pages), 1);
+}
 
 /*
  * Fill the pages and tuples information for a given hypoIndex and a given
@@ -1785,8 +2523,30 @@ hypo_estimate_index(hypoIndex *entry, RelOptInfo *rel, PlannerInfo *root)
 	int			additional_bloat = 20;
 	ListCell   *lc;
 
-	for (i = 0; i < entry->ncolumns; i++)
-		ind_avg_width += hypo_estimate_index_colsize(entry, i);
+	/*
+	 * The columns average width only depends on the statistics of the
+	 * underlying relation, so it's cached until a pg_statistic or relcache
+	 * invalidation is received for it, until the estimation mode changes or
+	 * until the hypothetical column types change.  In accurate mode, first try
+	 * to compute it on a sample of the table, unless some of its columns have
+	 * an hypothetical type as the sample would only contain the real values.
+	 */
+	if (entry->avg_width < 0 || entry->avg_width_mode != hypo_estimation_mode)
+	{
+		if (hypo_estimation_mode != HYPO_ESTIMATION_ACCURATE ||
+			hypo_index_has_column_types(entry) ||
+			!hypo_sample_index_width(entry, rel->tuples, &ind_avg_width))
+		{
+			ind_avg_width = 0;
+			for (i = 0; i < entry->ncolumns; i++)
+				ind_avg_width += hypo_estimate_index_colsize(entry, i, true);
+		}
+
+		entry->avg_width = ind_avg_width;
+		entry->avg_width_mode = hypo_estimation_mode;
+	}
+	else
+		ind_avg_width = entry->avg_width;
 
 	if (entry->indpred == NIL)
 	{
@@ -1862,56 +2622,56 @@ hypo_estimate_index(hypoIndex *entry, RelOptInfo *rel, PlannerInfo *root)
 #if PG_VERSION_NUM >= 90500
 	else if (entry->relam == BRIN_AM_OID)
 	{
-		HeapTuple	ht_opc;
-		Form_pg_opclass opcrec;
-		char	   *opcname;
 		int			ranges = rel->pages / pages_per_range + 1;
-		bool		is_minmax = true;
-		int			data_size;
+		int		   *colwidths;
+		int			sum_widths = 0;
+		double		data_size;
 
 		/* -------------------------------
 		 * quick estimation of index size. A BRIN index contains
 		 * - a root page
 		 * - a range map: REVMAP_PAGE_MAXITEMS items (one per range
 		 *	 block) per revmap block
-		 * - regular type: sizeof(BrinTuple) per range, plus depending
-		 *	 on opclass:
-		 *	 - *_minmax_ops: 2 Datums (min & max obviously)
-		 *	 - *_inclusion_ops: 3 datumes (inclusion and 2 bool)
+		 * - regular type: sizeof(BrinTuple) per range, plus the summary of
+		 *	 each column depending on its opclass, see
+		 *	 hypo_estimate_brin_colsize()
 		 *
-		 * I assume same minmax VS. inclusion opclass for all columns.
 		 * BRIN access method does not bloat, don't add any additional.
 		 */
 
 		entry->pages = 1		/* root page */
 			+ (ranges / REVMAP_PAGE_MAXITEMS) + 1;	/* revmap */
 
-		/* get the operator class name */
-		ht_opc = SearchSysCache1(CLAOID,
-								 ObjectIdGetDatum(entry->opclass[0]));
-		if (!HeapTupleIsValid(ht_opc))
-			elog(ERROR, "hypopg: cache lookup failed for opclass %u",
-				 entry->opclass[0]);
-		opcrec = (Form_pg_opclass) GETSTRUCT(ht_opc);
-
-		opcname = NameStr(opcrec->opcname);
-		ReleaseSysCache(ht_opc);
+		/*
+		 * The average width of the index may come from a sample of the
+		 * table, so only use the estimated width of each column to split it
+		 * between the columns.
+		 */
+		colwidths = (int *) palloc(sizeof(int) * entry->nkeycolumns);
+		for (i = 0; i < entry->nkeycolumns; i++)
+		{
+			colwidths[i] = hypo_estimate_index_colsize(entry, i, true);
+			sum_widths += colwidths[i];
+		}
 
-		/* is it a minmax or an inclusion operator class ? */
-		if (!strstr(opcname, "minmax_ops"))
-			is_minmax = false;
+		data_size = sizeof(BrinTuple);
+		for (i = 0; i < entry->nkeycolumns; i++)
+		{
+			int			width;
 
-		/* compute data_size according to opclass kind */
-		if (is_minmax)
-			data_size = sizeof(BrinTuple) + 2 * ind_avg_width;
-		else
-			data_size = sizeof(BrinTuple) + ind_avg_width
-				+ 2 * sizeof(bool);
+			if (sum_widths > 0)
+				width = (int) ceil((double) ind_avg_width * colwidths[i] /
+								   sum_widths);
+			else
+				width = ind_avg_width / entry->nkeycolumns;
 
-		data_size = data_size * ranges
-			/ (BLCKSZ - MAXALIGN(SizeOfPageHeaderData)) + 1;
+			data_size += hypo_estimate_brin_colsize(entry, i, width);
+		}
+		pfree(colwidths);
 
-		entry->pages += data_size;
+		entry->pages += (BlockNumber) (data_size * ranges
+									   / (BLCKSZ - MAXALIGN(SizeOfPageHeaderData)))
+			+ 1;
 	}
 #endif
 #if PG_VERSION_NUM >= 90600
@@ -1947,49 +2707,304 @@ hypo_estimate_index(hypoIndex *entry, RelOptInfo *rel, PlannerInfo *root)
 			 entry->relam);
 	}
 
+	/*
+	 * The estimations above describe a freshly built index.  Simulate the
+	 * bloat accumulated between two REINDEX if asked, except for BRIN indexes
+	 * that don't bloat.
+	 */
+	if (hypo_index_bloat_factor != 1.0
+#if PG_VERSION_NUM >= 90500
+		&& entry->relam != BRIN_AM_OID
+#endif
+		)
+		entry->pages = (BlockNumber) ceil(entry->pages * hypo_index_bloat_factor);
+
 	/* make sure the index size is at least one block */
 	if (entry->pages <= 0)
 		entry->pages = 1;
+
+	/* and use the estimates set by the user instead, if any */
+	if (entry->set_pages >= 0)
+		entry->pages = (BlockNumber) Max(entry->set_pages, 1);
+	if (entry->set_tuples >= 0)
+		entry->tuples = entry->set_tuples;
+#if PG_VERSION_NUM >= 90300
+	if (entry->set_tree_height >= 0)
+		entry->tree_height = entry->set_tree_height;
+#endif
 }
 
+#if PG_VERSION_NUM >= 90500
 /*
- * Estimate a single index's column of an hypothetical index.
+ * Estimate the size of the summary of a single range for the given column of
+ * an hypothetical BRIN index, depending on the kind of its opclass:
+ *	 - *_minmax_ops: 2 Datums (min & max obviously)
+ *	 - *_inclusion_ops: 1 Datum (inclusion) and 2 bool
  */
 static int
-hypo_estimate_index_colsize(hypoIndex *entry, int col)
+hypo_estimate_brin_colsize(hypoIndex *entry, int col, int width)
 {
-	int			i,
-				pos;
-	Node	   *expr;
+	HeapTuple	ht_opc;
+	char	   *opcname;
+	int			result;
+
+	/* get the operator class name */
+	ht_opc = SearchSysCache1(CLAOID, ObjectIdGetDatum(entry->opclass[col]));
+	if (!HeapTupleIsValid(ht_opc))
+		elog(ERROR, "hypopg: cache lookup failed for opclass %u",
+			 entry->opclass[col]);
+	opcname = pstrdup(NameStr(((Form_pg_opclass) GETSTRUCT(ht_opc))->opcname));
+	ReleaseSysCache(ht_opc);
+
+	if (strstr(opcname, "_inclusion_ops"))
+		result = width + 2 * sizeof(bool);
+	else
+		result = 2 * width;
 
-	/* If simple attribute, return avg width */
-	if (entry->indexkeys[col] != 0)
-		return get_attavgwidth(entry->relid, entry->indexkeys[col]);
+	pfree(opcname);
 
-	/* It's an expression */
-	pos = 0;
+	return result;
+}
+#endif
 
-	for (i = 0; i < col; i++)
+/*
+ * Compute the average width of all the columns of an hypothetical index on a
+ * sample of the underlying table.  Returns false if it couldn't be computed,
+ * for instance if the sample doesn't contain any non-NULL value.
+ */
+static bool
+hypo_sample_index_width(hypoIndex *entry, double reltuples, int *width)
+{
+	Oid			relid = entry->relid;
+	char	   *qual = NULL;
+	ListCell   *indexpr_item;
+	List	   *context;
+	StringInfoData buf;
+	double		result;
+	int			i;
+
+#if PG_VERSION_NUM >= 100000
 	{
-		/* get the position in the expression list */
-		if (entry->indexkeys[i] == 0)
-			pos++;
-	}
+		hypoTable  *table = hypo_find_table(entry->relid, true);
 
-	expr = (Node *) list_nth(entry->indexprs, pos);
+		/*
+		 * Sample the rows of the root table belonging to the partition for
+		 * indexes on an hypothetical partition
+		 */
+		if (table)
+		{
+			relid = table->rootid;
+			if (OidIsValid(table->parentid))
+				qual = hypo_partition_qual_string(table);
+		}
+	}
+#endif
 
-	if (IsA(expr, Var) &&((Var *) expr)->varattno != InvalidAttrNumber)
-		return get_attavgwidth(entry->relid, ((Var *) expr)->varattno);
+	context = deparse_context_for(get_rel_name(relid), relid);
+	indexpr_item = list_head(entry->indexprs);
 
-	if (IsA(expr, FuncExpr))
+	initStringInfo(&buf);
+	for (i = 0; i < entry->ncolumns; i++)
 	{
-		FuncExpr   *funcexpr = (FuncExpr *) expr;
+		if (i != 0)
+			appendStringInfoString(&buf, " + ");
 
-		switch (funcexpr->funcid)
+		appendStringInfoString(&buf,
+							   "pg_catalog.avg(pg_catalog.pg_column_size(");
+
+		if (entry->indexkeys[i] != 0)
 		{
-			case 2311:
-				/* md5 */
-				return 32;
+#if PG_VERSION_NUM >= 110000
+			appendStringInfoString(&buf,
+								   quote_identifier(get_attname(relid,
+																entry->indexkeys[i],
+																false)));
+#else
+			appendStringInfoString(&buf,
+								   quote_identifier(get_attname(relid,
+																entry->indexkeys[i])));
+#endif
+		}
+		else
+		{
+			Node	   *indexkey;
+
+			if (indexpr_item == NULL)
+				elog(ERROR, "too few entries in indexprs list");
+			indexkey = (Node *) lfirst(indexpr_item);
+			indexpr_item = lnext(indexpr_item);
+
+			appendStringInfoString(&buf, deparse_expression(indexkey, context,
+															false, false));
+		}
+
+		appendStringInfoString(&buf, "))");
+	}
+
+	if (!hypo_sample_relation(relid, reltuples, buf.data, qual, &result))
+		return false;
+
+	elog(DEBUG1, "hypopg: sampled average width for index \"%s\": %lf",
+		 entry->indexname, result);
+
+	*width = (int) ceil(result);
+
+	return true;
+}
+
+/*
+ * Return the average width of a column of the relation an hypothetical index
+ * is defined on, weighted by its fraction of non-NULL values as those don't
+ * take space in the index tuples.  For an hypothetical partition, the
+ * statistics gathered by hypopg_analyze are used if any, otherwise the ones
+ * of the root table.  Statistics imported from a snapshot are preferred over
+ * the real ones.  Returns 0 if no statistics are available.
+ *
+ * If use_coltypes is true and the column has an hypothetical type, the width
+ * of the hypothetical type is used instead.
+ */
+static int32
+hypo_get_attwidth(hypoIndex *entry, AttrNumber attnum, bool use_coltypes)
+{
+	Oid			relid = entry->relid;
+	HeapTuple	tuple = NULL;
+	bool		from_cache = false;
+	hypoColumnType *coltype = NULL;
+	int32		width = 0;
+#if PG_VERSION_NUM >= 100000
+	hypoTable  *table = hypo_find_table(entry->relid, true);
+
+	if (table && OidIsValid(table->parentid))
+	{
+		tuple = hypo_get_stats_tuple(entry->relid, attnum);
+		relid = table->rootid;
+	}
+#endif
+
+	if (!HeapTupleIsValid(tuple))
+		tuple = hypo_get_imported_stats_tuple(relid, attnum, false);
+
+	if (!HeapTupleIsValid(tuple))
+	{
+		tuple = SearchSysCache3(STATRELATTINH,
+								ObjectIdGetDatum(relid),
+								Int16GetDatum(attnum),
+								BoolGetDatum(false));
+		from_cache = true;
+	}
+
+	if (use_coltypes)
+		coltype = hypo_find_column_type(relid, attnum);
+
+	if (HeapTupleIsValid(tuple))
+	{
+		Form_pg_statistic stats = (Form_pg_statistic) GETSTRUCT(tuple);
+		int32		stawidth = stats->stawidth;
+
+		if (coltype)
+			stawidth = hypo_column_type_width(coltype, stawidth);
+
+		if (stawidth > 0)
+			width = (int32) ceil(stawidth * (1.0 - stats->stanullfrac));
+
+		if (from_cache)
+			ReleaseSysCache(tuple);
+	}
+	else if (coltype)
+		width = hypo_column_type_width(coltype, 0);
+
+	return width;
+}
+
+/*
+ * Return true if any of the columns the given hypothetical index depends on
+ * has an hypothetical type.
+ */
+static bool
+hypo_index_has_column_types(hypoIndex *entry)
+{
+	Oid			relid = entry->relid;
+	Bitmapset  *attrs = NULL;
+	ListCell   *lc;
+	int			i;
+
+	if (hypoColumnTypes == NIL)
+		return false;
+
+#if PG_VERSION_NUM >= 100000
+	{
+		hypoTable  *table = hypo_find_table(entry->relid, true);
+
+		if (table)
+			relid = table->rootid;
+	}
+#endif
+
+	for (i = 0; i < entry->ncolumns; i++)
+	{
+		if (entry->indexkeys[i] != 0)
+			attrs = bms_add_member(attrs, entry->indexkeys[i] -
+								   FirstLowInvalidHeapAttributeNumber);
+	}
+
+	pull_varattnos((Node *) entry->indexprs, 1, &attrs);
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		if (coltype->relid == relid &&
+			bms_is_member(coltype->attnum - FirstLowInvalidHeapAttributeNumber,
+						  attrs))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Estimate a single index's column of an hypothetical index.
+ */
+static int
+hypo_estimate_index_colsize(hypoIndex *entry, int col, bool use_coltypes)
+{
+	int			i,
+				pos;
+	Node	   *expr;
+
+	/* If simple attribute, return avg width */
+	if (entry->indexkeys[col] != 0)
+		return hypo_get_attwidth(entry, entry->indexkeys[col], use_coltypes);
+
+	/* It's an expression */
+	pos = 0;
+
+	for (i = 0; i < col; i++)
+	{
+		/* get the position in the expression list */
+		if (entry->indexkeys[i] == 0)
+			pos++;
+	}
+
+	expr = (Node *) list_nth(entry->indexprs, pos);
+
+	/* In fast mode, only rely on the catalog for expressions */
+	if (hypo_estimation_mode == HYPO_ESTIMATION_FAST)
+		return get_typavgwidth(exprType(expr), exprTypmod(expr));
+
+	if (IsA(expr, Var) &&((Var *) expr)->varattno != InvalidAttrNumber)
+		return hypo_get_attwidth(entry, ((Var *) expr)->varattno,
+								 use_coltypes);
+
+	if (IsA(expr, FuncExpr))
+	{
+		FuncExpr   *funcexpr = (FuncExpr *) expr;
+
+		switch (funcexpr->funcid)
+		{
+			case 2311:
+				/* md5 */
+				return 32;
 				break;
 			case 870:
 			case 871:
@@ -2002,7 +3017,8 @@ hypo_estimate_index_colsize(hypoIndex *entry, int col)
 						var = (Var *) linitial(funcexpr->args);
 
 						if (var->varattno > 0)
-							return get_attavgwidth(entry->relid, var->varattno);
+							return hypo_get_attwidth(entry, var->varattno,
+													 use_coltypes);
 					}
 					break;
 				}
@@ -2015,6 +3031,105 @@ hypo_estimate_index_colsize(hypoIndex *entry, int col)
 	return 50;					/* default fallback estimate */
 }
 
+/*
+ * Check that the given relation, on which the hypothetical index is defined,
+ * still exists and that all the columns the index depends on still exist with
+ * a compatible type.  relid should be the real relation the index depends on,
+ * which is the root table for an index on an hypothetical partition.
+ */
+bool
+hypo_index_check_columns(hypoIndex *entry, Oid relid)
+{
+	int			i;
+
+	if (!SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relid)))
+		return false;
+
+	for (i = 0; i < entry->ncolumns; i++)
+	{
+		AttrNumber	attnum = entry->indexkeys[i];
+		Oid			atttype;
+
+		/* expressions are checked below */
+		if (attnum == 0)
+			continue;
+
+		/* dropped columns have an invalid type */
+		atttype = get_atttype(relid, attnum);
+		if (!OidIsValid(atttype))
+			return false;
+
+		/* opclass informations are only available for key columns */
+		if (i < entry->nkeycolumns &&
+			!IsBinaryCoercible(atttype, entry->opcintype[i]))
+			return false;
+	}
+
+	if (hypo_index_vars_walker((Node *) entry->indexprs, &relid))
+		return false;
+
+	return !hypo_index_vars_walker((Node *) entry->indpred, &relid);
+}
+
+/*
+ * Return true if any column referenced in the given expression has been
+ * dropped or has changed its type.
+ */
+static bool
+hypo_index_vars_walker(Node *node, Oid *relid)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, Var))
+	{
+		Var		   *var = (Var *) node;
+
+		if (var->varattno <= 0)
+			return false;
+
+		return get_atttype(*relid, var->varattno) != var->vartype;
+	}
+
+	return expression_tree_walker(node, hypo_index_vars_walker,
+								  (void *) relid);
+}
+
+/*
+ * Does the given pg_statistic syscache hash value match one of the columns
+ * the hypothetical index depends on?  A zero hash value means that the whole
+ * cache has been invalidated.
+ */
+bool
+hypo_index_match_stats(hypoIndex *entry, Oid relid, uint32 hashvalue)
+{
+	Bitmapset  *attnums = NULL;
+	int			i;
+
+	if (hashvalue == 0)
+		return true;
+
+	for (i = 0; i < entry->ncolumns; i++)
+	{
+		if (entry->indexkeys[i] != 0)
+			attnums = bms_add_member(attnums, entry->indexkeys[i] -
+									 FirstLowInvalidHeapAttributeNumber);
+	}
+	pull_varattnos((Node *) entry->indexprs, 1, &attnums);
+
+	while ((i = bms_first_member(attnums)) >= 0)
+	{
+		AttrNumber	attnum = i + FirstLowInvalidHeapAttributeNumber;
+
+		if (GetSysCacheHashValue3(STATRELATTINH, ObjectIdGetDatum(relid),
+								  Int16GetDatum(attnum),
+								  BoolGetDatum(false)) == hashvalue)
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * canreturn should been checked with the amcanreturn proc, but this
  * can't be done without a real Relation, so try to find it out
@@ -2134,3 +3249,536 @@ hypo_discover_am(char *amname, Oid oid)
 		BLOOM_AM_OID = oid;
 #endif
 }
+
+/*
+ * Return true if a visible hypothetical btree index of the given relation, or
+ * of the given hypothetical partition if partid is valid, has the given
+ * column as its leading key, so that the planner would probe the actual range
+ * of the column if the index was real.
+ */
+static bool
+hypo_index_has_leading_btree(Oid relid, Oid partid, AttrNumber attnum)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+
+		if ((entry->relid == relid ||
+			 (OidIsValid(partid) && entry->relid == partid)) &&
+			entry->relam == BTREE_AM_OID &&
+			entry->indexkeys[0] == attnum && entry->indpred == NIL &&
+			!hypo_index_is_hidden(entry->oid))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Look for a real valid btree index of the given relation having the given
+ * column as its leading key.  Returns true if one is found, and set *visible
+ * if at least one of them is not hidden, in which case the planner will probe
+ * it itself.
+ */
+static bool
+hypo_real_leading_btree(Oid relid, AttrNumber attnum, bool *visible)
+{
+	Relation	relation;
+	List	   *indexoids;
+	ListCell   *lc;
+	bool		found = false;
+
+	*visible = false;
+
+	relation = heap_open(relid, AccessShareLock);
+	indexoids = RelationGetIndexList(relation);
+	heap_close(relation, NoLock);
+
+	foreach(lc, indexoids)
+	{
+		Oid			indexoid = lfirst_oid(lc);
+		HeapTuple	tuple;
+		Form_pg_index index;
+		bool		match;
+
+		tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(indexoid));
+		if (!HeapTupleIsValid(tuple))
+			continue;
+		match = (((Form_pg_class) GETSTRUCT(tuple))->relam == BTREE_AM_OID);
+		ReleaseSysCache(tuple);
+
+		if (!match)
+			continue;
+
+		tuple = SearchSysCache1(INDEXRELID, ObjectIdGetDatum(indexoid));
+		if (!HeapTupleIsValid(tuple))
+			continue;
+		index = (Form_pg_index) GETSTRUCT(tuple);
+
+		match = (index->indisvalid && index->indkey.values[0] == attnum &&
+				 heap_attisnull(tuple, Anum_pg_index_indpred
+#if PG_VERSION_NUM >= 120000
+								,NULL
+#endif
+								));
+		ReleaseSysCache(tuple);
+
+		if (!match)
+			continue;
+
+		found = true;
+		if (!hypo_index_is_hidden(indexoid))
+			*visible = true;
+	}
+
+	list_free(indexoids);
+
+	return found;
+}
+
+/*
+ * Fetch the smallest or biggest non-NULL value of the given column, ordered
+ * by the default btree operator class of its type, either using a real index
+ * or on a sample of the table.  The value is allocated in the caller's memory
+ * context.  Returns false if no value was found.
+ *
+ * This is called during planning, so make sure that the query won't see any
+ * hypothetical object, as hypo_sample_relation() does.
+ */
+static bool
+hypo_fetch_endpoint(Oid relid, AttrNumber attnum, bool inherit, bool sample,
+					bool max, Datum *value)
+{
+	MemoryContext callercxt = CurrentMemoryContext;
+	StringInfoData buf;
+	bool		save_isExplain = isExplain;
+	bool		found = false;
+	Oid			typid = get_atttype(relid, attnum);
+	int16		typlen;
+	bool		typbyval;
+	const char *attname;
+	int			ret;
+
+	get_typlenbyval(typid, &typlen, &typbyval);
+
+#if PG_VERSION_NUM >= 110000
+	attname = quote_identifier(get_attname(relid, attnum, false));
+#else
+	attname = quote_identifier(get_attname(relid, attnum));
+#endif
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT %s FROM %s%s.%s",
+					 attname,
+					 inherit ? "" : "ONLY ",
+					 quote_identifier(get_namespace_name(get_rel_namespace(relid))),
+					 quote_identifier(get_rel_name(relid)));
+
+#if PG_VERSION_NUM >= 90500
+	if (sample)
+	{
+		double		targrows = 300.0 * default_statistics_target;
+		double		reltuples = 0;
+		double		percent = 100.0;
+		HeapTuple	tuple;
+
+		tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+		if (HeapTupleIsValid(tuple))
+		{
+			reltuples = ((Form_pg_class) GETSTRUCT(tuple))->reltuples;
+			ReleaseSysCache(tuple);
+		}
+
+		if (reltuples > targrows)
+			percent = targrows * 100.0 / reltuples;
+
+		appendStringInfo(&buf, " TABLESAMPLE SYSTEM(%f)", percent);
+	}
+#else
+	/* TABLESAMPLE is required */
+	if (sample)
+		return false;
+#endif
+
+	appendStringInfo(&buf, " WHERE %s IS NOT NULL ORDER BY %s %s LIMIT 1",
+					 attname, attname, max ? "DESC" : "ASC");
+
+	isExplain = false;
+	PG_TRY();
+	{
+		if (SPI_connect() != SPI_OK_CONNECT)
+			elog(ERROR, "hypopg: could not connect to SPI manager");
+
+		ret = SPI_execute(buf.data, true, 1);
+		if (ret != SPI_OK_SELECT)
+			elog(ERROR, "hypopg: could not fetch the range of relation \"%s\":"
+				 " SPI_execute returned %d", get_rel_name(relid), ret);
+
+		if (SPI_processed == 1)
+		{
+			Datum		datum;
+			bool		isnull;
+
+			datum = SPI_getbinval(SPI_tuptable->vals[0],
+								  SPI_tuptable->tupdesc, 1, &isnull);
+			if (!isnull)
+			{
+				MemoryContext spicxt = MemoryContextSwitchTo(callercxt);
+
+				*value = datumCopy(datum, typbyval, typlen);
+				MemoryContextSwitchTo(spicxt);
+				found = true;
+			}
+		}
+
+		SPI_finish();
+	}
+	PG_CATCH();
+	{
+		isExplain = save_isExplain;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	isExplain = save_isExplain;
+	pfree(buf.data);
+
+	return found;
+}
+
+/*
+ * Return the actual range of the given column.  A real index on the column is
+ * probed if there's one, otherwise the extremes are computed on a sample of
+ * the table in accurate mode.  In both cases, the range is cached until the
+ * relation is invalidated, as the stats hook is called for each estimation.
+ */
+static bool
+hypo_get_actual_range(Oid relid, AttrNumber attnum, bool inherit,
+					  bool has_index, Datum *min, Datum *max)
+{
+	hypoActualRange *range = NULL;
+	MemoryContext oldcontext;
+	ListCell   *lc;
+	int16		typlen;
+	bool		typbyval;
+
+	if (!has_index && hypo_estimation_mode != HYPO_ESTIMATION_ACCURATE)
+		return false;
+
+	foreach(lc, hypoActualRanges)
+	{
+		hypoActualRange *r = (hypoActualRange *) lfirst(lc);
+
+		if (r->relid == relid && r->attnum == attnum &&
+			r->inherit == inherit && r->probed == has_index)
+		{
+			range = r;
+			break;
+		}
+	}
+
+	if (!range)
+	{
+		Datum		smin,
+					smax;
+		bool		found;
+
+		found = hypo_fetch_endpoint(relid, attnum, inherit, !has_index, false,
+									&smin) &&
+			hypo_fetch_endpoint(relid, attnum, inherit, !has_index, true,
+								&smax);
+
+		get_typlenbyval(get_atttype(relid, attnum), &typlen, &typbyval);
+
+		oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+		range = (hypoActualRange *) palloc0(sizeof(hypoActualRange));
+		range->relid = relid;
+		range->attnum = attnum;
+		range->inherit = inherit;
+		range->probed = has_index;
+		range->found = found;
+		range->typbyval = typbyval;
+		if (found)
+		{
+			range->min = datumCopy(smin, typbyval, typlen);
+			range->max = datumCopy(smax, typbyval, typlen);
+		}
+		hypoActualRanges = lappend(hypoActualRanges, range);
+		MemoryContextSwitchTo(oldcontext);
+
+		elog(DEBUG1, "hypopg: %s range of column %d of relation \"%s\": %s",
+			 has_index ? "probed" : "sampled", attnum, get_rel_name(relid),
+			 found ? "found" : "not found");
+	}
+
+	if (!range->found)
+		return false;
+
+	*min = range->min;
+	*max = range->max;
+
+	return true;
+}
+
+/*
+ * Remove the cached ranges of the given relation, or of all relations
+ * if relid is InvalidOid.  This can be called from a relcache callback, so it
+ * must not access the catalogs.
+ */
+void
+hypo_actual_range_inval(Oid relid)
+{
+	List	   *keep = NIL;
+	ListCell   *lc;
+	MemoryContext oldcontext;
+
+	if (hypoActualRanges == NIL)
+		return;
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	foreach(lc, hypoActualRanges)
+	{
+		hypoActualRange *range = (hypoActualRange *) lfirst(lc);
+
+		if (relid == InvalidOid || range->relid == relid)
+		{
+			if (range->found && !range->typbyval)
+			{
+				pfree(DatumGetPointer(range->min));
+				pfree(DatumGetPointer(range->max));
+			}
+			pfree(range);
+		}
+		else
+			keep = lappend(keep, range);
+	}
+	list_free(hypoActualRanges);
+	hypoActualRanges = keep;
+	MemoryContextSwitchTo(oldcontext);
+}
+
+#if PG_VERSION_NUM >= 100000
+/*
+ * Clamp the given actual range, which is the one of the whole root table, to
+ * the bounds of the given hypothetical partition and of its hypothetical
+ * ancestors, for the levels range partitioned on the given column.
+ */
+static void
+hypo_actual_range_clamp(hypoTable *part, AttrNumber attnum, Oid atttype,
+						Oid ltop, Oid collid, Datum *min, Datum *max)
+{
+	Oid			ltproc = get_opcode(ltop);
+
+	while (part && OidIsValid(part->parentid))
+	{
+		hypoTable  *parent = hypo_find_table(part->parentid, false);
+		PartitionBoundSpec *spec = part->boundspec;
+		PartitionRangeDatum *lower;
+		PartitionRangeDatum *upper;
+		Const	   *bound;
+
+		if (spec == NULL || spec->strategy != PARTITION_STRATEGY_RANGE ||
+			parent->partkey == NULL || parent->partkey->partattrs[0] != attnum)
+		{
+			part = parent;
+			continue;
+		}
+
+		lower = (PartitionRangeDatum *) linitial(spec->lowerdatums);
+		upper = (PartitionRangeDatum *) linitial(spec->upperdatums);
+
+		/* MINVALUE and MAXVALUE bounds don't have a value */
+		bound = (Const *) lower->value;
+		if (bound && IsA(bound, Const) && bound->consttype == atttype &&
+			DatumGetBool(OidFunctionCall2Coll(ltproc, collid, *min,
+											  bound->constvalue)))
+			*min = bound->constvalue;
+
+		bound = (Const *) upper->value;
+		if (bound && IsA(bound, Const) && bound->consttype == atttype &&
+			DatumGetBool(OidFunctionCall2Coll(ltproc, collid,
+											  bound->constvalue, *max)))
+			*max = bound->constvalue;
+
+		part = parent;
+	}
+}
+#endif
+
+/*
+ * Emulate selfuncs.c/get_actual_variable_range() for hypothetical btree
+ * indexes, which the planner ignores.  If the given column is the leading key
+ * of a visible hypothetical btree and no visible real index would be probed
+ * instead, the first and last bounds of the histogram are widened to the
+ * actual range of the column, as the planner does for real indexes.
+ *
+ * The statistics of an hypothetical partition are widened to the actual range
+ * of the root table clamped to the partition bounds, as the real table isn't
+ * partitioned.
+ *
+ * The stats hook doesn't know the compared constant, so contrary to the
+ * planner the actual range can't only be fetched when the constant falls
+ * outside the histogram.  It's cached instead, see hypo_get_actual_range().
+ *
+ * found tells whether the stats hook already filled vardata.  Returns true if
+ * vardata now contains a pg_statistic row.
+ */
+bool
+hypo_actual_range_adjust(PlannerInfo *root, RangeTblEntry *rte,
+						 AttrNumber attnum, VariableStatData *vardata,
+						 bool found)
+{
+	Oid			relid = rte->relid;
+	Oid			partid = InvalidOid;
+	HeapTuple	statsTuple;
+	Form_pg_statistic stats;
+	bool		has_index;
+	bool		visible;
+	int			k;
+#if PG_VERSION_NUM >= 100000
+	hypoTable  *part = NULL;
+
+	if (hypoTables && root)
+	{
+		Index		rti;
+
+		rti = hypo_rte_get_rti(root, rte,
+							   (vardata->var && IsA(vardata->var, Var)) ?
+							   ((Var *) vardata->var)->varno : 0);
+		if (rti != 0)
+			part = hypo_rti_get_table(root, rti);
+		if (part)
+			partid = part->oid;
+	}
+#endif
+
+	if (attnum <= 0 || hypoIndexes == NIL ||
+		!hypo_index_has_leading_btree(relid, partid, attnum))
+		return found;
+
+	has_index = hypo_real_leading_btree(relid, attnum, &visible);
+	if (visible)
+		return found;
+
+	if (!found)
+	{
+		vardata->statsTuple = SearchSysCache3(STATRELATTINH,
+											  ObjectIdGetDatum(relid),
+											  Int16GetDatum(attnum),
+											  BoolGetDatum(rte->inh));
+		if (!HeapTupleIsValid(vardata->statsTuple))
+			return false;
+
+		vardata->freefunc = ReleaseSysCache;
+		/* check if user has permission to read this column */
+		vardata->acl_ok =
+			(pg_class_aclcheck(relid, GetUserId(),
+							   ACL_SELECT) == ACLCHECK_OK) ||
+			(pg_attribute_aclcheck(relid, attnum, GetUserId(),
+								   ACL_SELECT) == ACLCHECK_OK);
+	}
+
+	statsTuple = vardata->statsTuple;
+	if (!HeapTupleIsValid(statsTuple))
+		return found;
+	stats = (Form_pg_statistic) GETSTRUCT(statsTuple);
+
+	for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+	{
+		Oid			atttype;
+		int32		atttypmod;
+		Oid			collid;
+		Oid			ltop = (&stats->staop1)[k];
+		int16		typlen;
+		bool		typbyval;
+		char		typalign;
+		Datum		datum;
+		Datum	   *values;
+		Datum		min,
+					max;
+		int			nvalues;
+		bool		isnull;
+		bool		changed = false;
+
+		if ((&stats->stakind1)[k] != STATISTIC_KIND_HISTOGRAM ||
+			!OidIsValid(ltop))
+			continue;
+
+		datum = SysCacheGetAttr(STATRELATTINH, statsTuple,
+								Anum_pg_statistic_stavalues1 + k, &isnull);
+		if (isnull)
+			break;
+
+		get_atttypetypmodcoll(relid, attnum, &atttype, &atttypmod, &collid);
+#if PG_VERSION_NUM >= 120000
+		collid = (&stats->stacoll1)[k];
+#endif
+
+		if (ARR_ELEMTYPE(DatumGetArrayTypeP(datum)) != atttype)
+			break;
+
+		if (!hypo_get_actual_range(relid, attnum, stats->stainherit,
+								   has_index, &min, &max))
+			break;
+
+#if PG_VERSION_NUM >= 100000
+		if (part)
+			hypo_actual_range_clamp(part, attnum, atttype, ltop, collid,
+									&min, &max);
+#endif
+
+		get_typlenbyvalalign(atttype, &typlen, &typbyval, &typalign);
+		deconstruct_array(DatumGetArrayTypeP(datum), atttype, typlen,
+						  typbyval, typalign, &values, NULL, &nvalues);
+		if (nvalues < 2)
+			break;
+
+		if (DatumGetBool(OidFunctionCall2Coll(get_opcode(ltop), collid,
+											  min, values[0])))
+		{
+			values[0] = min;
+			changed = true;
+		}
+		if (DatumGetBool(OidFunctionCall2Coll(get_opcode(ltop), collid,
+											  values[nvalues - 1], max)))
+		{
+			values[nvalues - 1] = max;
+			changed = true;
+		}
+
+		if (changed)
+		{
+			Relation	pgstats;
+			Datum		replvalues[Natts_pg_statistic];
+			bool		replnulls[Natts_pg_statistic];
+			bool		replaces[Natts_pg_statistic];
+			HeapTuple	newtuple;
+
+			memset(replnulls, 0, sizeof(replnulls));
+			memset(replaces, 0, sizeof(replaces));
+			replaces[Anum_pg_statistic_stavalues1 - 1 + k] = true;
+			replvalues[Anum_pg_statistic_stavalues1 - 1 + k] =
+				PointerGetDatum(construct_array(values, nvalues, atttype,
+												typlen, typbyval, typalign));
+
+			pgstats = heap_open(StatisticRelationId, AccessShareLock);
+			newtuple = heap_modify_tuple(statsTuple, RelationGetDescr(pgstats),
+										 replvalues, replnulls, replaces);
+			heap_close(pgstats, AccessShareLock);
+
+			if (vardata->freefunc)
+				vardata->freefunc(statsTuple);
+			vardata->statsTuple = newtuple;
+			vardata->freefunc = (void *) pfree;
+
+			elog(DEBUG1, "hypopg: used the actual range of column %d of relation \"%s\"",
+				 attnum, get_rel_name(relid));
+		}
+
+		break;
+	}
+
+	return true;
+}
@@ -0,0 +1,1066 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_parallel.c: Parallel evaluation of a workload with the hypothetical
+ * objects, using dynamic background workers.
+ *
+ * All hypothetical objects are local to a backend.  The leader therefore
+ * serializes its hypothetical configuration in a dynamic shared memory
+ * segment, and each background worker rebuilds it before planning the
+ * queries of the workload.  Hypothetical partitions and indexes are rebuilt
+ * by replaying the SQL orders generated from their definition, since their
+ * oids will be different in the workers, while the computed statistics are
+ * copied as-is, as are the leader's settings.  The queries are distributed on
+ * demand between the workers and the leader, which also plans queries while
+ * waiting.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#if PG_VERSION_NUM >= 100000
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "statistics/statistics.h"
+#include "storage/shm_toc.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/snapmgr.h"
+#endif
+
+#include "include/hypopg.h"
+#include "include/hypopg_advisor.h"
+#include "include/hypopg_analyze.h"
+#include "include/hypopg_calibration.h"
+#include "include/hypopg_index.h"
+#include "include/hypopg_parallel.h"
+#include "include/hypopg_reloptions.h"
+#include "include/hypopg_snapshot.h"
+#include "include/hypopg_statistics.h"
+#include "include/hypopg_table.h"
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_parallel_evaluate);
+
+#if PG_VERSION_NUM >= 100000
+static void hypo_parallel_write(StringInfo buf, const void *data, Size len);
+static void hypo_parallel_write_string(StringInfo buf, const char *str);
+static void hypo_parallel_write_rel(StringInfo buf, Oid relid);
+static void hypo_parallel_read(StringInfo buf, void *data, Size len);
+static char *hypo_parallel_read_string(StringInfo buf);
+static Oid	hypo_parallel_read_rel(StringInfo buf);
+static List *hypo_parallel_get_script(void);
+static void hypo_parallel_serialize(StringInfo buf);
+static void hypo_parallel_restore(StringInfo buf);
+static void hypo_parallel_restore_stats_ext(StringInfo buf);
+static void hypo_parallel_plan_one(const char *sql, int worker,
+					   hypoParallelResult *result);
+static void hypo_parallel_plan_queries(hypoParallelShared *shared,
+						   char *queries, hypoParallelResult *results,
+						   int worker);
+
+
+/*
+ * Append raw data to the serialized state
+ */
+static void
+hypo_parallel_write(StringInfo buf, const void *data, Size len)
+{
+	appendBinaryStringInfo(buf, (const char *) data, len);
+}
+
+/*
+ * Append a nul-terminated string to the serialized state
+ */
+static void
+hypo_parallel_write_string(StringInfo buf, const char *str)
+{
+	appendBinaryStringInfo(buf, str, strlen(str) + 1);
+}
+
+/*
+ * Append a reference to the given relation to the serialized state.  The
+ * hypothetical partitions will have a different oid in the background
+ * workers, so they're referenced by name.  Other relations are referenced by
+ * oid.
+ */
+static void
+hypo_parallel_write_rel(StringInfo buf, Oid relid)
+{
+	hypoTable  *table = hypo_find_table(relid, true);
+
+	if (table && OidIsValid(table->parentid))
+		hypo_parallel_write_string(buf, table->tablename);
+	else
+		hypo_parallel_write_string(buf, "");
+
+	hypo_parallel_write(buf, &relid, sizeof(Oid));
+}
+
+/*
+ * Read raw data from the serialized state
+ */
+static void
+hypo_parallel_read(StringInfo buf, void *data, Size len)
+{
+	if (buf->cursor + len > buf->len)
+		elog(ERROR, "hypopg: invalid serialized hypothetical state");
+
+	memcpy(data, buf->data + buf->cursor, len);
+	buf->cursor += len;
+}
+
+/*
+ * Read a nul-terminated string from the serialized state.  The returned
+ * string points to the serialized state.
+ */
+static char *
+hypo_parallel_read_string(StringInfo buf)
+{
+	char	   *str = buf->data + buf->cursor;
+	Size		len = strnlen(str, buf->len - buf->cursor);
+
+	if (buf->cursor + len >= buf->len)
+		elog(ERROR, "hypopg: invalid serialized hypothetical state");
+
+	buf->cursor += len + 1;
+
+	return str;
+}
+
+/*
+ * Read a relation reference written by hypo_parallel_write_rel() and return
+ * the relation oid in the current backend.
+ */
+static Oid
+hypo_parallel_read_rel(StringInfo buf)
+{
+	char	   *tablename = hypo_parallel_read_string(buf);
+	Oid			relid;
+
+	hypo_parallel_read(buf, &relid, sizeof(Oid));
+
+	if (tablename[0] != '\0')
+	{
+		hypoTable  *table = hypo_table_name_get_entry(tablename);
+
+		if (!table)
+			elog(ERROR, "hypopg: could not find hypothetical partition \"%s\"",
+				 tablename);
+
+		relid = table->oid;
+	}
+
+	return relid;
+}
+
+/*
+ * Generate the list of SQL orders that will rebuild the hypothetical
+ * partitions and indexes, the hidden indexes and partitions and the
+ * hypothetical storage parameters and column types in another backend.
+ */
+static List *
+hypo_parallel_get_script(void)
+{
+	List	   *script = NIL;
+	ListCell   *lc;
+
+	if (hypoTables)
+	{
+		HASH_SEQ_STATUS hash_seq;
+		hypoTable  *entry;
+		List	   *pending = NIL;
+
+		/* Parents have to be created before their partitions */
+		hash_seq_init(&hash_seq, hypoTables);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		{
+			if (!OidIsValid(entry->parentid))
+				pending = lappend_oid(pending, entry->oid);
+		}
+
+		while (pending != NIL)
+		{
+			Oid			tableid = linitial_oid(pending);
+
+			pending = list_delete_first(pending);
+			entry = hypo_find_table(tableid, false);
+
+			if (!OidIsValid(entry->parentid))
+			{
+				script = lappend(script,
+								 psprintf("SELECT hypopg_partition_table(%u::regclass, %s)",
+										  entry->oid,
+										  quote_literal_cstr(hypo_get_partkeydef(entry))));
+			}
+			else
+			{
+				hypoTable  *parent = hypo_find_table(entry->parentid, false);
+				char	   *parentname;
+				char	   *partitionof;
+
+				if (OidIsValid(parent->parentid))
+					parentname = pstrdup(quote_identifier(parent->tablename));
+				else
+					parentname = psprintf("%s.%s",
+										  quote_identifier(get_namespace_name(get_rel_namespace(parent->oid))),
+										  quote_identifier(get_rel_name(parent->oid)));
+
+				partitionof = psprintf("PARTITION OF %s %s", parentname,
+									   hypo_get_partbounddef(entry));
+
+				script = lappend(script,
+								 psprintf("SELECT hypopg_add_partition(%s, %s, %s)",
+										  quote_literal_cstr(entry->tablename),
+										  quote_literal_cstr(partitionof),
+										  entry->partkey ?
+										  quote_literal_cstr(hypo_get_partkeydef(entry)) :
+										  "NULL"));
+			}
+
+			foreach(lc, entry->children)
+				pending = lappend_oid(pending, lfirst_oid(lc));
+		}
+	}
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+		char	   *indexdef;
+		StringInfoData sql;
+
+		indexdef = TextDatumGetCString(DirectFunctionCall1(hypopg_get_indexdef,
+														   ObjectIdGetDatum(entry->oid)));
+
+		/* The index will get a new oid, so refer to the created one */
+		initStringInfo(&sql);
+		appendStringInfoString(&sql, "SELECT indexrelid");
+		if (hypo_index_is_hidden(entry->oid))
+			appendStringInfoString(&sql, ", hypopg_hide_index(indexrelid)");
+		if (entry->set_pages >= 0 || entry->set_tuples >= 0 ||
+			entry->set_tree_height >= 0)
+		{
+			appendStringInfoString(&sql,
+								   ", hypopg_set_index_estimates(indexrelid, ");
+			if (entry->set_pages >= 0)
+				appendStringInfo(&sql, "%.0f, ", entry->set_pages);
+			else
+				appendStringInfoString(&sql, "NULL, ");
+			if (entry->set_tuples >= 0)
+				appendStringInfo(&sql, "%.17g, ", entry->set_tuples);
+			else
+				appendStringInfoString(&sql, "NULL, ");
+			if (entry->set_tree_height >= 0)
+				appendStringInfo(&sql, "%d)", entry->set_tree_height);
+			else
+				appendStringInfoString(&sql, "NULL)");
+		}
+		appendStringInfo(&sql, " FROM hypopg_create_index(%s)",
+						 quote_literal_cstr(indexdef));
+
+		script = lappend(script, sql.data);
+	}
+
+	foreach(lc, hypoHiddenIndexes)
+	{
+		Oid			indexid = lfirst_oid(lc);
+
+		/* Hidden hypothetical indexes have already been handled */
+		if (hypo_get_index(indexid) != NULL)
+			continue;
+
+		script = lappend(script,
+						 psprintf("SELECT hypopg_hide_index(%u)", indexid));
+	}
+
+	foreach(lc, hypoHiddenPartitions)
+		script = lappend(script,
+						 psprintf("SELECT hypopg_hide_partition(%u)",
+								  lfirst_oid(lc)));
+
+	foreach(lc, hypoRelOptionsList)
+	{
+		hypoRelOptions *entry = (hypoRelOptions *) lfirst(lc);
+
+		script = lappend(script,
+						 psprintf("SELECT hypopg_set_table_options(%u::regclass, %s)",
+								  entry->relid,
+								  hypo_reloptions_deparse(entry)));
+	}
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		script = lappend(script,
+						 psprintf("SELECT hypopg_alter_column_type(%s)",
+								  hypo_column_type_deparse(coltype)));
+	}
+
+	return script;
+}
+
+/*
+ * Serialize all the hypothetical objects stored in the current backend.
+ */
+static void
+hypo_parallel_serialize(StringInfo buf)
+{
+	List	   *script = hypo_parallel_get_script();
+	ListCell   *lc;
+	StringInfoData snapshot;
+	int			nb;
+
+	/*
+	 * Statistics imported from a snapshot, needed before creating the
+	 * hypothetical indexes as they're used for their estimation.
+	 */
+	initStringInfo(&snapshot);
+	hypo_snapshot_serialize(&snapshot);
+	hypo_parallel_write(buf, &snapshot.len, sizeof(int));
+	hypo_parallel_write(buf, snapshot.data, snapshot.len);
+	pfree(snapshot.data);
+
+	nb = list_length(script);
+	hypo_parallel_write(buf, &nb, sizeof(int));
+	foreach(lc, script)
+		hypo_parallel_write_string(buf, (char *) lfirst(lc));
+
+	/* Number of tuples computed by hypopg_analyze() */
+	nb = 0;
+	if (hypoTables)
+	{
+		HASH_SEQ_STATUS hash_seq;
+		hypoTable  *entry;
+
+		hash_seq_init(&hash_seq, hypoTables);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		{
+			if (entry->set_tuples)
+				nb++;
+		}
+	}
+	hypo_parallel_write(buf, &nb, sizeof(int));
+	if (nb > 0)
+	{
+		HASH_SEQ_STATUS hash_seq;
+		hypoTable  *entry;
+
+		hash_seq_init(&hash_seq, hypoTables);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		{
+			if (!entry->set_tuples)
+				continue;
+
+			hypo_parallel_write_rel(buf, entry->oid);
+			hypo_parallel_write(buf, &entry->tuples, sizeof(int));
+		}
+	}
+
+	/* Statistics computed by hypopg_analyze() */
+	nb = hypoStatsHash ? (int) hash_get_num_entries(hypoStatsHash) : 0;
+	hypo_parallel_write(buf, &nb, sizeof(int));
+	if (nb > 0)
+	{
+		HASH_SEQ_STATUS hash_seq;
+		hypoStatsEntry *entry;
+
+		hash_seq_init(&hash_seq, hypoStatsHash);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		{
+			uint32		len = entry->statsTuple->t_len;
+
+			hypo_parallel_write_rel(buf, entry->key.relid);
+			hypo_parallel_write(buf, &entry->key.attnum, sizeof(AttrNumber));
+			hypo_parallel_write(buf, &len, sizeof(uint32));
+			hypo_parallel_write(buf, entry->statsTuple->t_data, len);
+		}
+	}
+
+	/* Hypothetical extended statistics */
+	nb = list_length(hypoStatsExts);
+	hypo_parallel_write(buf, &nb, sizeof(int));
+	foreach(lc, hypoStatsExts)
+	{
+		hypoStatsExt *entry = (hypoStatsExt *) lfirst(lc);
+		ListCell   *lc2;
+		char	   *statname;
+		int			i,
+					k;
+
+		/* Remove the <oid> prefix, a new oid will be generated */
+		statname = strchr(entry->statname, '>');
+		statname = statname ? statname + 1 : entry->statname;
+
+		hypo_parallel_write_string(buf, statname);
+		hypo_parallel_write(buf, &entry->relid, sizeof(Oid));
+		hypo_parallel_write(buf, &entry->fraction, sizeof(float4));
+		hypo_parallel_write(buf, &entry->nkeys, sizeof(int));
+		hypo_parallel_write(buf, entry->keys, sizeof(AttrNumber) * entry->nkeys);
+		hypo_parallel_write(buf, entry->eqopr, sizeof(Oid) * entry->nkeys);
+		hypo_parallel_write(buf, entry->typlen, sizeof(int16) * entry->nkeys);
+		hypo_parallel_write(buf, entry->typbyval, sizeof(bool) * entry->nkeys);
+		hypo_parallel_write(buf, &entry->has_ndistinct, sizeof(bool));
+		hypo_parallel_write(buf, &entry->has_dependencies, sizeof(bool));
+		hypo_parallel_write(buf, &entry->has_mcv, sizeof(bool));
+
+		nb = list_length(entry->ndistinct);
+		hypo_parallel_write(buf, &nb, sizeof(int));
+		foreach(lc2, entry->ndistinct)
+		{
+			hypoNdistinct *item = (hypoNdistinct *) lfirst(lc2);
+			int			mask = 0;
+
+			k = -1;
+			while ((k = bms_next_member(item->keys, k)) >= 0)
+				mask |= (1 << k);
+
+			hypo_parallel_write(buf, &mask, sizeof(int));
+			hypo_parallel_write(buf, &item->ndistinct, sizeof(double));
+		}
+
+		nb = list_length(entry->dependencies);
+		hypo_parallel_write(buf, &nb, sizeof(int));
+		foreach(lc2, entry->dependencies)
+			hypo_parallel_write(buf, lfirst(lc2), sizeof(hypoDependency));
+
+		hypo_parallel_write(buf, &entry->nmcv, sizeof(int));
+		hypo_parallel_write(buf, &entry->mcv_totalfreq, sizeof(double));
+		for (i = 0; i < entry->nmcv; i++)
+		{
+			hypoMCVItem *item = &entry->mcv[i];
+
+			hypo_parallel_write(buf, &item->frequency, sizeof(double));
+			for (k = 0; k < entry->nkeys; k++)
+			{
+				char	   *ptr;
+
+				enlargeStringInfo(buf,
+								  datumEstimateSpace(item->values[k],
+													 item->isnull[k],
+													 entry->typbyval[k],
+													 entry->typlen[k]));
+				ptr = buf->data + buf->len;
+				datumSerialize(item->values[k], item->isnull[k],
+							   entry->typbyval[k], entry->typlen[k], &ptr);
+				buf->len = ptr - buf->data;
+			}
+		}
+	}
+
+	/* Cost calibration, to predict the latencies */
+	nb = list_length(hypoCalibrations);
+	hypo_parallel_write(buf, &nb, sizeof(int));
+	foreach(lc, hypoCalibrations)
+		hypo_parallel_write(buf, lfirst(lc), sizeof(hypoCalibration));
+}
+
+/*
+ * Rebuild all the hypothetical objects from the given serialized state.
+ */
+static void
+hypo_parallel_restore(StringInfo buf)
+{
+	StringInfoData snapshot;
+	int			nb;
+	int			i;
+	int			ret;
+
+	/* Import the statistics snapshot */
+	hypo_parallel_read(buf, &snapshot.len, sizeof(int));
+	if (snapshot.len < 0 || buf->cursor + snapshot.len > buf->len)
+		elog(ERROR, "hypopg: invalid serialized hypothetical state");
+	snapshot.data = buf->data + buf->cursor;
+	snapshot.maxlen = snapshot.len;
+	snapshot.cursor = 0;
+	buf->cursor += snapshot.len;
+	hypo_snapshot_import(&snapshot);
+
+	/* Replay the orders creating the partitions and the indexes */
+	if ((ret = SPI_connect()) < 0)
+		/* internal error */
+		elog(ERROR, "hypopg: SPI_connect returned %d", ret);
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+	{
+		char	   *sql = hypo_parallel_read_string(buf);
+
+		ret = SPI_execute(sql, false, 0);
+		if (ret != SPI_OK_SELECT)
+			elog(ERROR, "hypopg: could not execute \"%s\": SPI_execute returned %d",
+				 sql, ret);
+	}
+
+	SPI_finish();
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+	{
+		Oid			relid = hypo_parallel_read_rel(buf);
+		hypoTable  *table = hypo_find_table(relid, false);
+
+		hypo_parallel_read(buf, &table->tuples, sizeof(int));
+		table->set_tuples = true;
+	}
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+	{
+		Oid			relid = hypo_parallel_read_rel(buf);
+		AttrNumber	attnum;
+		HeapTupleData tuple;
+		uint32		len;
+
+		hypo_parallel_read(buf, &attnum, sizeof(AttrNumber));
+		hypo_parallel_read(buf, &len, sizeof(uint32));
+
+		if (buf->cursor + len > buf->len)
+			elog(ERROR, "hypopg: invalid serialized hypothetical state");
+
+		memset(&tuple, 0, sizeof(HeapTupleData));
+		tuple.t_len = len;
+		tuple.t_data = (HeapTupleHeader) palloc(len);
+		hypo_parallel_read(buf, tuple.t_data, len);
+		ItemPointerSetInvalid(&tuple.t_self);
+		tuple.t_tableOid = InvalidOid;
+
+		hypo_stat_store(relid, attnum, &tuple);
+		pfree(tuple.t_data);
+	}
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+		hypo_parallel_restore_stats_ext(buf);
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+	{
+		MemoryContext oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+		hypoCalibration *entry;
+
+		entry = (hypoCalibration *) palloc(sizeof(hypoCalibration));
+		hypo_parallel_read(buf, entry, sizeof(hypoCalibration));
+		hypoCalibrations = lappend(hypoCalibrations, entry);
+		MemoryContextSwitchTo(oldcontext);
+	}
+}
+
+/*
+ * Rebuild a single hypothetical extended statistics from the serialized
+ * state.
+ */
+static void
+hypo_parallel_restore_stats_ext(StringInfo buf)
+{
+	hypoStatsExt *entry;
+	MemoryContext oldcontext;
+	char	   *statname = hypo_parallel_read_string(buf);
+	int			nb;
+	int			i,
+				k;
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+
+	entry = (hypoStatsExt *) palloc0(sizeof(hypoStatsExt));
+	hypo_parallel_read(buf, &entry->relid, sizeof(Oid));
+	hypo_parallel_read(buf, &entry->fraction, sizeof(float4));
+	hypo_parallel_read(buf, &entry->nkeys, sizeof(int));
+
+	if (entry->nkeys < 2 || entry->nkeys > STATS_MAX_DIMENSIONS)
+		elog(ERROR, "hypopg: invalid serialized hypothetical state");
+
+	entry->oid = hypo_getNewOid(entry->relid);
+	entry->statname = psprintf("<%d>%s", entry->oid, statname);
+	entry->keys = (AttrNumber *) palloc(sizeof(AttrNumber) * entry->nkeys);
+	entry->eqopr = (Oid *) palloc(sizeof(Oid) * entry->nkeys);
+	entry->typlen = (int16 *) palloc(sizeof(int16) * entry->nkeys);
+	entry->typbyval = (bool *) palloc(sizeof(bool) * entry->nkeys);
+
+	hypo_parallel_read(buf, entry->keys, sizeof(AttrNumber) * entry->nkeys);
+	hypo_parallel_read(buf, entry->eqopr, sizeof(Oid) * entry->nkeys);
+	hypo_parallel_read(buf, entry->typlen, sizeof(int16) * entry->nkeys);
+	hypo_parallel_read(buf, entry->typbyval, sizeof(bool) * entry->nkeys);
+	hypo_parallel_read(buf, &entry->has_ndistinct, sizeof(bool));
+	hypo_parallel_read(buf, &entry->has_dependencies, sizeof(bool));
+	hypo_parallel_read(buf, &entry->has_mcv, sizeof(bool));
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+	{
+		hypoNdistinct *item = (hypoNdistinct *) palloc0(sizeof(hypoNdistinct));
+		int			mask;
+
+		hypo_parallel_read(buf, &mask, sizeof(int));
+		hypo_parallel_read(buf, &item->ndistinct, sizeof(double));
+
+		for (k = 0; k < entry->nkeys; k++)
+		{
+			if (mask & (1 << k))
+				item->keys = bms_add_member(item->keys, k);
+		}
+
+		entry->ndistinct = lappend(entry->ndistinct, item);
+	}
+
+	hypo_parallel_read(buf, &nb, sizeof(int));
+	for (i = 0; i < nb; i++)
+	{
+		hypoDependency *dep = (hypoDependency *) palloc(sizeof(hypoDependency));
+
+		hypo_parallel_read(buf, dep, sizeof(hypoDependency));
+		entry->dependencies = lappend(entry->dependencies, dep);
+	}
+
+	hypo_parallel_read(buf, &entry->nmcv, sizeof(int));
+	hypo_parallel_read(buf, &entry->mcv_totalfreq, sizeof(double));
+	if (entry->nmcv > 0)
+		entry->mcv = (hypoMCVItem *) palloc0(sizeof(hypoMCVItem) * entry->nmcv);
+	for (i = 0; i < entry->nmcv; i++)
+	{
+		hypoMCVItem *item = &entry->mcv[i];
+		char	   *ptr;
+
+		item->values = (Datum *) palloc0(sizeof(Datum) * entry->nkeys);
+		item->isnull = (bool *) palloc0(sizeof(bool) * entry->nkeys);
+		hypo_parallel_read(buf, &item->frequency, sizeof(double));
+
+		ptr = buf->data + buf->cursor;
+		for (k = 0; k < entry->nkeys; k++)
+			item->values[k] = datumRestore(&ptr, &item->isnull[k]);
+		buf->cursor = ptr - buf->data;
+
+		if (buf->cursor > buf->len)
+			elog(ERROR, "hypopg: invalid serialized hypothetical state");
+	}
+
+	hypoStatsExts = lappend(hypoStatsExts, entry);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Plan the given query in a subtransaction, and store its estimated costs or
+ * the error message in the given result.
+ */
+static void
+hypo_parallel_plan_one(const char *sql, int worker, hypoParallelResult *result)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	ResourceOwner oldowner = CurrentResourceOwner;
+	MemoryContext plan_context;
+
+	plan_context = AllocSetContextCreate(oldcontext,
+										 "hypopg parallel plan",
+										 ALLOCSET_DEFAULT_SIZES);
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(plan_context);
+
+	PG_TRY();
+	{
+		Query	   *query = hypo_parse_query(sql, NULL, 0);
+		PlannedStmt *pstmt = hypo_plan_query(query);
+
+		result->startup_cost = pstmt->planTree->startup_cost;
+		result->total_cost = pstmt->planTree->total_cost;
+		result->plan_rows = pstmt->planTree->plan_rows;
+		result->predicted_ms = hypo_predict_latency(pstmt);
+		result->failed = false;
+
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		MemoryContextSwitchTo(plan_context);
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+
+		result->failed = true;
+		strlcpy(result->errmsg, edata->message, HYPO_PARALLEL_ERRMSG_LEN);
+	}
+	PG_END_TRY();
+
+	MemoryContextDelete(plan_context);
+
+	result->worker = worker;
+	pg_write_barrier();
+	result->done = true;
+}
+
+/*
+ * Plan queries of the workload until there's no more query to plan.
+ */
+static void
+hypo_parallel_plan_queries(hypoParallelShared *shared, char *queries,
+						   hypoParallelResult *results, int worker)
+{
+	Size	   *offsets = (Size *) queries;
+
+	for (;;)
+	{
+		uint32		i = pg_atomic_fetch_add_u32(&shared->next_query, 1);
+
+		if (i >= shared->nqueries)
+			break;
+
+		CHECK_FOR_INTERRUPTS();
+
+		hypo_parallel_plan_one(queries + offsets[i], worker, &results[i]);
+	}
+}
+
+/*
+ * Entry point of the background workers.
+ */
+void
+hypo_parallel_worker_main(Datum main_arg)
+{
+	dsm_segment *seg;
+	shm_toc    *toc;
+	hypoParallelShared *shared;
+	StringInfoData state;
+	char	   *queries;
+	hypoParallelResult *results;
+	char	   *gucstate;
+	int			worker;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "hypopg parallel worker");
+
+	seg = dsm_attach(DatumGetUInt32(main_arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("hypopg: could not map dynamic shared memory segment")));
+
+	toc = shm_toc_attach(HYPO_PARALLEL_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("hypopg: bad magic number in dynamic shared memory segment")));
+
+	shared = shm_toc_lookup(toc, HYPO_PARALLEL_KEY_SHARED, false);
+	queries = shm_toc_lookup(toc, HYPO_PARALLEL_KEY_QUERIES, false);
+	results = shm_toc_lookup(toc, HYPO_PARALLEL_KEY_RESULTS, false);
+	gucstate = shm_toc_lookup(toc, HYPO_PARALLEL_KEY_GUC, false);
+
+	state.data = shm_toc_lookup(toc, HYPO_PARALLEL_KEY_STATE, false);
+	state.len = shared->state_len;
+	state.maxlen = shared->state_len;
+	state.cursor = 0;
+
+	memcpy(&worker, MyBgworkerEntry->bgw_extra, sizeof(int));
+
+	BackgroundWorkerInitializeConnectionByOid(shared->database_id,
+											  shared->user_id
+#if PG_VERSION_NUM >= 110000
+											  ,0
+#endif
+		);
+
+	StartTransactionCommand();
+
+	/*
+	 * Use the same settings as the leader, including the planner and hypopg
+	 * parameters, so that the queries are planned the same way.  As for the
+	 * parallel workers, this is done in a transaction as some check hooks
+	 * need to do catalog lookups.
+	 */
+	RestoreGUCState(gucstate);
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	hypo_parallel_restore(&state);
+	hypo_parallel_plan_queries(shared, queries, results, worker);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	dsm_detach(seg);
+	proc_exit(0);
+}
+#endif							/* PG_VERSION_NUM >= 100000 */
+
+/*
+ * SQL wrapper planning the given queries with the current hypothetical
+ * objects, using up to nb_workers dynamic background workers.
+ */
+Datum
+hypopg_parallel_evaluate(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	elog(ERROR, "hypopg: Parallel evaluation requires PostgreSQL 10 or above");
+	PG_RETURN_VOID();
+#else
+	ArrayType  *array = PG_GETARG_ARRAYTYPE_P(0);
+	int			nb_workers = PG_GETARG_INT32(1);
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nqueries;
+	StringInfoData state;
+	Size		queries_size;
+	shm_toc_estimator e;
+	Size		segsize;
+	dsm_segment *seg;
+	shm_toc    *toc;
+	hypoParallelShared *shared;
+	char	   *statebuf;
+	Size		gucsize;
+	char	   *gucstate;
+	char	   *queries;
+	Size	   *offsets;
+	hypoParallelResult *results;
+	BackgroundWorkerHandle **handles;
+	int			nlaunched = 0;
+	int			i;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	if (nb_workers < 0)
+		elog(ERROR, "hypopg: invalid number of workers: %d", nb_workers);
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	deconstruct_array(array, TEXTOID, -1, false, 'i', &elems, &nulls,
+					  &nqueries);
+
+	/* Serialize the hypothetical state and the queries */
+	initStringInfo(&state);
+	hypo_parallel_serialize(&state);
+
+	queries_size = sizeof(Size) * nqueries;
+	for (i = 0; i < nqueries; i++)
+	{
+		if (nulls[i])
+			elog(ERROR, "hypopg: queries must not be NULL");
+
+		queries_size += VARSIZE_ANY_EXHDR(DatumGetPointer(elems[i])) + 1;
+	}
+
+	/* Don't launch more workers than needed */
+	nb_workers = Min(nb_workers, nqueries);
+
+	gucsize = EstimateGUCStateSpace();
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, sizeof(hypoParallelShared));
+	shm_toc_estimate_chunk(&e, state.len);
+	shm_toc_estimate_chunk(&e, gucsize);
+	shm_toc_estimate_chunk(&e, queries_size);
+	shm_toc_estimate_chunk(&e, mul_size(sizeof(hypoParallelResult),
+										Max(nqueries, 1)));
+	shm_toc_estimate_keys(&e, 5);
+	segsize = shm_toc_estimate(&e);
+
+	seg = dsm_create(segsize, 0);
+	toc = shm_toc_create(HYPO_PARALLEL_MAGIC, dsm_segment_address(seg),
+						 segsize);
+
+	shared = shm_toc_allocate(toc, sizeof(hypoParallelShared));
+	shared->database_id = MyDatabaseId;
+	shared->user_id = GetUserId();
+	shared->nqueries = nqueries;
+	shared->state_len = state.len;
+	pg_atomic_init_u32(&shared->next_query, 0);
+	shm_toc_insert(toc, HYPO_PARALLEL_KEY_SHARED, shared);
+
+	statebuf = shm_toc_allocate(toc, state.len);
+	memcpy(statebuf, state.data, state.len);
+	shm_toc_insert(toc, HYPO_PARALLEL_KEY_STATE, statebuf);
+	pfree(state.data);
+
+	gucstate = shm_toc_allocate(toc, gucsize);
+	SerializeGUCState(gucsize, gucstate);
+	shm_toc_insert(toc, HYPO_PARALLEL_KEY_GUC, gucstate);
+
+	queries = shm_toc_allocate(toc, queries_size);
+	offsets = (Size *) queries;
+	{
+		Size		off = sizeof(Size) * nqueries;
+
+		for (i = 0; i < nqueries; i++)
+		{
+			text	   *t = DatumGetTextPP(elems[i]);
+			Size		len = VARSIZE_ANY_EXHDR(t);
+
+			offsets[i] = off;
+			memcpy(queries + off, VARDATA_ANY(t), len);
+			queries[off + len] = '\0';
+			off += len + 1;
+		}
+	}
+	shm_toc_insert(toc, HYPO_PARALLEL_KEY_QUERIES, queries);
+
+	results = shm_toc_allocate(toc, mul_size(sizeof(hypoParallelResult),
+											 Max(nqueries, 1)));
+	memset(results, 0, sizeof(hypoParallelResult) * nqueries);
+	shm_toc_insert(toc, HYPO_PARALLEL_KEY_RESULTS, results);
+
+	/* Launch the workers, and plan queries in the leader too */
+	handles = (BackgroundWorkerHandle **)
+		palloc0(sizeof(BackgroundWorkerHandle *) * Max(nb_workers, 1));
+
+	PG_TRY();
+	{
+		for (i = 0; i < nb_workers; i++)
+		{
+			BackgroundWorker worker;
+			int			worker_num = i + 1;
+
+			memset(&worker, 0, sizeof(worker));
+			worker.bgw_flags = BGWORKER_SHMEM_ACCESS |
+				BGWORKER_BACKEND_DATABASE_CONNECTION;
+			worker.bgw_start_time = BgWorkerStart_ConsistentState;
+			worker.bgw_restart_time = BGW_NEVER_RESTART;
+			snprintf(worker.bgw_library_name, BGW_MAXLEN, "hypopg");
+			snprintf(worker.bgw_function_name, BGW_MAXLEN,
+					 "hypo_parallel_worker_main");
+			snprintf(worker.bgw_name, BGW_MAXLEN,
+					 "hypopg parallel worker %d for PID %d",
+					 worker_num, MyProcPid);
+#if PG_VERSION_NUM >= 110000
+			snprintf(worker.bgw_type, BGW_MAXLEN, "hypopg parallel worker");
+#endif
+			worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(seg));
+			worker.bgw_notify_pid = MyProcPid;
+			memcpy(worker.bgw_extra, &worker_num, sizeof(int));
+
+			/* Not enough background worker slots, use what we have */
+			if (!RegisterDynamicBackgroundWorker(&worker, &handles[i]))
+				break;
+
+			nlaunched++;
+		}
+
+		hypo_parallel_plan_queries(shared, queries, results, 0);
+
+		for (i = 0; i < nlaunched; i++)
+			WaitForBackgroundWorkerShutdown(handles[i]);
+
+		/*
+		 * Plan the queries a failing worker couldn't plan, and the ones that
+		 * failed in a worker.  The workers use their own transaction, so they
+		 * can't see the temporary tables of the leader, nor the relations
+		 * created in its current transaction.
+		 */
+		pg_read_barrier();
+		for (i = 0; i < nqueries; i++)
+		{
+			if (!results[i].done ||
+				(results[i].failed && results[i].worker != 0))
+				hypo_parallel_plan_one(queries + offsets[i], 0, &results[i]);
+		}
+	}
+	PG_CATCH();
+	{
+		for (i = 0; i < nlaunched; i++)
+			TerminateBackgroundWorker(handles[i]);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/* Build the result set */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	for (i = 0; i < nqueries; i++)
+	{
+		hypoParallelResult *result = &results[i];
+		Datum		values[HYPO_PARALLEL_NB_COLS];
+		bool		nulls[HYPO_PARALLEL_NB_COLS];
+		int			j = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[j++] = Int32GetDatum(i + 1);
+		values[j++] = Int32GetDatum(result->worker);
+		if (result->failed)
+		{
+			nulls[j++] = true;
+			nulls[j++] = true;
+			nulls[j++] = true;
+			nulls[j++] = true;
+			values[j++] = CStringGetTextDatum(result->errmsg);
+		}
+		else
+		{
+			values[j++] = Float8GetDatum(result->startup_cost);
+			values[j++] = Float8GetDatum(result->total_cost);
+			values[j++] = Float8GetDatum(result->plan_rows);
+			if (result->predicted_ms >= 0)
+				values[j++] = Float8GetDatum(result->predicted_ms);
+			else
+				nulls[j++] = true;
+			nulls[j++] = true;
+		}
+
+		Assert(j == HYPO_PARALLEL_NB_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	dsm_detach(seg);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+#endif
+}
@@ -0,0 +1,895 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_reloptions.c: Implementation of hypothetical storage parameters for
+ * PostgreSQL
+ *
+ * This file contains all the internal code related to hypothetical storage
+ * parameters and column types of real tables.
+ *
+ * The storage parameters and column types don't change the number of tuples
+ * of a table, only the way they're stored.  The number of heap pages the
+ * table would have once rewritten is estimated from the average width and
+ * alignment of its columns, with both the real and the hypothetical storage
+ * parameters and column types, and the number of pages seen by the planner
+ * is scaled by the ratio of both estimations, so that any bloat of the real
+ * table is preserved.  The real indexes containing a column with an
+ * hypothetical type are scaled the same way.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <math.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
+#include "access/reloptions.h"
+#include "access/tuptoaster.h"
+#include "access/tupmacs.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "parser/parse_type.h"
+#include "storage/bufmgr.h"
+#include "storage/bufpage.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#include "include/hypopg.h"
+#include "include/hypopg_index.h"
+#include "include/hypopg_reloptions.h"
+
+/*--- Variables exported ---*/
+
+List	   *hypoRelOptionsList = NIL;
+List	   *hypoColumnTypes = NIL;
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_set_table_options);
+PG_FUNCTION_INFO_V1(hypopg_reset_table_options);
+PG_FUNCTION_INFO_V1(hypopg_table_options);
+PG_FUNCTION_INFO_V1(hypopg_alter_column_type);
+PG_FUNCTION_INFO_V1(hypopg_reset_column_types);
+PG_FUNCTION_INFO_V1(hypopg_column_types);
+
+static int	hypo_reloptions_real_toast_target(Relation relation);
+static double hypo_reloptions_estimate_pages(Relation relation, double tuples,
+							   int fillfactor, int toast_tuple_target,
+							   bool use_coltypes, double *toast_pages);
+static void hypo_column_type_changed(void);
+static BlockNumber hypo_reloptions_get_pages(hypoRelOptions *entry,
+						  Relation relation, BlockNumber pages,
+						  double tuples, double *toast_pages);
+
+
+/*
+ * Remove all the hypothetical storage parameters
+ */
+void
+hypo_reloptions_reset(void)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoRelOptionsList)
+	{
+		hypoRelOptions *entry = (hypoRelOptions *) lfirst(lc);
+
+		pfree(DatumGetPointer(entry->options));
+		pfree(entry);
+	}
+
+	list_free(hypoRelOptionsList);
+	hypoRelOptionsList = NIL;
+}
+
+/*
+ * Remove the hypothetical storage parameters of the given table.  Return
+ * true if the table had any.
+ */
+bool
+hypo_reloptions_remove(Oid relid)
+{
+	hypoRelOptions *entry = hypo_find_reloptions(relid);
+
+	if (entry == NULL)
+		return false;
+
+	hypoRelOptionsList = list_delete_ptr(hypoRelOptionsList, entry);
+	pfree(DatumGetPointer(entry->options));
+	pfree(entry);
+
+	return true;
+}
+
+/*
+ * Return the hypothetical storage parameters of the given table, or NULL if
+ * it doesn't have any.
+ */
+hypoRelOptions *
+hypo_find_reloptions(Oid relid)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoRelOptionsList)
+	{
+		hypoRelOptions *entry = (hypoRelOptions *) lfirst(lc);
+
+		if (entry->relid == relid)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Return the given hypothetical storage parameters as a text[] SQL
+ * expression.
+ */
+char *
+hypo_reloptions_deparse(hypoRelOptions *entry)
+{
+	StringInfoData buf;
+	List	   *options = untransformRelOptions(entry->options);
+	ListCell   *lc;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "ARRAY[");
+
+	foreach(lc, options)
+	{
+		DefElem    *elem = (DefElem *) lfirst(lc);
+		char	   *option;
+
+		option = psprintf("%s=%s", elem->defname, strVal(elem->arg));
+		appendStringInfo(&buf, "%s%s", (lc == list_head(options) ? "" : ", "),
+						 quote_literal_cstr(option));
+	}
+
+	appendStringInfoString(&buf, "]::text[]");
+
+	return buf.data;
+}
+
+/* Return the real toast_tuple_target of the given relation */
+static int
+hypo_reloptions_real_toast_target(Relation relation)
+{
+#if PG_VERSION_NUM >= 110000
+	return RelationGetToastTupleTarget(relation, TOAST_TUPLE_TARGET);
+#else
+	return TOAST_TUPLE_TARGET;
+#endif
+}
+
+/*
+ * Estimate the number of heap pages the given relation would have once
+ * rewritten with the given storage parameters, and the number of pages of
+ * its TOAST table, using the average width and alignment of each column.  If
+ * use_coltypes is true, the hypothetical column types are used instead of the
+ * real ones.
+ *
+ * Values bigger than the TOAST pointer of the toastable columns are moved to
+ * the TOAST table, biggest first, as long as the tuple is bigger than the
+ * TOAST threshold and target.  Note that the average width of the values
+ * already moved to the TOAST table is the one of the TOAST pointer, so a
+ * bigger toast_tuple_target can't bring them back in the heap.
+ */
+static double
+hypo_reloptions_estimate_pages(Relation relation, double tuples,
+							   int fillfactor, int toast_tuple_target,
+							   bool use_coltypes, double *toast_pages)
+{
+	TupleDesc	tupdesc = RelationGetDescr(relation);
+	int32	   *widths;
+	bool	   *toastable;
+	int32		data_width = 0;
+	int32		tuple_width;
+	double		toast_bytes = 0;
+	double		tuples_per_page;
+	int			i;
+
+	widths = (int32 *) palloc0(sizeof(int32) * tupdesc->natts);
+	toastable = (bool *) palloc0(sizeof(bool) * tupdesc->natts);
+
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+		hypoColumnType *coltype = NULL;
+		int16		attlen = att->attlen;
+		char		attalign = att->attalign;
+		char		attstorage = att->attstorage;
+
+		if (att->attisdropped)
+			continue;
+
+		widths[i] = get_attavgwidth(RelationGetRelid(relation), att->attnum);
+		if (widths[i] <= 0)
+			widths[i] = get_typavgwidth(att->atttypid, att->atttypmod);
+
+		if (use_coltypes)
+			coltype = hypo_find_column_type(RelationGetRelid(relation),
+											att->attnum);
+		if (coltype)
+		{
+			widths[i] = hypo_column_type_width(coltype, widths[i]);
+			attlen = coltype->typlen;
+			attalign = coltype->typalign;
+			attstorage = coltype->typstorage;
+		}
+
+		toastable[i] = (attlen == -1 &&
+						(attstorage == 'x' || attstorage == 'e'));
+
+		/* Short varlena values are not aligned */
+		if (attlen > 0)
+			data_width = att_align_nominal(data_width, attalign);
+
+		data_width += widths[i];
+	}
+
+	tuple_width = MAXALIGN(SizeofHeapTupleHeader) + MAXALIGN(data_width);
+
+	/* Move the biggest toastable values out of line */
+	if (tuple_width > TOAST_TUPLE_THRESHOLD)
+	{
+		while (tuple_width > toast_tuple_target)
+		{
+			int			biggest = -1;
+
+			for (i = 0; i < tupdesc->natts; i++)
+			{
+				if (!toastable[i])
+					continue;
+
+				if (widths[i] > TOAST_POINTER_SIZE &&
+					(biggest == -1 || widths[i] > widths[biggest]))
+					biggest = i;
+			}
+
+			if (biggest == -1)
+				break;
+
+			toast_bytes += widths[biggest];
+			data_width -= widths[biggest] - TOAST_POINTER_SIZE;
+			widths[biggest] = TOAST_POINTER_SIZE;
+			tuple_width = MAXALIGN(SizeofHeapTupleHeader) + MAXALIGN(data_width);
+		}
+	}
+
+	pfree(widths);
+	pfree(toastable);
+
+	if (toast_pages)
+		*toast_pages = ceil(tuples * ceil(toast_bytes / TOAST_MAX_CHUNK_SIZE) /
+							EXTERN_TUPLES_PER_PAGE);
+
+	tuples_per_page = floor((double) (BLCKSZ - SizeOfPageHeaderData) *
+							fillfactor / 100 /
+							(tuple_width + sizeof(ItemIdData)));
+	tuples_per_page = Max(tuples_per_page, 1);
+	tuples_per_page = Min(tuples_per_page, MaxHeapTuplesPerPage);
+
+	return ceil(tuples / tuples_per_page);
+}
+
+/*
+ * Return the number of heap pages the given relation would have with the
+ * given hypothetical storage parameters, if any, and its hypothetical column
+ * types, from its current number of pages and tuples, and optionally the
+ * estimated number of pages of its TOAST table.
+ */
+static BlockNumber
+hypo_reloptions_get_pages(hypoRelOptions *entry, Relation relation,
+						  BlockNumber pages, double tuples,
+						  double *toast_pages)
+{
+	int			fillfactor;
+	int			toast_tuple_target;
+	double		real_pages;
+	double		hypo_pages;
+
+	fillfactor = RelationGetFillFactor(relation, HEAP_DEFAULT_FILLFACTOR);
+	toast_tuple_target = hypo_reloptions_real_toast_target(relation);
+
+	real_pages = hypo_reloptions_estimate_pages(relation, tuples, fillfactor,
+												toast_tuple_target, false,
+												NULL);
+
+	if (entry && entry->fillfactor != -1)
+		fillfactor = entry->fillfactor;
+	if (entry && entry->toast_tuple_target != -1)
+		toast_tuple_target = entry->toast_tuple_target;
+
+	hypo_pages = hypo_reloptions_estimate_pages(relation, tuples, fillfactor,
+												toast_tuple_target, true,
+												toast_pages);
+
+	elog(DEBUG1, "hypopg: storage of \"%s\": %.0f pages instead of %.0f",
+		 RelationGetRelationName(relation), hypo_pages, real_pages);
+
+	if (pages == 0 || real_pages <= 0)
+		return pages;
+
+	return (BlockNumber) Max(ceil(pages * hypo_pages / real_pages), 1);
+}
+
+/*
+ * Scale the number of pages of the given relation according to its
+ * hypothetical storage parameters and column types, if any, and use its
+ * hypothetical number of parallel workers.  The width of
+ * the columns having an hypothetical type and the number of pages of the
+ * real indexes containing them are adjusted too.  This has to be called
+ * before any hypothetical index is added to the relation's indexlist.
+ */
+void
+hypo_reloptions_apply(PlannerInfo *root, Relation relation, RelOptInfo *rel)
+{
+	Oid			relid = RelationGetRelid(relation);
+	hypoRelOptions *entry = hypo_find_reloptions(relid);
+	bool		has_coltypes = false;
+	ListCell   *lc;
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		if (coltype->relid != relid)
+			continue;
+
+		has_coltypes = true;
+
+		/* The planner uses the cached width if any to compute the rows width */
+		if (coltype->attnum >= rel->min_attr &&
+			coltype->attnum <= rel->max_attr)
+			rel->attr_widths[coltype->attnum - rel->min_attr] =
+				hypo_column_type_width(coltype,
+									   get_attavgwidth(relid, coltype->attnum));
+	}
+
+	if (entry == NULL && !has_coltypes)
+		return;
+
+#if PG_VERSION_NUM >= 90600
+	/* Used by the planner to compute the number of parallel workers */
+	if (entry && entry->parallel_workers != -1)
+		rel->rel_parallel_workers = entry->parallel_workers;
+#endif
+
+	/* Nothing else to do if only the parallel workers are hypothetical */
+	if (!has_coltypes && entry->fillfactor == -1 &&
+		entry->toast_tuple_target == -1)
+		return;
+
+	if (rel->tuples > 0)
+		rel->pages = hypo_reloptions_get_pages(entry, relation, rel->pages,
+											   rel->tuples, NULL);
+
+	if (!has_coltypes)
+		return;
+
+	foreach(lc, rel->indexlist)
+	{
+		IndexOptInfo *index = (IndexOptInfo *) lfirst(lc);
+
+		index->pages = hypo_estimate_real_index_pages(root, rel, relid, index);
+	}
+}
+
+/*
+ * Remove all the hypothetical column types
+ */
+void
+hypo_column_type_reset(void)
+{
+	if (hypoColumnTypes == NIL)
+		return;
+
+	list_free_deep(hypoColumnTypes);
+	hypoColumnTypes = NIL;
+
+	hypo_column_type_changed();
+}
+
+/*
+ * Remove the hypothetical type of the given column, or of all the columns of
+ * the given table if attnum is InvalidAttrNumber.  Return true if any was
+ * removed.
+ */
+bool
+hypo_column_type_remove(Oid relid, AttrNumber attnum)
+{
+	List	   *to_remove = NIL;
+	ListCell   *lc;
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		if (coltype->relid == relid &&
+			(attnum == InvalidAttrNumber || coltype->attnum == attnum))
+			to_remove = lappend(to_remove, coltype);
+	}
+
+	if (to_remove == NIL)
+		return false;
+
+	foreach(lc, to_remove)
+	{
+		hypoColumnTypes = list_delete_ptr(hypoColumnTypes, lfirst(lc));
+		pfree(lfirst(lc));
+	}
+	list_free(to_remove);
+
+	hypo_column_type_changed();
+
+	return true;
+}
+
+/*
+ * Return the hypothetical type of the given column, or NULL if it doesn't
+ * have any.
+ */
+hypoColumnType *
+hypo_find_column_type(Oid relid, AttrNumber attnum)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+
+		if (coltype->relid == relid && coltype->attnum == attnum)
+			return coltype;
+	}
+
+	return NULL;
+}
+
+/*
+ * Check that the column having the given hypothetical type still exists with
+ * the same real type.
+ */
+bool
+hypo_column_type_is_valid(hypoColumnType *coltype)
+{
+	HeapTuple	tuple;
+	Form_pg_attribute att;
+	bool		valid;
+
+	tuple = SearchSysCache2(ATTNUM, ObjectIdGetDatum(coltype->relid),
+							Int16GetDatum(coltype->attnum));
+	if (!HeapTupleIsValid(tuple))
+		return false;
+
+	att = (Form_pg_attribute) GETSTRUCT(tuple);
+	valid = (!att->attisdropped && att->atttypid == coltype->atttypid);
+	ReleaseSysCache(tuple);
+
+	return valid;
+}
+
+/*
+ * Return the average width of a column with the given hypothetical type,
+ * given the average width of the real column, or 0 if unknown.  If both the
+ * real and the hypothetical types are variable length, the real width is
+ * kept.
+ */
+int32
+hypo_column_type_width(hypoColumnType *coltype, int32 width)
+{
+	if (coltype->typlen > 0)
+		return coltype->typlen;
+
+	if (coltype->attlen == -1 && width > 0)
+		return width;
+
+	return get_typavgwidth(coltype->typid, coltype->typmod);
+}
+
+/*
+ * Return the arguments of the hypopg_alter_column_type() call creating the
+ * given hypothetical column type.
+ */
+char *
+hypo_column_type_deparse(hypoColumnType *coltype)
+{
+	char	   *attname;
+
+#if PG_VERSION_NUM >= 110000
+	attname = get_attname(coltype->relid, coltype->attnum, false);
+#else
+	attname = get_attname(coltype->relid, coltype->attnum);
+#endif
+
+	return psprintf("%u::regclass, %s, %s", coltype->relid,
+					quote_literal_cstr(attname),
+					quote_literal_cstr(format_type_with_typemod(coltype->typid,
+																coltype->typmod)));
+}
+
+/*
+ * The cached average width of the hypothetical indexes depends on the
+ * hypothetical column types, so force them to be computed again.
+ */
+static void
+hypo_column_type_changed(void)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoIndexes)
+	{
+		hypoIndex  *entry = (hypoIndex *) lfirst(lc);
+
+		entry->avg_width = -1;
+	}
+}
+
+/*
+ * SQL wrapper to set the hypothetical storage parameters of a table, given
+ * in the same format as pg_class.reloptions.  An empty array removes them.
+ */
+Datum
+hypopg_set_table_options(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	ArrayType  *array = PG_GETARG_ARRAYTYPE_P(1);
+	hypoRelOptions *entry;
+	StdRdOptions *rdopts;
+	List	   *options;
+	ListCell   *lc;
+	char		relkind = get_rel_relkind(relid);
+	MemoryContext oldcontext;
+	int			fillfactor = -1;
+	int			toast_tuple_target = -1;
+	int			parallel_workers = -1;
+
+	if (relkind != RELKIND_RELATION
+#if PG_VERSION_NUM >= 90300
+		&& relkind != RELKIND_MATVIEW
+#endif
+		)
+		elog(ERROR, "hypopg: \"%s\" is not a table", get_rel_name(relid));
+
+	hypo_reloptions_remove(relid);
+
+	if (ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array)) == 0)
+		PG_RETURN_VOID();
+
+	/* Validate the options the same way ALTER TABLE does */
+	rdopts = (StdRdOptions *) heap_reloptions(RELKIND_RELATION,
+											  PointerGetDatum(array), true);
+
+	options = untransformRelOptions(PointerGetDatum(array));
+	foreach(lc, options)
+	{
+		DefElem    *elem = (DefElem *) lfirst(lc);
+
+		if (strcmp(elem->defname, "fillfactor") == 0)
+			fillfactor = rdopts->fillfactor;
+#if PG_VERSION_NUM >= 110000
+		else if (strcmp(elem->defname, "toast_tuple_target") == 0)
+			toast_tuple_target = rdopts->toast_tuple_target;
+#endif
+#if PG_VERSION_NUM >= 90600
+		else if (strcmp(elem->defname, "parallel_workers") == 0)
+			parallel_workers = rdopts->parallel_workers;
+#endif
+		else
+			elog(ERROR, "hypopg: storage parameter \"%s\" is not supported",
+				 elem->defname);
+	}
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	entry = (hypoRelOptions *) palloc0(sizeof(hypoRelOptions));
+	entry->relid = relid;
+	entry->options = datumCopy(PointerGetDatum(array), false, -1);
+	entry->fillfactor = fillfactor;
+	entry->toast_tuple_target = toast_tuple_target;
+	entry->parallel_workers = parallel_workers;
+	hypoRelOptionsList = lappend(hypoRelOptionsList, entry);
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SQL wrapper to remove the hypothetical storage parameters of the given
+ * table, or of all tables.
+ */
+Datum
+hypopg_reset_table_options(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		hypo_reloptions_reset();
+	else
+		hypo_reloptions_remove(PG_GETARG_OID(0));
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * List the hypothetical storage parameters, with the current and estimated
+ * number of heap and TOAST pages.
+ */
+Datum
+hypopg_table_options(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ListCell   *lc;
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	foreach(lc, hypoRelOptionsList)
+	{
+		hypoRelOptions *entry = (hypoRelOptions *) lfirst(lc);
+		Datum		values[HYPO_RELOPTIONS_NB_COLS];
+		bool		nulls[HYPO_RELOPTIONS_NB_COLS];
+		Relation	relation;
+		BlockNumber pages;
+		BlockNumber hypo_pages;
+		double		tuples;
+		double		allvisfrac;
+		double		toast_pages = 0;
+		int			j = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		relation = heap_open(entry->relid, AccessShareLock);
+
+		estimate_rel_size(relation, NULL, &pages, &tuples, &allvisfrac);
+		hypo_pages = hypo_reloptions_get_pages(entry, relation, pages, tuples,
+											   &toast_pages);
+
+		values[j++] = ObjectIdGetDatum(entry->relid);
+		values[j++] = entry->options;
+		values[j++] = Int64GetDatum((int64) pages);
+		if (OidIsValid(relation->rd_rel->reltoastrelid))
+		{
+			Relation	toastrel;
+
+			toastrel = heap_open(relation->rd_rel->reltoastrelid,
+								 AccessShareLock);
+			values[j++] = Int64GetDatum((int64)
+										RelationGetNumberOfBlocks(toastrel));
+			heap_close(toastrel, AccessShareLock);
+		}
+		else
+			nulls[j++] = true;
+		values[j++] = Int64GetDatum((int64) hypo_pages);
+		values[j++] = Int64GetDatum((int64) toast_pages);
+		Assert(j == HYPO_RELOPTIONS_NB_COLS);
+
+		heap_close(relation, AccessShareLock);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+/*
+ * SQL wrapper to set the hypothetical type of a column of a table.  Setting
+ * the real type of the column removes its hypothetical type.
+ */
+Datum
+hypopg_alter_column_type(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	char	   *attname = NameStr(*PG_GETARG_NAME(1));
+	char	   *typname = text_to_cstring(PG_GETARG_TEXT_PP(2));
+	char		relkind = get_rel_relkind(relid);
+	hypoColumnType *coltype;
+	AttrNumber	attnum;
+	Oid			atttypid;
+	int32		atttypmod;
+	Oid			attcollid;
+	Oid			typid;
+	int32		typmod;
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	MemoryContext oldcontext;
+
+	if (relkind != RELKIND_RELATION
+#if PG_VERSION_NUM >= 90300
+		&& relkind != RELKIND_MATVIEW
+#endif
+		)
+		elog(ERROR, "hypopg: \"%s\" is not a table", get_rel_name(relid));
+
+	attnum = get_attnum(relid, attname);
+	if (attnum == InvalidAttrNumber)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_COLUMN),
+				 errmsg("hypopg: column \"%s\" of relation \"%s\" does not exist",
+						attname, get_rel_name(relid))));
+	if (attnum < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hypopg: cannot alter system column \"%s\"",
+						attname)));
+
+#if PG_VERSION_NUM >= 90400
+	parseTypeString(typname, &typid, &typmod, false);
+#else
+	parseTypeString(typname, &typid, &typmod);
+#endif
+
+	if (get_typtype(typid) == TYPTYPE_PSEUDO)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+				 errmsg("hypopg: column \"%s\" cannot be of type %s",
+						attname, format_type_be(typid))));
+
+	get_atttypetypmodcoll(relid, attnum, &atttypid, &atttypmod, &attcollid);
+
+	hypo_column_type_remove(relid, attnum);
+
+	/* Nothing more to do if that's the real type */
+	if (typid == atttypid && typmod == atttypmod)
+		PG_RETURN_VOID();
+
+	get_typlenbyvalalign(typid, &typlen, &typbyval, &typalign);
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	coltype = (hypoColumnType *) palloc0(sizeof(hypoColumnType));
+	coltype->relid = relid;
+	coltype->attnum = attnum;
+	coltype->atttypid = atttypid;
+	coltype->attlen = get_typlen(atttypid);
+	coltype->typid = typid;
+	coltype->typmod = typmod;
+	coltype->typlen = typlen;
+	coltype->typalign = typalign;
+	coltype->typstorage = get_typstorage(typid);
+	hypoColumnTypes = lappend(hypoColumnTypes, coltype);
+	MemoryContextSwitchTo(oldcontext);
+
+	hypo_column_type_changed();
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * SQL wrapper to remove the hypothetical column types of the given table, or
+ * of all tables.
+ */
+Datum
+hypopg_reset_column_types(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		hypo_column_type_reset();
+	else
+		hypo_column_type_remove(PG_GETARG_OID(0), InvalidAttrNumber);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * List the hypothetical column types, with the real type of the columns.
+ */
+Datum
+hypopg_column_types(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ListCell   *lc;
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	foreach(lc, hypoColumnTypes)
+	{
+		hypoColumnType *coltype = (hypoColumnType *) lfirst(lc);
+		Datum		values[HYPO_COLUMN_TYPES_NB_COLS];
+		bool		nulls[HYPO_COLUMN_TYPES_NB_COLS];
+		Oid			atttypid;
+		int32		atttypmod;
+		Oid			attcollid;
+		char	   *attname;
+		int			j = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+#if PG_VERSION_NUM >= 110000
+		attname = get_attname(coltype->relid, coltype->attnum, false);
+#else
+		attname = get_attname(coltype->relid, coltype->attnum);
+#endif
+		get_atttypetypmodcoll(coltype->relid, coltype->attnum, &atttypid,
+							  &atttypmod, &attcollid);
+
+		values[j++] = ObjectIdGetDatum(coltype->relid);
+		values[j++] = CStringGetTextDatum(attname);
+		values[j++] = CStringGetTextDatum(format_type_with_typemod(atttypid,
+																   atttypmod));
+		values[j++] = CStringGetTextDatum(format_type_with_typemod(coltype->typid,
+																   coltype->typmod));
+		Assert(j == HYPO_COLUMN_TYPES_NB_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
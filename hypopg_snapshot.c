@@ -0,0 +1,1028 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_snapshot.c: Implementation of statistics snapshots for PostgreSQL
+ *
+ * This file contains all the internal code related to the export of the
+ * statistics of real relations, and to their import in another cluster.
+ *
+ * A snapshot contains, for each exported relation, its number of pages,
+ * tuples and all-visible pages as stored in pg_class, the height of the btree
+ * indexes and all the pg_statistic rows of the relation.  Relations, columns,
+ * types, operators and collations are referenced by name and the statistics
+ * values by their text representation, so that a snapshot taken on a
+ * production server can be imported on a data-less clone having the same
+ * schema.  The imported statistics are then used instead of the real ones
+ * during EXPLAIN, by the planner and by the hypothetical objects estimations.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#if PG_VERSION_NUM >= 90300
+#include "access/htup_details.h"
+#endif
+#include "access/nbtree.h"
+#include "catalog/index.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "libpq/pqformat.h"
+#include "mb/pg_wchar.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#include "include/hypopg.h"
+#include "include/hypopg_snapshot.h"
+
+/*--- Variables exported ---*/
+
+HTAB	   *hypoRelStatsHash = NULL;
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_export_real_stats);
+PG_FUNCTION_INFO_V1(hypopg_import_stats);
+PG_FUNCTION_INFO_V1(hypopg_reset_imported_stats);
+PG_FUNCTION_INFO_V1(hypopg_imported_stats);
+
+static void hypo_initRelStatsHash(void);
+static void hypo_snapshot_free(hypoRelStats *entry);
+static void hypo_snapshot_write_string(StringInfo buf, const char *str);
+static char *hypo_snapshot_read_string(StringInfo buf);
+static void hypo_snapshot_write_header(StringInfo buf, int nrels);
+static void hypo_snapshot_write_rel(StringInfo buf, Oid relid,
+						BlockNumber relpages, double reltuples,
+						BlockNumber relallvisible, int tree_height,
+						List *stats);
+static void hypo_snapshot_write_stats(StringInfo buf, Oid relid,
+						  HeapTuple tuple);
+static Oid	hypo_snapshot_slot_type(int16 kind, Oid typid);
+static HeapTuple hypo_snapshot_read_stats(StringInfo buf, Oid relid,
+						 const char *relname, TupleDesc tupdesc);
+static List *hypo_snapshot_all_relations(void);
+
+
+/* Setup the hypoRelStatsHash hash */
+static void
+hypo_initRelStatsHash(void)
+{
+	HASHCTL		info;
+
+	Assert(!hypoRelStatsHash);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(hypoRelStats);
+	info.hcxt = HypoMemoryContext;
+
+	hypoRelStatsHash = hash_create("hypo_rel_stats",
+								   128,
+								   &info,
+								   HASH_ELEM | HASH_BLOBS | HASH_CONTEXT
+		);
+}
+
+/*
+ * Free the pg_statistic rows of the given entry
+ */
+static void
+hypo_snapshot_free(hypoRelStats *entry)
+{
+	ListCell   *lc;
+
+	foreach(lc, entry->stats)
+		heap_freetuple((HeapTuple) lfirst(lc));
+
+	list_free(entry->stats);
+	entry->stats = NIL;
+}
+
+/*
+ * Remove all the imported statistics
+ */
+void
+hypo_snapshot_reset(void)
+{
+	HASH_SEQ_STATUS hash_seq;
+	hypoRelStats *entry;
+
+	if (!hypoRelStatsHash)
+		return;
+
+	hash_seq_init(&hash_seq, hypoRelStatsHash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		hypo_snapshot_free(entry);
+
+	hash_destroy(hypoRelStatsHash);
+	hypoRelStatsHash = NULL;
+}
+
+/*
+ * Remove the imported statistics of the given relation.  Return true if the
+ * relation had any.
+ */
+bool
+hypo_snapshot_remove(Oid relid)
+{
+	hypoRelStats *entry = hypo_find_relstats(relid);
+
+	if (entry == NULL)
+		return false;
+
+	hypo_snapshot_free(entry);
+	hash_search(hypoRelStatsHash, &relid, HASH_REMOVE, NULL);
+
+	return true;
+}
+
+/*
+ * Return the imported statistics of the given relation, or NULL if there
+ * isn't any.
+ */
+hypoRelStats *
+hypo_find_relstats(Oid relid)
+{
+	if (!hypoRelStatsHash)
+		return NULL;
+
+	return (hypoRelStats *) hash_search(hypoRelStatsHash, &relid, HASH_FIND,
+										NULL);
+}
+
+/*
+ * Return the imported pg_statistic row for the given relation's column, or
+ * NULL if there isn't any.
+ */
+HeapTuple
+hypo_get_imported_stats_tuple(Oid relid, AttrNumber attnum, bool inherit)
+{
+	hypoRelStats *entry = hypo_find_relstats(relid);
+	ListCell   *lc;
+
+	if (entry == NULL)
+		return NULL;
+
+	foreach(lc, entry->stats)
+	{
+		HeapTuple	tuple = (HeapTuple) lfirst(lc);
+		Form_pg_statistic stats = (Form_pg_statistic) GETSTRUCT(tuple);
+
+		if (stats->staattnum == attnum && stats->stainherit == inherit)
+			return tuple;
+	}
+
+	return NULL;
+}
+
+/*
+ * Use the imported number of pages and tuples of the given relation and of
+ * its real indexes, if any.  The real number of pages of the relation on the
+ * data-less clone is irrelevant, so the imported values are used as-is.
+ */
+void
+hypo_snapshot_apply(RelOptInfo *rel, Oid relid, bool inhparent)
+{
+	hypoRelStats *entry;
+	ListCell   *lc;
+
+	if (!hypoRelStatsHash)
+		return;
+
+	/* The planner doesn't estimate the size of inheritance parents */
+	entry = hypo_find_relstats(relid);
+	if (entry && !inhparent)
+	{
+		rel->pages = entry->relpages;
+		if (entry->reltuples >= 0)
+			rel->tuples = entry->reltuples;
+		if (entry->relpages > 0)
+			rel->allvisfrac = Min((double) entry->relallvisible /
+								  entry->relpages, 1.0);
+		else
+			rel->allvisfrac = 0;
+	}
+
+	foreach(lc, rel->indexlist)
+	{
+		IndexOptInfo *index = (IndexOptInfo *) lfirst(lc);
+
+		if (index->hypothetical)
+			continue;
+
+		entry = hypo_find_relstats(index->indexoid);
+		if (!entry)
+			continue;
+
+		index->pages = entry->relpages;
+		if (entry->reltuples >= 0)
+			index->tuples = entry->reltuples;
+		else
+			index->tuples = rel->tuples;
+#if PG_VERSION_NUM >= 90300
+		if (entry->tree_height >= 0)
+			index->tree_height = entry->tree_height;
+#endif
+	}
+}
+
+/*
+ * Append a string to a snapshot.  The length is stored first, and no
+ * encoding conversion is done, the snapshot encoding being checked as a
+ * whole.
+ */
+static void
+hypo_snapshot_write_string(StringInfo buf, const char *str)
+{
+	int			len = strlen(str);
+
+	pq_sendint(buf, len, 4);
+	pq_sendbytes(buf, str, len);
+}
+
+/*
+ * Read a string written by hypo_snapshot_write_string()
+ */
+static char *
+hypo_snapshot_read_string(StringInfo buf)
+{
+	int			len = (int) pq_getmsgint(buf, 4);
+
+	if (len < 0)
+		elog(ERROR, "hypopg: invalid statistics snapshot");
+
+	return pnstrdup(pq_getmsgbytes(buf, len), len);
+}
+
+/*
+ * Write the header of a snapshot of the given number of relations
+ */
+static void
+hypo_snapshot_write_header(StringInfo buf, int nrels)
+{
+	pq_sendint(buf, HYPO_SNAPSHOT_MAGIC, 4);
+	pq_sendint(buf, HYPO_SNAPSHOT_VERSION, 4);
+	hypo_snapshot_write_string(buf, GetDatabaseEncodingName());
+	pq_sendint(buf, nrels, 4);
+}
+
+/*
+ * Write a relation and the given pg_statistic rows to a snapshot
+ */
+static void
+hypo_snapshot_write_rel(StringInfo buf, Oid relid, BlockNumber relpages,
+						double reltuples, BlockNumber relallvisible,
+						int tree_height, List *stats)
+{
+	ListCell   *lc;
+
+	hypo_snapshot_write_string(buf,
+							   get_namespace_name(get_rel_namespace(relid)));
+	hypo_snapshot_write_string(buf, get_rel_name(relid));
+	pq_sendint(buf, relpages, 4);
+	pq_sendfloat8(buf, reltuples);
+	pq_sendint(buf, relallvisible, 4);
+	pq_sendint(buf, tree_height, 4);
+
+	pq_sendint(buf, list_length(stats), 4);
+	foreach(lc, stats)
+		hypo_snapshot_write_stats(buf, relid, (HeapTuple) lfirst(lc));
+}
+
+/*
+ * Write a pg_statistic row to a snapshot.  The type of the column is stored
+ * so that the row can be ignored if the column has a different type on the
+ * importing side.
+ */
+static void
+hypo_snapshot_write_stats(StringInfo buf, Oid relid, HeapTuple tuple)
+{
+	Form_pg_statistic stats = (Form_pg_statistic) GETSTRUCT(tuple);
+	int			k;
+
+	hypo_snapshot_write_string(buf, get_attname(relid, stats->staattnum,
+												false));
+	hypo_snapshot_write_string(buf,
+							   format_type_be(get_atttype(relid,
+														  stats->staattnum)));
+	pq_sendbyte(buf, stats->stainherit ? 1 : 0);
+	pq_sendfloat4(buf, stats->stanullfrac);
+	pq_sendint(buf, stats->stawidth, 4);
+	pq_sendfloat4(buf, stats->stadistinct);
+
+	for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+	{
+		int16		kind = (&stats->stakind1)[k];
+		Oid			op = (&stats->staop1)[k];
+		Datum		datum;
+		bool		isnull;
+
+		pq_sendint(buf, kind, 2);
+		if (kind == 0)
+			continue;
+
+		if (OidIsValid(op))
+			hypo_snapshot_write_string(buf,
+									   DatumGetCString(DirectFunctionCall1(regoperatorout,
+																		   ObjectIdGetDatum(op))));
+		else
+			hypo_snapshot_write_string(buf, "");
+
+#if PG_VERSION_NUM >= 120000
+		if (OidIsValid((&stats->stacoll1)[k]))
+			hypo_snapshot_write_string(buf,
+									   get_collation_name((&stats->stacoll1)[k]));
+		else
+#endif
+			hypo_snapshot_write_string(buf, "");
+
+		datum = SysCacheGetAttr(STATRELATTINH, tuple,
+								Anum_pg_statistic_stanumbers1 + k, &isnull);
+		if (isnull)
+			pq_sendint(buf, 0, 4);
+		else
+		{
+			Datum	   *numbers;
+			int			nnumbers;
+			int			i;
+
+			deconstruct_array(DatumGetArrayTypeP(datum), FLOAT4OID,
+							  sizeof(float4), FLOAT4PASSBYVAL, 'i',
+							  &numbers, NULL, &nnumbers);
+			pq_sendint(buf, nnumbers, 4);
+			for (i = 0; i < nnumbers; i++)
+				pq_sendfloat4(buf, DatumGetFloat4(numbers[i]));
+		}
+
+		datum = SysCacheGetAttr(STATRELATTINH, tuple,
+								Anum_pg_statistic_stavalues1 + k, &isnull);
+		if (isnull)
+			hypo_snapshot_write_string(buf, "");
+		else
+		{
+			ArrayType  *values = DatumGetArrayTypeP(datum);
+
+			hypo_snapshot_write_string(buf,
+									   format_type_be(ARR_ELEMTYPE(values)));
+			hypo_snapshot_write_string(buf,
+									   OidOutputFunctionCall(F_ARRAY_OUT,
+															 PointerGetDatum(values)));
+		}
+	}
+}
+
+/*
+ * Return the type of the values of a statistics slot of the given kind for a
+ * column of the given type, as ANALYZE stores them, or InvalidOid if this
+ * kind of slot shouldn't have values or is unknown.
+ */
+static Oid
+hypo_snapshot_slot_type(int16 kind, Oid typid)
+{
+	switch (kind)
+	{
+		case STATISTIC_KIND_MCV:
+		case STATISTIC_KIND_HISTOGRAM:
+		case STATISTIC_KIND_BOUNDS_HISTOGRAM:
+			return typid;
+		case STATISTIC_KIND_MCELEM:
+			/* tsvector lexemes are stored as text */
+			if (typid == TSVECTOROID)
+				return TEXTOID;
+			return get_base_element_type(typid);
+		case STATISTIC_KIND_RANGE_LENGTH_HISTOGRAM:
+			return FLOAT8OID;
+		default:
+			return InvalidOid;
+	}
+}
+
+/*
+ * Read a pg_statistic row written by hypo_snapshot_write_stats(), and return
+ * it as a pg_statistic tuple of the given relation.  If relid is invalid, the
+ * row is only skipped.  NULL is returned if the row is skipped, or if the
+ * column doesn't exist or has a different type, or if the statistics values
+ * don't match the column type.
+ */
+static HeapTuple
+hypo_snapshot_read_stats(StringInfo buf, Oid relid, const char *relname,
+						 TupleDesc tupdesc)
+{
+	char	   *attname = hypo_snapshot_read_string(buf);
+	char	   *atttype = hypo_snapshot_read_string(buf);
+	bool		inherit = (pq_getmsgbyte(buf) != 0);
+	float4		nullfrac = pq_getmsgfloat4(buf);
+	int32		width = (int32) pq_getmsgint(buf, 4);
+	float4		distinct = pq_getmsgfloat4(buf);
+	int16		kinds[STATISTIC_NUM_SLOTS];
+	char	   *ops[STATISTIC_NUM_SLOTS];
+	char	   *colls[STATISTIC_NUM_SLOTS];
+	float4	   *numbers[STATISTIC_NUM_SLOTS];
+	int			nnumbers[STATISTIC_NUM_SLOTS];
+	char	   *valuetypes[STATISTIC_NUM_SLOTS];
+	char	   *values[STATISTIC_NUM_SLOTS];
+	Datum		arrays[STATISTIC_NUM_SLOTS];
+	Datum		datums[Natts_pg_statistic];
+	bool		nulls[Natts_pg_statistic];
+	AttrNumber	attnum;
+	Oid			typid;
+	int			i,
+				k;
+
+	for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+	{
+		kinds[k] = (int16) pq_getmsgint(buf, 2);
+		ops[k] = colls[k] = valuetypes[k] = values[k] = NULL;
+		numbers[k] = NULL;
+		nnumbers[k] = 0;
+
+		if (kinds[k] == 0)
+			continue;
+
+		ops[k] = hypo_snapshot_read_string(buf);
+		colls[k] = hypo_snapshot_read_string(buf);
+
+		nnumbers[k] = (int) pq_getmsgint(buf, 4);
+		if (nnumbers[k] < 0 || nnumbers[k] > buf->len - buf->cursor)
+			elog(ERROR, "hypopg: invalid statistics snapshot");
+		if (nnumbers[k] > 0)
+		{
+			numbers[k] = (float4 *) palloc(sizeof(float4) * nnumbers[k]);
+			for (i = 0; i < nnumbers[k]; i++)
+				numbers[k][i] = pq_getmsgfloat4(buf);
+		}
+
+		valuetypes[k] = hypo_snapshot_read_string(buf);
+		if (valuetypes[k][0] != '\0')
+			values[k] = hypo_snapshot_read_string(buf);
+	}
+
+	if (!OidIsValid(relid))
+		return NULL;
+
+	attnum = get_attnum(relid, attname);
+	if (attnum == InvalidAttrNumber)
+	{
+		elog(WARNING, "hypopg: column \"%s\" of relation \"%s\" does not exist, skipping",
+			 attname, relname);
+		return NULL;
+	}
+
+	typid = get_atttype(relid, attnum);
+	if (strcmp(format_type_be(typid), atttype) != 0)
+	{
+		elog(WARNING, "hypopg: column \"%s\" of relation \"%s\" is not of type %s, skipping",
+			 attname, relname, atttype);
+		return NULL;
+	}
+
+	/*
+	 * The selectivity functions trust the statistics to be consistent with
+	 * the column, so check the type and dimensions of each slot's arrays
+	 * before using them.
+	 */
+	for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+	{
+		arrays[k] = (Datum) 0;
+
+		if (kinds[k] == 0)
+			continue;
+
+		if (values[k])
+		{
+			Oid			valuetypid;
+			ArrayType  *arr;
+
+			valuetypid = DatumGetObjectId(DirectFunctionCall1(regtypein,
+															  CStringGetDatum(valuetypes[k])));
+			if (valuetypid != hypo_snapshot_slot_type(kinds[k], typid))
+				break;
+
+			arrays[k] = OidInputFunctionCall(F_ARRAY_IN, values[k],
+											 valuetypid, -1);
+			arr = DatumGetArrayTypeP(arrays[k]);
+			if (ARR_NDIM(arr) != 1 || ARR_HASNULL(arr))
+				break;
+
+			/* numbers are the frequencies of the values */
+			if (kinds[k] == STATISTIC_KIND_MCV &&
+				nnumbers[k] != ARR_DIMS(arr)[0])
+				break;
+			if (kinds[k] == STATISTIC_KIND_MCELEM &&
+				nnumbers[k] < ARR_DIMS(arr)[0])
+				break;
+		}
+		else if (kinds[k] == STATISTIC_KIND_CORRELATION &&
+				 nnumbers[k] != 1)
+			break;
+	}
+
+	if (k < STATISTIC_NUM_SLOTS)
+	{
+		elog(WARNING, "hypopg: statistics of column \"%s\" of relation \"%s\" don't match its type, skipping",
+			 attname, relname);
+		return NULL;
+	}
+
+	/*
+	 * Construct a new pg_statistic tuple, as hypo_update_attstats() does
+	 */
+	memset(nulls, 0, sizeof(nulls));
+
+	datums[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(relid);
+	datums[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(attnum);
+	datums[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(inherit);
+	datums[Anum_pg_statistic_stanullfrac - 1] = Float4GetDatum(nullfrac);
+	datums[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(width);
+	datums[Anum_pg_statistic_stadistinct - 1] = Float4GetDatum(distinct);
+
+	for (k = 0; k < STATISTIC_NUM_SLOTS; k++)
+	{
+		Oid			op = InvalidOid;
+#if PG_VERSION_NUM >= 120000
+		Oid			coll = InvalidOid;
+#endif
+
+		if (ops[k] && ops[k][0] != '\0')
+			op = DatumGetObjectId(DirectFunctionCall1(regoperatorin,
+													  CStringGetDatum(ops[k])));
+
+		datums[Anum_pg_statistic_stakind1 - 1 + k] = Int16GetDatum(kinds[k]);
+		datums[Anum_pg_statistic_staop1 - 1 + k] = ObjectIdGetDatum(op);
+
+#if PG_VERSION_NUM >= 120000
+		if (colls[k] && colls[k][0] != '\0')
+			coll = get_collation_oid(list_make1(makeString(colls[k])), false);
+		datums[Anum_pg_statistic_stacoll1 - 1 + k] = ObjectIdGetDatum(coll);
+#endif
+
+		if (nnumbers[k] > 0)
+		{
+			Datum	   *numdatums = (Datum *) palloc(nnumbers[k] * sizeof(Datum));
+
+			for (i = 0; i < nnumbers[k]; i++)
+				numdatums[i] = Float4GetDatum(numbers[k][i]);
+			datums[Anum_pg_statistic_stanumbers1 - 1 + k] =
+				PointerGetDatum(construct_array(numdatums, nnumbers[k],
+												FLOAT4OID, sizeof(float4),
+												FLOAT4PASSBYVAL, 'i'));
+		}
+		else
+		{
+			nulls[Anum_pg_statistic_stanumbers1 - 1 + k] = true;
+			datums[Anum_pg_statistic_stanumbers1 - 1 + k] = (Datum) 0;
+		}
+
+		if (values[k])
+			datums[Anum_pg_statistic_stavalues1 - 1 + k] = arrays[k];
+		else
+		{
+			nulls[Anum_pg_statistic_stavalues1 - 1 + k] = true;
+			datums[Anum_pg_statistic_stavalues1 - 1 + k] = (Datum) 0;
+		}
+	}
+
+	return heap_form_tuple(tupdesc, datums, nulls);
+}
+
+/*
+ * Import a snapshot.  All the snapshot is read and checked before storing
+ * anything, so that a failure doesn't leave partially imported statistics.
+ * Relations, columns and types that don't match are ignored with a warning.
+ * Returns the number of imported relations.
+ */
+int
+hypo_snapshot_import(StringInfo buf)
+{
+	List	   *entries = NIL;
+	ListCell   *lc;
+	Relation	pgstats;
+	char	   *encoding;
+	int			nrels;
+	int			i;
+
+	if (buf->len - buf->cursor < 8 ||
+		pq_getmsgint(buf, 4) != HYPO_SNAPSHOT_MAGIC)
+		elog(ERROR, "hypopg: invalid statistics snapshot");
+
+	i = (int) pq_getmsgint(buf, 4);
+	if (i != HYPO_SNAPSHOT_VERSION)
+		elog(ERROR, "hypopg: unsupported statistics snapshot version %d", i);
+
+	encoding = hypo_snapshot_read_string(buf);
+	if (strcmp(encoding, GetDatabaseEncodingName()) != 0)
+		elog(ERROR, "hypopg: statistics snapshot encoding %s doesn't match database encoding %s",
+			 encoding, GetDatabaseEncodingName());
+
+	pgstats = heap_open(StatisticRelationId, AccessShareLock);
+
+	nrels = (int) pq_getmsgint(buf, 4);
+	for (i = 0; i < nrels; i++)
+	{
+		char	   *nspname = hypo_snapshot_read_string(buf);
+		char	   *relname = hypo_snapshot_read_string(buf);
+		hypoRelStats *entry;
+		Oid			nspid;
+		int			nstats;
+		int			j;
+
+		entry = (hypoRelStats *) palloc0(sizeof(hypoRelStats));
+		entry->relpages = (BlockNumber) pq_getmsgint(buf, 4);
+		entry->reltuples = pq_getmsgfloat8(buf);
+		entry->relallvisible = (BlockNumber) pq_getmsgint(buf, 4);
+		entry->tree_height = (int) pq_getmsgint(buf, 4);
+
+		nspid = get_namespace_oid(nspname, true);
+		if (OidIsValid(nspid))
+			entry->relid = get_relname_relid(relname, nspid);
+
+		if (!OidIsValid(entry->relid))
+			elog(WARNING, "hypopg: relation \"%s.%s\" does not exist, skipping",
+				 nspname, relname);
+
+		nstats = (int) pq_getmsgint(buf, 4);
+		for (j = 0; j < nstats; j++)
+		{
+			HeapTuple	tuple;
+
+			tuple = hypo_snapshot_read_stats(buf, entry->relid, relname,
+											 RelationGetDescr(pgstats));
+			if (tuple)
+				entry->stats = lappend(entry->stats, tuple);
+		}
+
+		if (OidIsValid(entry->relid))
+			entries = lappend(entries, entry);
+	}
+	pq_getmsgend(buf);
+
+	heap_close(pgstats, AccessShareLock);
+
+	/* Everything is valid, store the statistics */
+	if (!hypoRelStatsHash)
+		hypo_initRelStatsHash();
+
+	foreach(lc, entries)
+	{
+		hypoRelStats *entry = (hypoRelStats *) lfirst(lc);
+		hypoRelStats *s;
+		MemoryContext oldcontext;
+		ListCell   *lc2;
+
+		hypo_snapshot_remove(entry->relid);
+
+		s = hash_search(hypoRelStatsHash, &entry->relid, HASH_ENTER, NULL);
+		s->relpages = entry->relpages;
+		s->reltuples = entry->reltuples;
+		s->relallvisible = entry->relallvisible;
+		s->tree_height = entry->tree_height;
+		s->stats = NIL;
+
+		oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+		foreach(lc2, entry->stats)
+			s->stats = lappend(s->stats, heap_copytuple((HeapTuple) lfirst(lc2)));
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	return list_length(entries);
+}
+
+/*
+ * Write all the imported statistics as a snapshot, for the parallel
+ * evaluation workers.
+ */
+void
+hypo_snapshot_serialize(StringInfo buf)
+{
+	HASH_SEQ_STATUS hash_seq;
+	hypoRelStats *entry;
+	List	   *entries = NIL;
+	ListCell   *lc;
+
+	if (hypoRelStatsHash)
+	{
+		hash_seq_init(&hash_seq, hypoRelStatsHash);
+		while ((entry = hash_seq_search(&hash_seq)) != NULL)
+		{
+			/* Ignore the relations dropped since the import */
+			if (SearchSysCacheExists1(RELOID, ObjectIdGetDatum(entry->relid)))
+				entries = lappend(entries, entry);
+		}
+	}
+
+	hypo_snapshot_write_header(buf, list_length(entries));
+	foreach(lc, entries)
+	{
+		entry = (hypoRelStats *) lfirst(lc);
+
+		hypo_snapshot_write_rel(buf, entry->relid, entry->relpages,
+								entry->reltuples, entry->relallvisible,
+								entry->tree_height, entry->stats);
+	}
+}
+
+/*
+ * Return the oids of all the tables and materialized views that are not part
+ * of the catalogs.
+ */
+static List *
+hypo_snapshot_all_relations(void)
+{
+	List	   *result = NIL;
+	int			ret;
+	uint64		i;
+
+	if ((ret = SPI_connect()) < 0)
+		/* internal error */
+		elog(ERROR, "hypopg: SPI_connect returned %d", ret);
+
+	ret = SPI_execute("SELECT c.oid"
+					  " FROM pg_catalog.pg_class c"
+					  " JOIN pg_catalog.pg_namespace n"
+					  "   ON n.oid = c.relnamespace"
+					  " WHERE c.relkind IN ('r', 'm', 'p')"
+					  " AND n.nspname <> 'information_schema'"
+					  " AND n.nspname !~ '^pg_'"
+					  " ORDER BY c.oid", true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "hypopg: could not list the relations: %d", ret);
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		bool		isnull;
+		Datum		datum;
+
+		datum = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc,
+							  1, &isnull);
+		result = lappend_oid(result, DatumGetObjectId(datum));
+	}
+
+	SPI_finish();
+
+	return result;
+}
+
+/*
+ * SQL wrapper to export the statistics of the given tables and of their
+ * indexes, or of all the non catalog tables if none is given.  The
+ * pg_statistic rows of the columns the user can't read are not exported.
+ */
+Datum
+hypopg_export_real_stats(PG_FUNCTION_ARGS)
+{
+	List	   *tables = NIL;
+	List	   *relids = NIL;
+	ListCell   *lc;
+	StringInfoData buf;
+	bytea	   *result;
+
+	if (PG_ARGISNULL(0))
+		tables = hypo_snapshot_all_relations();
+	else
+	{
+		Datum	   *elems;
+		bool	   *nulls;
+		int			nelems;
+		int			i;
+
+		deconstruct_array(PG_GETARG_ARRAYTYPE_P(0), REGCLASSOID,
+						  sizeof(Oid), true, 'i', &elems, &nulls, &nelems);
+
+		for (i = 0; i < nelems; i++)
+		{
+			if (nulls[i])
+				continue;
+
+			if (!SearchSysCacheExists1(RELOID, elems[i]))
+				elog(ERROR, "hypopg: oid %u is not a relation",
+					 DatumGetObjectId(elems[i]));
+
+			tables = list_append_unique_oid(tables,
+											DatumGetObjectId(elems[i]));
+		}
+	}
+
+	/* Add the indexes of the tables */
+	foreach(lc, tables)
+	{
+		Oid			relid = lfirst_oid(lc);
+
+		relids = list_append_unique_oid(relids, relid);
+
+		if (get_rel_relkind(relid) != RELKIND_INDEX)
+		{
+			Relation	relation = heap_open(relid, AccessShareLock);
+
+			relids = list_concat_unique_oid(relids,
+											RelationGetIndexList(relation));
+			heap_close(relation, AccessShareLock);
+		}
+	}
+
+	initStringInfo(&buf);
+	hypo_snapshot_write_header(&buf, list_length(relids));
+
+	foreach(lc, relids)
+	{
+		Oid			relid = lfirst_oid(lc);
+		Oid			tableid = relid;
+		HeapTuple	tuple;
+		Form_pg_class classForm;
+		List	   *stats = NIL;
+		ListCell   *lc2;
+		int			tree_height = -1;
+		bool		table_acl;
+		AttrNumber	attnum;
+
+		tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+		if (!HeapTupleIsValid(tuple))
+			elog(ERROR, "hypopg: cache lookup failed for relation %u", relid);
+		classForm = (Form_pg_class) GETSTRUCT(tuple);
+
+		if (classForm->relkind == RELKIND_INDEX)
+		{
+			tableid = IndexGetRelation(relid, false);
+
+#if PG_VERSION_NUM >= 90300
+			if (classForm->relam == BTREE_AM_OID)
+			{
+				Relation	index = index_open(relid, AccessShareLock);
+
+				tree_height = _bt_getrootheight(index);
+				index_close(index, AccessShareLock);
+			}
+#endif
+		}
+
+		/* Same privileges as the pg_stats view */
+		table_acl = (pg_class_aclcheck(tableid, GetUserId(),
+									   ACL_SELECT) == ACLCHECK_OK);
+
+		for (attnum = 1; attnum <= classForm->relnatts; attnum++)
+		{
+			int			inh;
+
+			if (!table_acl && (relid != tableid ||
+							   pg_attribute_aclcheck(relid, attnum,
+													 GetUserId(),
+													 ACL_SELECT) != ACLCHECK_OK))
+				continue;
+
+			for (inh = 0; inh <= 1; inh++)
+			{
+				HeapTuple	statstuple;
+
+				statstuple = SearchSysCache3(STATRELATTINH,
+											 ObjectIdGetDatum(relid),
+											 Int16GetDatum(attnum),
+											 BoolGetDatum(inh == 1));
+				if (HeapTupleIsValid(statstuple))
+					stats = lappend(stats, statstuple);
+			}
+		}
+
+		hypo_snapshot_write_rel(&buf, relid, classForm->relpages,
+								classForm->reltuples,
+								classForm->relallvisible, tree_height,
+								stats);
+
+		foreach(lc2, stats)
+			ReleaseSysCache((HeapTuple) lfirst(lc2));
+		ReleaseSysCache(tuple);
+	}
+
+	result = (bytea *) palloc(VARHDRSZ + buf.len);
+	SET_VARSIZE(result, VARHDRSZ + buf.len);
+	memcpy(VARDATA(result), buf.data, buf.len);
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * SQL wrapper to import a snapshot created by hypopg_export_real_stats().
+ * Returns the number of imported relations.
+ */
+Datum
+hypopg_import_stats(PG_FUNCTION_ARGS)
+{
+	bytea	   *snapshot = PG_GETARG_BYTEA_PP(0);
+	StringInfoData buf;
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	buf.data = VARDATA_ANY(snapshot);
+	buf.len = VARSIZE_ANY_EXHDR(snapshot);
+	buf.maxlen = buf.len;
+	buf.cursor = 0;
+
+	PG_RETURN_INT32(hypo_snapshot_import(&buf));
+}
+
+/*
+ * SQL wrapper to remove the imported statistics of the given relation, or of
+ * all relations.
+ */
+Datum
+hypopg_reset_imported_stats(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		hypo_snapshot_reset();
+	else
+		hypo_snapshot_remove(PG_GETARG_OID(0));
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * List the relations having imported statistics.
+ */
+Datum
+hypopg_imported_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	HASH_SEQ_STATUS hash_seq;
+	hypoRelStats *entry;
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (!hypoRelStatsHash)
+		return (Datum) 0;
+
+	hash_seq_init(&hash_seq, hypoRelStatsHash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		Datum		values[HYPO_IMPORTED_STATS_NB_COLS];
+		bool		nulls[HYPO_IMPORTED_STATS_NB_COLS];
+		int			j = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[j++] = ObjectIdGetDatum(entry->relid);
+		values[j++] = Int64GetDatum((int64) entry->relpages);
+		values[j++] = Float8GetDatum(entry->reltuples);
+		values[j++] = Int64GetDatum((int64) entry->relallvisible);
+		if (entry->tree_height >= 0)
+			values[j++] = Int32GetDatum(entry->tree_height);
+		else
+			nulls[j++] = true;
+		values[j++] = Int32GetDatum(list_length(entry->stats));
+
+		Assert(j == HYPO_IMPORTED_STATS_NB_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
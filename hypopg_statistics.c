@@ -0,0 +1,1375 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_statistics.c: Implementation of hypothetical extended statistics
+ * for PostgreSQL
+ *
+ * This file contains all the internal code related to hypothetical extended
+ * statistics support.
+ *
+ * The data are computed on a sample of the table, in a similar way to what
+ * ANALYZE does for real extended statistics.  The planner can't use them
+ * directly, since the various statext_*_load() functions fetch the data from
+ * pg_statistic_ext, so the functional dependencies and multivariate MCV
+ * lists are instead used to adjust the estimated number of rows of the base
+ * relations after the paths have been generated.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <math.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#if PG_VERSION_NUM >= 100000
+#include "catalog/namespace.h"
+#include "commands/vacuum.h"
+#include "executor/spi.h"
+#include "nodes/relation.h"
+#include "optimizer/clauses.h"
+#include "optimizer/cost.h"
+#include "parser/parser.h"
+#include "statistics/statistics.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#if PG_VERSION_NUM >= 120000
+#include "utils/float.h"
+#endif
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+#include "utils/typcache.h"
+#endif
+
+#include "include/hypopg.h"
+#include "include/hypopg_statistics.h"
+#include "include/hypopg_table.h"
+
+#if PG_VERSION_NUM >= 100000
+/*--- Structs --- */
+
+/*
+ * Sampled rows of the key columns, and the information needed to sort them
+ * on any subset of the key columns.
+ */
+typedef struct hypoStatsSample
+{
+	int			nkeys;			/* number of key columns */
+	int			numrows;		/* number of sampled rows */
+	double		totalrows;		/* estimated number of rows in the table */
+	Datum	   *values;			/* numrows * nkeys values */
+	bool	   *isnull;			/* numrows * nkeys null flags */
+	int		   *rows;			/* row numbers, in sorted order */
+	FmgrInfo   *cmp;			/* btree comparison function of each key */
+	Oid		   *collations;		/* collation of each key */
+	int			sortcols[STATS_MAX_DIMENSIONS];	/* current sort keys */
+	int			nsortcols;		/* number of current sort keys */
+} hypoStatsSample;
+
+/* A group of identical rows in a sorted sample */
+typedef struct hypoStatsGroup
+{
+	int			first;			/* first row of the group */
+	int			count;			/* number of rows in the group */
+} hypoStatsGroup;
+
+/*--- Variables exported ---*/
+
+List	   *hypoStatsExts = NIL;
+#endif
+
+/*--- Functions --- */
+
+PG_FUNCTION_INFO_V1(hypopg_create_statistics);
+PG_FUNCTION_INFO_V1(hypopg_drop_statistics);
+PG_FUNCTION_INFO_V1(hypopg_reset_statistics);
+PG_FUNCTION_INFO_V1(hypopg_list_statistics);
+
+#if PG_VERSION_NUM >= 100000
+static hypoStatsExt *hypo_stats_ext_new(CreateStatsStmt *stmt);
+static void hypo_stats_ext_pfree(hypoStatsExt *entry);
+static bool hypo_stats_ext_remove(Oid statid);
+static hypoStatsSample *hypo_stats_ext_sample(hypoStatsExt *entry);
+static void hypo_stats_ext_build(hypoStatsExt *entry, hypoStatsSample *sample);
+static void hypo_sample_sort(hypoStatsSample *sample, int *cols, int ncols);
+static int	hypo_sample_cmp(const void *a, const void *b, void *arg);
+static double hypo_estimate_ndistinct(double totalrows, int numrows, int d,
+						int f1);
+static int	hypo_group_cmp(const void *a, const void *b);
+static int	hypo_stats_ext_match(hypoStatsExt *entry, RelOptInfo *rel,
+					 RestrictInfo **clauses, Const **consts,
+					 Oid *collations);
+static Selectivity hypo_dependencies_selectivity(hypoStatsExt *entry,
+							  Selectivity *sels, RestrictInfo **clauses);
+static Selectivity hypo_mcv_selectivity(hypoStatsExt *entry,
+					 RestrictInfo **clauses, Const **consts,
+					 Oid *collations, bool *found);
+static char *hypo_stats_ext_keys_out(hypoStatsExt *entry, Bitmapset *keys);
+
+
+/*
+ * Create a new hypothetical extended statistics entry from the given CREATE
+ * STATISTICS statement.  The data are not computed.
+ */
+static hypoStatsExt *
+hypo_stats_ext_new(CreateStatsStmt *stmt)
+{
+	hypoStatsExt *volatile entry;
+	MemoryContext oldcontext;
+	RangeVar   *rv;
+	Oid			relid;
+	ListCell   *lc;
+	StringInfoData name;
+	int			nkeys;
+	char		oid[12];		/* store <oid>, oid shouldn't be more than
+								 * 9999999999 */
+
+	if (list_length(stmt->relations) != 1 ||
+		!IsA(linitial(stmt->relations), RangeVar))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hypopg: only a single relation is allowed in CREATE STATISTICS")));
+
+	rv = (RangeVar *) linitial(stmt->relations);
+	relid = RangeVarGetRelid(rv, AccessShareLock, false);
+
+	if (get_rel_relkind(relid) != RELKIND_RELATION &&
+		get_rel_relkind(relid) != RELKIND_MATVIEW)
+		ereport(ERROR,
+				(errcode(ERRCODE_WRONG_OBJECT_TYPE),
+				 errmsg("hypopg: relation \"%s\" is not a table or materialized view",
+						rv->relname)));
+
+	nkeys = list_length(stmt->exprs);
+	if (nkeys < 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+				 errmsg("hypopg: extended statistics require at least 2 columns")));
+	if (nkeys > STATS_MAX_DIMENSIONS)
+		ereport(ERROR,
+				(errcode(ERRCODE_TOO_MANY_COLUMNS),
+				 errmsg("hypopg: cannot have more than %d columns in statistics",
+						STATS_MAX_DIMENSIONS)));
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+
+	entry = (hypoStatsExt *) palloc0(sizeof(hypoStatsExt));
+	entry->relid = relid;
+	entry->nkeys = nkeys;
+	entry->keys = (AttrNumber *) palloc0(sizeof(AttrNumber) * nkeys);
+	entry->eqopr = (Oid *) palloc0(sizeof(Oid) * nkeys);
+	entry->typlen = (int16 *) palloc0(sizeof(int16) * nkeys);
+	entry->typbyval = (bool *) palloc0(sizeof(bool) * nkeys);
+
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_TRY();
+	{
+		int			i = 0;
+
+		foreach(lc, stmt->exprs)
+		{
+			ColumnRef  *cref = (ColumnRef *) lfirst(lc);
+			char	   *attname;
+			AttrNumber	attnum;
+			TypeCacheEntry *typentry;
+			int			j;
+
+			if (!IsA(cref, ColumnRef) || list_length(cref->fields) != 1 ||
+				!IsA(linitial(cref->fields), String))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_OBJECT_DEFINITION),
+						 errmsg("hypopg: only simple column references are allowed in CREATE STATISTICS")));
+
+			attname = strVal(linitial(cref->fields));
+			attnum = get_attnum(relid, attname);
+
+			if (attnum == InvalidAttrNumber)
+				ereport(ERROR,
+						(errcode(ERRCODE_UNDEFINED_COLUMN),
+						 errmsg("hypopg: column \"%s\" does not exist",
+								attname)));
+			if (attnum < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("hypopg: statistics creation on system columns is not supported")));
+
+			for (j = 0; j < i; j++)
+			{
+				if (entry->keys[j] == attnum)
+					ereport(ERROR,
+							(errcode(ERRCODE_DUPLICATE_COLUMN),
+							 errmsg("hypopg: duplicate column name in statistics definition")));
+			}
+
+			typentry = lookup_type_cache(get_atttype(relid, attnum),
+										 TYPECACHE_EQ_OPR |
+										 TYPECACHE_CMP_PROC_FINFO);
+			if (!OidIsValid(typentry->eq_opr) ||
+				!OidIsValid(typentry->cmp_proc_finfo.fn_oid))
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("hypopg: column \"%s\" cannot be used in statistics because its type %s has no default btree operator class",
+								attname, format_type_be(typentry->type_id))));
+
+			entry->keys[i] = attnum;
+			entry->eqopr[i] = typentry->eq_opr;
+			entry->typlen[i] = typentry->typlen;
+			entry->typbyval[i] = typentry->typbyval;
+			i++;
+		}
+
+		foreach(lc, stmt->stat_types)
+		{
+			char	   *type = strVal(lfirst(lc));
+
+			if (strcmp(type, "ndistinct") == 0)
+				entry->has_ndistinct = true;
+			else if (strcmp(type, "dependencies") == 0)
+				entry->has_dependencies = true;
+			else if (strcmp(type, "mcv") == 0)
+				entry->has_mcv = true;
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("hypopg: unrecognized statistics kind \"%s\"",
+								type)));
+		}
+
+		/* If no statistic type was specified, build them all. */
+		if (stmt->stat_types == NIL)
+		{
+			entry->has_ndistinct = true;
+			entry->has_dependencies = true;
+			entry->has_mcv = true;
+		}
+
+		/* Build the name, prefixed with the oid as hypothetical indexes */
+		entry->oid = hypo_getNewOid(relid);
+		snprintf(oid, sizeof(oid), "<%d>", entry->oid);
+
+		initStringInfo(&name);
+		appendStringInfoString(&name, oid);
+		if (stmt->defnames != NIL)
+			appendStringInfoString(&name, strVal(llast(stmt->defnames)));
+		else
+		{
+			appendStringInfoString(&name, get_rel_name(relid));
+			for (i = 0; i < entry->nkeys; i++)
+				appendStringInfo(&name, "_%s",
+								 get_attname(relid, entry->keys[i]
+#if PG_VERSION_NUM >= 110000
+											 ,false
+#endif
+											 ));
+			appendStringInfoString(&name, "_stat");
+		}
+
+		entry->statname = MemoryContextStrdup(HypoMemoryContext, name.data);
+		pfree(name.data);
+	}
+	PG_CATCH();
+	{
+		hypo_stats_ext_pfree(entry);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	return entry;
+}
+
+/*
+ * Release all the memory used by a hypoStatsExt entry
+ */
+static void
+hypo_stats_ext_pfree(hypoStatsExt *entry)
+{
+	ListCell   *lc;
+	int			i;
+
+	if (entry->statname)
+		pfree(entry->statname);
+	foreach(lc, entry->ndistinct)
+	{
+		hypoNdistinct *item = (hypoNdistinct *) lfirst(lc);
+
+		bms_free(item->keys);
+	}
+	list_free_deep(entry->ndistinct);
+	list_free_deep(entry->dependencies);
+
+	for (i = 0; i < entry->nmcv; i++)
+	{
+		int			k;
+
+		for (k = 0; k < entry->nkeys; k++)
+		{
+			if (!entry->typbyval[k] && !entry->mcv[i].isnull[k])
+				pfree(DatumGetPointer(entry->mcv[i].values[k]));
+		}
+		pfree(entry->mcv[i].values);
+		pfree(entry->mcv[i].isnull);
+	}
+	if (entry->mcv)
+		pfree(entry->mcv);
+
+	pfree(entry->keys);
+	pfree(entry->eqopr);
+	pfree(entry->typlen);
+	pfree(entry->typbyval);
+	pfree(entry);
+}
+
+/*
+ * Remove the given hypothetical extended statistics, return true if found
+ */
+static bool
+hypo_stats_ext_remove(Oid statid)
+{
+	ListCell   *lc;
+
+	foreach(lc, hypoStatsExts)
+	{
+		hypoStatsExt *entry = (hypoStatsExt *) lfirst(lc);
+
+		if (entry->oid == statid)
+		{
+			hypoStatsExts = list_delete_ptr(hypoStatsExts, entry);
+			hypo_stats_ext_pfree(entry);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Remove all the hypothetical extended statistics defined on the given
+ * relation, return true if any was found
+ */
+bool
+hypo_stats_ext_remove_rel(Oid relid)
+{
+	List	   *to_remove = NIL;
+	ListCell   *lc;
+	bool		found;
+
+	foreach(lc, hypoStatsExts)
+	{
+		hypoStatsExt *entry = (hypoStatsExt *) lfirst(lc);
+
+		if (entry->relid == relid)
+			to_remove = lappend_oid(to_remove, entry->oid);
+	}
+
+	found = (to_remove != NIL);
+
+	foreach(lc, to_remove)
+		hypo_stats_ext_remove(lfirst_oid(lc));
+
+	list_free(to_remove);
+
+	return found;
+}
+
+/*
+ * Remove all the hypothetical extended statistics
+ */
+void
+hypo_stats_ext_reset(void)
+{
+	ListCell   *lc;
+
+	/*
+	 * The cell is removed in hypo_stats_ext_remove(), so we can't iterate
+	 * using standard foreach / lnext macros.
+	 */
+	while ((lc = list_head(hypoStatsExts)) != NULL)
+	{
+		hypoStatsExt *entry = (hypoStatsExt *) lfirst(lc);
+
+		hypo_stats_ext_remove(entry->oid);
+	}
+
+	list_free(hypoStatsExts);
+	hypoStatsExts = NIL;
+}
+
+/*
+ * Acquire a sample of the key columns of the given entry.  Caller is
+ * responsible for calling SPI_connect() and SPI_finish() before and after
+ * this function, and for switching to a memory context that can hold the
+ * sample.
+ */
+static hypoStatsSample *
+hypo_stats_ext_sample(hypoStatsExt *entry)
+{
+	hypoStatsSample *sample;
+	StringInfoData buf;
+	int			ret;
+	int			i;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "SELECT ");
+	for (i = 0; i < entry->nkeys; i++)
+	{
+		if (i != 0)
+			appendStringInfoString(&buf, ", ");
+		appendStringInfoString(&buf,
+							   quote_identifier(get_attname(entry->relid,
+															entry->keys[i]
+#if PG_VERSION_NUM >= 110000
+															,false
+#endif
+															)));
+	}
+	appendStringInfo(&buf, " FROM %s.%s TABLESAMPLE SYSTEM(%.2f)",
+					 quote_identifier(get_namespace_name(get_rel_namespace(entry->relid))),
+					 quote_identifier(get_rel_name(entry->relid)),
+					 entry->fraction);
+
+	ret = SPI_execute(buf.data, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "hypopg: Could not sample rows for hypothetical "
+			 "statistics \"%s\": SPI_execute returned %d",
+			 entry->statname, ret);
+
+	if (SPI_processed == 0)
+		elog(ERROR, "hypopg: the %f fraction of rows to analyze is too low."
+			 " No row has been sampled.",
+			 entry->fraction);
+
+	/* And make sure we don't overflow the sort */
+	if (SPI_processed >= PG_INT32_MAX / entry->nkeys)
+		elog(ERROR, "hypopg: the %f fraction of rows to analyze is too high.",
+			 entry->fraction);
+
+	sample = (hypoStatsSample *) palloc0(sizeof(hypoStatsSample));
+	sample->nkeys = entry->nkeys;
+	sample->numrows = (int) SPI_processed;
+	sample->totalrows = SPI_processed * 100 / entry->fraction;
+	sample->values = (Datum *) palloc(sizeof(Datum) * sample->numrows * entry->nkeys);
+	sample->isnull = (bool *) palloc(sizeof(bool) * sample->numrows * entry->nkeys);
+	sample->rows = (int *) palloc(sizeof(int) * sample->numrows);
+	sample->cmp = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * entry->nkeys);
+	sample->collations = (Oid *) palloc0(sizeof(Oid) * entry->nkeys);
+
+	for (i = 0; i < entry->nkeys; i++)
+	{
+		TypeCacheEntry *typentry;
+		Oid			atttypid;
+		int32		atttypmod;
+
+		typentry = lookup_type_cache(SPI_gettypeid(SPI_tuptable->tupdesc, i + 1),
+									 TYPECACHE_CMP_PROC_FINFO);
+		fmgr_info_copy(&sample->cmp[i], &typentry->cmp_proc_finfo,
+					   CurrentMemoryContext);
+		get_atttypetypmodcoll(entry->relid, entry->keys[i], &atttypid,
+							  &atttypmod, &sample->collations[i]);
+	}
+
+	for (i = 0; i < sample->numrows; i++)
+	{
+		int			k;
+
+		CHECK_FOR_INTERRUPTS();
+
+		sample->rows[i] = i;
+		for (k = 0; k < entry->nkeys; k++)
+			sample->values[i * entry->nkeys + k] =
+				SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc,
+							  k + 1, &sample->isnull[i * entry->nkeys + k]);
+	}
+
+	return sample;
+}
+
+/*
+ * Sort the sampled rows on the given key columns
+ */
+static void
+hypo_sample_sort(hypoStatsSample *sample, int *cols, int ncols)
+{
+	Assert(ncols <= STATS_MAX_DIMENSIONS);
+
+	memcpy(sample->sortcols, cols, sizeof(int) * ncols);
+	sample->nsortcols = ncols;
+
+	qsort_arg(sample->rows, sample->numrows, sizeof(int), hypo_sample_cmp,
+			  sample);
+}
+
+/*
+ * Compare two sampled rows on the current sort keys, NULLs sorting last
+ */
+static int
+hypo_sample_cmp(const void *a, const void *b, void *arg)
+{
+	hypoStatsSample *sample = (hypoStatsSample *) arg;
+	int			ra = *((const int *) a);
+	int			rb = *((const int *) b);
+	int			i;
+
+	for (i = 0; i < sample->nsortcols; i++)
+	{
+		int			k = sample->sortcols[i];
+		int			ia = ra * sample->nkeys + k;
+		int			ib = rb * sample->nkeys + k;
+		int32		cmp;
+
+		if (sample->isnull[ia] && sample->isnull[ib])
+			continue;
+		if (sample->isnull[ia])
+			return 1;
+		if (sample->isnull[ib])
+			return -1;
+
+		cmp = DatumGetInt32(FunctionCall2Coll(&sample->cmp[k],
+											  sample->collations[k],
+											  sample->values[ia],
+											  sample->values[ib]));
+		if (cmp != 0)
+			return cmp;
+	}
+
+	return 0;
+}
+
+/*
+ * Estimate the number of distinct values using the Duj1 estimator of Haas
+ * and Stokes, as ANALYZE does.
+ */
+static double
+hypo_estimate_ndistinct(double totalrows, int numrows, int d, int f1)
+{
+	double		numer,
+				denom,
+				ndistinct;
+
+	numer = (double) numrows * (double) d;
+
+	denom = (double) (numrows - f1) +
+		(double) f1 * (double) numrows / totalrows;
+
+	ndistinct = numer / denom;
+
+	/* Clamp to sane range in case of roundoff error */
+	if (ndistinct < (double) d)
+		ndistinct = (double) d;
+
+	if (ndistinct > totalrows)
+		ndistinct = totalrows;
+
+	return floor(ndistinct + 0.5);
+}
+
+/*
+ * Sort groups by decreasing number of rows
+ */
+static int
+hypo_group_cmp(const void *a, const void *b)
+{
+	const hypoStatsGroup *ga = (const hypoStatsGroup *) a;
+	const hypoStatsGroup *gb = (const hypoStatsGroup *) b;
+
+	if (ga->count > gb->count)
+		return -1;
+	if (ga->count < gb->count)
+		return 1;
+	return 0;
+}
+
+/*
+ * Compute the requested kinds of statistics from the given sample, and store
+ * them in the given entry.
+ */
+static void
+hypo_stats_ext_build(hypoStatsExt *entry, hypoStatsSample *sample)
+{
+	int			cols[STATS_MAX_DIMENSIONS];
+	int			i;
+
+	if (entry->has_ndistinct)
+	{
+		int			mask;
+
+		/* Every combination of at least two key columns */
+		for (mask = 1; mask < (1 << entry->nkeys); mask++)
+		{
+			hypoNdistinct *item;
+			MemoryContext oldcontext;
+			Bitmapset  *keys = NULL;
+			int			ncols = 0;
+			int			d = 1;
+			int			f1 = 0;
+			int			cnt = 1;
+
+			for (i = 0; i < entry->nkeys; i++)
+			{
+				if (mask & (1 << i))
+					cols[ncols++] = i;
+			}
+
+			if (ncols < 2)
+				continue;
+
+			CHECK_FOR_INTERRUPTS();
+
+			hypo_sample_sort(sample, cols, ncols);
+
+			for (i = 1; i < sample->numrows; i++)
+			{
+				if (hypo_sample_cmp(&sample->rows[i - 1], &sample->rows[i],
+									sample) != 0)
+				{
+					if (cnt == 1)
+						f1++;
+					d++;
+					cnt = 0;
+				}
+				cnt++;
+			}
+			if (cnt == 1)
+				f1++;
+
+			oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+			for (i = 0; i < ncols; i++)
+				keys = bms_add_member(keys, cols[i]);
+
+			item = (hypoNdistinct *) palloc0(sizeof(hypoNdistinct));
+			item->keys = keys;
+			item->ndistinct = hypo_estimate_ndistinct(sample->totalrows,
+													  sample->numrows, d, f1);
+			entry->ndistinct = lappend(entry->ndistinct, item);
+			MemoryContextSwitchTo(oldcontext);
+		}
+	}
+
+	if (entry->has_dependencies)
+	{
+		int			from,
+					to;
+
+		for (from = 0; from < entry->nkeys; from++)
+		{
+			for (to = 0; to < entry->nkeys; to++)
+			{
+				MemoryContext oldcontext;
+				hypoDependency *dep;
+				int			supporting = 0;
+				int			start = 0;
+
+				if (from == to)
+					continue;
+
+				CHECK_FOR_INTERRUPTS();
+
+				cols[0] = from;
+				cols[1] = to;
+				hypo_sample_sort(sample, cols, 2);
+
+				/*
+				 * Rows are sorted by (from, to), so a group of rows having the
+				 * same value for the determinant column supports the
+				 * dependency if its first and last rows have the same value
+				 * for the dependent column.
+				 */
+				sample->nsortcols = 1;
+				for (i = 1; i <= sample->numrows; i++)
+				{
+					if (i < sample->numrows &&
+						hypo_sample_cmp(&sample->rows[start], &sample->rows[i],
+										sample) == 0)
+						continue;
+
+					sample->sortcols[0] = to;
+					if (hypo_sample_cmp(&sample->rows[start],
+										&sample->rows[i - 1], sample) == 0)
+						supporting += i - start;
+					sample->sortcols[0] = from;
+
+					start = i;
+				}
+
+				if (supporting == 0)
+					continue;
+
+				oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+				dep = (hypoDependency *) palloc0(sizeof(hypoDependency));
+				dep->from = from;
+				dep->to = to;
+				dep->degree = (double) supporting / sample->numrows;
+				entry->dependencies = lappend(entry->dependencies, dep);
+				MemoryContextSwitchTo(oldcontext);
+			}
+		}
+	}
+
+	if (entry->has_mcv)
+	{
+		hypoStatsGroup *groups;
+		int			ngroups = 0;
+		int			start = 0;
+		int			mincount;
+		int			nitems = 0;
+
+		for (i = 0; i < entry->nkeys; i++)
+			cols[i] = i;
+
+		CHECK_FOR_INTERRUPTS();
+
+		hypo_sample_sort(sample, cols, entry->nkeys);
+
+		groups = (hypoStatsGroup *) palloc(sizeof(hypoStatsGroup) *
+										   sample->numrows);
+
+		for (i = 1; i <= sample->numrows; i++)
+		{
+			if (i < sample->numrows &&
+				hypo_sample_cmp(&sample->rows[start], &sample->rows[i],
+								sample) == 0)
+				continue;
+
+			groups[ngroups].first = sample->rows[start];
+			groups[ngroups].count = i - start;
+			ngroups++;
+			start = i;
+		}
+
+		qsort(groups, ngroups, sizeof(hypoStatsGroup), hypo_group_cmp);
+
+		/*
+		 * Unless the whole table has been sampled, only keep the combinations
+		 * seen more than once, as ANALYZE does.
+		 */
+		mincount = (sample->numrows < sample->totalrows) ? 2 : 1;
+
+		while (nitems < ngroups && nitems < default_statistics_target &&
+			   groups[nitems].count >= mincount)
+			nitems++;
+
+		if (nitems > 0)
+		{
+			MemoryContext oldcontext;
+
+			oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+
+			entry->mcv = (hypoMCVItem *) palloc0(sizeof(hypoMCVItem) * nitems);
+			entry->nmcv = nitems;
+			entry->mcv_totalfreq = 0;
+
+			for (i = 0; i < nitems; i++)
+			{
+				hypoMCVItem *item = &entry->mcv[i];
+				int			k;
+
+				item->values = (Datum *) palloc0(sizeof(Datum) * entry->nkeys);
+				item->isnull = (bool *) palloc0(sizeof(bool) * entry->nkeys);
+				item->frequency = (double) groups[i].count / sample->numrows;
+				entry->mcv_totalfreq += item->frequency;
+
+				for (k = 0; k < entry->nkeys; k++)
+				{
+					int			idx = groups[i].first * entry->nkeys + k;
+
+					item->isnull[k] = sample->isnull[idx];
+					if (!item->isnull[k])
+						item->values[k] = datumCopy(sample->values[idx],
+													entry->typbyval[k],
+													entry->typlen[k]);
+				}
+			}
+
+			MemoryContextSwitchTo(oldcontext);
+		}
+	}
+}
+
+/*
+ * Find the restriction clauses of the given relation that are an equality
+ * between a key column of the given entry and a constant.  The clauses,
+ * constants and collations are stored at the position of the key column in
+ * the given arrays.  Return the number of matched key columns.
+ */
+static int
+hypo_stats_ext_match(hypoStatsExt *entry, RelOptInfo *rel,
+					 RestrictInfo **clauses, Const **consts, Oid *collations)
+{
+	ListCell   *lc;
+	int			nmatched = 0;
+
+	foreach(lc, rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		OpExpr	   *opexpr;
+		Node	   *left,
+				   *right;
+		Var		   *var;
+		int			k;
+
+		if (rinfo->pseudoconstant || !is_opclause(rinfo->clause))
+			continue;
+
+		opexpr = (OpExpr *) rinfo->clause;
+		if (list_length(opexpr->args) != 2)
+			continue;
+
+		left = (Node *) linitial(opexpr->args);
+		right = (Node *) lsecond(opexpr->args);
+
+		if (IsA(left, RelabelType))
+			left = (Node *) ((RelabelType *) left)->arg;
+		if (IsA(right, RelabelType))
+			right = (Node *) ((RelabelType *) right)->arg;
+
+		if (IsA(left, Const) && IsA(right, Var))
+		{
+			Node	   *tmp = left;
+
+			left = right;
+			right = tmp;
+		}
+
+		if (!IsA(left, Var) || !IsA(right, Const) ||
+			((Const *) right)->constisnull)
+			continue;
+
+		var = (Var *) left;
+		if (var->varno != rel->relid || var->varlevelsup != 0)
+			continue;
+
+		for (k = 0; k < entry->nkeys; k++)
+		{
+			if (entry->keys[k] == var->varattno &&
+				entry->eqopr[k] == opexpr->opno &&
+				clauses[k] == NULL)
+			{
+				clauses[k] = rinfo;
+				consts[k] = (Const *) right;
+				collations[k] = opexpr->inputcollid;
+				nmatched++;
+				break;
+			}
+		}
+	}
+
+	return nmatched;
+}
+
+/*
+ * Estimate the selectivity of the matched clauses using the functional
+ * dependencies: P(a,b) = P(a) * [f + (1-f)*P(b)], applying the strongest
+ * dependencies first.
+ */
+static Selectivity
+hypo_dependencies_selectivity(hypoStatsExt *entry, Selectivity *sels,
+							  RestrictInfo **clauses)
+{
+	bool		implied[STATS_MAX_DIMENSIONS];
+	Selectivity s = 1.0;
+	int			k;
+
+	memset(implied, 0, sizeof(implied));
+
+	for (;;)
+	{
+		hypoDependency *best = NULL;
+		ListCell   *lc;
+
+		foreach(lc, entry->dependencies)
+		{
+			hypoDependency *dep = (hypoDependency *) lfirst(lc);
+
+			if (clauses[dep->from] == NULL || clauses[dep->to] == NULL ||
+				implied[dep->from] || implied[dep->to])
+				continue;
+
+			if (best == NULL || dep->degree > best->degree)
+				best = dep;
+		}
+
+		if (best == NULL)
+			break;
+
+		implied[best->to] = true;
+		s *= best->degree + (1 - best->degree) * sels[best->to];
+	}
+
+	for (k = 0; k < entry->nkeys; k++)
+	{
+		if (clauses[k] != NULL && !implied[k])
+			s *= sels[k];
+	}
+
+	return s;
+}
+
+/*
+ * Sum the frequencies of the MCV items matching all the matched clauses.
+ * found is set to true if at least one item matched.
+ */
+static Selectivity
+hypo_mcv_selectivity(hypoStatsExt *entry, RestrictInfo **clauses,
+					 Const **consts, Oid *collations, bool *found)
+{
+	FmgrInfo	eqproc[STATS_MAX_DIMENSIONS];
+	Selectivity s = 0;
+	int			i,
+				k;
+
+	*found = false;
+
+	for (k = 0; k < entry->nkeys; k++)
+	{
+		if (clauses[k] != NULL)
+			fmgr_info(get_opcode(entry->eqopr[k]), &eqproc[k]);
+	}
+
+	for (i = 0; i < entry->nmcv; i++)
+	{
+		hypoMCVItem *item = &entry->mcv[i];
+		bool		match = true;
+
+		for (k = 0; match && k < entry->nkeys; k++)
+		{
+			if (clauses[k] == NULL)
+				continue;
+
+			match = (!item->isnull[k] &&
+					 DatumGetBool(FunctionCall2Coll(&eqproc[k], collations[k],
+													item->values[k],
+													consts[k]->constvalue)));
+		}
+
+		if (match)
+		{
+			*found = true;
+			s += item->frequency;
+		}
+	}
+
+	return s;
+}
+
+/*
+ * Adjust the estimated number of rows of the given base relation and of its
+ * paths using the stored hypothetical extended statistics, if any apply.
+ * Only the statistics matching the highest number of clauses is used.
+ */
+void
+hypo_stats_ext_adjust_rel(PlannerInfo *root, RelOptInfo *rel,
+						  RangeTblEntry *rte)
+{
+	hypoStatsExt *best = NULL;
+	RestrictInfo *best_clauses[STATS_MAX_DIMENSIONS];
+	Const	   *best_consts[STATS_MAX_DIMENSIONS];
+	Oid			best_collations[STATS_MAX_DIMENSIONS];
+	int			best_nmatched = 1;
+	Selectivity sels[STATS_MAX_DIMENSIONS];
+	Selectivity sel_indep = 1.0;
+	Selectivity sel_new = -1;
+	double		ratio;
+	ListCell   *lc;
+	int			k;
+
+	if (rel->reloptkind != RELOPT_BASEREL || rte->rtekind != RTE_RELATION ||
+		rte->inh || IS_DUMMY_REL(rel) || list_length(rel->baserestrictinfo) < 2)
+		return;
+
+	foreach(lc, hypoStatsExts)
+	{
+		hypoStatsExt *entry = (hypoStatsExt *) lfirst(lc);
+		RestrictInfo *clauses[STATS_MAX_DIMENSIONS];
+		Const	   *consts[STATS_MAX_DIMENSIONS];
+		Oid			collations[STATS_MAX_DIMENSIONS];
+		Bitmapset  *attnums = NULL;
+		ListCell   *lc2;
+		bool		covered = false;
+		int			nmatched;
+
+		if (entry->relid != rte->relid ||
+			(!entry->has_dependencies && !entry->has_mcv))
+			continue;
+
+		memset(clauses, 0, sizeof(clauses));
+		nmatched = hypo_stats_ext_match(entry, rel, clauses, consts, collations);
+
+		if (nmatched <= best_nmatched)
+			continue;
+
+		/*
+		 * Don't use the hypothetical statistics if real extended statistics
+		 * already cover the same columns, the planner already used them.
+		 */
+		for (k = 0; k < entry->nkeys; k++)
+		{
+			if (clauses[k] != NULL)
+				attnums = bms_add_member(attnums, entry->keys[k]);
+		}
+		foreach(lc2, rel->statlist)
+		{
+			StatisticExtInfo *info = (StatisticExtInfo *) lfirst(lc2);
+
+			if (bms_is_subset(attnums, info->keys))
+				covered = true;
+		}
+		bms_free(attnums);
+
+		if (covered)
+			continue;
+
+		best = entry;
+		best_nmatched = nmatched;
+		memcpy(best_clauses, clauses, sizeof(clauses));
+		memcpy(best_consts, consts, sizeof(consts));
+		memcpy(best_collations, collations, sizeof(collations));
+	}
+
+	if (best == NULL)
+		return;
+
+	/* Selectivity of the matched clauses, as estimated by the planner */
+	for (k = 0; k < best->nkeys; k++)
+	{
+		if (best_clauses[k] == NULL)
+			continue;
+
+		sels[k] = clause_selectivity(root, (Node *) best_clauses[k], 0,
+									 JOIN_INNER, NULL);
+		sel_indep *= sels[k];
+	}
+
+	if (best->has_dependencies && best->dependencies != NIL)
+		sel_new = hypo_dependencies_selectivity(best, sels, best_clauses);
+
+	if (best->has_mcv && best->nmcv > 0)
+	{
+		Selectivity sel_mcv;
+		Selectivity sel_other = (sel_new >= 0 ? sel_new : sel_indep);
+		bool		found;
+
+		sel_mcv = hypo_mcv_selectivity(best, best_clauses, best_consts,
+									   best_collations, &found);
+
+		/*
+		 * If all the key columns are matched, the rows are either described
+		 * by an MCV item or not part of the MCV list at all.
+		 */
+		if (best_nmatched == best->nkeys && found)
+			sel_new = sel_mcv;
+		else if (best_nmatched == best->nkeys)
+			sel_new = Min(sel_other, 1.0 - best->mcv_totalfreq);
+		else
+			sel_new = sel_mcv + (1.0 - best->mcv_totalfreq) * sel_other;
+	}
+
+	if (sel_new < 0 || sel_indep <= 0)
+		return;
+
+	CLAMP_PROBABILITY(sel_new);
+	ratio = sel_new / sel_indep;
+
+	elog(DEBUG1, "hypopg: statistics \"%s\" changed selectivity from %f to %f",
+		 best->statname, sel_indep, sel_new);
+
+	rel->rows = clamp_row_est(rel->rows * ratio);
+
+	foreach(lc, rel->pathlist)
+	{
+		Path	   *path = (Path *) lfirst(lc);
+
+		path->rows = clamp_row_est(path->rows * ratio);
+	}
+
+	foreach(lc, rel->partial_pathlist)
+	{
+		Path	   *path = (Path *) lfirst(lc);
+
+		path->rows = clamp_row_est(path->rows * ratio);
+	}
+}
+
+/*
+ * Return a text representation of the given set of key columns attnums
+ */
+static char *
+hypo_stats_ext_keys_out(hypoStatsExt *entry, Bitmapset *keys)
+{
+	StringInfoData buf;
+	int			k = -1;
+	bool		first = true;
+
+	initStringInfo(&buf);
+	while ((k = bms_next_member(keys, k)) >= 0)
+	{
+		if (!first)
+			appendStringInfoString(&buf, ", ");
+		appendStringInfo(&buf, "%d", entry->keys[k]);
+		first = false;
+	}
+
+	return buf.data;
+}
+#endif							/* PG_VERSION_NUM >= 100000 */
+
+/*
+ * SQL wrapper to create hypothetical extended statistics.  The data are
+ * computed on the given percentage of the table.
+ */
+Datum
+hypopg_create_statistics(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	elog(ERROR, "hypopg: Hypothetical extended statistics require PostgreSQL 10 or above");
+	PG_RETURN_VOID();
+#else
+	char	   *sql = TextDatumGetCString(PG_GETARG_TEXT_PP(0));
+	float4		fraction = PG_GETARG_FLOAT4(1);
+	List	   *parsetree_list;
+	Node	   *parsetree;
+	hypoStatsExt *entry;
+	MemoryContext stats_context;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Datum		values[HYPO_STATS_CREATE_COLS];
+	bool		nulls[HYPO_STATS_CREATE_COLS];
+	int			ret;
+
+	if (isnan(fraction) || fraction == get_float4_infinity()
+		|| fraction <= 0 || fraction > 100)
+		elog(ERROR, "hypopg: invalid fraction: %f", fraction);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	parsetree_list = pg_parse_query(sql);
+
+	if (list_length(parsetree_list) != 1)
+		elog(ERROR, "hypopg: a single CREATE STATISTICS statement is expected");
+
+	parsetree = ((RawStmt *) linitial(parsetree_list))->stmt;
+
+	if (!IsA(parsetree, CreateStatsStmt))
+		elog(ERROR, "hypopg: SQL order is not a CREATE STATISTICS statement");
+
+	entry = hypo_stats_ext_new((CreateStatsStmt *) parsetree);
+	entry->fraction = fraction;
+
+	/* Connect to SPI manager */
+	if ((ret = SPI_connect()) < 0)
+		/* internal error */
+		elog(ERROR, "hypopg: SPI_connect returned %d", ret);
+
+	/*
+	 * Set up a working context so that we can easily free the sample and
+	 * whatever junk gets created.
+	 */
+	stats_context = AllocSetContextCreate(CurrentMemoryContext,
+										  "hypopg statistics",
+										  ALLOCSET_DEFAULT_SIZES);
+	oldcontext = MemoryContextSwitchTo(stats_context);
+
+	PG_TRY();
+	{
+		hypoStatsSample *sample = hypo_stats_ext_sample(entry);
+
+		hypo_stats_ext_build(entry, sample);
+	}
+	PG_CATCH();
+	{
+		hypo_stats_ext_pfree(entry);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextDelete(stats_context);
+
+	/* release SPI related resources (and return to caller's context) */
+	SPI_finish();
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	hypoStatsExts = lappend(hypoStatsExts, entry);
+	MemoryContextSwitchTo(oldcontext);
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = ObjectIdGetDatum(entry->oid);
+	values[1] = CStringGetTextDatum(entry->statname);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+#endif
+}
+
+/*
+ * SQL wrapper to drop a hypothetical extended statistics.
+ */
+Datum
+hypopg_drop_statistics(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	elog(ERROR, "hypopg: Hypothetical extended statistics require PostgreSQL 10 or above");
+	PG_RETURN_VOID();
+#else
+	Oid			statid = PG_GETARG_OID(0);
+
+	PG_RETURN_BOOL(hypo_stats_ext_remove(statid));
+#endif
+}
+
+/*
+ * SQL wrapper to remove all hypothetical extended statistics.
+ */
+Datum
+hypopg_reset_statistics(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 100000
+	hypo_stats_ext_reset();
+#endif
+	PG_RETURN_VOID();
+}
+
+/*
+ * List all the hypothetical extended statistics, with a text representation
+ * of the computed data similar to pg_ndistinct and pg_dependencies output.
+ */
+Datum
+hypopg_list_statistics(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	elog(ERROR, "hypopg: Hypothetical extended statistics require PostgreSQL 10 or above");
+	PG_RETURN_VOID();
+#else
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ListCell   *lc;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Discard the statistics of the relations that have been dropped */
+	hypo_process_inval();
+
+	foreach(lc, hypoStatsExts)
+	{
+		hypoStatsExt *entry = (hypoStatsExt *) lfirst(lc);
+		Datum		values[HYPO_STATS_NB_COLS];
+		bool		nulls[HYPO_STATS_NB_COLS];
+		Datum	   *keys;
+		ArrayType  *arry;
+		StringInfoData buf;
+		ListCell   *lc2;
+		int			i = 0;
+		int			k;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		values[i++] = ObjectIdGetDatum(entry->oid);
+		values[i++] = CStringGetTextDatum(entry->statname);
+		values[i++] = ObjectIdGetDatum(entry->relid);
+
+		keys = (Datum *) palloc(sizeof(Datum) * entry->nkeys);
+		for (k = 0; k < entry->nkeys; k++)
+			keys[k] = Int16GetDatum(entry->keys[k]);
+		arry = construct_array(keys, entry->nkeys, INT2OID, sizeof(int16),
+							   true, 's');
+		values[i++] = PointerGetDatum(arry);
+
+		if (entry->has_ndistinct)
+		{
+			bool		first = true;
+
+			initStringInfo(&buf);
+			appendStringInfoChar(&buf, '{');
+			foreach(lc2, entry->ndistinct)
+			{
+				hypoNdistinct *item = (hypoNdistinct *) lfirst(lc2);
+
+				if (!first)
+					appendStringInfoString(&buf, ", ");
+				appendStringInfo(&buf, "\"%s\": %d",
+								 hypo_stats_ext_keys_out(entry, item->keys),
+								 (int) item->ndistinct);
+				first = false;
+			}
+			appendStringInfoChar(&buf, '}');
+			values[i++] = CStringGetTextDatum(buf.data);
+		}
+		else
+			nulls[i++] = true;
+
+		if (entry->has_dependencies)
+		{
+			bool		first = true;
+
+			initStringInfo(&buf);
+			appendStringInfoChar(&buf, '{');
+			foreach(lc2, entry->dependencies)
+			{
+				hypoDependency *dep = (hypoDependency *) lfirst(lc2);
+
+				if (!first)
+					appendStringInfoString(&buf, ", ");
+				appendStringInfo(&buf, "\"%d => %d\": %f",
+								 entry->keys[dep->from],
+								 entry->keys[dep->to],
+								 dep->degree);
+				first = false;
+			}
+			appendStringInfoChar(&buf, '}');
+			values[i++] = CStringGetTextDatum(buf.data);
+		}
+		else
+			nulls[i++] = true;
+
+		if (entry->has_mcv)
+			values[i++] = Int32GetDatum(entry->nmcv);
+		else
+			nulls[i++] = true;
+
+		Assert(i == HYPO_STATS_NB_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+#endif
+}
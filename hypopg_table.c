@@ -42,6 +42,7 @@
 #include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
 #include "optimizer/predtest.h"
 #include "optimizer/prep.h"
 #include "optimizer/restrictinfo.h"
@@ -71,13 +72,23 @@
 
 HTAB	   *hypoTables;
 
+/* List of hidden real partitions for current backend */
+List	   *hypoHiddenPartitions = NIL;
+
+/* Hypothetical partitioning information of the PlannerInfo being planned */
+static hypoPlannerMap *hypoPlannerMaps = NULL;
+
 /*--- Functions --- */
 
 PG_FUNCTION_INFO_V1(hypopg_add_partition);
 PG_FUNCTION_INFO_V1(hypopg_drop_table);
+PG_FUNCTION_INFO_V1(hypopg_hidden_partitions);
+PG_FUNCTION_INFO_V1(hypopg_hide_partition);
 PG_FUNCTION_INFO_V1(hypopg_partition_table);
 PG_FUNCTION_INFO_V1(hypopg_reset_table);
 PG_FUNCTION_INFO_V1(hypopg_table);
+PG_FUNCTION_INFO_V1(hypopg_unhide_all_partitions);
+PG_FUNCTION_INFO_V1(hypopg_unhide_partition);
 
 
 #if PG_VERSION_NUM >= 100000	/* closed just before the SQL wrapper */
@@ -113,8 +124,9 @@ static PartitionBoundSpec *hypo_get_boundspec(Oid tableid);
 #if PG_VERSION_NUM >= 110000
 static Oid	hypo_get_default_partition_oid(hypoTable *parent);
 #endif
-static char *hypo_get_partbounddef(hypoTable *entry);
-static char *hypo_get_partkeydef(hypoTable *entry);
+static hypoPlannerMap *hypo_planner_map_find(PlannerInfo *root, Index rti,
+					  bool create);
+static void hypo_planner_map_forget(void *arg);
 static hypoTable *hypo_newTable(Oid parentid);
 #if PG_VERSION_NUM >= 110000
 static void hypo_table_check_constraints_compatibility(hypoTable *table);
@@ -135,6 +147,9 @@ static List *hypo_get_qual_for_range(hypoTable *parent, PartitionBoundSpec *spec
 						bool for_default);
 static void hypo_check_new_partition_bound(char *relname, hypoTable *parent,
 							   PartitionBoundSpec *spec);
+static bool hypo_rel_is_partition(Oid relid);
+static Oid	hypo_get_partition_parent(Oid relid);
+static bool hypo_partition_set_hidden(Oid relid, bool hidden);
 
 
 /* Setup the hypoTables hash */
@@ -246,7 +261,7 @@ hypo_expand_partitioned_entry(PlannerInfo *root, Oid relationObjectId,
 
 		rte->relkind = RELKIND_PARTITIONED_TABLE;
 		rte->inh = (nparts > 0);
-		HYPO_TAG_RTI(rel->relid, root);
+		hypo_tag_rti(root, rel->relid, NULL);
 #if PG_VERSION_NUM < 110000
 		*partitioned_child_rels = lappend_int(*partitioned_child_rels,
 											  firstpos);
@@ -276,7 +291,7 @@ hypo_expand_partitioned_entry(PlannerInfo *root, Oid relationObjectId,
 	root->parse->rtable = lappend(root->parse->rtable,
 								  root->simple_rte_array[firstpos]);
 
-	HYPO_TAG_RTI(firstpos, root);
+	hypo_tag_rti(root, firstpos, NULL);
 
 	/*
 	 * if the table has no partition, we need to tell caller than it has to
@@ -370,15 +385,10 @@ hypo_expand_single_inheritance_child(PlannerInfo *root, Oid relationObjectId,
 	childrte->alias->aliasname = child->tablename;
 
 	Assert(rte->rtekind != RTE_CTE);
-	if (expandBranch)
-		HYPO_TABLE_RTE_SET_HYPOOID(childrte, branch->oid);
-	//partitionOID
-		else
-		HYPO_TABLE_RTE_SET_HYPOOID(childrte, child->oid);
-	//partitionOID
+	HYPO_TABLE_RTE_SET_HYPOOID(childrte, child->oid);
 
-		root->simple_rte_array[newrelid] = childrte;
-	HYPO_TAG_RTI(newrelid, root);
+	root->simple_rte_array[newrelid] = childrte;
+	hypo_tag_rti(root, newrelid, child);
 	root->parse->rtable = lappend(root->parse->rtable,
 								  root->simple_rte_array[newrelid]);
 #if PG_VERSION_NUM < 110000
@@ -1491,7 +1501,7 @@ hypo_get_default_partition_oid(hypoTable *parent)
  *
  * Heavily inspired on get_rule_expr()
  */
-static char *
+char *
 hypo_get_partbounddef(hypoTable *entry)
 {
 	StringInfoData _buf;
@@ -1570,7 +1580,7 @@ hypo_get_partbounddef(hypoTable *entry)
  *
  * Heavily inspired on pg_get_partkeydef_worker()
  */
-static char *
+char *
 hypo_get_partkeydef(hypoTable *entry)
 {
 	StringInfoData buf;
@@ -1871,6 +1881,7 @@ hypo_newTable(Oid parentid)
 	entry->children = NIL;		/* maintained add child creation */
 	entry->boundspec = NULL;	/* wil be generated later if needed */
 	entry->partkey = NULL;		/* wil be generated later if needed */
+	entry->fraction_sampled = false;	/* wil be sampled later if needed */
 	entry->valid = false;		/* set to true when all initialization is done */
 
 	if (parent)
@@ -1919,6 +1930,170 @@ hypo_find_table(Oid tableid, bool missing_ok)
 	return NULL;
 }
 
+/*
+ * Return the hypoPlannerMap of the given PlannerInfo.  If create is true, the
+ * map is created if needed and made big enough to store the given rti,
+ * otherwise NULL is returned if there's no map or if the rti isn't covered.
+ */
+static hypoPlannerMap *
+hypo_planner_map_find(PlannerInfo *root, Index rti, bool create)
+{
+	hypoPlannerMap *map;
+	MemoryContext oldcontext;
+	int			size;
+
+	for (map = hypoPlannerMaps; map != NULL; map = map->next)
+	{
+		if (map->root == root)
+			break;
+	}
+
+	if (!create)
+	{
+		if (map && rti < map->size)
+			return map;
+		return NULL;
+	}
+
+	if (map && rti < map->size)
+		return map;
+
+	/* The map lives and dies with the PlannerInfo */
+	oldcontext = MemoryContextSwitchTo(GetMemoryChunkContext(root));
+
+	size = Max(root->simple_rel_array_size, rti + 1);
+	if (!map)
+	{
+		map = (hypoPlannerMap *) palloc0(sizeof(hypoPlannerMap));
+		map->root = root;
+		map->size = size;
+		map->tagged = (bool *) palloc0(sizeof(bool) * size);
+		map->tables = (hypoTable **) palloc0(sizeof(hypoTable *) * size);
+
+		map->callback.func = hypo_planner_map_forget;
+		map->callback.arg = (void *) map;
+		MemoryContextRegisterResetCallback(CurrentMemoryContext,
+										   &map->callback);
+
+		map->next = hypoPlannerMaps;
+		hypoPlannerMaps = map;
+	}
+	else
+	{
+		map->tagged = (bool *) repalloc(map->tagged, sizeof(bool) * size);
+		map->tables = (hypoTable **) repalloc(map->tables,
+											  sizeof(hypoTable *) * size);
+		memset(map->tagged + map->size, 0,
+			   sizeof(bool) * (size - map->size));
+		memset(map->tables + map->size, 0,
+			   sizeof(hypoTable *) * (size - map->size));
+		map->size = size;
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return map;
+}
+
+/*
+ * Memory context callback, unlink a hypoPlannerMap whose PlannerInfo is going
+ * away.  The map may already have been released.
+ */
+static void
+hypo_planner_map_forget(void *arg)
+{
+	hypoPlannerMap *map = (hypoPlannerMap *) arg;
+	hypoPlannerMap **prev;
+
+	for (prev = &hypoPlannerMaps; *prev != NULL; prev = &(*prev)->next)
+	{
+		if (*prev == map)
+		{
+			*prev = map->next;
+			break;
+		}
+	}
+}
+
+/*
+ * Forget the hypothetical partitioning information of the given PlannerInfo,
+ * for PlannerInfo that are freed before their memory context.
+ */
+void
+hypo_planner_map_release(PlannerInfo *root)
+{
+	hypoPlannerMap *map = hypo_planner_map_find(root, 0, false);
+
+	if (map)
+		hypo_planner_map_forget(map);
+}
+
+/*
+ * Has the given rti been handled by the hypothetical partitioning?
+ */
+bool
+hypo_rti_is_tagged(PlannerInfo *root, Index rti)
+{
+	hypoPlannerMap *map = hypo_planner_map_find(root, rti, false);
+
+	return (map && map->tagged[rti]);
+}
+
+/*
+ * Return the hypothetical partition the given rti stands for, or NULL if it's
+ * not a hypothetical partition.
+ */
+hypoTable *
+hypo_rti_get_table(PlannerInfo *root, Index rti)
+{
+	hypoPlannerMap *map = hypo_planner_map_find(root, rti, false);
+
+	if (!map)
+		return NULL;
+
+	return map->tables[rti];
+}
+
+/*
+ * Mark the given rti as handled by the hypothetical partitioning, and
+ * remember the hypothetical partition it stands for if part isn't NULL.
+ */
+void
+hypo_tag_rti(PlannerInfo *root, Index rti, hypoTable *part)
+{
+	hypoPlannerMap *map = hypo_planner_map_find(root, rti, true);
+
+	map->tagged[rti] = true;
+	if (part)
+		map->tables[rti] = part;
+}
+
+/*
+ * Return the range table index of the given RangeTblEntry in the PlannerInfo,
+ * or 0 if it's not found.  hint is checked first, as callers usually know
+ * the rti.
+ */
+Index
+hypo_rte_get_rti(PlannerInfo *root, RangeTblEntry *rte, Index hint)
+{
+	Index		rti;
+
+	if (!root->simple_rte_array)
+		return 0;
+
+	if (hint > 0 && hint < root->simple_rel_array_size &&
+		root->simple_rte_array[hint] == rte)
+		return hint;
+
+	for (rti = 1; rti < root->simple_rel_array_size; rti++)
+	{
+		if (root->simple_rte_array[rti] == rte)
+			return rti;
+	}
+
+	return 0;
+}
+
 /*
  * Return the hypothetical oid if  the given name is an hypothetical partition,
  * otherwise return InvalidOid
@@ -2053,6 +2228,9 @@ hypo_table_remove(Oid tableid, hypoTable *parent, bool deep)
 			Assert(list_member_oid(parent->children, tableid));
 
 			parent->children = list_delete_oid(parent->children, tableid);
+
+			/* as well as a removed one */
+			hypo_table_reset_fractions(entry->rootid);
 		}
 	}
 
@@ -2087,6 +2265,28 @@ hypo_table_reset(void)
 	return;
 }
 
+/*
+ * Forget the sampled fractions of all the hypothetical partitions of the
+ * given root table, as they depend on its content and on the bounds of all
+ * the partitions.
+ */
+void
+hypo_table_reset_fractions(Oid rootid)
+{
+	HASH_SEQ_STATUS hash_seq;
+	hypoTable  *entry;
+
+	if (!hypoTables)
+		return;
+
+	hash_seq_init(&hash_seq, hypoTables);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		if (entry->rootid == rootid)
+			entry->fraction_sampled = false;
+	}
+}
+
 /*
  * Create an hypothetical partition from its CREATE TABLE parsetree.  This
  * function is where all the hypothetic partition creation is done, except the
@@ -2427,6 +2627,46 @@ hypo_transformPartitionBound(ParseState *pstate, hypoTable *parent,
 	return result_spec;
 }
 
+/*
+ * Return the fraction of the root table's rows a partition would contain if
+ * the rows were uniformly distributed among the partitions of each level.
+ */
+Selectivity
+hypo_partition_uniform_fraction(hypoTable *part)
+{
+	Selectivity fraction = 1.0;
+	hypoTable  *cur_part = part;
+
+	while (OidIsValid(cur_part->parentid))
+	{
+		hypoTable  *parent = hypo_find_table(cur_part->parentid, false);
+
+		Assert(list_length(parent->children) > 0);
+		fraction /= list_length(parent->children);
+		cur_part = parent;
+	}
+
+	return fraction;
+}
+
+/*
+ * Return the estimated fraction of the root table's rows a partition
+ * contains, when no PlannerInfo is available.  The number of tuples computed
+ * by hypopg_analyze() or the fraction sampled in accurate mode are used if
+ * any, otherwise the rows are assumed to be uniformly distributed.
+ */
+Selectivity
+hypo_partition_fraction(hypoTable *part, double roottuples)
+{
+	if (part->set_tuples && roottuples > 0)
+		return Min(part->tuples / roottuples, 1.0);
+
+	if (part->fraction_sampled && part->fraction >= 0)
+		return part->fraction;
+
+	return hypo_partition_uniform_fraction(part);
+}
+
 
 /*
  * If this rel is the table we want to partition hypothetically, we inject
@@ -2443,7 +2683,7 @@ hypo_injectHypotheticalPartitioning(PlannerInfo *root,
 	 * if this rel is parent, prepare some structures to inject hypothetical
 	 * partitioning
 	 */
-	if (!HYPO_RTI_IS_TAGGED(rel->relid, root))
+	if (!hypo_rti_is_tagged(root, rel->relid))
 	{
 		Relation	parentrel;
 #if PG_VERSION_NUM < 110000
@@ -2486,9 +2726,8 @@ hypo_injectHypotheticalPartitioning(PlannerInfo *root,
 	 * product of the number of partitions.
 	 */
 	if (rel->reloptkind != RELOPT_BASEREL
-		&& HYPO_RTI_IS_TAGGED(rel->relid, root))
+		&& hypo_rti_get_table(root, rel->relid) != NULL)
 	{
-		Oid			partoid;
 		hypoTable  *part;
 #if PG_VERSION_NUM >= 110000
 		hypoTable  *cur_part;
@@ -2498,9 +2737,7 @@ hypo_injectHypotheticalPartitioning(PlannerInfo *root,
 		double		pages;
 		int			total_modulus = 1;
 
-		Assert(rte->rtekind != RTE_CTE && HYPO_TABLE_RTE_HAS_HYPOOID(rte));
-		partoid = HYPO_TABLE_RTE_GET_HYPOOID(rte);
-		part = hypo_find_table(partoid, false);
+		part = hypo_rti_get_table(root, rel->relid);
 #if PG_VERSION_NUM >= 110000
 
 		/*
@@ -2553,17 +2790,45 @@ hypo_injectHypotheticalPartitioning(PlannerInfo *root,
 			rel->pages = (BlockNumber) pages;
 			rel->tuples = clamp_row_est(part->tuples / total_modulus);
 		}
+		else if (hypo_estimation_mode == HYPO_ESTIMATION_FAST)
+		{
+			/*
+			 * Assume that the rows are uniformly distributed among the
+			 * partitions, which also accounts for the hash partitions.
+			 */
+			selectivity = hypo_partition_uniform_fraction(part);
+
+			elog(DEBUG1, "hypopg: uniform fraction for partition \"%s\": %lf",
+				 part->tablename, selectivity);
+
+			pages = ceil(rel->pages * selectivity);
+			rel->pages = (BlockNumber) pages;
+			rel->tuples = clamp_row_est(rel->tuples * selectivity);
+		}
 		else
 		{
 			/*
 			 * hypo_clauselist_selectivity will retrieve the constraints for
-			 * this partition and all its ancestors
+			 * this partition and all its ancestors.  In accurate mode, first
+			 * try to compute the fraction of the root table's rows belonging
+			 * to the partition on a sample of the table.  This isn't possible
+			 * for hash partitions, as satisfies_hash_partition() requires a
+			 * real partitioned table.
 			 */
-			selectivity = hypo_clauselist_selectivity(root, rel, NIL,
-													  part->rootid, part->parentid);
+			bool		sampled = false;
+
+			if (hypo_estimation_mode == HYPO_ESTIMATION_ACCURATE &&
+				total_modulus == 1)
+				sampled = hypo_sample_partition_fraction(part, rel->tuples,
+														 &selectivity);
+
+			if (!sampled)
+				selectivity = hypo_clauselist_selectivity(root, rel, NIL,
+														  part->rootid,
+														  part->parentid);
 
 			elog(DEBUG1, "hypopg: selectivity for partition \"%s\": %lf",
-				 hypo_find_table(HYPO_TABLE_RTE_GET_HYPOOID(rte), false)->tablename,
+				 part->tablename,
 				 selectivity);
 
 			/* compute pages and tuples using selectivity and total_modulus */
@@ -2606,12 +2871,11 @@ hypo_markDummyIfExcluded(PlannerInfo *root, RelOptInfo *rel,
 	List	   *constraints;
 	List	   *safe_constraints = NIL;
 	ListCell   *lc;
-	Oid			partoid = HYPO_TABLE_RTE_GET_HYPOOID(rte);
-	hypoTable  *part = hypo_find_table(partoid, false);
+	hypoTable  *part = hypo_rti_get_table(root, rti);
 	hypoTable  *parent = hypo_find_table(part->parentid, false);
 
 	Assert(hypo_table_oid_is_hypothetical(rte->relid));
-	Assert(rte->rtekind != RTE_CTE);
+	Assert(part != NULL);
 	Assert(rte->relkind == 'r');
 
 	/* get its partition constraints */
@@ -2888,13 +3152,11 @@ hypo_get_partition_constraints(PlannerInfo *root, RelOptInfo *rel,
 							   hypoTable *parent, bool force_generation)
 {
 	Index		varno = rel->relid;
-	Oid			childOid;
 	hypoTable  *child;
 	List	   *pcqual;
 
-	Assert((planner_rt_fetch(rel->relid, root))->rtekind != RTE_CTE);
-	childOid = HYPO_TABLE_RTI_GET_HYPOOID(rel->relid, root);
-	child = hypo_find_table(childOid, false);
+	child = hypo_rti_get_table(root, rel->relid);
+	Assert(child != NULL);
 
 	Assert(child->parentid == parent->oid);
 
@@ -3883,42 +4145,29 @@ hypo_check_new_partition_bound(char *relname, hypoTable *parent,
 	}
 }
 
-#endif							/* pg10+ (~l. 81) */
-
 /*
- * SQL wrapper to create an hypothetical partition with his parsetree
+ * Create an hypothetical partition from its CREATE TABLE ... PARTITION OF
+ * parsetree, checking that its name is available and that its parent is a
+ * hypothetically partitioned table.
  */
-Datum
-hypopg_add_partition(PG_FUNCTION_ARGS)
+hypoTable *
+hypo_table_add_partition(CreateStmt *stmt, const char *queryString)
 {
-#if PG_VERSION_NUM < 100000
-	HYPO_PARTITION_NOT_SUPPORTED();
-#else
-	const char *partname = PG_GETARG_NAME(0)->data;
-	char	   *partitionof = TextDatumGetCString(PG_GETARG_TEXT_PP(1));
-	char	   *partition_by = NULL;
-	StringInfoData sql;
+	const char *partname = stmt->relation->relname;
 	hypoTable  *parent;
 	Oid			parentid,
 				rootid;
-	hypoTable  *entry;
-	List	   *parsetree_list;
-	RawStmt    *raw_stmt;
-	CreateStmt *stmt;
 	RangeVar   *rv;
-	TupleDesc	tupdesc;
-	Datum		values[HYPO_ADD_PART_COLS];
-	bool		nulls[HYPO_ADD_PART_COLS];
-	int			i = 0;
-
-	/* Process any pending invalidation */
-	hypo_process_inval();
 
 	if (!hypoTables)
 		hypo_initTablesHash();
 
-	if (!PG_ARGISNULL(2))
-		partition_by = TextDatumGetCString(PG_GETARG_TEXT_PP(2));
+	if (!stmt->partbound || !stmt->inhRelations)
+		elog(ERROR, "hypopg: you must specify a PARTITION OF clause");
+
+	if (stmt->relation->schemaname)
+		elog(ERROR, "hypopg: cannot use qualified name with hypothetical"
+			 " partition");
 
 	if (RelnameGetRelid(partname) != InvalidOid)
 		elog(ERROR, "hypopg: real table %s already exists",
@@ -3928,31 +4177,6 @@ hypopg_add_partition(PG_FUNCTION_ARGS)
 		elog(ERROR, "hypopg: hypothetical table %s already exists",
 			 quote_identifier(partname));
 
-	tupdesc = CreateTemplateTupleDesc(HYPO_ADD_PART_COLS, false);
-	TupleDescInitEntry(tupdesc, (AttrNumber) ++i, "relid", OIDOID, -1, 0);
-	TupleDescInitEntry(tupdesc, (AttrNumber) ++i, "tablename", TEXTOID, -1, 0);
-	Assert(i == HYPO_ADD_PART_COLS);
-	tupdesc = BlessTupleDesc(tupdesc);
-
-	MemSet(nulls, 0, sizeof(nulls));
-	i = 0;
-
-	initStringInfo(&sql);
-	appendStringInfo(&sql, "CREATE TABLE %s %s",
-					 quote_identifier(partname), partitionof);
-
-	if (partition_by)
-		appendStringInfo(&sql, " %s",
-						 partition_by);
-
-	parsetree_list = pg_parse_query(sql.data);
-	raw_stmt = (RawStmt *) linitial(parsetree_list);
-	stmt = (CreateStmt *) raw_stmt->stmt;
-	Assert(IsA(stmt, CreateStmt));
-
-	if (!stmt->partbound || !stmt->inhRelations)
-		elog(ERROR, "hypopg: you must specify a PARTITION OF clause");
-
 	/* Find the parent's oid */
 	if (list_length(stmt->inhRelations) != 1)
 		elog(ERROR, "hypopg: unexpected list length %d, expected 1",
@@ -3991,8 +4215,195 @@ hypopg_add_partition(PG_FUNCTION_ARGS)
 		parent = hypo_find_table(parentid, false);
 	}
 
-	entry = hypo_table_store_parsetree((CreateStmt *) stmt, sql.data,
-									   parent, rootid);
+	/* a new partition changes the rows a default partition would get */
+	hypo_table_reset_fractions(rootid);
+
+	return hypo_table_store_parsetree(stmt, queryString, parent, rootid);
+}
+
+/*
+ * Is the given oid a real partition?
+ */
+static bool
+hypo_rel_is_partition(Oid relid)
+{
+	HeapTuple	tuple;
+	bool		result;
+
+	tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relid));
+	if (!HeapTupleIsValid(tuple))
+		return false;
+
+	result = ((Form_pg_class) GETSTRUCT(tuple))->relispartition;
+	ReleaseSysCache(tuple);
+
+	return result;
+}
+
+/*
+ * Hide or unhide the given real partition.  Return true if the visibility of
+ * the partition changed.
+ */
+static bool
+hypo_partition_set_hidden(Oid relid, bool hidden)
+{
+	MemoryContext oldcontext;
+
+	if (list_member_oid(hypoHiddenPartitions, relid) == hidden)
+		return false;
+
+	if (!hidden)
+	{
+		hypoHiddenPartitions = list_delete_oid(hypoHiddenPartitions, relid);
+		return true;
+	}
+
+	oldcontext = MemoryContextSwitchTo(HypoMemoryContext);
+	hypoHiddenPartitions = lappend_oid(hypoHiddenPartitions, relid);
+	MemoryContextSwitchTo(oldcontext);
+
+	return true;
+}
+
+/*
+ * Forget the given real partition if it was hidden, as it has been dropped.
+ * Its oid could otherwise be reused by a new relation after a wraparound,
+ * which would then be silently hidden.  Return true if it was hidden.
+ */
+bool
+hypo_hidden_partition_remove(Oid relid)
+{
+	return hypo_partition_set_hidden(relid, false);
+}
+
+/*
+ * Return the oid of the parent of the given real partition, or InvalidOid if
+ * it's not a partition (anymore).
+ */
+static Oid
+hypo_get_partition_parent(Oid relid)
+{
+	if (!hypo_rel_is_partition(relid))
+		return InvalidOid;
+
+	return get_partition_parent(relid);
+}
+
+/*
+ * If the given rel is a hidden real partition, or a partition of a hidden
+ * one, mark it as proven empty and return true.  Only the partitions
+ * expanded from the queried table are hidden, querying a hidden partition
+ * directly is not affected.
+ *
+ * set_append_rel_size() and set_append_rel_pathlist() skip the dummy
+ * children, so the parent is planned and sized as if the partition had been
+ * detached, without taking any lock on it other than the AccessShareLock the
+ * planner already holds.
+ */
+bool
+hypo_hidePartition(PlannerInfo *root, Oid relationObjectId, RelOptInfo *rel)
+{
+	RelOptInfo *parentrel = rel;
+	Oid			rootid = InvalidOid;
+	Oid			relid = relationObjectId;
+
+	if (hypoHiddenPartitions == NIL
+		|| rel->reloptkind != RELOPT_OTHER_MEMBER_REL)
+		return false;
+
+	/* Find the queried table this rel has been expanded from */
+	while (parentrel->reloptkind == RELOPT_OTHER_MEMBER_REL)
+	{
+		AppendRelInfo *appinfo;
+
+#if PG_VERSION_NUM >= 110000
+		appinfo = root->append_rel_array[parentrel->relid];
+#else
+		appinfo = find_childrel_appendrelinfo(root, parentrel);
+#endif
+
+		/* the parent of a UNION ALL member is a subquery */
+		if (!OidIsValid(appinfo->parent_reloid))
+			break;
+
+		rootid = appinfo->parent_reloid;
+		parentrel = find_base_rel(root, appinfo->parent_relid);
+	}
+
+	if (!OidIsValid(rootid))
+		return false;
+
+	/*
+	 * Walk up the real partitioning tree rather than the appendrels, as
+	 * PostgreSQL 10 expands all the partitions as children of the root table.
+	 */
+	while (OidIsValid(relid) && relid != rootid)
+	{
+		if (list_member_oid(hypoHiddenPartitions, relid))
+		{
+			mark_dummy_rel(rel);
+			return true;
+		}
+
+		relid = hypo_get_partition_parent(relid);
+	}
+
+	return false;
+}
+
+#endif							/* pg10+ (~l. 81) */
+
+/*
+ * SQL wrapper to create an hypothetical partition with his parsetree
+ */
+Datum
+hypopg_add_partition(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	HYPO_PARTITION_NOT_SUPPORTED();
+#else
+	const char *partname = PG_GETARG_NAME(0)->data;
+	char	   *partitionof = TextDatumGetCString(PG_GETARG_TEXT_PP(1));
+	char	   *partition_by = NULL;
+	StringInfoData sql;
+	hypoTable  *entry;
+	List	   *parsetree_list;
+	RawStmt    *raw_stmt;
+	CreateStmt *stmt;
+	TupleDesc	tupdesc;
+	Datum		values[HYPO_ADD_PART_COLS];
+	bool		nulls[HYPO_ADD_PART_COLS];
+	int			i = 0;
+
+	/* Process any pending invalidation */
+	hypo_process_inval();
+
+	if (!PG_ARGISNULL(2))
+		partition_by = TextDatumGetCString(PG_GETARG_TEXT_PP(2));
+
+	tupdesc = CreateTemplateTupleDesc(HYPO_ADD_PART_COLS, false);
+	TupleDescInitEntry(tupdesc, (AttrNumber) ++i, "relid", OIDOID, -1, 0);
+	TupleDescInitEntry(tupdesc, (AttrNumber) ++i, "tablename", TEXTOID, -1, 0);
+	Assert(i == HYPO_ADD_PART_COLS);
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	MemSet(nulls, 0, sizeof(nulls));
+	i = 0;
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "CREATE TABLE %s %s",
+					 quote_identifier(partname), partitionof);
+
+	if (partition_by)
+		appendStringInfo(&sql, " %s",
+						 partition_by);
+
+	parsetree_list = pg_parse_query(sql.data);
+	raw_stmt = (RawStmt *) linitial(parsetree_list);
+	stmt = (CreateStmt *) raw_stmt->stmt;
+	Assert(IsA(stmt, CreateStmt));
+
+	entry = hypo_table_add_partition(stmt, sql.data);
 
 	pfree(sql.data);
 
@@ -4213,3 +4624,135 @@ hypopg_table(PG_FUNCTION_ARGS)
 	return (Datum) 0;
 #endif
 }
+
+/*
+ * SQL wrapper to hide a real partition from the planner during EXPLAIN, as if
+ * it had been detached.
+ */
+Datum
+hypopg_hide_partition(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	HYPO_PARTITION_NOT_SUPPORTED();
+#else
+	Oid			relid = PG_GETARG_OID(0);
+
+	if (!hypo_rel_is_partition(relid))
+	{
+		char	   *relname = get_rel_name(relid);
+
+		if (relname)
+			elog(ERROR, "hypopg: table %s is not a partition",
+				 quote_identifier(relname));
+		elog(ERROR, "hypopg: oid %u is not a partition", relid);
+	}
+
+	PG_RETURN_BOOL(hypo_partition_set_hidden(relid, true));
+#endif
+}
+
+/*
+ * SQL wrapper to restore the visibility of a previously hidden partition.
+ */
+Datum
+hypopg_unhide_partition(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	HYPO_PARTITION_NOT_SUPPORTED();
+#else
+	Oid			relid = PG_GETARG_OID(0);
+
+	PG_RETURN_BOOL(hypo_partition_set_hidden(relid, false));
+#endif
+}
+
+/*
+ * SQL wrapper to restore the visibility of all hidden partitions.
+ */
+Datum
+hypopg_unhide_all_partitions(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	HYPO_PARTITION_NOT_SUPPORTED();
+#else
+	list_free(hypoHiddenPartitions);
+	hypoHiddenPartitions = NIL;
+	PG_RETURN_VOID();
+#endif
+}
+
+/*
+ * List all the hidden partitions
+ */
+Datum
+hypopg_hidden_partitions(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM < 100000
+	HYPO_PARTITION_NOT_SUPPORTED();
+#else
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	ListCell   *lc;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not " \
+						"allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	/* Forget the hidden partitions that have been dropped */
+	hypo_process_inval();
+
+	foreach(lc, hypoHiddenPartitions)
+	{
+		Datum		values[HYPO_HIDDEN_PART_COLS];
+		bool		nulls[HYPO_HIDDEN_PART_COLS];
+		Oid			relid = lfirst_oid(lc);
+		Oid			parentid;
+		int			i = 0;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		parentid = hypo_get_partition_parent(relid);
+
+		values[i++] = ObjectIdGetDatum(relid);
+
+		/* The partition may have been detached or dropped since */
+		if (OidIsValid(parentid))
+			values[i++] = ObjectIdGetDatum(parentid);
+		else
+			nulls[i++] = true;
+		Assert(i == HYPO_HIDDEN_PART_COLS);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+#endif
+}
@@ -23,10 +23,28 @@ extern bool isExplain;
 
 /* GUC for enabling / disabling hypopg during EXPLAIN */
 extern bool hypo_is_enabled;
+
+/* Possible values of hypopg.estimation_mode GUC */
+typedef enum
+{
+	HYPO_ESTIMATION_FAST,		/* cheap approximations only */
+	HYPO_ESTIMATION_STANDARD,	/* statistics based estimations */
+	HYPO_ESTIMATION_ACCURATE	/* sample the tables when possible */
+} hypoEstimationMode;
+
+/* GUC for choosing the hypothetical objects estimation strategy */
+extern int	hypo_estimation_mode;
+
+/* GUC for the bloat factor applied to the hypothetical indexes size */
+extern double hypo_index_bloat_factor;
+
+/* GUC for reporting the progress of hypopg_analyze() */
+extern bool hypo_analyze_progress;
 extern MemoryContext HypoMemoryContext;
 
 Oid			hypo_getNewOid(Oid relid);
 void		hypo_process_inval(void);
 void		hypo_clear_inval(void);
+void		hypo_check_query(Query *query);
 
 #endif
@@ -0,0 +1,55 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_advisor.h: Implementation of hypothetical indexes for PostgreSQL
+ *
+ * This file contains all includes for the internal code related to the
+ * functions planning queries with the stored hypothetical objects.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_ADVISOR_H_
+#define _HYPOPG_ADVISOR_H_
+
+#include "nodes/plannodes.h"
+
+#define HYPO_CONSOLIDATION_NB_COLS	12	/* # of column
+										 * hypopg_consolidation_report()
+										 * returns */
+#define HYPO_FK_REPORT_NB_COLS		12	/* # of column hypopg_fk_index_report()
+										 * returns */
+#define HYPO_EVALUATE_NB_COLS		6	/* # of column hypopg_evaluate()
+										 * returns */
+#define HYPO_PLAN_DIFF_NB_COLS		15	/* # of column hypopg_plan_diff()
+										 * returns */
+#define HYPO_CACHE_PRESSURE_NB_COLS	9	/* # of column
+										 * hypopg_cache_pressure_report()
+										 * returns */
+
+/* Callback called for each plan node by hypo_walk_plannedstmt */
+typedef bool (*hypo_walk_plan_callback) (Plan *plan, void *context);
+
+/*--- Functions --- */
+
+Query	   *hypo_parse_query(const char *query, Oid *paramTypes, int numParams);
+PlannedStmt *hypo_plan_query(Query *query);
+bool		hypo_walk_plannedstmt(PlannedStmt *pstmt,
+				 hypo_walk_plan_callback callback, void *context);
+bool		hypo_plan_uses_index(PlannedStmt *pstmt, Oid indexid);
+List	   *hypo_plan_children(Plan *plan);
+const char *hypo_plan_node_name(Plan *plan);
+Oid			hypo_plan_indexid(Plan *plan);
+const char *hypo_plan_relname(PlannedStmt *pstmt, Plan *plan);
+
+PGDLLEXPORT Datum hypopg_consolidation_report(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_fk_index_report(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_evaluate(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_plan_diff(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_cache_pressure_report(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_assert_plan(PG_FUNCTION_ARGS);
+
+#endif
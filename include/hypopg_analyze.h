@@ -19,6 +19,27 @@
 
 #if PG_VERSION_NUM >= 100000
 
+/*
+ * Progress parameters of hypopg_analyze().  The backend progress API only
+ * knows the core commands, so the progress is reported as a VACUUM command
+ * on the root table, with a magic number identifying hypopg_analyze().
+ */
+#define HYPO_PROGRESS_ANALYZE_PHASE				0
+#define HYPO_PROGRESS_ANALYZE_TOTAL_PARTITIONS	1
+#define HYPO_PROGRESS_ANALYZE_DONE_PARTITIONS	2
+#define HYPO_PROGRESS_ANALYZE_CURRENT_PARTITION	3
+#define HYPO_PROGRESS_ANALYZE_SAMPLE_ROWS		4
+#define HYPO_PROGRESS_ANALYZE_TOTAL_COLUMNS		5
+#define HYPO_PROGRESS_ANALYZE_DONE_COLUMNS		6
+#define HYPO_PROGRESS_ANALYZE_MAGIC_PARAM		9
+
+#define HYPO_PROGRESS_ANALYZE_MAGIC				0x48595047
+
+/* Phases of hypopg_analyze() */
+#define HYPO_PROGRESS_ANALYZE_PHASE_INIT		0
+#define HYPO_PROGRESS_ANALYZE_PHASE_ACQUIRE		1
+#define HYPO_PROGRESS_ANALYZE_PHASE_COMPUTE		2
+
 /*--- Structs --- */
 
 typedef struct hypoStatsKey
@@ -33,6 +54,9 @@ typedef struct hypoStatsEntry
 	HeapTuple	statsTuple;
 } hypoStatsEntry;
 
+/* defined in hypopg_table.h */
+struct hypoTable;
+
 /*--- Variables exported ---*/
 
 /* Hash table storing the partition-level statistics */
@@ -41,12 +65,21 @@ extern HTAB *hypoStatsHash;
 
 Selectivity hypo_clauselist_selectivity(PlannerInfo *root, RelOptInfo *rel,
 							List *clauses, Oid table_relid, Oid parent_oid);
+bool		hypo_sample_relation(Oid relid, double reltuples,
+					 const char *targetlist, const char *qual,
+					 double *result);
 
 /*--- Functions --- */
 PGDLLEXPORT Datum hypopg_analyze(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_statistic(PG_FUNCTION_ARGS);
 #if PG_VERSION_NUM >= 100000
 PGDLLEXPORT void hypo_stat_remove(Oid tableid);
+void		hypo_stat_store(Oid relid, AttrNumber attnum, HeapTuple statsTuple);
+HeapTuple	hypo_get_stats_tuple(Oid partid, AttrNumber attnum);
+char	   *hypo_partition_qual_string(struct hypoTable *part);
+bool		hypo_sample_partition_fraction(struct hypoTable *part,
+							   double reltuples,
+							   Selectivity *fraction);
 #endif
 
 #endif							/* _HYPOPG_ANALYZE_H_ */
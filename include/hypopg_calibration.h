@@ -0,0 +1,51 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_calibration.h: Implementation of cost calibration for PostgreSQL
+ *
+ * This file contains all includes for the internal code related to the
+ * conversion of the estimated costs to predicted latencies.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_CALIBRATION_H_
+#define _HYPOPG_CALIBRATION_H_
+
+#include "nodes/plannodes.h"
+
+#define HYPO_CALIBRATION_NB_COLS	3	/* # of column hypopg_calibration()
+										 * returns */
+
+/*--- Structs --- */
+
+/*
+ * Cost to time model of a plan node type, fitted by least squares on the
+ * exclusive cost and time of the nodes measured by hypopg_calibrate()
+ */
+typedef struct hypoCalibration
+{
+	char		nodename[NAMEDATALEN];	/* node type, as EXPLAIN displays it */
+	int			samples;		/* number of measured nodes */
+	double		sum_ct;			/* sum of cost * time */
+	double		sum_cc;			/* sum of cost * cost */
+} hypoCalibration;
+
+/*--- Variables exported ---*/
+
+/* List of the calibrated node types for current backend */
+extern List *hypoCalibrations;
+
+/*--- Functions --- */
+
+double		hypo_predict_latency(PlannedStmt *pstmt);
+double		hypo_predict_node_latency(PlannedStmt *pstmt, Plan *plan);
+
+PGDLLEXPORT Datum hypopg_calibrate(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_calibration(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_reset_calibration(PG_FUNCTION_ARGS);
+
+#endif							/* _HYPOPG_CALIBRATION_H_ */
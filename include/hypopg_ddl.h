@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_ddl.h: Implementation of hypothetical migrations for PostgreSQL
+ *
+ * This file contains all includes for the internal code related to the
+ * rehearsal of DDL scripts as hypothetical objects.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_DDL_H_
+#define _HYPOPG_DDL_H_
+
+#define HYPO_APPLY_DDL_NB_COLS	5	/* # of column hypopg_apply_ddl() returns */
+
+/*--- Functions --- */
+
+PGDLLEXPORT Datum hypopg_apply_ddl(PG_FUNCTION_ARGS);
+
+#endif							/* _HYPOPG_DDL_H_ */
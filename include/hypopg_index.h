@@ -20,10 +20,15 @@
 #endif
 #include "optimizer/plancat.h"
 #include "tcop/utility.h"
+#include "utils/selfuncs.h"
 
 #define HYPO_INDEX_NB_COLS		12	/* # of column hypopg() returns */
 #define HYPO_INDEX_CREATE_COLS	2	/* # of column hypopg_create_index()
 									 * returns */
+#define HYPO_HIDDEN_INDEX_COLS	2	/* # of column hypopg_hidden_indexes()
+									 * returns */
+#define HYPO_RELATION_SIZES_COLS	6	/* # of column hypopg_relation_sizes()
+										 * returns */
 
 #if PG_VERSION_NUM >= 90600
 /* hardcode some bloom values, bloom.h is not exported */
@@ -50,9 +55,17 @@ typedef struct hypoIndex
 	BlockNumber pages;			/* number of estimated disk pages for the
 								 * index */
 	double		tuples;			/* number of estimated tuples in the index */
+	int			avg_width;		/* cached sum of the columns average width, -1
+								 * if it needs to be computed again */
+	int			avg_width_mode; /* hypopg.estimation_mode used to compute
+								 * avg_width */
 #if PG_VERSION_NUM >= 90300
 	int			tree_height;	/* estimated index tree height, -1 if unknown */
 #endif
+	/* estimates set by hypopg_set_index_estimates(), -1 if not set */
+	double		set_pages;
+	double		set_tuples;
+	int			set_tree_height;
 
 	/* index descriptor informations */
 	int			ncolumns;		/* number of columns, only 1 for now */
@@ -105,19 +118,68 @@ typedef struct hypoIndex
 
 } hypoIndex;
 
+#if PG_VERSION_NUM >= 100000
+/*
+ * Estimation of an hypothetical index as computed when it was added to the
+ * indexlist of a relation, as the hypoIndex only keeps the last one computed.
+ */
+typedef struct hypoIndexEstimate
+{
+	Oid			indexid;		/* hypothetical index oid */
+	Oid			relid;			/* oid of the scanned real relation */
+	Oid			partid;			/* oid of the hypothetical partition, if any */
+	BlockNumber pages;
+	double		tuples;
+	int			tree_height;
+} hypoIndexEstimate;
+#endif
+
 /* List of hypothetic indexes for current backend */
 extern List *hypoIndexes;
 
+/* List of real or hypothetical indexes hidden for current backend */
+extern List *hypoHiddenIndexes;
+
 /*--- Functions --- */
 
 void		hypo_index_reset(void);
+bool		hypo_index_remove(Oid indexid);
+hypoIndex  *hypo_get_index(Oid indexid);
+bool		hypo_index_is_hidden(Oid indexid);
+bool		hypo_index_set_hidden(Oid indexid, bool hidden);
+void		hypo_hideIndexes(RelOptInfo *rel);
+void		hypo_estimate_index_simple(hypoIndex *entry,
+						   BlockNumber *pages, double *tuples);
+void		hypo_estimate_indexes(List *entries);
+#if PG_VERSION_NUM >= 100000
+void		hypo_index_collect_estimates(bool collect);
+hypoIndexEstimate *hypo_index_find_estimate(Oid indexid, Oid relid,
+						 Oid partid);
+#endif
+void		hypo_actual_range_inval(Oid relid);
+bool hypo_actual_range_adjust(PlannerInfo *root, RangeTblEntry *rte,
+						 AttrNumber attnum, VariableStatData *vardata,
+						 bool found);
+BlockNumber hypo_estimate_real_index_pages(PlannerInfo *root, RelOptInfo *rel,
+							   Oid relid, IndexOptInfo *index);
+bool		hypo_index_check_columns(hypoIndex *entry, Oid relid);
+bool		hypo_index_match_stats(hypoIndex *entry, Oid relid,
+					   uint32 hashvalue);
+const hypoIndex *hypo_index_store_parsetree(IndexStmt *node,
+						   const char *queryString);
 
 PGDLLEXPORT Datum hypopg(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_create_index(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_drop_index(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_relation_size(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_relation_sizes(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_set_index_estimates(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_get_indexdef(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_reset_index(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_hide_index(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_unhide_index(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_unhide_all_indexes(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_hidden_indexes(PG_FUNCTION_ARGS);
 
 extern explain_get_index_name_hook_type prev_explain_get_index_name_hook;
 const char *hypo_explain_get_index_name_hook(Oid indexId);
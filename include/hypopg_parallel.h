@@ -0,0 +1,67 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_parallel.h: Implementation of hypothetical indexes for PostgreSQL
+ *
+ * This file contains all includes for the internal code related to the
+ * parallel evaluation of a workload using dynamic background workers.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_PARALLEL_H_
+#define _HYPOPG_PARALLEL_H_
+
+#define HYPO_PARALLEL_NB_COLS	7	/* # of column hypopg_parallel_evaluate()
+									 * returns */
+
+#if PG_VERSION_NUM >= 100000
+
+#include "port/atomics.h"
+
+/* Magic number and keys of the shared memory table of contents */
+#define HYPO_PARALLEL_MAGIC			0x48595047
+#define HYPO_PARALLEL_KEY_SHARED	1
+#define HYPO_PARALLEL_KEY_STATE		2
+#define HYPO_PARALLEL_KEY_QUERIES	3
+#define HYPO_PARALLEL_KEY_RESULTS	4
+#define HYPO_PARALLEL_KEY_GUC		5
+
+#define HYPO_PARALLEL_ERRMSG_LEN	256
+
+/*--- Structs --- */
+
+/* Fixed size information shared with the background workers */
+typedef struct hypoParallelShared
+{
+	Oid			database_id;	/* database to connect to */
+	Oid			user_id;		/* user to connect as */
+	int			nqueries;		/* number of queries to plan */
+	Size		state_len;		/* size of the serialized hypothetical state */
+	pg_atomic_uint32 next_query;	/* next query to plan */
+} hypoParallelShared;
+
+/* Result of the planning of a single query */
+typedef struct hypoParallelResult
+{
+	bool		done;			/* has the query been planned? */
+	bool		failed;			/* did the planning fail? */
+	int			worker;			/* worker number, 0 being the leader */
+	double		startup_cost;
+	double		total_cost;
+	double		plan_rows;
+	double		predicted_ms;	/* predicted latency, or -1 */
+	char		errmsg[HYPO_PARALLEL_ERRMSG_LEN];
+} hypoParallelResult;
+#endif							/* PG_VERSION_NUM >= 100000 */
+
+/*--- Functions --- */
+
+PGDLLEXPORT void hypo_parallel_worker_main(Datum main_arg);
+
+PGDLLEXPORT Datum hypopg_parallel_evaluate(PG_FUNCTION_ARGS);
+
+#endif
@@ -0,0 +1,89 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_reloptions.h: Implementation of hypothetical storage parameters for
+ * PostgreSQL
+ *
+ * This file contains all includes for the internal code related to
+ * hypothetical storage parameters and column types of real tables.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_RELOPTIONS_H_
+#define _HYPOPG_RELOPTIONS_H_
+
+#include "optimizer/plancat.h"
+
+#define HYPO_RELOPTIONS_NB_COLS	6	/* # of column hypopg_table_options()
+									 * returns */
+#define HYPO_COLUMN_TYPES_NB_COLS	4	/* # of column hypopg_column_types()
+										 * returns */
+
+/*--- Structs --- */
+
+/*
+ * Hypothetical storage parameters of a table, used instead of the real ones
+ * during EXPLAIN.  A value of -1 means that the real value is used, or for
+ * parallel_workers that the planner computes the number of workers itself.
+ */
+typedef struct hypoRelOptions
+{
+	Oid			relid;			/* real table Oid */
+	Datum		options;		/* text[] in pg_class.reloptions format */
+	int			fillfactor;		/* heap fillfactor */
+	int			toast_tuple_target; /* target length of TOASTed tuples */
+	int			parallel_workers;	/* number of parallel workers */
+} hypoRelOptions;
+
+/*
+ * Hypothetical type of a column of a table, used instead of the real one to
+ * estimate the size of the table and of its indexes during EXPLAIN.
+ */
+typedef struct hypoColumnType
+{
+	Oid			relid;			/* real table Oid */
+	AttrNumber	attnum;			/* column number */
+	Oid			atttypid;		/* real type of the column */
+	int16		attlen;			/* real typlen of the column */
+	Oid			typid;			/* hypothetical type */
+	int32		typmod;			/* hypothetical typmod */
+	int16		typlen;			/* typlen of the hypothetical type */
+	char		typalign;		/* typalign of the hypothetical type */
+	char		typstorage;		/* typstorage of the hypothetical type */
+} hypoColumnType;
+
+/*--- Variables exported ---*/
+
+/* List of hypothetical storage parameters for current backend */
+extern List *hypoRelOptionsList;
+
+/* List of hypothetical column types for current backend */
+extern List *hypoColumnTypes;
+
+/*--- Functions --- */
+
+void		hypo_reloptions_reset(void);
+bool		hypo_reloptions_remove(Oid relid);
+hypoRelOptions *hypo_find_reloptions(Oid relid);
+char	   *hypo_reloptions_deparse(hypoRelOptions *entry);
+void		hypo_reloptions_apply(PlannerInfo *root, Relation relation,
+					  RelOptInfo *rel);
+void		hypo_column_type_reset(void);
+bool		hypo_column_type_remove(Oid relid, AttrNumber attnum);
+hypoColumnType *hypo_find_column_type(Oid relid, AttrNumber attnum);
+bool		hypo_column_type_is_valid(hypoColumnType *coltype);
+int32		hypo_column_type_width(hypoColumnType *coltype, int32 width);
+char	   *hypo_column_type_deparse(hypoColumnType *coltype);
+
+PGDLLEXPORT Datum hypopg_set_table_options(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_reset_table_options(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_table_options(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_alter_column_type(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_reset_column_types(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_column_types(PG_FUNCTION_ARGS);
+
+#endif							/* _HYPOPG_RELOPTIONS_H_ */
@@ -0,0 +1,64 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_snapshot.h: Implementation of statistics snapshots for PostgreSQL
+ *
+ * This file contains all includes for the internal code related to the
+ * export and import of the statistics of real relations.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_SNAPSHOT_H_
+#define _HYPOPG_SNAPSHOT_H_
+
+#include "lib/stringinfo.h"
+#include "optimizer/plancat.h"
+
+#define HYPO_SNAPSHOT_MAGIC		0x48595053	/* identifies a snapshot */
+#define HYPO_SNAPSHOT_VERSION	1	/* version of the snapshot format */
+
+#define HYPO_IMPORTED_STATS_NB_COLS	6	/* # of column hypopg_imported_stats()
+										 * returns */
+
+/*--- Structs --- */
+
+/*
+ * Statistics of a real relation imported from a snapshot, used instead of the
+ * real ones during EXPLAIN.
+ */
+typedef struct hypoRelStats
+{
+	Oid			relid;			/* real relation Oid, hash key */
+	BlockNumber relpages;		/* imported pg_class.relpages */
+	double		reltuples;		/* imported pg_class.reltuples */
+	BlockNumber relallvisible;	/* imported pg_class.relallvisible */
+	int			tree_height;	/* imported btree height, -1 if unknown */
+	List	   *stats;			/* imported pg_statistic rows, as HeapTuple */
+} hypoRelStats;
+
+/*--- Variables exported ---*/
+
+/* Hash table of the imported statistics for current backend */
+extern HTAB *hypoRelStatsHash;
+
+/*--- Functions --- */
+
+void		hypo_snapshot_reset(void);
+bool		hypo_snapshot_remove(Oid relid);
+hypoRelStats *hypo_find_relstats(Oid relid);
+HeapTuple	hypo_get_imported_stats_tuple(Oid relid, AttrNumber attnum,
+							  bool inherit);
+void		hypo_snapshot_apply(RelOptInfo *rel, Oid relid, bool inhparent);
+void		hypo_snapshot_serialize(StringInfo buf);
+int			hypo_snapshot_import(StringInfo buf);
+
+PGDLLEXPORT Datum hypopg_export_real_stats(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_import_stats(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_reset_imported_stats(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_imported_stats(PG_FUNCTION_ARGS);
+
+#endif							/* _HYPOPG_SNAPSHOT_H_ */
@@ -0,0 +1,102 @@
+/*-------------------------------------------------------------------------
+ *
+ * hypopg_statistics.h: Implementation of hypothetical extended statistics
+ * for PostgreSQL
+ *
+ * This file contains all includes for the internal code related to
+ * hypothetical extended statistics support.
+ *
+ * This program is open source, licensed under the PostgreSQL license.
+ * For license terms, see the LICENSE file.
+ *
+ * Copyright (C) 2015-2018: Julien Rouhaud
+ *
+ *-------------------------------------------------------------------------
+*/
+#ifndef _HYPOPG_STATISTICS_H_
+#define _HYPOPG_STATISTICS_H_
+
+#define HYPO_STATS_CREATE_COLS	2	/* # of column hypopg_create_statistics()
+									 * returns */
+#define HYPO_STATS_NB_COLS		7	/* # of column hypopg_list_statistics()
+									 * returns */
+
+#if PG_VERSION_NUM >= 100000
+
+#include "optimizer/paths.h"
+
+/*--- Structs --- */
+
+/* Multivariate MCV list item */
+typedef struct hypoMCVItem
+{
+	Datum	   *values;			/* value of each key column */
+	bool	   *isnull;			/* is the value of each key column NULL? */
+	double		frequency;		/* frequency of this combination */
+} hypoMCVItem;
+
+/* Functional dependency between two key columns */
+typedef struct hypoDependency
+{
+	int			from;			/* index of the determinant key column */
+	int			to;				/* index of the dependent key column */
+	double		degree;			/* degree of the dependency */
+} hypoDependency;
+
+/* Number of distinct values for a combination of key columns */
+typedef struct hypoNdistinct
+{
+	Bitmapset  *keys;			/* indexes of the key columns */
+	double		ndistinct;		/* estimated number of distinct values */
+} hypoNdistinct;
+
+/*--------------------------------------------------------
+ * Hypothetical extended statistics storage, pretty much what
+ * CREATE STATISTICS would store in pg_statistic_ext.
+ */
+typedef struct hypoStatsExt
+{
+	Oid			oid;			/* hypothetical statistics unique identifier */
+	Oid			relid;			/* related relation Oid */
+	char	   *statname;		/* hypothetical statistics name */
+	float4		fraction;		/* sample fraction used to compute the data */
+
+	/* key columns description */
+	int			nkeys;			/* number of key columns */
+	AttrNumber *keys;			/* attnums */
+	Oid		   *eqopr;			/* OIDs of the equality operators */
+	int16	   *typlen;			/* typlen of the key columns */
+	bool	   *typbyval;		/* typbyval of the key columns */
+
+	/* requested kinds of statistics */
+	bool		has_ndistinct;
+	bool		has_dependencies;
+	bool		has_mcv;
+
+	/* computed data */
+	List	   *ndistinct;		/* List of hypoNdistinct */
+	List	   *dependencies;	/* List of hypoDependency */
+	int			nmcv;			/* number of MCV items */
+	hypoMCVItem *mcv;			/* MCV items, most common first */
+	double		mcv_totalfreq;	/* sum of all MCV items frequencies */
+} hypoStatsExt;
+
+/*--- Variables exported ---*/
+
+/* List of hypothetical extended statistics for current backend */
+extern List *hypoStatsExts;
+
+/*--- Functions --- */
+
+void		hypo_stats_ext_reset(void);
+bool		hypo_stats_ext_remove_rel(Oid relid);
+void		hypo_stats_ext_adjust_rel(PlannerInfo *root, RelOptInfo *rel,
+						  RangeTblEntry *rte);
+#endif							/* PG_VERSION_NUM >= 100000 */
+
+PGDLLEXPORT Datum hypopg_create_statistics(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_drop_statistics(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_reset_statistics(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_list_statistics(PG_FUNCTION_ARGS);
+
+#endif							/* _HYPOPG_STATISTICS_H_ */
@@ -20,18 +20,18 @@
 
 #define HYPO_TABLE_NB_COLS		6	/* # of column hypopg_table() returns */
 #define HYPO_ADD_PART_COLS	2	/* # of column hypopg_add_partition() returns */
+#define HYPO_HIDDEN_PART_COLS	2	/* # of column hypopg_hidden_partitions()
+									 * returns */
 
-#define HYPO_RTE_IS_TAGGED(rte) (rte && (rte->security_barrier))
-#define HYPO_RTI_IS_TAGGED(rti, root) (planner_rt_fetch(rti, root)->security_barrier)
-#define HYPO_TAG_RTI(rti, root) (planner_rt_fetch(rti, root)->security_barrier = true)
-
-/* XXX maybe use a mapping array here instead of rte->ctelevelsup*/
+/*
+ * The planner only relies on the hypoPlannerMap of the PlannerInfo.  The
+ * hypothetical partition oid is also stored in the otherwise unused
+ * ctelevelsup field of the RTE_RELATION entries, so that it's still available
+ * in the final PlannedStmt, e.g. for EXPLAIN.  The planner never reads it.
+ */
 #define HYPO_TABLE_RTE_HAS_HYPOOID(rte) (rte && (rte->ctelevelsup != InvalidOid))
 #define HYPO_TABLE_RTE_GET_HYPOOID(rte) (rte->ctelevelsup)
-#define HYPO_TABLE_RTI_GET_HYPOOID(rti, root) (planner_rt_fetch(rti, root)->ctelevelsup)
 #define HYPO_TABLE_RTE_SET_HYPOOID(rte, oid) (rte->ctelevelsup = oid)
-#define HYPO_TABLE_RTE_CLEAR_HYPOOID(rte) rte->ctelevelsup = InvalidOid
-#define HYPO_TABLE_RTE_COPY_HYPOOID_FROM_RTE(target, src) target->ctelevelsup = src->ctelevelsup
 
 #include "optimizer/paths.h"
 
@@ -63,11 +63,36 @@ typedef struct hypoTable
 								 * expressions and deparsing */
 	Oid		   *partopclass;	/* oid of partkey's element opclass, needed
 								 * for deparsing the key */
+	bool		fraction_sampled;	/* fraction has been computed */
+	Selectivity fraction;		/* fraction of the root table's rows sampled
+								 * in accurate mode, or -1 if it couldn't be,
+								 * cached until the root table is
+								 * invalidated */
 	bool		valid;
 } hypoTable;
 
 /* List of hypothetic partitions for current backend */
 extern HTAB *hypoTables;
+
+/* List of hidden real partitions for current backend */
+extern List *hypoHiddenPartitions;
+
+/*
+ * Hypothetical partitioning information of a PlannerInfo, indexed by range
+ * table index.  A tagged rti has been handled by the hypothetical
+ * partitioning, and tables points to the hypothetical partition it stands
+ * for, if any.  The map is allocated in the memory context of the PlannerInfo
+ * and forgotten when this context is reset or deleted.
+ */
+typedef struct hypoPlannerMap
+{
+	PlannerInfo *root;			/* owning PlannerInfo */
+	int			size;			/* allocated size of the arrays */
+	bool	   *tagged;			/* rti handled by hypothetical partitioning */
+	hypoTable **tables;			/* hypothetical partition of rti, or NULL */
+	MemoryContextCallback callback; /* forget the map with its PlannerInfo */
+	struct hypoPlannerMap *next;
+} hypoPlannerMap;
 #else
 #define HYPO_PARTITION_NOT_SUPPORTED() elog(ERROR, "hypopg: Hypothetical partitioning requires PostgreSQl 10 or above"); PG_RETURN_VOID();
 #endif
@@ -75,21 +100,39 @@ extern HTAB *hypoTables;
 /*--- Functions --- */
 
 void		hypo_table_reset(void);
+void		hypo_table_reset_fractions(Oid rootid);
 
 PGDLLEXPORT Datum hypopg_table(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_add_partition(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_drop_table(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_hide_partition(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_hidden_partitions(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_partition_table(PG_FUNCTION_ARGS);
 PGDLLEXPORT Datum hypopg_reset_table(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_unhide_all_partitions(PG_FUNCTION_ARGS);
+PGDLLEXPORT Datum hypopg_unhide_partition(PG_FUNCTION_ARGS);
 
 #if PG_VERSION_NUM >= 100000
 hypoTable  *hypo_find_table(Oid tableid, bool missing_ok);
+bool		hypo_rti_is_tagged(PlannerInfo *root, Index rti);
+hypoTable  *hypo_rti_get_table(PlannerInfo *root, Index rti);
+void		hypo_tag_rti(PlannerInfo *root, Index rti, hypoTable *part);
+Index		hypo_rte_get_rti(PlannerInfo *root, RangeTblEntry *rte, Index hint);
+void		hypo_planner_map_release(PlannerInfo *root);
+char	   *hypo_get_partbounddef(hypoTable *entry);
+char	   *hypo_get_partkeydef(hypoTable *entry);
 List *hypo_get_partition_constraints(PlannerInfo *root, RelOptInfo *rel,
 							   hypoTable *parent, bool force_generation);
 List	   *hypo_get_partition_quals_inh(hypoTable *part, hypoTable *parent);
 hypoTable  *hypo_table_name_get_entry(const char *name);
 bool		hypo_table_oid_is_hypothetical(Oid relid);
+Selectivity hypo_partition_uniform_fraction(hypoTable *part);
+Selectivity hypo_partition_fraction(hypoTable *part, double roottuples);
 bool		hypo_table_remove(Oid tableid, hypoTable *parent, bool deep);
+hypoTable  *hypo_table_add_partition(CreateStmt *stmt, const char *queryString);
+bool		hypo_hidden_partition_remove(Oid relid);
+bool		hypo_hidePartition(PlannerInfo *root, Oid relationObjectId,
+				   RelOptInfo *rel);
 void hypo_injectHypotheticalPartitioning(PlannerInfo *root,
 									Oid relationObjectId,
 									RelOptInfo *rel);
@@ -86,3 +86,380 @@ WHERE e ~ 'Index.*<\d+>btree_hypo.*';
 
 -- Deparse an index DDL, with almost every possible pathcode
 SELECT hypopg_get_indexdef(indexrelid) FROM hypopg_create_index('create index on hypo using btree(id desc, id desc nulls first, id desc nulls last, cast(md5(val) as bpchar)  bpchar_pattern_ops) with (fillfactor = 10) WHERE id < 1000 AND id +1 %2 = 3');
+
+-- Remove all the hypothetical indexes
+SELECT hypopg_reset();
+
+SELECT COUNT(*) AS nb
+FROM public.hypopg_create_index('CREATE INDEX ON hypo (id)');
+
+-- Hide the hypothetical index
+SELECT hypopg_hide_index(indexrelid) FROM hypopg();
+
+SELECT COUNT(*) FROM hypopg_hidden_indexes() WHERE hypothetical;
+
+-- Should not use hypothetical index
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo WHERE id = 1') e
+WHERE e ~ 'Index.*<\d+>btree_hypo.*';
+
+-- Unhide all indexes
+SELECT hypopg_unhide_all_indexes();
+
+-- Should use hypothetical index
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo WHERE id = 1') e
+WHERE e ~ 'Index.*<\d+>btree_hypo.*';
+
+-- Index consolidation
+SELECT COUNT(*) AS nb
+FROM public.hypopg_create_index('CREATE INDEX ON hypo (id);CREATE INDEX ON hypo (id, val)');
+
+SELECT overlap, hypothetical, reclaimed_bytes > 0 AS reclaimed, nb_queries
+FROM hypopg_consolidation_report('hypo',
+    ARRAY['SELECT * FROM hypo WHERE val = ''line 1''', 'SELECT 1'])
+ORDER BY indexrelid;
+
+-- Foreign keys without index
+CREATE TABLE hypo_fk_parent (id integer PRIMARY KEY);
+CREATE TABLE hypo_fk_child (id integer, parent_id integer REFERENCES hypo_fk_parent (id));
+INSERT INTO hypo_fk_parent SELECT i FROM generate_series(1, 100) i;
+INSERT INTO hypo_fk_child SELECT i, i % 100 + 1 FROM generate_series(1, 10000) i;
+ANALYZE hypo_fk_parent;
+ANALYZE hypo_fk_child;
+
+SELECT conname, indexdef, cost_with < cost_without AS gain
+FROM hypopg_fk_index_report('hypo_fk_child');
+
+-- The hypothetical index should have been removed
+SELECT COUNT(*) FROM hypopg() WHERE indrelid = 'hypo_fk_child'::regclass;
+
+-- No report once the referencing columns are indexed
+CREATE INDEX ON hypo_fk_child (parent_id, id);
+SELECT COUNT(*) FROM hypopg_fk_index_report('hypo_fk_child');
+
+DROP TABLE hypo_fk_child;
+DROP TABLE hypo_fk_parent;
+
+-- Dependency tracking
+CREATE TABLE hypo_dep (id integer, val text);
+SELECT COUNT(*) AS nb
+FROM hypopg_create_index('CREATE INDEX ON hypo_dep (id);CREATE INDEX ON hypo_dep (val)');
+-- The index on the dropped column should be removed
+ALTER TABLE hypo_dep DROP COLUMN val;
+SELECT COUNT(*) FROM hypopg() WHERE indrelid = 'hypo_dep'::regclass;
+-- The index on the column whose type changed should be removed
+ALTER TABLE hypo_dep ALTER COLUMN id TYPE text;
+SELECT COUNT(*) FROM hypopg() WHERE indrelid = 'hypo_dep'::regclass;
+-- The index on the dropped table should be removed
+SELECT COUNT(*) AS nb
+FROM hypopg_create_index('CREATE INDEX ON hypo_dep (id)');
+DROP TABLE hypo_dep;
+SELECT COUNT(*) FROM hypopg() WHERE indexname LIKE '%hypo_dep%';
+
+-- Configuration matrix evaluation
+CREATE TABLE hypo_eval (id integer, val text);
+INSERT INTO hypo_eval SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_eval;
+SELECT COUNT(*) AS nb
+FROM hypopg_create_index('CREATE INDEX ON hypo_eval (id);CREATE INDEX ON hypo_eval (val)');
+WITH idx AS (
+    SELECT (SELECT indexrelid FROM hypopg() WHERE indexname ~ 'hypo_eval_id') AS id,
+        (SELECT indexrelid FROM hypopg() WHERE indexname ~ 'hypo_eval_val') AS val
+)
+SELECT e.query_num, e.config_num, e.total_cost < 100 AS use_index
+FROM idx, hypopg_evaluate(ARRAY['SELECT * FROM hypo_eval WHERE id = 1',
+                                'SELECT * FROM hypo_eval WHERE val = ''line 1'''],
+    ARRAY[ARRAY[0, 0]::oid[], ARRAY[idx.id, 0], ARRAY[idx.id, idx.val]]) e
+ORDER BY e.query_num, e.config_num;
+-- The indexes visibility should have been restored
+SELECT COUNT(*) FROM hypopg_hidden_indexes();
+-- Only hypothetical indexes can be part of a configuration
+SELECT * FROM hypopg_evaluate(ARRAY['SELECT 1'], ARRAY[1]::oid[]);
+-- Plan differences
+SELECT node_num, depth, change, node_before, node_after, relation_after,
+    index_after ~ 'btree_hypo_eval_id' AS hypo_index
+FROM hypopg_plan_diff('SELECT * FROM hypo_eval WHERE id < 100 ORDER BY id',
+    ARRAY[(SELECT indexrelid FROM hypopg() WHERE indexname ~ 'hypo_eval_id')])
+ORDER BY node_num;
+-- Cache pressure
+SELECT config_num, relations, index_bytes > 0 AS uses_index,
+    working_set = table_bytes + index_bytes AS total,
+    fits_shared_buffers, fits_effective_cache,
+    working_set < first_value(working_set) OVER (ORDER BY config_num) AS smaller
+FROM hypopg_cache_pressure_report(ARRAY['SELECT * FROM hypo_eval WHERE id = 1'],
+    ARRAY[ARRAY[0]::oid[],
+          ARRAY[(SELECT indexrelid FROM hypopg() WHERE indexname ~ 'hypo_eval_id')]])
+ORDER BY config_num;
+DROP TABLE hypo_eval;
+
+-- Hypothetical storage parameters
+CREATE TABLE hypo_storage (id integer, val text);
+INSERT INTO hypo_storage SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_storage;
+CREATE TEMPORARY TABLE hypo_storage_cost AS
+    SELECT total_cost FROM hypopg_evaluate(ARRAY['SELECT * FROM hypo_storage'], '{}');
+SELECT hypopg_set_table_options('hypo_storage', ARRAY['fillfactor=50']);
+SELECT relid::regclass, options, estimated_pages > pages AS more_pages,
+    toast_pages, estimated_toast_pages
+FROM hypopg_table_options();
+-- A lower fillfactor should make the seqscan more expensive
+SELECT e.total_cost > c.total_cost AS more_expensive
+FROM hypo_storage_cost c,
+    hypopg_evaluate(ARRAY['SELECT * FROM hypo_storage'], '{}') e;
+-- Invalid or unsupported storage parameters
+SELECT hypopg_set_table_options('hypo_storage', ARRAY['fillfactor=5']);
+SELECT hypopg_set_table_options('hypo_storage', ARRAY['autovacuum_enabled=off']);
+-- Reset the storage parameters
+SELECT hypopg_reset_table_options('hypo_storage');
+SELECT COUNT(*) FROM hypopg_table_options();
+-- The storage parameters of a dropped table should be removed
+SELECT hypopg_set_table_options('hypo_storage', ARRAY['fillfactor=50']);
+DROP TABLE hypo_storage_cost;
+DROP TABLE hypo_storage;
+SELECT COUNT(*) FROM hypopg_table_options();
+
+-- Hypothetical column types
+CREATE TABLE hypo_coltype (id bigint, val text);
+INSERT INTO hypo_coltype SELECT i, md5(i::text) FROM generate_series(1, 10000) i;
+ANALYZE hypo_coltype;
+CREATE TEMPORARY TABLE hypo_coltype_cost AS
+    SELECT total_cost FROM hypopg_evaluate(ARRAY['SELECT * FROM hypo_coltype'], '{}');
+CREATE TEMPORARY TABLE hypo_coltype_size AS
+    SELECT indexrelid, hypopg_relation_size(indexrelid) AS size
+    FROM hypopg_create_index('CREATE INDEX ON hypo_coltype (val)');
+SELECT hypopg_alter_column_type('hypo_coltype', 'val', 'uuid');
+SELECT relid::regclass, attname, old_type, new_type FROM hypopg_column_types();
+-- A narrower column should make the table and its indexes smaller
+SELECT e.total_cost < c.total_cost AS less_expensive
+FROM hypo_coltype_cost c,
+    hypopg_evaluate(ARRAY['SELECT * FROM hypo_coltype'], '{}') e;
+SELECT hypopg_relation_size(indexrelid) < size AS smaller
+FROM hypo_coltype_size;
+-- Invalid columns or types
+SELECT hypopg_alter_column_type('hypo_coltype', 'nope', 'uuid');
+SELECT hypopg_alter_column_type('hypo_coltype', 'val', 'record');
+-- Using the real type removes the hypothetical type
+SELECT hypopg_alter_column_type('hypo_coltype', 'val', 'text');
+SELECT COUNT(*) FROM hypopg_column_types();
+-- The hypothetical type of a dropped column should be removed
+SELECT hypopg_alter_column_type('hypo_coltype', 'val', 'uuid');
+ALTER TABLE hypo_coltype DROP COLUMN val;
+SELECT COUNT(*) FROM hypopg_column_types();
+SELECT hypopg_reset();
+DROP TABLE hypo_coltype_cost;
+DROP TABLE hypo_coltype_size;
+DROP TABLE hypo_coltype;
+-- Index estimates and bloat factor
+CREATE TABLE hypo_bloat (id integer);
+INSERT INTO hypo_bloat SELECT generate_series(1, 10000);
+ANALYZE hypo_bloat;
+CREATE TEMPORARY TABLE hypo_bloat_size AS
+    SELECT indexrelid, hypopg_relation_size(indexrelid) AS size
+    FROM hypopg_create_index('CREATE INDEX ON hypo_bloat (id)');
+-- The bloat factor should make the index bigger
+SET hypopg.index_bloat_factor = 4;
+SELECT hypopg_relation_size(indexrelid) > 3 * size AS bloated
+FROM hypo_bloat_size;
+RESET hypopg.index_bloat_factor;
+-- The estimates set by the user should be used instead
+SELECT hypopg_set_index_estimates(indexrelid, 1000, 10000, 3)
+FROM hypo_bloat_size;
+SELECT hypopg_relation_size(indexrelid) = 1000 * current_setting('block_size')::bigint AS pinned
+FROM hypo_bloat_size;
+-- A NULL value restores the estimation
+SELECT hypopg_set_index_estimates(indexrelid, NULL) FROM hypo_bloat_size;
+SELECT hypopg_relation_size(indexrelid) = size AS estimated
+FROM hypo_bloat_size;
+-- Invalid estimates
+SELECT hypopg_set_index_estimates(indexrelid, 0) FROM hypo_bloat_size;
+SELECT hypopg_set_index_estimates(0, 10);
+SELECT hypopg_reset();
+DROP TABLE hypo_bloat_size;
+DROP TABLE hypo_bloat;
+-- Statistics snapshots
+CREATE TABLE hypo_snap (id integer, val text);
+INSERT INTO hypo_snap SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+CREATE INDEX hypo_snap_id_idx ON hypo_snap (id);
+ANALYZE hypo_snap;
+CREATE TEMPORARY TABLE hypo_snap_export AS
+    SELECT hypopg_export_real_stats('{hypo_snap}') AS snapshot;
+-- Simulate a data-less clone
+TRUNCATE hypo_snap;
+SELECT hypopg_import_stats(snapshot) FROM hypo_snap_export;
+SELECT relid::regclass, relpages > 0 AS has_pages, reltuples, tree_height,
+    nb_stats
+FROM hypopg_imported_stats() ORDER BY relid::regclass::text;
+-- The imported statistics should be used
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_snap') e
+WHERE e ~ 'rows=10000 ';
+SELECT hypopg_relation_size(indexrelid) > 10 * current_setting('block_size')::bigint AS estimated
+FROM hypopg_create_index('CREATE INDEX ON hypo_snap (val)');
+SELECT hypopg_reset_imported_stats('hypo_snap');
+SELECT COUNT(*) FROM hypopg_imported_stats();
+-- The imported statistics of a dropped relation should be removed
+DROP INDEX hypo_snap_id_idx;
+SELECT COUNT(*) FROM hypopg_imported_stats();
+-- Statistics whose values don't match the column type are ignored
+SELECT hypopg_import_stats(overlay(snapshot PLACING '\x000000046e616d65'::bytea
+    FROM p + 7 + position('\x0000000474657874'::bytea IN substring(snapshot FROM p + 8))
+    FOR 8))
+FROM (SELECT snapshot, position('\x0000000474657874'::bytea IN snapshot) AS p
+    FROM hypo_snap_export) s;
+SELECT relid::regclass, nb_stats FROM hypopg_imported_stats();
+SELECT hypopg_reset_imported_stats();
+-- Missing relations are ignored
+DROP TABLE hypo_snap;
+SELECT hypopg_import_stats(snapshot) FROM hypo_snap_export;
+-- Invalid snapshot
+SELECT hypopg_import_stats('\x00'::bytea);
+SELECT hypopg_reset();
+DROP TABLE hypo_snap_export;
+-- Batch size estimation
+CREATE TABLE hypo_sizes (id integer, val text);
+INSERT INTO hypo_sizes SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_sizes;
+CREATE TEMPORARY TABLE hypo_sizes_idx AS
+    SELECT indexrelid FROM hypopg_create_index('CREATE INDEX ON hypo_sizes (id)')
+    UNION ALL
+    SELECT indexrelid FROM hypopg_create_index('CREATE INDEX ON hypo_sizes (val)');
+-- Should match hypopg_relation_size()
+SELECT relid::regclass, bytes = hypopg_relation_size(s.indexrelid) AS same_size,
+    bytes = pages * current_setting('block_size')::bigint AS bytes_ok,
+    tuples, tree_height > 0 AS has_height
+FROM hypopg_relation_sizes() s JOIN hypo_sizes_idx USING (indexrelid);
+-- Only the given indexes, ignoring unknown ones
+SELECT COUNT(*) FROM hypopg_relation_sizes(
+    (SELECT array_agg(indexrelid) FROM hypo_sizes_idx) || '{0}'::oid[]);
+SELECT COUNT(*) FROM hypopg_relation_sizes('{}');
+SELECT hypopg_reset();
+DROP TABLE hypo_sizes_idx;
+DROP TABLE hypo_sizes;
+-- Actual range of the hypothetical btree indexes
+CREATE TABLE hypo_range (id integer) WITH (autovacuum_enabled = false);
+INSERT INTO hypo_range SELECT generate_series(1, 10000);
+ANALYZE hypo_range;
+-- Rows appended after the last ANALYZE, beyond the histogram
+INSERT INTO hypo_range SELECT generate_series(10001, 20000);
+CREATE TEMPORARY TABLE hypo_range_idx AS
+    SELECT indexrelid FROM hypopg_create_index('CREATE INDEX ON hypo_range (id)');
+-- Without real index, the range is only sampled in accurate mode
+SELECT e.config_num, e.plan_rows > 10 AS widened
+FROM hypo_range_idx i, hypopg_evaluate(ARRAY['SELECT * FROM hypo_range WHERE id > 15000'],
+    ARRAY[ARRAY[0]::oid[], ARRAY[i.indexrelid]]) e
+ORDER BY e.config_num;
+SET hypopg.estimation_mode = 'accurate';
+SELECT e.config_num, e.plan_rows > 10 AS widened
+FROM hypo_range_idx i, hypopg_evaluate(ARRAY['SELECT * FROM hypo_range WHERE id > 15000'],
+    ARRAY[ARRAY[0]::oid[], ARRAY[i.indexrelid]]) e
+ORDER BY e.config_num;
+RESET hypopg.estimation_mode;
+-- A hidden real index should be probed
+CREATE INDEX hypo_range_id_idx ON hypo_range (id);
+SELECT hypopg_hide_index('hypo_range_id_idx'::regclass);
+SELECT e.config_num, e.plan_rows > 10 AS widened
+FROM hypo_range_idx i, hypopg_evaluate(ARRAY['SELECT * FROM hypo_range WHERE id > 15000'],
+    ARRAY[ARRAY[0]::oid[], ARRAY[i.indexrelid]]) e
+ORDER BY e.config_num;
+SELECT hypopg_reset();
+DROP TABLE hypo_range_idx;
+DROP TABLE hypo_range;
+-- Plan assertions
+CREATE TABLE hypo_assert (id integer, val text);
+INSERT INTO hypo_assert SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_assert;
+-- Without requirement, the assertion always succeeds
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1');
+-- The plan details depend on the environment, only display the messages
+\set VERBOSITY terse
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1',
+    NULL, '{"Seq Scan on hypo_assert"}');
+-- Only the named relation is checked
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1',
+    NULL, '{"Seq Scan on hypo_other", NULL}');
+CREATE TEMPORARY TABLE hypo_assert_idx AS
+    SELECT indexrelid FROM hypopg_create_index('CREATE INDEX ON hypo_assert (id)');
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1',
+    NULL, '{"seq scan"}', indexrelid)
+FROM hypo_assert_idx;
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1', 1);
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1',
+    NULL, '{"Index Scan"}');
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE val = ''line 1''',
+    NULL, NULL, indexrelid)
+FROM hypo_assert_idx;
+SELECT hypopg_assert_plan('SELECT * FROM hypo_assert WHERE id = 1',
+    NULL, NULL, 0);
+\set VERBOSITY default
+SELECT hypopg_reset();
+DROP TABLE hypo_assert_idx;
+DROP TABLE hypo_assert;
+-- Rehearsal of a DDL script
+CREATE TABLE hypo_ddl (id integer, val text);
+CREATE INDEX hypo_ddl_val_idx ON hypo_ddl (val);
+SELECT stmt_num, command, action,
+    regexp_replace(objname, '<\d+>', '') AS objname
+FROM hypopg_apply_ddl($$CREATE INDEX ON hypo_ddl (val, id);
+    DROP INDEX hypo_ddl_val_idx;
+    DROP INDEX IF EXISTS hypo_ddl_missing_idx;
+    ALTER TABLE hypo_ddl ADD PRIMARY KEY (id),
+        ADD CONSTRAINT hypo_ddl_val_check CHECK (val <> '');
+    VACUUM hypo_ddl;$$);
+SELECT regexp_replace(indexname, '<\d+>', '') AS indexname, indisunique
+FROM hypopg() WHERE indrelid = 'hypo_ddl'::regclass ORDER BY 1;
+SELECT COUNT(*) FROM hypopg_hidden_indexes()
+WHERE indexid = 'hypo_ddl_val_idx'::regclass;
+-- A failing statement reverts the whole script
+SELECT * FROM hypopg_apply_ddl('CREATE INDEX ON hypo_ddl (val); DROP INDEX hypo_ddl_missing_idx');
+SELECT COUNT(*) FROM hypopg() WHERE indrelid = 'hypo_ddl'::regclass;
+SELECT hypopg_reset();
+DROP TABLE hypo_ddl;
+-- Cost calibration
+CREATE TABLE hypo_calib (id integer, val text);
+INSERT INTO hypo_calib SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_calib;
+SELECT hypopg_reset_calibration();
+SELECT predicted_ms IS NULL AS no_model
+FROM hypopg_evaluate(ARRAY['SELECT * FROM hypo_calib WHERE id = 1'], '{}');
+SELECT node_type, samples, ms_per_cost >= 0 AS valid
+FROM hypopg_calibrate(ARRAY['SELECT * FROM hypo_calib WHERE id = 1',
+                            'SELECT count(*) FROM hypo_calib'])
+ORDER BY node_type;
+CREATE TEMPORARY TABLE hypo_calib_idx AS
+    SELECT indexrelid FROM hypopg_create_index('CREATE INDEX ON hypo_calib (id)');
+-- Node types not calibrated use the ratio of all the measured nodes
+SELECT e.config_num, e.predicted_ms >= 0 AS predicted
+FROM hypo_calib_idx i, hypopg_evaluate(ARRAY['SELECT * FROM hypo_calib WHERE id = 1'],
+    ARRAY[ARRAY[0]::oid[], ARRAY[i.indexrelid]]) e
+ORDER BY e.config_num;
+-- The hypothetical index should be predicted to be faster
+SELECT (array_agg(e.predicted_ms ORDER BY e.config_num))[2]
+    < (array_agg(e.predicted_ms ORDER BY e.config_num))[1] AS index_faster
+FROM hypo_calib_idx i, hypopg_evaluate(ARRAY['SELECT * FROM hypo_calib WHERE id = 1'],
+    ARRAY[ARRAY[0]::oid[], ARRAY[i.indexrelid]]) e;
+-- Nodes below a LIMIT are only charged for the rows they return
+SELECT l.predicted_ms < f.predicted_ms / 10 AS limit_prorated
+FROM hypopg_evaluate(ARRAY['SELECT * FROM hypo_calib LIMIT 1'], '{}') l,
+    hypopg_evaluate(ARRAY['SELECT * FROM hypo_calib'], '{}') f;
+-- The other reports also give the predicted latencies
+SELECT bool_and(d.predicted_ms_after >= 0) AS predicted
+FROM hypo_calib_idx i, hypopg_plan_diff('SELECT * FROM hypo_calib WHERE id = 1',
+    ARRAY[i.indexrelid]) d;
+SELECT COUNT(*) FROM hypopg_create_index('CREATE INDEX ON hypo_calib (id, val)');
+SELECT overlap, nb_queries, predicted_ms_before >= 0 AS predicted_before,
+    predicted_ms_after >= 0 AS predicted_after
+FROM hypopg_consolidation_report('hypo_calib',
+    ARRAY['SELECT * FROM hypo_calib WHERE id = 1']);
+CREATE TABLE hypo_calib_parent (id integer PRIMARY KEY);
+CREATE TABLE hypo_calib_child (parent_id integer REFERENCES hypo_calib_parent (id));
+SELECT predicted_ms_without >= 0 AS predicted_without,
+    predicted_ms_with >= 0 AS predicted_with
+FROM hypopg_fk_index_report('hypo_calib_child');
+DROP TABLE hypo_calib_child;
+DROP TABLE hypo_calib_parent;
+-- Only read-only queries can be executed
+SELECT * FROM hypopg_calibrate(ARRAY['DELETE FROM hypo_calib']);
+SELECT * FROM hypopg_calibrate(ARRAY['SELECT * FROM hypo_calib WHERE id > random()']);
+SELECT hypopg_reset_calibration();
+SELECT COUNT(*) FROM hypopg_calibration();
+SELECT hypopg_reset();
+DROP TABLE hypo_calib_idx;
+DROP TABLE hypo_calib;
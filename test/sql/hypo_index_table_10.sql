@@ -73,6 +73,86 @@ WHERE e ~ 'Index.*<\d+>btree.*hypo_part_range_1_10000';
 SELECT COUNT(*) FROM do_explain ('SELECT * FROM hypo_part_range WHERE id > 28000') e
 WHERE e ~ 'Index.*<\d+>btree.*hypo_part_range_20000_30000';
 
+-- 3.6.1 Hypothetical objects annotations in EXPLAIN
+SET hypopg.explain_annotations = on;
+SELECT COUNT(*) FROM do_explain ('SELECT * FROM hypo_part_range WHERE id = 42') e
+WHERE e ~ '^Hypothetical Index: <\d+>btree_hypo_part_range_1_10000';
+SELECT COUNT(*) FROM do_explain ('SELECT * FROM hypo_part_range WHERE id = 42') e
+WHERE e ~ '^Hypothetical Partition: hypo_part_range_1_10000';
+SELECT COUNT(*) FROM do_explain ('SELECT * FROM hypo_part_range WHERE id = 42') e
+WHERE e ~ '^  Stats Source: hypopg_analyze';
+CREATE FUNCTION do_explain_json(stmt text) RETURNS json AS
+$_$
+DECLARE
+    ret json;
+BEGIN
+    EXECUTE format('EXPLAIN (FORMAT json) %s', stmt) INTO ret;
+    RETURN ret;
+END;
+$_$
+LANGUAGE plpgsql;
+SELECT j->1->'Hypothetical Indexes'->0->>'Hypothetical' AS hypothetical,
+    j->1->'Hypothetical Indexes'->0->>'Node Type' AS node_type,
+    j->1->'Hypothetical Indexes'->0->>'Relation Name' AS relname,
+    (j->1->'Hypothetical Indexes'->0->>'Estimated Pages')::int > 0 AS has_pages,
+    j->1->'Hypothetical Partitions'->0->>'Parent Name' AS parent
+FROM do_explain_json('SELECT * FROM hypo_part_range WHERE id = 42') j;
+-- Each node should report the estimation done for its own partition
+CREATE TABLE part_annot (id integer) PARTITION BY RANGE (id);
+CREATE TABLE part_annot_1 PARTITION OF part_annot FOR VALUES FROM (1) TO (100);
+CREATE TABLE part_annot_2 PARTITION OF part_annot FOR VALUES FROM (100) TO (100000);
+INSERT INTO part_annot SELECT generate_series(1, 99999);
+ANALYZE part_annot;
+CREATE TEMPORARY TABLE part_annot_idx AS
+    SELECT indexrelid FROM hypopg_create_index('CREATE INDEX ON part_annot (id)');
+SET enable_seqscan = off;
+SELECT COUNT(*) AS nb_nodes, COUNT(DISTINCT i->>'Estimated Pages') AS nb_estimates
+FROM do_explain_json('SELECT * FROM part_annot WHERE id IN (50, 5000)') j,
+    json_array_elements(j->1->'Hypothetical Indexes') i;
+RESET enable_seqscan;
+SELECT hypopg_drop_index(indexrelid) FROM part_annot_idx;
+DROP TABLE part_annot_idx;
+DROP TABLE part_annot;
+-- The statistics source depends on the estimation mode
+CREATE TABLE hypo_part_source (id integer);
+INSERT INTO hypo_part_source SELECT generate_series(1, 1000);
+ANALYZE hypo_part_source;
+SELECT * FROM hypopg_partition_table('hypo_part_source', 'PARTITION BY RANGE (id)');
+SELECT tablename FROM hypopg_add_partition('hypo_part_source_1', 'PARTITION OF hypo_part_source FOR VALUES FROM (1) TO (500)');
+SELECT tablename FROM hypopg_add_partition('hypo_part_source_2', 'PARTITION OF hypo_part_source FOR VALUES FROM (500) TO (1001)');
+SELECT p->>'Stats Source' AS source
+FROM do_explain_json('SELECT * FROM hypo_part_source WHERE id = 42') j,
+    json_array_elements(j->1->'Hypothetical Partitions') p;
+SET hypopg.estimation_mode = 'fast';
+SELECT p->>'Stats Source' AS source
+FROM do_explain_json('SELECT * FROM hypo_part_source WHERE id = 42') j,
+    json_array_elements(j->1->'Hypothetical Partitions') p;
+SET hypopg.estimation_mode = 'accurate';
+SELECT p->>'Stats Source' AS source
+FROM do_explain_json('SELECT * FROM hypo_part_source WHERE id = 42') j,
+    json_array_elements(j->1->'Hypothetical Partitions') p;
+RESET hypopg.estimation_mode;
+DROP TABLE hypo_part_source;
+DROP FUNCTION do_explain_json(text);
+RESET hypopg.explain_annotations;
+
+-- 3.6.2 Size of indexes on hypothetical partitions should follow hypopg_analyze
+CREATE TABLE hypo_part_width (id integer, val text);
+INSERT INTO hypo_part_width SELECT i, 'line ' || i FROM generate_series(1, 9999) i;
+ANALYZE hypo_part_width;
+SELECT * FROM hypopg_partition_table('hypo_part_width', 'PARTITION BY RANGE (id)');
+SELECT tablename FROM hypopg_add_partition('hypo_part_width_1_10000', 'PARTITION OF hypo_part_width FOR VALUES FROM (1) TO (10000)');
+SELECT * FROM hypopg_analyze('hypo_part_width',100);
+CREATE TEMP TABLE hypo_width_before AS
+SELECT hypopg_relation_size(indexrelid) AS size
+FROM hypopg_create_index('CREATE INDEX ON hypo_part_width_1_10000 (val)');
+UPDATE hypo_part_width SET val = repeat('x', 200);
+SELECT * FROM hypopg_analyze('hypo_part_width',100);
+SELECT hypopg_relation_size(indexrelid) > size AS size_increased
+FROM hypopg(), hypo_width_before WHERE indexname ~ 'hypo_part_width_1_10000';
+DROP TABLE hypo_width_before;
+DROP TABLE hypo_part_width;
+
 -- 3.7 Sanity checks
 -- -------------
 SELECT * FROM hypopg_reset_index();
@@ -100,3 +180,89 @@ SELECT COUNT(*) AS nb FROM hypopg_create_index('CREATE INDEX ON part_multi_1_q1
 
 SELECT COUNT(*) AS nb FROM hypopg_create_index('CREATE INDEX ON hypo_part_multi_1 (dpt)');
 SELECT COUNT(*) AS nb FROM hypopg_create_index('CREATE INDEX ON hypo_part_multi_1_q1 (dpt)');
+
+-- Estimation modes
+CREATE TABLE hypo_mode (id integer, val text);
+INSERT INTO hypo_mode SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_mode;
+SELECT * FROM hypopg_partition_table('hypo_mode', 'PARTITION BY RANGE (id)');
+SELECT tablename FROM hypopg_add_partition('hypo_mode_a', 'PARTITION OF hypo_mode FOR VALUES FROM (1) TO (1001)');
+SELECT tablename FROM hypopg_add_partition('hypo_mode_b', 'PARTITION OF hypo_mode FOR VALUES FROM (1001) TO (10001)');
+-- uniform distribution of the rows among the partitions
+SET hypopg.estimation_mode = 'fast';
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_mode') e
+WHERE e ~ 'hypo_mode_a .*rows=5000 ';
+-- the whole table is small enough to be sampled
+SET hypopg.estimation_mode = 'accurate';
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_mode') e
+WHERE e ~ 'hypo_mode_a .*rows=1000 ';
+RESET hypopg.estimation_mode;
+DROP TABLE hypo_mode;
+
+-- BRIN indexes mixing minmax and inclusion operator classes
+CREATE TABLE hypo_brin (id integer, r int4range);
+INSERT INTO hypo_brin SELECT i, int4range(i, i + 10) FROM generate_series(1, 200000) i;
+ANALYZE hypo_brin;
+CREATE TEMPORARY TABLE hypo_brin_size AS
+    SELECT hypopg_relation_size(indexrelid) AS size
+    FROM hypopg_create_index('CREATE INDEX ON hypo_brin USING brin (id) WITH (pages_per_range = 1)');
+-- each column should be estimated according to its own operator class
+SELECT hypopg_relation_size(a.indexrelid) > s.size AS bigger,
+    hypopg_relation_size(a.indexrelid) = hypopg_relation_size(b.indexrelid) AS same_size
+FROM hypo_brin_size s,
+    hypopg_create_index('CREATE INDEX ON hypo_brin USING brin (id int4_minmax_ops, r range_inclusion_ops) WITH (pages_per_range = 1)') a,
+    hypopg_create_index('CREATE INDEX ON hypo_brin USING brin (r range_inclusion_ops, id int4_minmax_ops) WITH (pages_per_range = 1)') b;
+SELECT * FROM hypopg_reset_index();
+DROP TABLE hypo_brin_size;
+DROP TABLE hypo_brin;
+
+-- Actual range of the hypothetical partitions
+CREATE TABLE hypo_clamp (id integer) WITH (autovacuum_enabled = false);
+INSERT INTO hypo_clamp SELECT generate_series(1, 10000);
+ANALYZE hypo_clamp;
+SELECT * FROM hypopg_partition_table('hypo_clamp', 'PARTITION BY RANGE (id)');
+SELECT tablename FROM hypopg_add_partition('hypo_clamp_1', 'PARTITION OF hypo_clamp FOR VALUES FROM (1) TO (5000)');
+SELECT tablename FROM hypopg_add_partition('hypo_clamp_2', 'PARTITION OF hypo_clamp FOR VALUES FROM (5000) TO (MAXVALUE)');
+SELECT * FROM hypopg_analyze('hypo_clamp', 100);
+-- Rows appended after the last ANALYZE, beyond the histogram
+INSERT INTO hypo_clamp SELECT generate_series(10001, 20000);
+SELECT COUNT(*) AS nb FROM hypopg_create_index('CREATE INDEX ON hypo_clamp (id)');
+SET hypopg.estimation_mode = 'accurate';
+-- the last partition should be widened
+SELECT (regexp_match(e, 'rows=(\d+)'))[1]::int > 10 AS widened
+FROM do_explain('SELECT * FROM hypo_clamp WHERE id > 15000') e
+WHERE e ~ 'hypo_clamp_2 ';
+-- but the first one only up to its upper bound
+SELECT (regexp_match(e, 'rows=(\d+)'))[1]::int < 30 AS clamped
+FROM do_explain('SELECT * FROM hypo_clamp WHERE id > 4990') e
+WHERE e ~ 'hypo_clamp_1 ';
+RESET hypopg.estimation_mode;
+SELECT * FROM hypopg_reset_index();
+DROP TABLE hypo_clamp;
+
+-- Sampled width of the indexes on hypothetical partitions
+CREATE TABLE hypo_part_sample (id integer, val text);
+INSERT INTO hypo_part_sample SELECT i, CASE WHEN i <= 5000 THEN 'x' ELSE repeat('x', 100) END FROM generate_series(1, 10000) i;
+ANALYZE hypo_part_sample;
+SELECT * FROM hypopg_partition_table('hypo_part_sample', 'PARTITION BY RANGE (id)');
+SELECT tablename FROM hypopg_add_partition('hypo_part_sample_a', 'PARTITION OF hypo_part_sample FOR VALUES FROM (1) TO (5001)');
+SELECT tablename FROM hypopg_add_partition('hypo_part_sample_b', 'PARTITION OF hypo_part_sample FOR VALUES FROM (5001) TO (10001)');
+SET hypopg.estimation_mode = 'accurate';
+-- only the rows of each partition should be sampled
+SELECT hypopg_relation_size(a.indexrelid) < hypopg_relation_size(b.indexrelid) AS smaller
+FROM hypopg_create_index('CREATE INDEX ON hypo_part_sample_a (val)') a,
+    hypopg_create_index('CREATE INDEX ON hypo_part_sample_b (val)') b;
+RESET hypopg.estimation_mode;
+SELECT * FROM hypopg_reset_index();
+DROP TABLE hypo_part_sample;
+
+-- CREATE INDEX IF NOT EXISTS is skipped when the name is already used
+CREATE TABLE hypo_ddl_ine (id integer, val text);
+CREATE INDEX hypo_ddl_ine_id_idx ON hypo_ddl_ine (id);
+SELECT stmt_num, action, regexp_replace(objname, '<\d+>', '') AS objname
+FROM hypopg_apply_ddl($$CREATE INDEX IF NOT EXISTS hypo_ddl_ine_id_idx ON hypo_ddl_ine (id);
+    CREATE INDEX IF NOT EXISTS hypo_ddl_ine_val_idx ON hypo_ddl_ine (val);
+    CREATE INDEX IF NOT EXISTS hypo_ddl_ine_val_idx ON hypo_ddl_ine (val, id);$$);
+SELECT COUNT(*) FROM hypopg() WHERE indrelid = 'hypo_ddl_ine'::regclass;
+SELECT * FROM hypopg_reset_index();
+DROP TABLE hypo_ddl_ine;
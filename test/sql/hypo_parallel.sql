@@ -0,0 +1,103 @@
+-- Parallel evaluation tests
+-- =========================
+
+-- 0. Dropping any hypothetical object
+SELECT * FROM hypopg_reset();
+
+-- 1. Setup
+CREATE TABLE hypo_parallel (id integer, val text);
+INSERT INTO hypo_parallel SELECT i, 'line ' || i FROM generate_series(1, 10000) i;
+ANALYZE hypo_parallel;
+
+CREATE TABLE hypo_workload (queries text[]);
+INSERT INTO hypo_workload SELECT ARRAY['SELECT * FROM hypo_parallel WHERE id = 1',
+    'SELECT * FROM hypo_parallel WHERE id < 10 ORDER BY id',
+    'SELECT * FROM nope'];
+
+SELECT COUNT(*) FROM hypopg_create_index('CREATE INDEX ON hypo_parallel (id)');
+
+-- 2. Workers should get the same estimations as the leader
+WITH leader AS (
+    SELECT e.* FROM hypo_workload, hypopg_parallel_evaluate(queries, 0) e
+), workers AS (
+    SELECT e.* FROM hypo_workload, hypopg_parallel_evaluate(queries, 2) e
+)
+SELECT l.query_num, l.total_cost IS NOT DISTINCT FROM w.total_cost AS same_cost,
+    w.error
+FROM leader l
+JOIN workers w USING (query_num)
+ORDER BY l.query_num;
+
+-- The hypothetical index should be used
+SELECT w.total_cost < 100 AS use_index
+FROM hypo_workload, hypopg_parallel_evaluate(queries, 2) w
+WHERE w.query_num = 1;
+
+-- 3. Workers should use the planner settings of the leader
+SET random_page_cost = 40;
+SET enable_seqscan = off;
+WITH leader AS (
+    SELECT e.total_cost
+    FROM hypopg_parallel_evaluate(ARRAY['SELECT * FROM hypo_parallel WHERE id < 1000'], 0) e
+), workers AS (
+    SELECT e.total_cost
+    FROM hypopg_parallel_evaluate(array_fill('SELECT * FROM hypo_parallel WHERE id < 1000'::text, ARRAY[20]), 4) e
+)
+SELECT COUNT(DISTINCT w.total_cost) AS nb_costs,
+    bool_and(w.total_cost = l.total_cost) AS same_cost
+FROM workers w, leader l;
+RESET random_page_cost;
+RESET enable_seqscan;
+
+-- 4. Hypothetical number of parallel workers
+SET max_parallel_workers_per_gather = 2;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+-- The table is too small for a parallel scan
+SELECT COUNT(*) FROM do_explain('SELECT count(*) FROM hypo_parallel') e
+WHERE e ~ 'Workers Planned';
+SELECT hypopg_set_table_options('hypo_parallel', ARRAY['parallel_workers=2']);
+SELECT COUNT(*) FROM do_explain('SELECT count(*) FROM hypo_parallel') e
+WHERE e ~ 'Workers Planned: 2';
+RESET max_parallel_workers_per_gather;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+SELECT hypopg_reset_table_options('hypo_parallel');
+
+-- 5. Relations only visible to the leader
+CREATE TEMPORARY TABLE hypo_parallel_tmp (id integer);
+SELECT COUNT(*), bool_and(error IS NULL) AS no_error
+FROM hypopg_parallel_evaluate(array_fill('SELECT * FROM hypo_parallel_tmp'::text, ARRAY[10]), 2);
+DROP TABLE hypo_parallel_tmp;
+BEGIN;
+CREATE TABLE hypo_parallel_new (id integer);
+SELECT COUNT(*), bool_and(error IS NULL) AS no_error
+FROM hypopg_parallel_evaluate(array_fill('SELECT * FROM hypo_parallel_new'::text, ARRAY[10]), 2);
+ROLLBACK;
+
+-- 6. Predicted latencies
+SELECT COUNT(*) > 0 AS calibrated
+FROM hypopg_calibrate(ARRAY['SELECT * FROM hypo_parallel WHERE id < 10']);
+WITH leader AS (
+    SELECT e.* FROM hypo_workload, hypopg_parallel_evaluate(queries, 0) e
+), workers AS (
+    SELECT e.* FROM hypo_workload, hypopg_parallel_evaluate(queries, 2) e
+)
+SELECT l.query_num, l.predicted_ms IS NOT DISTINCT FROM w.predicted_ms AS same_prediction,
+    w.predicted_ms >= 0 AS predicted
+FROM leader l
+JOIN workers w USING (query_num)
+ORDER BY l.query_num;
+SET hypopg.explain_annotations = on;
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_parallel WHERE id = 1') e
+WHERE e ~ 'Predicted Latency';
+RESET hypopg.explain_annotations;
+SELECT hypopg_reset_calibration();
+
+-- 7. Errors
+SELECT * FROM hypopg_parallel_evaluate(ARRAY['SELECT 1'], -1);
+
+-- Cleanup
+SELECT * FROM hypopg_reset();
+DROP TABLE hypo_workload;
+DROP TABLE hypo_parallel;
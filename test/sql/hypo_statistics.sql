@@ -0,0 +1,62 @@
+-- Hypothetical extended statistics tests
+-- ======================================
+
+-- 0. Dropping any hypothetical object
+SELECT * FROM hypopg_reset();
+
+-- 1. Setup
+CREATE TABLE hypo_stats (a integer, b integer);
+INSERT INTO hypo_stats SELECT i % 100, i % 100 FROM generate_series(1, 10000) i;
+ANALYZE hypo_stats;
+
+-- Should detect a single row
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_stats WHERE a = 1 AND b = 1') e
+WHERE e ~ 'rows=1 ';
+
+-- 2. Create hypothetical extended statistics on the whole table
+SELECT statname LIKE '%hypo_stats_ab'
+FROM hypopg_create_statistics('CREATE STATISTICS hypo_stats_ab ON a, b FROM hypo_stats', 100);
+
+SELECT attnums, ndistinct, dependencies, nb_mcv
+FROM hypopg_list_statistics();
+
+-- Should detect the correlation
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_stats WHERE a = 1 AND b = 1') e
+WHERE e ~ 'rows=100 ';
+
+-- Only build the functional dependencies
+SELECT statname LIKE '%mystat'
+FROM hypopg_create_statistics('CREATE STATISTICS mystat (dependencies) ON a, b FROM hypo_stats', 100);
+
+SELECT ndistinct IS NULL, dependencies, nb_mcv IS NULL
+FROM hypopg_list_statistics()
+WHERE statname LIKE '%mystat';
+
+-- 3. Drop the hypothetical extended statistics
+SELECT hypopg_drop_statistics(statid)
+FROM hypopg_list_statistics()
+WHERE statname LIKE '%mystat';
+
+SELECT COUNT(*) FROM hypopg_list_statistics();
+
+SELECT * FROM hypopg_reset_statistics();
+
+SELECT COUNT(*) FROM hypopg_list_statistics();
+
+-- Should detect a single row again
+SELECT COUNT(*) FROM do_explain('SELECT * FROM hypo_stats WHERE a = 1 AND b = 1') e
+WHERE e ~ 'rows=1 ';
+
+-- 4. Errors
+SELECT * FROM hypopg_create_statistics('CREATE STATISTICS hypo_stats_a ON a FROM hypo_stats');
+SELECT * FROM hypopg_create_statistics('CREATE STATISTICS hypo_stats_ab ON a, nope FROM hypo_stats');
+SELECT * FROM hypopg_create_statistics('CREATE STATISTICS hypo_stats_ab ON a, b FROM hypo_stats', 0);
+
+-- 5. The hypothetical extended statistics are dropped with their table
+SELECT COUNT(*) FROM hypopg_create_statistics('CREATE STATISTICS hypo_stats_drop ON a, b FROM hypo_stats', 100);
+
+SELECT COUNT(*) FROM hypopg_list_statistics();
+
+DROP TABLE hypo_stats;
+
+SELECT COUNT(*) FROM hypopg_list_statistics();
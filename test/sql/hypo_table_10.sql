@@ -89,6 +89,52 @@ SELECT * FROM hypopg_analyze('hypo_part_range',100);
 SELECT * FROM hypopg_analyze('hypo_part_list',100);
 SELECT * FROM hypopg_analyze('hypo_part_multi',100);
 
+-- Progress reporting and resuming
+SELECT COUNT(*) FROM hypopg_stat_progress_analyze WHERE pid = pg_backend_pid();
+CREATE TEMPORARY TABLE hypo_stats_before AS
+    SELECT starelid, staattnum FROM hypopg_statistic();
+SELECT * FROM hypopg_analyze('hypo_part_range', 100, true);
+SELECT COUNT(*) FROM hypopg_statistic() s
+FULL JOIN hypo_stats_before b USING (starelid, staattnum)
+WHERE s.starelid IS NULL OR b.starelid IS NULL;
+DROP TABLE hypo_stats_before;
+-- The progress is visible while the partitions are analyzed
+CREATE FUNCTION hypo_progress_probe(i integer) RETURNS integer AS
+$_$
+DECLARE
+    r record;
+BEGIN
+    IF current_setting('hypopg_test.probed', true) IS DISTINCT FROM 'on' THEN
+        PERFORM set_config('hypopg_test.probed', 'on', true);
+        PERFORM pg_stat_clear_snapshot();
+        SELECT relid::regclass AS relname, phase, partitions_done,
+            partitions_total,
+            (SELECT COUNT(*) FROM pg_stat_progress_vacuum v
+             WHERE v.pid = pg_backend_pid() AND v.pid NOT IN
+                 (SELECT pid FROM hypopg_stat_progress_analyze)) AS nb_vacuum
+            INTO r
+        FROM hypopg_stat_progress_analyze WHERE pid = pg_backend_pid();
+        RAISE NOTICE 'relation: %, phase: %, partitions: %/%, vacuum: %',
+            r.relname, r.phase, r.partitions_done, r.partitions_total,
+            r.nb_vacuum;
+    END IF;
+    RETURN i;
+END;
+$_$ LANGUAGE plpgsql IMMUTABLE;
+CREATE TABLE hypo_part_probe (id integer);
+INSERT INTO hypo_part_probe SELECT generate_series(1, 999);
+SELECT * FROM hypopg_partition_table('hypo_part_probe', 'PARTITION BY RANGE (hypo_progress_probe(id))');
+SELECT tablename FROM hypopg_add_partition('hypo_part_probe_1_500', 'PARTITION OF hypo_part_probe FOR VALUES FROM (1) TO (500)');
+SELECT tablename FROM hypopg_add_partition('hypo_part_probe_500_1000', 'PARTITION OF hypo_part_probe FOR VALUES FROM (500) TO (1000)');
+SET hypopg.analyze_progress = on;
+SELECT * FROM hypopg_analyze('hypo_part_probe', 100);
+RESET hypopg.analyze_progress;
+-- Nothing is reported unless asked to
+SELECT * FROM hypopg_analyze('hypo_part_probe', 100);
+SELECT COUNT(*) FROM hypopg_stat_progress_analyze WHERE pid = pg_backend_pid();
+DROP TABLE hypo_part_probe;
+DROP FUNCTION hypo_progress_probe(integer);
+
 
 -- Test deparsing
 -- ==============
@@ -257,3 +303,64 @@ EXPLAIN (COSTS OFF) SELECT * FROM hypo_part_multi;
 
 SELECT hypopg_drop_table(oid) FROM pg_class WHERE relname = 'pg_class';
 SELECT hypopg_drop_table(1);
+
+-- rehearsing a migration
+-- ======================
+CREATE TABLE hypo_part_ddl (id integer, val text);
+SELECT * FROM hypopg_partition_table('hypo_part_ddl', 'PARTITION BY RANGE (id)');
+SELECT stmt_num, command, action, objname FROM hypopg_apply_ddl($$CREATE TABLE hypo_part_ddl_1 PARTITION OF hypo_part_ddl FOR VALUES FROM (1) TO (100); CREATE TABLE hypo_part_ddl_2 PARTITION OF hypo_part_ddl FOR VALUES FROM (100) TO (200);$$);
+-- a failing statement reverts the whole script
+SELECT * FROM hypopg_apply_ddl($$CREATE TABLE hypo_part_ddl_3 PARTITION OF hypo_part_ddl FOR VALUES FROM (200) TO (300); CREATE TABLE hypo_part_ddl_3 PARTITION OF hypo_part_ddl FOR VALUES FROM (300) TO (400);$$);
+SELECT tablename FROM hypopg_table() WHERE tablename LIKE 'hypo\_part\_ddl\_%' ORDER BY tablename;
+
+SELECT hypopg_reset_table();
+DROP TABLE hypo_part_ddl;
+
+-- hiding real partitions
+-- ======================
+CREATE TABLE part_hide (id integer, val text) PARTITION BY RANGE (id);
+CREATE TABLE part_hide_1 PARTITION OF part_hide FOR VALUES FROM (1) TO (100);
+CREATE TABLE part_hide_2 PARTITION OF part_hide FOR VALUES FROM (100) TO (200);
+CREATE TABLE part_hide_3 PARTITION OF part_hide FOR VALUES FROM (200) TO (300) PARTITION BY RANGE (id);
+CREATE TABLE part_hide_3_a PARTITION OF part_hide_3 FOR VALUES FROM (200) TO (300);
+SELECT hypopg_hide_partition('part_hide_1');
+SELECT hypopg_hide_partition('part_hide_1');
+EXPLAIN (COSTS OFF) SELECT * FROM part_hide;
+-- querying a hidden partition directly is not affected
+EXPLAIN (COSTS OFF) SELECT * FROM part_hide_1;
+-- hiding a partitioned partition hides its own partitions
+SELECT hypopg_hide_partition('part_hide_3');
+SELECT relid::regclass, parentid::regclass FROM hypopg_hidden_partitions();
+EXPLAIN (COSTS OFF) SELECT * FROM part_hide;
+SELECT hypopg_hide_partition('part_hide');
+SELECT hypopg_unhide_partition('part_hide_3');
+SELECT hypopg_unhide_partition('part_hide_3');
+SELECT hypopg_unhide_all_partitions();
+SELECT count(*) FROM hypopg_hidden_partitions();
+-- a dropped partition isn't hidden anymore
+SELECT hypopg_hide_partition('part_hide_2');
+DROP TABLE part_hide_2;
+SELECT count(*) FROM hypopg_hidden_partitions();
+DROP TABLE part_hide;
+
+-- cache pressure of hypothetical partitions
+-- ==========================================
+CREATE TABLE hypo_part_cache (id integer, val text);
+INSERT INTO hypo_part_cache SELECT i, 'line ' || i FROM generate_series(1, 100000) i;
+VACUUM ANALYZE hypo_part_cache;
+SELECT * FROM hypopg_partition_table('hypo_part_cache', 'PARTITION BY RANGE (id)');
+SELECT count(*) FROM (
+    SELECT hypopg_add_partition('hypo_part_cache_' || i,
+        format('PARTITION OF hypo_part_cache FOR VALUES FROM (%s) TO (%s)',
+            (i - 1) * 10000 + 1, i * 10000 + 1))
+    FROM generate_series(1, 10) i) s;
+SET effective_cache_size = '1MB';
+-- a single partition fits in the cache
+SELECT relations, fits_effective_cache
+FROM hypopg_cache_pressure_report(ARRAY['SELECT * FROM hypo_part_cache WHERE id <= 10000']);
+-- but not all of them
+SELECT relations, fits_effective_cache
+FROM hypopg_cache_pressure_report(ARRAY['SELECT * FROM hypo_part_cache']);
+RESET effective_cache_size;
+SELECT hypopg_reset_table();
+DROP TABLE hypo_part_cache;